@@ -0,0 +1,169 @@
+
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+#include <lavos/glm_config.h>
+
+#include <vulkan/vulkan.h>
+#include <lavos/engine.h>
+#include <lavos/renderer.h>
+#include <lavos/asset_container.h>
+#include <lavos/offscreen_render_target.h>
+#include <lavos/component/camera.h>
+#include <lavos/material/gouraud_material.h>
+#include <lavos/component/directional_light.h>
+
+
+// Renders a glTF scene without a window and reads every frame back to the host.
+// Usage: headless [gltf file] [frame count] [width] [height] [output ppm]
+
+
+lavos::Engine *engine = nullptr;
+lavos::OffscreenRenderTarget *render_target = nullptr;
+lavos::ManagedDepthRenderTarget *depth_render_target = nullptr;
+
+lavos::Renderer *renderer = nullptr;
+lavos::Material *material;
+
+lavos::AssetContainer *asset_container = nullptr;
+
+lavos::Scene *scene;
+lavos::Node *camera_node;
+
+std::vector<std::uint8_t> last_frame;
+
+
+void Init(std::string gltf_filename, vk::Extent2D extent)
+{
+	lavos::Engine::CreateInfo create_info;
+	create_info.app_info = "Lavos Headless Demo";
+	engine = new lavos::Engine(create_info);
+	engine->InitializeWithPhysicalDeviceIndex(0);
+
+	render_target = new lavos::OffscreenRenderTarget(engine, extent);
+	depth_render_target = new lavos::ManagedDepthRenderTarget(engine, render_target);
+
+	material = new lavos::GouraudMaterial(engine);
+
+	auto render_config = lavos::RenderConfigBuilder().Build();
+
+	renderer = new lavos::Renderer(engine, render_config, render_target, depth_render_target);
+	renderer->AddMaterial(material);
+
+	asset_container = lavos::AssetContainer::LoadFromGLTF(engine, render_config, material, gltf_filename);
+
+	scene = asset_container->scenes[0];
+	scene->SetAmbientLightIntensity(glm::vec3(0.3f, 0.3f, 0.3f));
+
+	renderer->SetScene(scene);
+
+	lavos::Camera *camera = scene->GetRootNode()->GetComponentInChildren<lavos::Camera>();
+	if(camera == nullptr)
+	{
+		camera_node = new lavos::Node();
+		scene->GetRootNode()->AddChild(camera_node);
+		camera_node->AddComponent(new lavos::TransformComp());
+
+		camera = new lavos::Camera();
+		camera->SetNearClip(0.01f);
+		camera_node->AddComponent(camera);
+	}
+	else
+	{
+		camera_node = camera->GetNode();
+	}
+
+	lavos::Node *light_node = new lavos::Node();
+	scene->GetRootNode()->AddChild(light_node);
+
+	light_node->AddComponent(new lavos::TransformComp());
+	light_node->GetTransformComp()->SetLookAt(glm::vec3(-1.0f, -1.0f, -1.0f));
+
+	lavos::DirectionalLight *light = new lavos::DirectionalLight();
+	light_node->AddComponent(light);
+
+	renderer->SetCamera(camera);
+
+	render_target->SetReadbackCallback([](const lavos::OffscreenRenderTarget::Readback &readback) {
+		auto size = static_cast<std::size_t>(readback.row_pitch * readback.extent.height);
+		last_frame.resize(size);
+		memcpy(last_frame.data(), readback.pixels, size);
+	});
+}
+
+void Update(unsigned int frame, unsigned int frame_count)
+{
+	// orbit around the origin, so every frame is different
+	float angle = 2.0f * glm::pi<float>() * static_cast<float>(frame) / static_cast<float>(frame_count);
+	camera_node->GetTransformComp()->translation = glm::vec3(glm::sin(angle), 0.5f, glm::cos(angle)) * 5.0f;
+	camera_node->GetTransformComp()->SetLookAt(glm::vec3(0.0f, 0.0f, 0.0f));
+
+	scene->Update(1.0f / 60.0f);
+}
+
+void WritePPM(const std::string &filename, vk::Extent2D extent)
+{
+	std::ofstream file(filename, std::ios::binary);
+	file << "P6\n" << extent.width << " " << extent.height << "\n255\n";
+
+	// R8G8B8A8 to R8G8B8
+	for(std::size_t i=0; i<last_frame.size(); i+=4)
+		file.write(reinterpret_cast<const char *>(&last_frame[i]), 3);
+}
+
+void Cleanup()
+{
+	delete asset_container;
+	delete renderer;
+	delete material;
+	delete depth_render_target;
+	delete render_target;
+	delete engine;
+}
+
+int main(int argc, const char **argv)
+{
+	std::string gltf_filename = "data/gltftest.gltf";
+	if(argc > 1)
+		gltf_filename = argv[1];
+
+	unsigned int frame_count = 600;
+	if(argc > 2)
+		frame_count = static_cast<unsigned int>(std::stoul(argv[2]));
+
+	vk::Extent2D extent(1280, 720);
+	if(argc > 4)
+		extent = vk::Extent2D(static_cast<uint32_t>(std::stoul(argv[3])), static_cast<uint32_t>(std::stoul(argv[4])));
+
+	Init(gltf_filename, extent);
+
+	auto start_time = std::chrono::high_resolution_clock::now();
+
+	for(unsigned int frame=0; frame<frame_count; frame++)
+	{
+		Update(frame, frame_count);
+
+		auto image_index = render_target->AcquireImage();
+		renderer->DrawFrame(image_index, {}, {}, {});
+		render_target->SubmitReadback(image_index);
+		render_target->CollectReadbacks();
+	}
+
+	render_target->FlushReadbacks();
+
+	auto end_time = std::chrono::high_resolution_clock::now();
+	double seconds = std::chrono::duration<double>(end_time - start_time).count();
+
+	std::cout << "Rendered and read back " << frame_count << " frames of " << extent.width << "x" << extent.height
+			  << " in " << seconds << " s: " << (static_cast<double>(frame_count) / seconds) << " fps" << std::endl;
+
+	if(argc > 5)
+		WritePPM(argv[5], extent);
+
+	Cleanup();
+
+	return EXIT_SUCCESS;
+}
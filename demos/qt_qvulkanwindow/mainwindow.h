@@ -42,6 +42,17 @@ class QVulkanWindowColorRenderTarget : public lavos::ColorRenderTarget
 			return ret;
 		}
 
+		std::vector<vk::Image> GetImages() const override
+		{
+			int count = vulkan_window->swapChainImageCount();
+			std::vector<vk::Image> ret(static_cast<unsigned long>(count));
+			for (int i=0; i<count; i++)
+			{
+				ret[i] = vulkan_window->swapChainImage(i);
+			}
+			return ret;
+		}
+
 		void SwapchainChanged()
 		{
 			SignalChangedCallbacks();
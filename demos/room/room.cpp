@@ -4,6 +4,8 @@
 #include <set>
 #include <fstream>
 #include <chrono>
+#include <cstring>
+#include <cmath>
 
 #include <lavos/glm_config.h>
 
@@ -18,8 +20,10 @@
 #include <lavos/material/unlit_material.h>
 #include <lavos/component/directional_light.h>
 #include <lavos/component/spot_light.h>
+#include <lavos/component/point_light.h>
 #include <lavos/component/fp_controller.h>
 #include <lavos/spot_light_shadow_renderer.h>
+#include <lavos/point_light_shadow_renderer.h>
 
 #include <window_application.h>
 
@@ -44,12 +48,14 @@ lavos::FirstPersonController *fp_controller;
 void UpdateMouseSettings();
 void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
 
-void Init(std::string gltf_filename)
+void Init(std::string gltf_filename, bool multiview, bool depth_shadows, bool point_light, unsigned int extra_lights, bool depth_prepass, bool deferred)
 {
 	material = new lavos::PhongMaterial(app->GetEngine());
 
 	auto render_config = lavos::RenderConfigBuilder()
 			.SetShadowEnabled(true)
+			.SetDepthPrepassEnabled(depth_prepass)
+			.SetDeferredEnabled(deferred)
 			.Build();
 
 	renderer = new lavos::Renderer(app->GetEngine(), render_config, app->GetSwapchain(), app->GetDepthRenderTarget());
@@ -98,10 +104,67 @@ void Init(std::string gltf_filename)
 	lavos::SpotLight *light = new lavos::SpotLight(glm::vec3(1.0f, 1.0f, 1.0f), glm::pi<float>() * 0.8f);
 	light_node->AddComponent(light);
 
-	auto shadow_renderer = new lavos::SpotLightShadowRenderer(app->GetEngine(), 1024, 1024, vk::SampleCountFlagBits::e8);
+	auto shadow_renderer = new lavos::SpotLightShadowRenderer(app->GetEngine(), 1024, 1024,
+			depth_shadows ? vk::SampleCountFlagBits::e1 : vk::SampleCountFlagBits::e8,
+			multiview ? 4 : 1,
+			depth_shadows ? lavos::ShadowMode::Depth : lavos::ShadowMode::MSM);
 	renderer->AddSubRenderer(shadow_renderer);
 	light->InitShadow(app->GetEngine(), shadow_renderer);
 
+	if(multiview)
+	{
+		// additional lights to fill the layers of the multiview batch
+		const glm::vec3 light_targets[] = {
+				glm::vec3(-3.0f, 2.0f, 0.0f),
+				glm::vec3(0.0f, 2.0f, 3.0f),
+				glm::vec3(0.0f, 2.0f, -3.0f)
+		};
+
+		for(const auto &target : light_targets)
+		{
+			lavos::Node *node = new lavos::Node();
+			scene->GetRootNode()->AddChild(node);
+			node->AddComponent(new lavos::TransformComp());
+			node->GetTransformComp()->translation = glm::vec3(0.0f, 2.0f, 0.0f);
+			node->GetTransformComp()->SetLookAt(target);
+
+			auto additional_light = new lavos::SpotLight(glm::vec3(0.3f, 0.3f, 0.3f), glm::pi<float>() * 0.5f);
+			node->AddComponent(additional_light);
+			additional_light->InitShadow(app->GetEngine(), shadow_renderer);
+		}
+	}
+
+	if(point_light)
+	{
+		lavos::Node *node = new lavos::Node();
+		scene->GetRootNode()->AddChild(node);
+		node->AddComponent(new lavos::TransformComp());
+		node->GetTransformComp()->translation = glm::vec3(0.0f, 1.5f, 0.0f);
+
+		auto point_light_comp = new lavos::PointLight(glm::vec3(0.5f, 0.4f, 0.3f));
+		node->AddComponent(point_light_comp);
+
+		auto point_shadow_renderer = new lavos::PointLightShadowRenderer(app->GetEngine(), 512);
+		renderer->AddSubRenderer(point_shadow_renderer);
+		point_light_comp->InitShadow(app->GetEngine(), point_shadow_renderer, 0.05f, 20.0f);
+	}
+
+	// small unshadowed lights on a grid below the ceiling, to stress the clustered light assignment
+	unsigned int grid_size = static_cast<unsigned int>(std::ceil(std::sqrt(static_cast<float>(extra_lights))));
+	for(unsigned int i=0; i<extra_lights; i++)
+	{
+		lavos::Node *node = new lavos::Node();
+		scene->GetRootNode()->AddChild(node);
+		node->AddComponent(new lavos::TransformComp());
+		glm::vec2 grid_pos = (glm::vec2(i % grid_size, i / grid_size) / static_cast<float>(grid_size) - 0.5f) * 8.0f;
+		node->GetTransformComp()->translation = glm::vec3(grid_pos.x, 2.5f, grid_pos.y);
+		node->GetTransformComp()->SetLookAt(glm::vec3(grid_pos.x, 0.0f, grid_pos.y + 0.01f));
+
+		auto extra_light = new lavos::SpotLight(glm::vec3(0.1f, 0.1f, 0.1f), glm::pi<float>() * 0.5f);
+		extra_light->SetRange(3.0f);
+		node->AddComponent(extra_light);
+	}
+
 	renderer->SetCamera(camera);
 
 	material_instance = asset_container->material_instances.front();
@@ -134,6 +197,19 @@ void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
 		mouse_caught = !mouse_caught;
 		UpdateMouseSettings();
 	}
+
+	if (key == GLFW_KEY_F2 && action == GLFW_PRESS)
+	{
+		const auto &statistics = renderer->GetStatistics();
+		if(statistics.available)
+		{
+			std::cout << "vertex shader invocations: " << statistics.vertex_shader_invocations
+					  << ", primitives: " << statistics.clipping_primitives
+					  << ", fragment shader invocations: " << statistics.fragment_shader_invocations << std::endl;
+		}
+		else
+			std::cout << "no statistics available, run with --statistics" << std::endl;
+	}
 }
 
 
@@ -183,12 +259,44 @@ void Cleanup()
 int main(int argc, const char **argv)
 {
 	std::string gltf_filename = "data/room.gltf";
-	if(argc > 1)
-		gltf_filename = argv[1];
+	bool multiview = false;
+	bool depth_shadows = false;
+	bool point_light = false;
+	unsigned int extra_lights = 0;
+	bool depth_prepass = false;
+	bool statistics = false;
+	bool deferred = false;
+	bool bindless = false;
+	for(int i=1; i<argc; i++)
+	{
+		if(strcmp(argv[i], "--multiview") == 0)
+			multiview = true;
+		else if(strcmp(argv[i], "--depth-shadows") == 0)
+			depth_shadows = true;
+		else if(strcmp(argv[i], "--point-light") == 0)
+			point_light = true;
+		else if(strcmp(argv[i], "--lights") == 0 && i + 1 < argc)
+			extra_lights = static_cast<unsigned int>(atoi(argv[++i]));
+		else if(strcmp(argv[i], "--depth-prepass") == 0)
+			depth_prepass = true;
+		else if(strcmp(argv[i], "--statistics") == 0)
+			statistics = true;
+		else if(strcmp(argv[i], "--deferred") == 0)
+			deferred = true;
+		else if(strcmp(argv[i], "--bindless") == 0)
+			bindless = true;
+		else
+			gltf_filename = argv[i];
+	}
+
+	lavos::Engine::CreateInfo engine_create_info;
+	engine_create_info.enable_multiview = multiview || point_light; // point light shadows render all faces with multiview
+	engine_create_info.enable_pipeline_statistics = statistics;
+	engine_create_info.enable_descriptor_indexing = bindless;
 
-	app = new lavos::shell::glfw::WindowApplication(800, 600, "First Person", true);
+	app = new lavos::shell::glfw::WindowApplication(800, 600, "First Person", true, engine_create_info);
 
-	Init(gltf_filename);
+	Init(gltf_filename, multiview, depth_shadows, point_light, extra_lights, depth_prepass, deferred);
 
 	while(true)
 	{
@@ -7,13 +7,48 @@
 #define DESCRIPTOR_SET_INDEX_COMMON		0
 #define DESCRIPTOR_SET_INDEX_MATERIAL	1
 
-#define MAX_SPOT_LIGHTS_COUNT 16
+// spot lights themselves are unlimited, but only this many of them can have a shadow map at once
+#define MAX_SPOT_LIGHT_SHADOWS_COUNT 16
+#define MAX_POINT_LIGHTS_COUNT 4
+
+// minimum value of maxMultiviewViewCount guaranteed by VK_KHR_multiview
+#define MAX_SHADOW_MULTIVIEW_COUNT 6
 
 #define DESCRIPTOR_SET_COMMON_BINDING_MATRIX_BUFFER			0
 #define DESCRIPTOR_SET_COMMON_BINDING_LIGHTING_BUFFER		1
 #define DESCRIPTOR_SET_COMMON_BINDING_CAMERA_BUFFER			2
 #define DESCRIPTOR_SET_COMMON_BINDING_SPOT_LIGHT_SHADOW_TEX	3
+#define DESCRIPTOR_SET_COMMON_BINDING_SPOT_LIGHT_SHADOW_DEPTH_TEX	4
+#define DESCRIPTOR_SET_COMMON_BINDING_POINT_LIGHT_SHADOW_TEX	5
+#define DESCRIPTOR_SET_COMMON_BINDING_SPOT_LIGHT_BUFFER		6
+#define DESCRIPTOR_SET_COMMON_BINDING_LIGHT_CLUSTER_BUFFER	7
+
+// input attachments of the deferred lighting pass, bound at DESCRIPTOR_SET_INDEX_MATERIAL
+#define DESCRIPTOR_SET_GBUFFER_BINDING_ALBEDO	0
+#define DESCRIPTOR_SET_GBUFFER_BINDING_NORMAL	1
+#define DESCRIPTOR_SET_GBUFFER_BINDING_DEPTH	2
+
+// global MaterialTable of bindless materials, bound at DESCRIPTOR_SET_INDEX_MATERIAL
+#define DESCRIPTOR_SET_MATERIAL_TABLE_BINDING_TEXTURES		0
+#define DESCRIPTOR_SET_MATERIAL_TABLE_BINDING_PARAMETERS	1
+#define MATERIAL_TABLE_BLOCK_SIZE	64
+
+// specialization constants of lighting code, see Material::AppendLightingSpecializationConstants()
+#define SPECIALIZATION_CONSTANT_LIGHTING_DIRECTIONAL_LIGHT		0
+#define SPECIALIZATION_CONSTANT_LIGHTING_SPOT_LIGHT_SHADOW_MODES	1
+#define SPECIALIZATION_CONSTANT_LIGHTING_CLUSTERED_SPOT_LIGHTS	2
+#define SPECIALIZATION_CONSTANT_LIGHTING_POINT_LIGHTS_MAX		3
+
+// specialization constants of PhongMaterial, following the lighting ones
+#define SPECIALIZATION_CONSTANT_PHONG_BASE_COLOR_TEX	4
+#define SPECIALIZATION_CONSTANT_PHONG_NORMAL_TEX		5
+#define SPECIALIZATION_CONSTANT_PHONG_ALPHA_MASK		6
+
+// specialization constant of the shadow shaders, set by MaterialPipelineManager for all materials
+#define SPECIALIZATION_CONSTANT_SHADOW_MOMENTS	0
 
-#define SHADOW_MSM 1
+#define SPOT_LIGHT_SHADOW_MODE_NONE		0
+#define SPOT_LIGHT_SHADOW_MODE_DEPTH	1
+#define SPOT_LIGHT_SHADOW_MODE_MSM		2
 
 #endif //LAVOS_COMMON_GLSL_CPP_H
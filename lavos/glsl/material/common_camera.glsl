@@ -7,6 +7,8 @@
 layout(set = DESCRIPTOR_SET_INDEX_COMMON, binding = DESCRIPTOR_SET_COMMON_BINDING_CAMERA_BUFFER, std140) uniform CameraBuffer
 {
 	vec3 position;
+	vec3 direction;
+	mat4 screen_to_world; // (framebuffer coordinates, depth, 1) to homogeneous world space
 } camera_uni;
 
 #endif
\ No newline at end of file
@@ -9,9 +9,20 @@ struct SpotLight
     vec3 position;
     float angle_cos;
     vec3 direction;
+    float range;
+    uint shadow_mode;
     mat4 shadow_mvp_matrix;
 };
 
+struct PointLight
+{
+	vec3 position;
+	float shadow_near_clip;
+	vec3 intensity;
+	float shadow_far_clip;
+	uint shadow_mode;
+};
+
 layout(set = DESCRIPTOR_SET_INDEX_COMMON, binding = DESCRIPTOR_SET_COMMON_BINDING_LIGHTING_BUFFER, std140) uniform LightingBuffer
 {
 	vec3 ambient_intensity;
@@ -20,32 +31,112 @@ layout(set = DESCRIPTOR_SET_INDEX_COMMON, binding = DESCRIPTOR_SET_COMMON_BINDIN
 	vec3 directional_light_dir;
 	vec3 directional_light_intensity;
 
-	uint spot_lights_count;
+	uint shadowed_spot_lights_count;
+
+	uvec3 cluster_count;
+	float cluster_z_scale;
+	vec2 cluster_tile_size;
+	float cluster_z_bias;
 
-	SpotLight spot_lights[MAX_SPOT_LIGHTS_COUNT];
+	uint point_lights_count;
+
+	PointLight point_lights[MAX_POINT_LIGHTS_COUNT];
 } lighting_uni;
 
-layout(set = DESCRIPTOR_SET_INDEX_COMMON, binding = DESCRIPTOR_SET_COMMON_BINDING_SPOT_LIGHT_SHADOW_TEX) uniform sampler2D spot_light_shadow_tex_uni[MAX_SPOT_LIGHTS_COUNT];
+// the first shadowed_spot_lights_count lights have shadow maps at the same index and are not part of the clusters,
+// because the shadow textures can only be indexed with dynamically uniform values
+layout(set = DESCRIPTOR_SET_INDEX_COMMON, binding = DESCRIPTOR_SET_COMMON_BINDING_SPOT_LIGHT_BUFFER, std430) readonly buffer SpotLightBuffer
+{
+	SpotLight spot_lights[];
+} spot_light_buf;
 
-#if SHADOW_MSM
-#include "../lib/msm.glsl"
-#endif
+// (offset, count) for each cluster, followed by the light indices referenced by the offsets
+layout(set = DESCRIPTOR_SET_INDEX_COMMON, binding = DESCRIPTOR_SET_COMMON_BINDING_LIGHT_CLUSTER_BUFFER, std430) readonly buffer LightClusterBuffer
+{
+	uint data[];
+} light_cluster_buf;
+
+layout(set = DESCRIPTOR_SET_INDEX_COMMON, binding = DESCRIPTOR_SET_COMMON_BINDING_SPOT_LIGHT_SHADOW_TEX) uniform sampler2D spot_light_shadow_tex_uni[MAX_SPOT_LIGHT_SHADOWS_COUNT];
+layout(set = DESCRIPTOR_SET_INDEX_COMMON, binding = DESCRIPTOR_SET_COMMON_BINDING_SPOT_LIGHT_SHADOW_DEPTH_TEX) uniform sampler2DShadow spot_light_shadow_depth_tex_uni[MAX_SPOT_LIGHT_SHADOWS_COUNT];
+layout(set = DESCRIPTOR_SET_INDEX_COMMON, binding = DESCRIPTOR_SET_COMMON_BINDING_POINT_LIGHT_SHADOW_TEX) uniform samplerCubeShadow point_light_shadow_tex_uni[MAX_POINT_LIGHTS_COUNT];
+
+// lights present in the scene, see Material::AppendLightingSpecializationConstants()
+// the defaults enable everything for pipelines that are not specialized
+layout(constant_id = SPECIALIZATION_CONSTANT_LIGHTING_DIRECTIONAL_LIGHT) const bool directional_light_spec = true;
+layout(constant_id = SPECIALIZATION_CONSTANT_LIGHTING_SPOT_LIGHT_SHADOW_MODES) const uint spot_light_shadow_modes_spec
+		= (1u << SPOT_LIGHT_SHADOW_MODE_DEPTH) | (1u << SPOT_LIGHT_SHADOW_MODE_MSM);
+layout(constant_id = SPECIALIZATION_CONSTANT_LIGHTING_CLUSTERED_SPOT_LIGHTS) const bool clustered_spot_lights_spec = true;
+layout(constant_id = SPECIALIZATION_CONSTANT_LIGHTING_POINT_LIGHTS_MAX) const int point_lights_max_spec = MAX_POINT_LIGHTS_COUNT;
 
-#define SPOT_LIGHT_SHADOW_DEPTH_BIAS 0.0001
+#include "../lib/msm.glsl"
 
-float EvaluateSpotLightShadow(int index, vec3 pos)
+float EvaluateSpotLightShadow(int index, SpotLight spot, vec3 pos)
 {
-	vec4 shadow_pos = lighting_uni.spot_lights[index].shadow_mvp_matrix * vec4(pos, 1.0);
-#if SHADOW_MSM
-	vec2 uv = shadow_pos.xy * 0.5 / shadow_pos.w + 0.5;
-	return MSMShadow(texture(spot_light_shadow_tex_uni[index], uv), shadow_pos.z);
-#else
+	uint shadow_mode = spot.shadow_mode;
+	if(shadow_mode == SPOT_LIGHT_SHADOW_MODE_NONE)
+		return 1.0;
+
+	// with only one shadow mode in the scene, the branch is resolved by specialization
+	bool msm = shadow_mode == SPOT_LIGHT_SHADOW_MODE_MSM;
+	if((spot_light_shadow_modes_spec & (1u << SPOT_LIGHT_SHADOW_MODE_DEPTH)) == 0u)
+		msm = true;
+	else if((spot_light_shadow_modes_spec & (1u << SPOT_LIGHT_SHADOW_MODE_MSM)) == 0u)
+		msm = false;
+
+	vec4 shadow_pos = spot.shadow_mvp_matrix * vec4(pos, 1.0);
+	if(msm)
+	{
+		vec2 uv = shadow_pos.xy * 0.5 / shadow_pos.w + 0.5;
+		return MSMShadow(texture(spot_light_shadow_tex_uni[index], uv), shadow_pos.z);
+	}
+
+	// depth bias is applied while rendering the shadow map, the comparison sampler does the filtering
 	shadow_pos /= shadow_pos.w;
 	vec2 uv = shadow_pos.xy * 0.5 + 0.5;
-	float shadow_depth = texture(spot_light_shadow_tex_uni[index], uv).r;
-	float frag_depth = shadow_pos.z - SPOT_LIGHT_SHADOW_DEPTH_BIAS;
-	return frag_depth < shadow_depth ? 1.0 : 0.0;
-#endif
+	return texture(spot_light_shadow_depth_tex_uni[index], vec3(uv, shadow_pos.z));
+}
+
+/**
+ * Smooth falloff to zero at range, or no attenuation at all for range == 0.
+ */
+float LightRangeAttenuation(float dist, float range)
+{
+	if(range <= 0.0)
+		return 1.0;
+	float x = dist / range;
+	float window = clamp(1.0 - x * x * x * x, 0.0, 1.0);
+	return window * window;
+}
+
+/**
+ * @param view_depth distance of the fragment from the camera along its view direction
+ * @return offset into light_cluster_buf.data and number of spot lights in the cluster of the fragment
+ */
+uvec2 GetLightCluster(vec2 frag_coord, float view_depth)
+{
+	uvec2 tile = min(uvec2(frag_coord / lighting_uni.cluster_tile_size), lighting_uni.cluster_count.xy - 1u);
+	float slice_f = floor(log(max(view_depth, 1e-6)) * lighting_uni.cluster_z_scale + lighting_uni.cluster_z_bias);
+	uint slice = uint(clamp(slice_f, 0.0, float(lighting_uni.cluster_count.z - 1u)));
+	uint cluster = (slice * lighting_uni.cluster_count.y + tile.y) * lighting_uni.cluster_count.x + tile.x;
+	return uvec2(light_cluster_buf.data[2u * cluster], light_cluster_buf.data[2u * cluster + 1u]);
+}
+
+float EvaluatePointLightShadow(int index, vec3 pos)
+{
+	PointLight point = lighting_uni.point_lights[index];
+	if(point.shadow_mode == SPOT_LIGHT_SHADOW_MODE_NONE)
+		return 1.0;
+
+	// the face is selected by the major axis, whose length is the view space depth in that face
+	vec3 dir = pos - point.position;
+	vec3 dir_abs = abs(dir);
+	float depth = max(dir_abs.x, max(dir_abs.y, dir_abs.z));
+
+	float n = point.shadow_near_clip;
+	float f = point.shadow_far_clip;
+	float ref = f * (depth - n) / ((f - n) * depth);
+
+	return texture(point_light_shadow_tex_uni[index], vec4(dir, ref));
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,15 @@
+
+#ifndef _MATERIAL_COMMON_PUSH_CONSTANT_GLSL
+#define _MATERIAL_COMMON_PUSH_CONSTANT_GLSL
+
+// per-draw data, must match TransformPushConstant in renderer.h
+
+layout(push_constant) uniform TransformPushConstant
+{
+	mat4 transform;
+	uint view_mask;
+	uint spot_light_mask;
+	uint material_index;
+} transform_push_constant;
+
+#endif
@@ -6,7 +6,9 @@
 
 layout(set = DESCRIPTOR_SET_INDEX_COMMON, binding = DESCRIPTOR_SET_COMMON_BINDING_MATRIX_BUFFER) uniform MatrixBuffer
 {
-#ifdef COMMON_VERT_MATRIX_COMPACT
+#if defined(COMMON_VERT_MATRIX_MULTIVIEW)
+	mat4 modelview_projection[MAX_SHADOW_MULTIVIEW_COUNT];
+#elif defined(COMMON_VERT_MATRIX_COMPACT)
     mat4 modelview_projection;
 #else
 	mat4 modelview;
@@ -14,20 +16,24 @@ layout(set = DESCRIPTOR_SET_INDEX_COMMON, binding = DESCRIPTOR_SET_COMMON_BINDIN
 #endif
 } matrix_uni;
 
-layout(push_constant) uniform TransformPushConstant
-{
-	mat4 transform;
-} transform_push_constant;
+#include "common_push_constant.glsl"
 
 layout(location = 0) in vec3 position_in;
+#ifndef COMMON_VERT_POSITION_ONLY
 layout(location = 1) in vec2 uv_in;
 layout(location = 2) in vec3 normal_in;
 layout(location = 3) in vec3 tang_in;
 layout(location = 4) in vec3 bitang_in;
+#endif
 
 vec4 CalculateVertexPosition()
 {
-#ifdef COMMON_VERT_MATRIX_COMPACT
+#if defined(COMMON_VERT_MATRIX_MULTIVIEW)
+		// objects culled for this view collapse to a degenerate point
+		if((transform_push_constant.view_mask & (1u << gl_ViewIndex)) == 0u)
+			return vec4(0.0);
+		mat4 mvp = matrix_uni.modelview_projection[gl_ViewIndex];
+#elif defined(COMMON_VERT_MATRIX_COMPACT)
 		mat4 mvp = matrix_uni.modelview_projection;
 #else
 		mat4 mvp = matrix_uni.projection * matrix_uni.modelview;
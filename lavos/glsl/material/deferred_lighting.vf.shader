@@ -0,0 +1,53 @@
+#version 450
+
+// Lighting pass of the deferred path, shading every pixel of the G-buffer with a fullscreen triangle.
+
+#include "common.glsl"
+
+#ifdef SHADER_VERT
+
+out gl_PerVertex
+{
+	vec4 gl_Position;
+};
+
+void main()
+{
+	vec2 pos = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2);
+	gl_Position = vec4(pos * 2.0 - 1.0, 0.0, 1.0);
+}
+
+// -------------------------------------------------
+#elif SHADER_FRAG
+
+#include "common_frag.glsl"
+#include "shading_phong.glsl"
+#include "gbuffer.glsl"
+
+layout(input_attachment_index = 0, set = DESCRIPTOR_SET_INDEX_MATERIAL, binding = DESCRIPTOR_SET_GBUFFER_BINDING_ALBEDO) uniform subpassInput albedo_in;
+layout(input_attachment_index = 1, set = DESCRIPTOR_SET_INDEX_MATERIAL, binding = DESCRIPTOR_SET_GBUFFER_BINDING_NORMAL) uniform subpassInput normal_in;
+layout(input_attachment_index = 2, set = DESCRIPTOR_SET_INDEX_MATERIAL, binding = DESCRIPTOR_SET_GBUFFER_BINDING_DEPTH) uniform subpassInput depth_in;
+
+void main()
+{
+	float depth = subpassLoad(depth_in).r;
+
+	// background, nothing was rendered here
+	if(depth >= 1.0)
+	{
+		out_color = vec4(0.0, 0.0, 0.0, 1.0);
+		return;
+	}
+
+	vec4 albedo = subpassLoad(albedo_in);
+	vec3 normal = DecodeNormal(subpassLoad(normal_in).xy);
+	float specular_exponent = DecodeSpecularExponent(albedo.a);
+
+	vec4 position = camera_uni.screen_to_world * vec4(gl_FragCoord.xy, depth, 1.0);
+	position /= position.w;
+
+	// the G-buffer does not know which object a pixel belongs to, so all shadowed spot lights are evaluated
+	out_color = vec4(ShadePhong(albedo.rgb, position.xyz, normal, specular_exponent, gl_FragCoord.xy, ~0u), 1.0);
+}
+
+#endif
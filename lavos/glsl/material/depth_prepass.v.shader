@@ -0,0 +1,21 @@
+#version 450
+
+// Vertex shader for the depth prepass, reading only the position stream.
+// Rendered without a fragment shader.
+
+#include "common.glsl"
+
+#define COMMON_VERT_POSITION_ONLY
+#include "common_vert.glsl"
+
+out gl_PerVertex
+{
+	vec4 gl_Position;
+};
+
+invariant gl_Position;
+
+void main()
+{
+	gl_Position = CalculateVertexPosition();
+}
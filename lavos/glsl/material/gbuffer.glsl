@@ -0,0 +1,39 @@
+
+#ifndef _MATERIAL_GBUFFER_GLSL
+#define _MATERIAL_GBUFFER_GLSL
+
+// G-buffer layout:
+//   albedo (RGBA8):   rgb = base color, a = encoded specular exponent
+//   normal (RG16F):   octahedral encoded world space normal
+
+vec2 OctWrap(vec2 v)
+{
+	return (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+vec2 EncodeNormal(vec3 n)
+{
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	return n.z >= 0.0 ? n.xy : OctWrap(n.xy);
+}
+
+vec3 DecodeNormal(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if(n.z < 0.0)
+		n.xy = OctWrap(n.xy);
+	return normalize(n);
+}
+
+// exponents from 1 to 1024 on a logarithmic scale
+float EncodeSpecularExponent(float exponent)
+{
+	return clamp(log2(max(exponent, 1.0)) / 10.0, 0.0, 1.0);
+}
+
+float DecodeSpecularExponent(float e)
+{
+	return exp2(e * 10.0);
+}
+
+#endif
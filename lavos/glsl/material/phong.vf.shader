@@ -9,6 +9,9 @@ out gl_PerVertex
 	vec4 gl_Position;
 };
 
+// must match depth_prepass.v.shader exactly for the eEqual depth test
+invariant gl_Position;
+
 layout(location = 0) out vec2 uv_out;
 
 layout(location = 1) out vec3 position_out;
@@ -31,64 +34,16 @@ void main()
 #elif SHADER_FRAG
 
 #include "common_frag.glsl"
-#include "common_lighting.glsl"
-#include "common_camera.glsl"
-#include "lighting_phong.glsl"
-
-layout(set = DESCRIPTOR_SET_INDEX_MATERIAL, binding = 0, std140) uniform MaterialBuffer
-{
-	PhongMaterialParameters phong_params;
-} material_uni;
-
-layout(set = DESCRIPTOR_SET_INDEX_MATERIAL, binding = 1) uniform sampler2D base_color_tex_uni;
-layout(set = DESCRIPTOR_SET_INDEX_MATERIAL, binding = 2) uniform sampler2D normal_tex_uni;
-
-
-layout(location = 0) in vec2 uv_in;
-
-layout(location = 1) in vec3 position_in;
-layout(location = 2) in vec3 normal_in;
-layout(location = 3) in vec3 tang_in;
-layout(location = 4) in vec3 bitang_in;
-
-
+#include "common_push_constant.glsl"
+#include "shading_phong.glsl"
+#include "phong_surface.glsl"
 
 void main()
 {
-	vec4 base_color = texture(base_color_tex_uni, uv_in).rgba;
-	base_color *= material_uni.phong_params.base_color;
-
-	vec3 normal = normalize(normal_in);
-	vec3 tang = normalize(tang_in);
-	vec3 bitang = normalize(bitang_in);
-
-	vec3 tang_normal = texture(normal_tex_uni, uv_in).rgb * 2.0 - 1.0;
-	normal = mat3(tang, bitang, normal) * tang_normal;
-	normal = normalize(normal);
-
-	vec3 cam_dir = normalize(camera_uni.position - position_in);
-
-	vec3 color = base_color.rgb * lighting_uni.ambient_intensity;
-
-	if(lighting_uni.directional_light_enabled)
-	{
-		color += base_color.rgb * LightingPhong(normal, -lighting_uni.directional_light_dir, cam_dir, material_uni.phong_params.specular_exponent);
-	}
-
-	for(int i=0; i<lighting_uni.spot_lights_count; i++)
-	{
-	    SpotLight spot = lighting_uni.spot_lights[i];
-	    vec3 light_dir = normalize(spot.position - position_in);
-
-	    float ndotl = -dot(spot.direction, light_dir);
-	    if(ndotl < spot.angle_cos)
-	        continue;
-
-		float shadow = EvaluateSpotLightShadow(i, position_in);
-	    color += base_color.rgb * shadow * LightingPhong(normal, light_dir, cam_dir, material_uni.phong_params.specular_exponent);
-	}
-
-	out_color = vec4(color, base_color.a);
+	PhongSurface surface = EvaluatePhongSurface();
+	vec3 color = ShadePhong(surface.base_color.rgb, position_in, surface.normal, surface.specular_exponent, gl_FragCoord.xy,
+			transform_push_constant.spot_light_mask);
+	out_color = vec4(color, surface.base_color.a);
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,20 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+// Fragment shader of PhongMaterial with textures and parameters from the global MaterialTable.
+// The vertex stage is shared with phong.vf.shader.
+
+#define PHONG_SURFACE_MATERIAL_TABLE
+
+#include "common_frag.glsl"
+#include "common_push_constant.glsl"
+#include "shading_phong.glsl"
+#include "phong_surface.glsl"
+
+void main()
+{
+	PhongSurface surface = EvaluatePhongSurface();
+	vec3 color = ShadePhong(surface.base_color.rgb, position_in, surface.normal, surface.specular_exponent, gl_FragCoord.xy,
+			transform_push_constant.spot_light_mask);
+	out_color = vec4(color, surface.base_color.a);
+}
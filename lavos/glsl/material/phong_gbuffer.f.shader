@@ -0,0 +1,17 @@
+#version 450
+
+// Fragment shader of PhongMaterial for the G-buffer pass of the deferred path.
+// The vertex stage is shared with phong.vf.shader.
+
+#include "phong_surface.glsl"
+#include "gbuffer.glsl"
+
+layout(location = 0) out vec4 albedo_out;
+layout(location = 1) out vec2 normal_out;
+
+void main()
+{
+	PhongSurface surface = EvaluatePhongSurface();
+	albedo_out = vec4(surface.base_color.rgb, EncodeSpecularExponent(surface.specular_exponent));
+	normal_out = EncodeNormal(surface.normal);
+}
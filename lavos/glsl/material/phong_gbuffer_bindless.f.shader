@@ -0,0 +1,20 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+// Fragment shader of PhongMaterial for the G-buffer pass with textures and parameters from the global MaterialTable.
+// The vertex stage is shared with phong.vf.shader.
+
+#define PHONG_SURFACE_MATERIAL_TABLE
+
+#include "phong_surface.glsl"
+#include "gbuffer.glsl"
+
+layout(location = 0) out vec4 albedo_out;
+layout(location = 1) out vec2 normal_out;
+
+void main()
+{
+	PhongSurface surface = EvaluatePhongSurface();
+	albedo_out = vec4(surface.base_color.rgb, EncodeSpecularExponent(surface.specular_exponent));
+	normal_out = EncodeNormal(surface.normal);
+}
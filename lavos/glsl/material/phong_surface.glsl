@@ -0,0 +1,108 @@
+
+#ifndef _MATERIAL_PHONG_SURFACE_GLSL
+#define _MATERIAL_PHONG_SURFACE_GLSL
+
+// Fragment inputs and material resources of PhongMaterial, shared by the forward and G-buffer shaders.
+
+#include "common.glsl"
+#include "lighting_phong.glsl"
+
+#ifdef PHONG_SURFACE_MATERIAL_TABLE
+
+// bindless resources from the global MaterialTable, requires GL_EXT_nonuniform_qualifier
+
+#include "common_push_constant.glsl"
+
+struct PhongMaterialTableBlock
+{
+	vec4 base_color;
+	float specular_exponent;
+	float alpha_cutoff;
+	uint base_color_tex;
+	uint normal_tex;
+	vec4 unused[2];
+};
+
+layout(set = DESCRIPTOR_SET_INDEX_MATERIAL, binding = DESCRIPTOR_SET_MATERIAL_TABLE_BINDING_PARAMETERS, std430) readonly buffer MaterialTableBuffer
+{
+	PhongMaterialTableBlock blocks[];
+} material_table_buf;
+
+layout(set = DESCRIPTOR_SET_INDEX_MATERIAL, binding = DESCRIPTOR_SET_MATERIAL_TABLE_BINDING_TEXTURES) uniform sampler2D material_table_tex[];
+
+#define PHONG_BLOCK material_table_buf.blocks[transform_push_constant.material_index]
+#define PHONG_BASE_COLOR_FACTOR PHONG_BLOCK.base_color
+#define PHONG_SPECULAR_EXPONENT PHONG_BLOCK.specular_exponent
+#define PHONG_ALPHA_CUTOFF PHONG_BLOCK.alpha_cutoff
+#define PHONG_BASE_COLOR_TEX material_table_tex[PHONG_BLOCK.base_color_tex]
+#define PHONG_NORMAL_TEX material_table_tex[PHONG_BLOCK.normal_tex]
+
+#else
+
+layout(set = DESCRIPTOR_SET_INDEX_MATERIAL, binding = 0, std140) uniform MaterialBuffer
+{
+	PhongMaterialParameters phong_params;
+	float alpha_cutoff;
+} material_uni;
+
+layout(set = DESCRIPTOR_SET_INDEX_MATERIAL, binding = 1) uniform sampler2D base_color_tex_uni;
+layout(set = DESCRIPTOR_SET_INDEX_MATERIAL, binding = 2) uniform sampler2D normal_tex_uni;
+
+#define PHONG_BASE_COLOR_FACTOR material_uni.phong_params.base_color
+#define PHONG_SPECULAR_EXPONENT material_uni.phong_params.specular_exponent
+#define PHONG_ALPHA_CUTOFF material_uni.alpha_cutoff
+#define PHONG_BASE_COLOR_TEX base_color_tex_uni
+#define PHONG_NORMAL_TEX normal_tex_uni
+
+#endif
+
+// features of the MaterialInstance, see PhongMaterial::GetSpecializationConstants()
+layout(constant_id = SPECIALIZATION_CONSTANT_PHONG_BASE_COLOR_TEX) const bool base_color_tex_enabled = true;
+layout(constant_id = SPECIALIZATION_CONSTANT_PHONG_NORMAL_TEX) const bool normal_tex_enabled = true;
+layout(constant_id = SPECIALIZATION_CONSTANT_PHONG_ALPHA_MASK) const bool alpha_mask_enabled = false;
+
+layout(location = 0) in vec2 uv_in;
+
+layout(location = 1) in vec3 position_in;
+layout(location = 2) in vec3 normal_in;
+layout(location = 3) in vec3 tang_in;
+layout(location = 4) in vec3 bitang_in;
+
+struct PhongSurface
+{
+	vec4 base_color;
+	vec3 normal;
+	float specular_exponent;
+};
+
+PhongSurface EvaluatePhongSurface()
+{
+	PhongSurface surface;
+
+	surface.base_color = PHONG_BASE_COLOR_FACTOR;
+	if(base_color_tex_enabled)
+		surface.base_color *= texture(PHONG_BASE_COLOR_TEX, uv_in).rgba;
+
+	if(alpha_mask_enabled && surface.base_color.a < PHONG_ALPHA_CUTOFF)
+		discard;
+
+	vec3 normal = normalize(normal_in);
+	if(normal_tex_enabled)
+	{
+		vec3 tang = normalize(tang_in);
+		vec3 bitang = normalize(bitang_in);
+
+		vec3 tang_normal = texture(PHONG_NORMAL_TEX, uv_in).rgb * 2.0 - 1.0;
+		surface.normal = normalize(mat3(tang, bitang, normal) * tang_normal);
+	}
+	else
+	{
+		surface.normal = normal;
+	}
+
+	surface.specular_exponent = PHONG_SPECULAR_EXPONENT;
+
+	return surface;
+}
+
+#endif
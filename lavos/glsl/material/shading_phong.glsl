@@ -0,0 +1,73 @@
+
+#ifndef _MATERIAL_SHADING_PHONG_GLSL
+#define _MATERIAL_SHADING_PHONG_GLSL
+
+// Phong shading of one surface point with all lights, shared by the forward and deferred paths.
+
+#include "common_lighting.glsl"
+#include "common_camera.glsl"
+#include "lighting_phong.glsl"
+
+vec3 EvaluateSpotLight(SpotLight spot, int shadow_index, vec3 position, vec3 normal, vec3 cam_dir, float specular_exponent)
+{
+	vec3 light_vec = spot.position - position;
+	vec3 light_dir = normalize(light_vec);
+
+	float ndotl = -dot(spot.direction, light_dir);
+	if(ndotl < spot.angle_cos)
+		return vec3(0.0);
+
+	float attenuation = LightRangeAttenuation(length(light_vec), spot.range);
+	if(attenuation <= 0.0)
+		return vec3(0.0);
+
+	float shadow = shadow_index >= 0 ? EvaluateSpotLightShadow(shadow_index, spot, position) : 1.0;
+	return vec3(attenuation * shadow * LightingPhong(normal, light_dir, cam_dir, specular_exponent));
+}
+
+// shadowed_spot_light_mask selects the shadowed spot lights that may reach the surface, bit i for light i
+vec3 ShadePhong(vec3 base_color, vec3 position, vec3 normal, float specular_exponent, vec2 frag_coord, uint shadowed_spot_light_mask)
+{
+	vec3 cam_dir = normalize(camera_uni.position - position);
+
+	vec3 color = base_color * lighting_uni.ambient_intensity;
+
+	if(directional_light_spec && lighting_uni.directional_light_enabled)
+	{
+		color += base_color * LightingPhong(normal, -lighting_uni.directional_light_dir, cam_dir, specular_exponent);
+	}
+
+	uint shadowed_mask = shadowed_spot_light_mask & ((1u << lighting_uni.shadowed_spot_lights_count) - 1u);
+	while(spot_light_shadow_modes_spec != 0u && shadowed_mask != 0u)
+	{
+		int i = findLSB(shadowed_mask);
+		shadowed_mask &= shadowed_mask - 1u;
+		SpotLight spot = spot_light_buf.spot_lights[i];
+		color += base_color * EvaluateSpotLight(spot, i, position, normal, cam_dir, specular_exponent);
+	}
+
+	// unshadowed spot lights, only the ones assigned to the cluster of this fragment
+	if(clustered_spot_lights_spec)
+	{
+		uvec2 cluster = GetLightCluster(frag_coord, dot(position - camera_uni.position, camera_uni.direction));
+		for(uint i=0; i<cluster.y; i++)
+		{
+			SpotLight spot = spot_light_buf.spot_lights[light_cluster_buf.data[cluster.x + i]];
+			color += base_color * EvaluateSpotLight(spot, -1, position, normal, cam_dir, specular_exponent);
+		}
+	}
+
+	int point_lights_count = min(int(lighting_uni.point_lights_count), point_lights_max_spec);
+	for(int i=0; i<point_lights_count; i++)
+	{
+		PointLight point = lighting_uni.point_lights[i];
+		vec3 light_dir = normalize(point.position - position);
+
+		float shadow = EvaluatePointLightShadow(i, position);
+		color += base_color * point.intensity * shadow * LightingPhong(normal, light_dir, cam_dir, specular_exponent);
+	}
+
+	return color;
+}
+
+#endif
@@ -7,9 +7,10 @@
 #define COMMON_VERT_MATRIX_COMPACT
 #include "common_vert.glsl"
 
-#if SHADOW_MSM
 layout(location = 0) out float z_out;
-#endif
+
+// false for depth-only shadows, which are rendered without fragment shader
+layout(constant_id = SPECIALIZATION_CONSTANT_SHADOW_MOMENTS) const bool shadow_moments_spec = true;
 
 out gl_PerVertex
 {
@@ -19,26 +20,23 @@ out gl_PerVertex
 void main()
 {
 	vec4 pos = CalculateVertexPosition();
-	#if SHADOW_MSM
+	if(shadow_moments_spec)
 		z_out = pos.z;
-	#endif
 	gl_Position = pos;
 }
 
 // -------------------------------------------------
 #elif SHADER_FRAG
 
-#if SHADOW_MSM
+// only used for moment shadow maps, depth-only shadows are rendered without a fragment shader
+
 layout(location = 0) in float z_in;
 layout(location = 0) out vec4 shadow_out;
-#endif
 
 void main()
 {
-	#if SHADOW_MSM
-		float z = z_in;
-		shadow_out = vec4(z, z*z, z*z*z, z*z*z*z);
-	#endif
+	float z = z_in;
+	shadow_out = vec4(z, z*z, z*z*z, z*z*z*z);
 }
 
 #endif
\ No newline at end of file
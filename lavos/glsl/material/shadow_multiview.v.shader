@@ -0,0 +1,28 @@
+#version 450
+#extension GL_EXT_multiview : require
+
+// Vertex shader for rendering multiple shadow maps into the layers of one image in a single pass.
+// The fragment stage is shared with shadow.vf.shader.
+
+#include "common.glsl"
+
+#define COMMON_VERT_MATRIX_MULTIVIEW
+#include "common_vert.glsl"
+
+layout(location = 0) out float z_out;
+
+// false for depth-only shadows, which are rendered without fragment shader
+layout(constant_id = SPECIALIZATION_CONSTANT_SHADOW_MOMENTS) const bool shadow_moments_spec = true;
+
+out gl_PerVertex
+{
+	vec4 gl_Position;
+};
+
+void main()
+{
+	vec4 pos = CalculateVertexPosition();
+	if(shadow_moments_spec)
+		z_out = pos.z;
+	gl_Position = pos;
+}
@@ -5,9 +5,11 @@
 #include <string>
 #include <map>
 
+#include "engine.h"
 #include "material/material_instance.h"
 #include "mesh.h"
 #include "scene.h"
+#include "texture_streamer.h"
 
 namespace lavos
 {
@@ -18,18 +20,38 @@ class AssetContainer
 		Engine * const engine;
 		const RenderConfig render_config;
 
+		/**
+		 * If not null, textures are added to it instead of being fully loaded into textures.
+		 */
+		TextureStreamer * const texture_streamer;
+
 		vk::DescriptorPool descriptor_pool;
 
+		/**
+		 * Images of all loaded textures by their key for Engine::AcquireSharedTexture(), referenced by the MaterialInstances.
+		 * Images with the same content are shared with all other AssetContainers. Their samplers are owned by the Engine.
+		 */
+		std::map<Engine::SharedTextureKey, Texture> textures;
+
+		std::vector<TextureStreamer::StreamedTexture *> streamed_textures;
+
 		std::vector<MaterialInstance *> material_instances;
 		std::vector<Mesh *> meshes;
 		std::vector<Scene *> scenes;
 
-		AssetContainer(Engine *engine, const RenderConfig &render_config);
+		AssetContainer(Engine *engine, const RenderConfig &render_config, TextureStreamer *texture_streamer = nullptr);
 		~AssetContainer();
 
 		const RenderConfig &GetRenderConfig()	{ return render_config; }
 
-		static AssetContainer *LoadFromGLTF(Engine *engine, const RenderConfig &render_config, Material *material, std::string filename);
+		/**
+		 * @return the device memory used by the textures and meshes of this container, streamed textures with their currently resident levels.
+		 * 			Textures shared with other containers are only counted for the one that has held them the longest.
+		 */
+		vk::DeviceSize GetMemoryUsage() const;
+
+		static AssetContainer *LoadFromGLTF(Engine *engine, const RenderConfig &render_config, Material *material, std::string filename,
+				TextureStreamer *texture_streamer = nullptr);
 };
 
 }
@@ -26,6 +26,7 @@ class Buffer
 		~Buffer();
 
 		vk::Buffer GetVkBuffer()	{ return buffer; }
+		VmaAllocation GetAllocation() const	{ return allocation; }
 
 		void *Map();
 		void UnMap();
@@ -6,6 +6,7 @@ namespace lavos
 {
 
 class Node;
+class Scene;
 
 class Component
 {
@@ -19,6 +20,11 @@ class Component
 
 		Node *GetNode() const			{ return node; }
 
+		/**
+		 * @return the Scene the node of this component is attached to, or nullptr
+		 */
+		Scene *GetScene() const;
+
 		virtual void Update(float delta_time) {}
 };
 
@@ -22,7 +22,11 @@ class MeshComp: public Component, public Renderable
 
 		bool GetCurrentlyRenderable() const override	{ return mesh != nullptr; }
 
+		bool GetBounds(glm::vec3 &min, glm::vec3 &max) override;
+
 		void BindBuffers(vk::CommandBuffer command_buffer) override;
+		bool BindPositionBuffers(vk::CommandBuffer command_buffer) override;
+		bool GetBufferBinding(bool position_only, BufferBinding &binding) override;
 		unsigned int GetPrimitivesCount() override;
 		Primitive *GetPrimitive(unsigned int i) override;
 };
@@ -29,7 +29,16 @@ class PointCloudComp: public Component, public Renderable, public Renderable::Pr
 
 		void BindBuffers(vk::CommandBuffer command_buffer) override
 		{
-			command_buffer.bindVertexBuffers(0, { point_cloud->vertex_buffer->GetVkBuffer() }, { 0 });
+			command_buffer.bindVertexBuffers(0, { point_cloud->GetVkVertexBuffer() }, { 0 });
+		}
+
+		bool GetBufferBinding(bool position_only, BufferBinding &binding) override
+		{
+			if(position_only)
+				return false;
+			binding.vertex_buffer = point_cloud->GetVkVertexBuffer();
+			binding.index_buffer = nullptr;
+			return true;
 		}
 
 		unsigned int GetPrimitivesCount() override							{ return 1; }
@@ -39,7 +48,7 @@ class PointCloudComp: public Component, public Renderable, public Renderable::Pr
 
 		void Draw(vk::CommandBuffer command_buffer) override
 		{
-			command_buffer.draw(static_cast<uint32_t>(point_cloud->points.size()), 1, 0, 0);
+			command_buffer.draw(point_cloud->vertex_allocation->count, 1, point_cloud->vertex_allocation->offset, 0);
 		}
 };
 
@@ -0,0 +1,43 @@
+
+#ifndef LAVOS_POINT_LIGHT_H
+#define LAVOS_POINT_LIGHT_H
+
+#include "../glm_config.h"
+#include <glm/ext/vector_float3.hpp>
+
+#include "component.h"
+
+namespace lavos
+{
+
+class Engine;
+class PointLightShadow;
+class PointLightShadowRenderer;
+
+/**
+ * Light emitting in all directions from the position of its node.
+ */
+class PointLight: public Component
+{
+	private:
+		glm::vec3 intensity;
+
+		PointLightShadow *shadow = nullptr;
+
+	public:
+		PointLight(glm::vec3 intensity = glm::vec3(1.0f, 1.0f, 1.0f));
+		~PointLight();
+
+		glm::vec3 GetIntensity() const 					{ return intensity; }
+		void SetIntensity(const glm::vec3 &intensity)	{ this->intensity = intensity; }
+
+		glm::vec3 GetPositionWorld();
+
+		void InitShadow(Engine *engine, PointLightShadowRenderer *renderer, float near_clip = 0.1f, float far_clip = 100.0f);
+		void DestroyShadow();
+		PointLightShadow *GetShadow()					{ return shadow; }
+};
+
+}
+
+#endif //LAVOS_POINT_LIGHT_H
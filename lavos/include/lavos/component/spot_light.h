@@ -21,6 +21,7 @@ class SpotLight: public Component
 	private:
 		glm::vec3 intensity;
 		float angle;
+		float range = 0.0f;
 
 		SpotLightShadow *shadow = nullptr;
 
@@ -38,6 +39,24 @@ class SpotLight: public Component
 		 */
 		void SetIntensity(float angle)					{ this->angle = angle; }
 
+		/**
+		 * Intensity below which a light without an explicit range is considered to have faded out.
+		 */
+		static constexpr float range_cutoff_intensity = 1.0f / 256.0f;
+
+		/**
+		 * Distance at which the light has faded out completely, 0 to derive it from the intensity.
+		 * Lights are only evaluated for the clusters they reach.
+		 */
+		float GetRange() const							{ return range; }
+		void SetRange(float range)						{ this->range = range; }
+
+		/**
+		 * @return the range if set, else the distance at which the brightest channel of the intensity,
+		 * 			falling off with the inverse square of the distance, drops below range_cutoff_intensity
+		 */
+		float GetEffectiveRange() const;
+
 		glm::vec3 GetIntensity() const 					{ return intensity; }
 		void SetIntensity(const glm::vec3 &intensity)	{ this->intensity = intensity; }
 
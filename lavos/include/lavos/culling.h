@@ -0,0 +1,52 @@
+
+#ifndef LAVOS_CULLING_H
+#define LAVOS_CULLING_H
+
+#include "glm_config.h"
+#include <glm/ext/vector_float3.hpp>
+#include <glm/ext/matrix_float4x4.hpp>
+
+#include <cstdint>
+
+namespace lavos
+{
+
+class Node;
+class Renderable;
+
+/**
+ * Conservative test whether an axis-aligned box intersects the view volume of a projection.
+ * The box is transformed into clip space and rejected only if all corners are outside of the same clip plane,
+ * so large boxes near the corners of the frustum may be reported as visible even if they are not.
+ *
+ * @param model_view_projection transformation from the space of the box to clip space, with depth in [0, 1]
+ */
+bool BoxIntersectsFrustum(const glm::mat4 &model_view_projection, const glm::vec3 &min, const glm::vec3 &max);
+
+/**
+ * Cull the bounds of a renderable against multiple views, e.g. the layers of a multiview pass.
+ * Renderables without bounds are visible in all views.
+ *
+ * @return mask with bit i set if the renderable may be visible in view_projections[i]
+ */
+std::uint32_t CalculateViewMask(Node *node, Renderable *renderable, const glm::mat4 *view_projections, std::uint32_t view_count);
+
+/**
+ * Conservative test whether a sphere intersects the cone of a spot light.
+ *
+ * @param angle_cos cosine of half the opening angle of the cone
+ * @param range maximum distance reached by the light, unlimited if <= 0
+ */
+bool SphereIntersectsSpotLight(const glm::vec3 &center, float radius,
+		const glm::vec3 &light_position, const glm::vec3 &light_direction, float angle_cos, float range);
+
+/**
+ * Bounding sphere of the bounds of a renderable in world space.
+ *
+ * @return false if the renderable has no bounds
+ */
+bool CalculateBoundingSphere(Node *node, Renderable *renderable, glm::vec3 &center, float &radius);
+
+}
+
+#endif //LAVOS_CULLING_H
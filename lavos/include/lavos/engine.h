@@ -5,7 +5,12 @@
 #include <vulkan/vulkan.hpp>
 #include <vk_mem_alloc.h>
 
+#include <array>
+#include <deque>
+#include <functional>
 #include <set>
+#include <map>
+#include <tuple>
 
 #include "lavos/buffer.h"
 #include "lavos/texture.h"
@@ -13,6 +18,10 @@
 namespace lavos
 {
 
+class MaterialTable;
+class MaterialParameterArena;
+class GeometryArena;
+
 class Engine
 {
 	public:
@@ -26,9 +35,106 @@ class Engine
 
 			bool enable_anisotropy = true;
 
+			/**
+			 * Enable VK_KHR_multiview, required for SpotLightShadowRenderers with a view count > 1.
+			 * If the device is created externally (InitializeWithDevice), it must have been created with this.
+			 */
+			bool enable_multiview = false;
+
+			/**
+			 * Enable pipelineStatisticsQuery, used by Renderer to collect RenderStatistics.
+			 */
+			bool enable_pipeline_statistics = false;
+
+			/**
+			 * Enable VK_EXT_descriptor_indexing and create a MaterialTable for bindless materials.
+			 * If the device is created externally (InitializeWithDevice), it must have been created with
+			 * the extension and the features checked by GetDescriptorIndexingSupport().
+			 */
+			bool enable_descriptor_indexing = false;
+
+			/**
+			 * Capacity of the MaterialTable, the number of textures is further limited by the device.
+			 */
+			std::uint32_t material_table_texture_capacity = 4096;
+			std::uint32_t material_table_block_capacity = 4096;
+
+			/**
+			 * Initial capacities in elements of the GeometryArena pools for the vertices and indices of Meshes.
+			 * The buffers are only created with the first allocation and grow beyond these if necessary.
+			 */
+			std::uint32_t geometry_mesh_vertices_capacity = 1u << 18;
+			std::uint32_t geometry_mesh_indices_capacity = 1u << 20;
+
+			/**
+			 * Enable VK_EXT_memory_budget, so heap budgets reflect the actual usage of all processes
+			 * instead of an estimate from the heap sizes.
+			 * If the device is created externally (InitializeWithDevice), it must have been created with this.
+			 */
+			bool enable_memory_budget = false;
+
+			/**
+			 * Fraction of a heap's budget above which the MemoryBudgetCallback is called and a warning is logged.
+			 */
+			float memory_budget_warning_fraction = 0.9f;
+
+			/**
+			 * Enable VK_KHR_dynamic_rendering. Renderers then record passes without vk::RenderPass and vk::Framebuffer
+			 * where possible, so their pipelines only depend on the attachment formats.
+			 * If the device is created externally (InitializeWithDevice), it must have been created with this.
+			 */
+			bool enable_dynamic_rendering = false;
+
+			/**
+			 * Enable VK_KHR_timeline_semaphore to track the progress of all submissions with a single semaphore
+			 * instead of a fence per submission, see Submit().
+			 * If the device is created externally (InitializeWithDevice), it must have been created with this.
+			 */
+			bool enable_timeline_semaphore = false;
+
 			CreateInfo() = default;
 		};
 
+		/**
+		 * What an allocation is used for, to account memory usage per category.
+		 */
+		enum class MemoryCategory
+		{
+			Other,
+			Meshes,
+			Textures,
+			Shadows,
+			RenderTargets,
+			Staging,
+			Uniforms,
+			Count
+		};
+
+		struct HeapBudget
+		{
+			vk::DeviceSize usage;
+			vk::DeviceSize budget;
+		};
+
+		typedef std::function<void (std::uint32_t heap_index, const HeapBudget &budget)> MemoryBudgetCallback;
+
+		/**
+		 * Identifies the content of a texture created through AcquireSharedTexture(). The hash alone may collide,
+		 * so textures are only shared if the size and format of their images are equal too.
+		 */
+		struct SharedTextureKey
+		{
+			std::uint64_t hash;
+			std::uint32_t width;
+			std::uint32_t height;
+			vk::Format format;
+
+			bool operator<(const SharedTextureKey &rhs) const
+			{
+				return std::tie(hash, width, height, format) < std::tie(rhs.hash, rhs.width, rhs.height, rhs.format);
+			}
+		};
+
 		struct QueueFamilyIndices
 		{
 			int graphics_family = -1;
@@ -52,12 +158,94 @@ class Engine
 
 		VmaAllocator allocator;
 
+		struct AllocationRecord
+		{
+			MemoryCategory category;
+			vk::DeviceSize size;
+		};
+
+		std::map<VmaAllocation, AllocationRecord> allocation_records;
+		std::array<vk::DeviceSize, static_cast<std::size_t>(MemoryCategory::Count)> category_usage = {};
+
+		/**
+		 * Heaps that are currently above the warning fraction of their budget, to warn only once per crossing.
+		 */
+		std::vector<bool> heaps_over_budget;
+		MemoryBudgetCallback memory_budget_callback;
+
+		bool lazily_allocated_memory_available = false;
+
+		/**
+		 * Transient attachments currently placed in lazily allocated memory, with their size
+		 */
+		std::map<VmaAllocation, vk::DeviceSize> lazily_allocated_images;
+		vk::DeviceSize lazily_allocated_size = 0;
+
 		vk::Queue graphics_queue;
 
 
 		vk::CommandPool transient_command_pool;
 		vk::CommandPool render_command_pool;
 
+		MaterialTable *material_table = nullptr;
+		MaterialParameterArena *material_parameter_arena = nullptr;
+		GeometryArena *geometry_arena = nullptr;
+
+		/**
+		 * Samplers created through GetSampler(), destroyed together with the Engine
+		 */
+		std::vector<std::pair<vk::SamplerCreateInfo, vk::Sampler>> samplers;
+
+		struct SharedTexture
+		{
+			Texture texture;
+
+			/**
+			 * Everyone holding a reference, in the order of their AcquireSharedTexture() calls
+			 */
+			std::vector<const void *> holders;
+		};
+
+		/**
+		 * Textures created through AcquireSharedTexture() by their key
+		 */
+		std::map<SharedTextureKey, SharedTexture> shared_textures;
+
+		PFN_vkCmdBeginRenderingKHR cmd_begin_rendering = nullptr;
+		PFN_vkCmdEndRenderingKHR cmd_end_rendering = nullptr;
+		PFN_vkGetSemaphoreCounterValueKHR get_semaphore_counter_value = nullptr;
+		PFN_vkWaitSemaphoresKHR wait_semaphores = nullptr;
+
+		/**
+		 * Value of the last submission made through Submit() and of the last one known to be finished
+		 */
+		std::uint64_t submitted_value = 0;
+		std::uint64_t completed_value = 0;
+
+		/**
+		 * Signaled with the value of every submission, only with timeline semaphores
+		 */
+		vk::Semaphore timeline_semaphore;
+
+		/**
+		 * Without timeline semaphores, the fences of unfinished submissions with their values, and finished ones for reuse
+		 */
+		std::deque<std::pair<std::uint64_t, vk::Fence>> submission_fences;
+		std::vector<vk::Fence> free_fences;
+
+		struct DeferredDestruction
+		{
+			std::uint64_t value;
+			std::function<void()> destroy;
+		};
+
+		std::vector<DeferredDestruction> deferred_destructions;
+
+		/**
+		 * Destructions waiting for the submission of a command buffer that is still being recorded
+		 */
+		std::vector<std::pair<vk::CommandBuffer, std::function<void()>>> pending_destructions;
+
 
 		std::vector<const char *> GetRequiredInstanceExtensions();
 		std::vector<const char *> GetRequiredDeviceExtensions();
@@ -74,8 +262,39 @@ class Engine
 		void CreateLogicalDevice();
 
 		void CreateAllocator();
+		void LoadDeviceFunctions();
+
+		void TrackAllocation(VmaAllocation allocation, const VmaAllocationInfo &allocation_info, MemoryCategory category);
+		void UntrackAllocation(VmaAllocation allocation);
+		void CheckMemoryBudget(std::uint32_t heap_index);
+		void DetectLazilyAllocatedMemory();
 
 		void CreateGlobalCommandPools();
+		void CreateSubmissionTracking();
+		void CleanupSubmissionTracking();
+
+		/**
+		 * Call all deferred destructions whose submissions are finished.
+		 */
+		void RunDeferredDestructions();
+		void CreateMaterialTable();
+		void CreateMaterialParameterArena();
+		void CreateGeometryArena();
+
+		/**
+		 * Query the VK_EXT_descriptor_indexing features of physical_device, through VK_KHR_get_physical_device_properties2.
+		 */
+		bool GetDescriptorIndexingSupport(vk::PhysicalDevice physical_device, vk::PhysicalDeviceDescriptorIndexingPropertiesEXT *properties = nullptr);
+
+		/**
+		 * Query the VK_KHR_dynamic_rendering feature of physical_device, through VK_KHR_get_physical_device_properties2.
+		 */
+		bool GetDynamicRenderingSupport(vk::PhysicalDevice physical_device);
+
+		/**
+		 * Query the VK_KHR_timeline_semaphore feature of physical_device, through VK_KHR_get_physical_device_properties2.
+		 */
+		bool GetTimelineSemaphoreSupport(vk::PhysicalDevice physical_device);
 
 	public:
 		Engine(const CreateInfo &info);
@@ -95,6 +314,20 @@ class Engine
 		const vk::Queue &GetGraphicsQueue()	const 					{ return graphics_queue; }
 
 		bool GetAnisotropyEnabled()									{ return info.enable_anisotropy; }
+		bool GetMultiviewEnabled() const							{ return info.enable_multiview; }
+		bool GetPipelineStatisticsEnabled() const					{ return info.enable_pipeline_statistics; }
+		bool GetDescriptorIndexingEnabled() const					{ return info.enable_descriptor_indexing; }
+		bool GetMemoryBudgetEnabled() const							{ return info.enable_memory_budget; }
+		bool GetDynamicRenderingEnabled() const						{ return info.enable_dynamic_rendering; }
+		bool GetTimelineSemaphoreEnabled() const					{ return info.enable_timeline_semaphore; }
+
+		/**
+		 * @return the global MaterialTable or nullptr if descriptor indexing is not enabled
+		 */
+		MaterialTable *GetMaterialTable() const						{ return material_table; }
+
+		MaterialParameterArena *GetMaterialParameterArena() const	{ return material_parameter_arena; }
+		GeometryArena *GetGeometryArena() const						{ return geometry_arena; }
 
 		uint32_t FindMemoryType(uint32_t type_filter, vk::MemoryPropertyFlags properties);
 		int FindPresentQueueFamily(vk::SurfaceKHR surface);
@@ -105,27 +338,173 @@ class Engine
 
 		vk::CommandPool GetRenderCommandPool()						{ return render_command_pool; }
 
+		/**
+		 * vkCmdBeginRenderingKHR and vkCmdEndRenderingKHR, only if dynamic rendering is enabled.
+		 */
+		void CmdBeginRendering(vk::CommandBuffer command_buffer, const vk::RenderingInfoKHR &rendering_info);
+		void CmdEndRendering(vk::CommandBuffer command_buffer);
+
+		/**
+		 * Submit command_buffer to the graphics queue. All submissions to the graphics queue must go through here,
+		 * so the values of the submissions describe the progress of the GPU.
+		 *
+		 * @param wait_semaphores, signal_semaphores binary semaphores, e.g. to synchronize with a swapchain
+		 * @return the value of the submission, greater than that of any earlier submission
+		 */
+		std::uint64_t Submit(vk::CommandBuffer command_buffer,
+				const std::vector<vk::Semaphore> &wait_semaphores = {},
+				const std::vector<vk::PipelineStageFlags> &wait_stages = {},
+				const std::vector<vk::Semaphore> &signal_semaphores = {});
+
+		/**
+		 * @return the value of the last submission
+		 */
+		std::uint64_t GetSubmittedValue() const						{ return submitted_value; }
+
+		/**
+		 * @return the value of the last submission the GPU has finished. All submissions with lower values are finished, too.
+		 */
+		std::uint64_t GetCompletedValue();
+
+		/**
+		 * Block until the GPU has finished the submission value and all before it.
+		 */
+		void WaitForValue(std::uint64_t value);
+
+		/**
+		 * Call destroy once the GPU has finished the submission value, e.g. to free resources it still uses.
+		 */
+		void DestroyAfter(std::uint64_t value, std::function<void()> destroy);
+
+		/**
+		 * Call destroy once command_buffer, which is still being recorded, has been submitted and finished.
+		 */
+		void DestroyAfterSubmission(vk::CommandBuffer command_buffer, std::function<void()> destroy);
+
+		/**
+		 * @return the semaphore that is signaled with the value of every submission, null without timeline semaphores
+		 */
+		vk::Semaphore GetTimelineSemaphore() const					{ return timeline_semaphore; }
+
 		vk::CommandBuffer BeginSingleTimeCommandBuffer();
+
+		/**
+		 * Submit a command buffer from BeginSingleTimeCommandBuffer() without waiting for it.
+		 * The command buffer is freed once it is finished.
+		 * @return the value of the submission
+		 */
+		std::uint64_t SubmitSingleTimeCommandBuffer(vk::CommandBuffer command_buffer);
+
+		/**
+		 * Submit a command buffer from BeginSingleTimeCommandBuffer() and wait for it and all earlier submissions to finish.
+		 */
 		void EndSingleTimeCommandBuffer(vk::CommandBuffer command_buffer);
 
-		Buffer *CreateBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage, VmaMemoryUsage vma_usage, vk::SharingMode sharing_mode = vk::SharingMode::eExclusive);
+		Buffer *CreateBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage, VmaMemoryUsage vma_usage,
+				MemoryCategory category = MemoryCategory::Other, vk::SharingMode sharing_mode = vk::SharingMode::eExclusive);
 		void DestroyBuffer(vk::Buffer buffer, VmaAllocation allocation);
 
 		void *MapMemory(const VmaAllocation &allocation);
 		void UnmapMemory(const VmaAllocation &allocation);
 
+		/**
+		 * Make writes of the device to allocation visible to the host, required before reading memory that may not be
+		 * host coherent, e.g. of VMA_MEMORY_USAGE_GPU_TO_CPU.
+		 */
+		void InvalidateMemory(const VmaAllocation &allocation, vk::DeviceSize offset = 0, vk::DeviceSize size = VK_WHOLE_SIZE);
+
 		void CopyBuffer(vk::Buffer src_buffer, vk::Buffer dst_buffer, vk::DeviceSize size);
 
 
-		Image CreateImage(vk::ImageCreateInfo create_info, VmaMemoryUsage vma_usage);
+		/**
+		 * If create_info.usage contains vk::ImageUsageFlagBits::eTransientAttachment, vma_usage is VMA_MEMORY_USAGE_GPU_ONLY
+		 * and the device has lazily allocated memory, the image is placed in lazily allocated memory instead.
+		 */
+		Image CreateImage(vk::ImageCreateInfo create_info, VmaMemoryUsage vma_usage, MemoryCategory category = MemoryCategory::Other);
 		void DestroyImage(const Image &image);
 
+		/**
+		 * Allocate memory without binding it to a resource, e.g. to bind multiple aliasing images to it with
+		 * vmaBindImageMemory().
+		 */
+		VmaAllocation AllocateMemory(const vk::MemoryRequirements &requirements, VmaMemoryUsage vma_usage,
+				MemoryCategory category = MemoryCategory::Other);
+		void FreeMemory(VmaAllocation allocation);
+
+		/**
+		 * Destroys the image, image view and sampler of texture, unless the sampler was created through GetSampler().
+		 */
 		void DestroyTexture(const Texture &texture);
 
-		Image Create2DImage(uint32_t width, uint32_t height, vk::Format format, vk::ImageTiling tiling, vk::ImageUsageFlags usage, VmaMemoryUsage vma_usage, vk::SharingMode sharing_mode = vk::SharingMode::eExclusive);
+		/**
+		 * @param create_info must not have a pNext chain
+		 * @return a sampler for create_info, shared with everyone requesting an equal one.
+		 * 			It is owned by the Engine and must not be destroyed by the caller.
+		 */
+		vk::Sampler GetSampler(const vk::SamplerCreateInfo &create_info);
+
+		/**
+		 * @param key identifies the content of the texture, e.g. a hash of its pixel data together with its size and format
+		 * @param holder identifies the reference, e.g. the AssetContainer using the texture
+		 * @param create creates the texture, only called if there is no texture for key yet
+		 * @return the texture for key without sampler, shared with everyone acquiring the same key.
+		 * 			It must be released with ReleaseSharedTexture() instead of being destroyed.
+		 */
+		Texture AcquireSharedTexture(const SharedTextureKey &key, const void *holder, const std::function<Texture()> &create);
+
+		/**
+		 * Drop the reference of holder acquired through AcquireSharedTexture(). The last one destroys the texture
+		 * after all submitted frames have finished.
+		 */
+		void ReleaseSharedTexture(const SharedTextureKey &key, const void *holder);
+
+		/**
+		 * @return the holder that accounts for the memory of the shared texture for key, i.e. the earliest one
+		 * 			that has not released it yet, or nullptr if there is no texture for key
+		 */
+		const void *GetSharedTextureOwner(const SharedTextureKey &key) const;
+
+		Image Create2DImage(uint32_t width, uint32_t height, vk::Format format, vk::ImageTiling tiling, vk::ImageUsageFlags usage, VmaMemoryUsage vma_usage,
+				MemoryCategory category = MemoryCategory::Other, vk::SharingMode sharing_mode = vk::SharingMode::eExclusive);
 
 		void TransitionImageLayout(vk::Image image, vk::Format format, vk::ImageLayout old_layout, vk::ImageLayout new_layout, vk::ImageAspectFlags aspect_mask = vk::ImageAspectFlagBits::eColor);
 
+		bool GetLazilyAllocatedMemoryAvailable() const 			{ return lazily_allocated_memory_available; }
+
+		/**
+		 * @return the total size of all transient attachments currently placed in lazily allocated memory,
+		 * 			i.e. the amount of memory that would have been committed up front otherwise
+		 */
+		vk::DeviceSize GetLazilyAllocatedMemorySize() const 		{ return lazily_allocated_size; }
+
+		/**
+		 * @return the total size of all live allocations of category
+		 */
+		vk::DeviceSize GetMemoryUsage(MemoryCategory category) const	{ return category_usage[static_cast<std::size_t>(category)]; }
+
+		/**
+		 * @return the size of an allocation created by CreateBuffer() or CreateImage(), 0 if unknown
+		 */
+		vk::DeviceSize GetAllocationSize(VmaAllocation allocation) const;
+
+		/**
+		 * @return usage and budget of every memory heap, from VK_EXT_memory_budget if enabled
+		 */
+		std::vector<HeapBudget> GetMemoryBudgets();
+
+		/**
+		 * Set a function to be called when an allocation brings a heap above
+		 * CreateInfo::memory_budget_warning_fraction of its budget.
+		 */
+		void SetMemoryBudgetCallback(MemoryBudgetCallback callback)	{ memory_budget_callback = std::move(callback); }
+
+		static const char *GetMemoryCategoryName(MemoryCategory category);
+
+		/**
+		 * Log the usage of all categories and heaps.
+		 */
+		void LogMemoryUsage();
+
 		void CopyBufferTo2DImage(vk::Buffer src_buffer, vk::Image dst_image, uint32_t width, uint32_t height, vk::ImageAspectFlags aspect_mask = vk::ImageAspectFlagBits::eColor);
 };
 
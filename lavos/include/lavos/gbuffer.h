@@ -0,0 +1,95 @@
+
+#ifndef LAVOS_GBUFFER_H
+#define LAVOS_GBUFFER_H
+
+#include "image.h"
+
+#include <vulkan/vulkan.hpp>
+
+namespace lavos
+{
+
+class Engine;
+
+/**
+ * Attachments and lighting pipeline of the deferred path of Renderer.
+ *
+ * The G-buffer is written by the materials in Material::DefaultRenderMode::GBuffer
+ * and read as input attachments by a fullscreen lighting pass in the following subpass.
+ * It never leaves the render pass, so its images are transient.
+ */
+class GBuffer
+{
+	private:
+		Engine * const engine;
+
+		vk::Extent2D extent;
+
+		Image albedo_image;
+		vk::ImageView albedo_image_view;
+
+		Image normal_image;
+		vk::ImageView normal_image_view;
+
+		vk::DescriptorSetLayout descriptor_set_layout;
+		vk::DescriptorPool descriptor_pool;
+		vk::DescriptorSet descriptor_set;
+
+		vk::ShaderModule vert_shader_module;
+		vk::ShaderModule frag_shader_module;
+
+		vk::PipelineLayout pipeline_layout;
+		vk::Pipeline pipeline;
+
+		Image CreateAttachment(vk::Format format, vk::ImageView *image_view, const char *name);
+
+		void CreateImages();
+		void CleanupImages();
+		void CreateDescriptorSetLayout();
+		void CreateDescriptorPool();
+		void CreateDescriptorSet();
+
+	public:
+		/**
+		 * rgb: base color, a: encoded specular exponent
+		 */
+		static const vk::Format albedo_format = vk::Format::eR8G8B8A8Unorm;
+
+		/**
+		 * octahedral encoded world space normal
+		 */
+		static const vk::Format normal_format = vk::Format::eR16G16Sfloat;
+
+		GBuffer(Engine *engine, vk::Extent2D extent);
+		~GBuffer();
+
+		/**
+		 * Recreate the images for a new extent.
+		 * WriteDescriptorSet() must be called again afterwards.
+		 */
+		void SetExtent(vk::Extent2D extent);
+
+		vk::ImageView GetAlbedoImageView() const 	{ return albedo_image_view; }
+		vk::ImageView GetNormalImageView() const 	{ return normal_image_view; }
+
+		/**
+		 * Write the input attachment descriptors.
+		 * @param depth_image_view depth attachment of the render pass, must have been created with eInputAttachment usage
+		 */
+		void WriteDescriptorSet(vk::ImageView depth_image_view);
+
+		void CreatePipeline(vk::RenderPass render_pass, std::uint32_t subpass, vk::DescriptorSetLayout renderer_descriptor_set_layout);
+
+		/**
+		 * Record the fullscreen lighting pass, must be called inside the subpass given to CreatePipeline().
+		 */
+		/**
+		 * @param renderer_dynamic_offsets dynamic offsets of renderer_descriptor_set
+		 */
+		void RecordLighting(vk::CommandBuffer command_buffer, vk::DescriptorSet renderer_descriptor_set,
+				vk::ArrayProxy<const std::uint32_t> renderer_dynamic_offsets);
+};
+
+}
+
+#endif //LAVOS_GBUFFER_H
@@ -0,0 +1,161 @@
+
+#ifndef LAVOS_GEOMETRY_ARENA_H
+#define LAVOS_GEOMETRY_ARENA_H
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+namespace lavos
+{
+
+class Engine;
+class Buffer;
+
+/**
+ * Shared vertex and index storage for all Meshes and PointClouds, owned by the Engine.
+ *
+ * Geometry is suballocated from a few pools, each consisting of one large device local buffer per stream
+ * and a free list of element ranges. The buffers of a pool are only created by its first allocation. Renderables of the same pool bind the same buffers and select their
+ * data through the offsets of their draws, so consecutive draws don't need to rebind them.
+ *
+ * Freed ranges are coalesced with their neighbours. Once the free space of a pool is scattered,
+ * RecordDefragmentation() compacts all live allocations into new buffers with GPU copies and updates
+ * their offsets in place.
+ */
+class GeometryArena
+{
+	public:
+		using PoolId = std::uint32_t;
+
+		/**
+		 * Range of elements in a pool. Owned by the arena and moved by defragmentation,
+		 * so offset must be read again whenever a draw is recorded.
+		 */
+		struct Allocation
+		{
+			PoolId pool;
+			std::uint32_t offset;
+			std::uint32_t count;
+		};
+
+		/**
+		 * Vertex, with the position only of the same vertex at the same offset in stream 1 for depth-only passes.
+		 */
+		static const PoolId pool_mesh_vertices = 0;
+
+		/**
+		 * 16 bit indices, relative to the vertex allocation of their Mesh.
+		 */
+		static const PoolId pool_mesh_indices = 1;
+
+	private:
+		struct Pool
+		{
+			std::vector<vk::DeviceSize> strides;
+			vk::BufferUsageFlags usage;
+
+			/**
+			 * Capacity of the buffers created by the first allocation
+			 */
+			std::uint32_t initial_capacity;
+
+			/**
+			 * 0 until the first allocation
+			 */
+			std::uint32_t capacity;
+
+			/**
+			 * One buffer per stream, empty until the first allocation
+			 */
+			std::vector<lavos::Buffer *> buffers;
+
+			/**
+			 * Free ranges by their offset, never adjacent to each other
+			 */
+			std::map<std::uint32_t, std::uint32_t> free_ranges;
+
+			std::set<Allocation *> allocations;
+		};
+
+		Engine * const engine;
+
+		std::vector<Pool> pools;
+
+		float defragmentation_threshold = 0.5f;
+
+		PoolId CreatePool(std::vector<vk::DeviceSize> strides, vk::BufferUsageFlags usage, std::uint32_t initial_capacity);
+		std::vector<lavos::Buffer *> CreatePoolBuffers(const Pool &pool, std::uint32_t capacity);
+
+		/**
+		 * Grow pool to at least capacity elements. If it already has buffers, their content is copied
+		 * and the copy is waited for.
+		 */
+		void Grow(Pool &pool, std::uint32_t capacity);
+
+		void Defragment(vk::CommandBuffer command_buffer, Pool &pool);
+
+	public:
+		/**
+		 * The capacities are the initial number of elements of the mesh pools, no memory is allocated before
+		 * the first Allocate() of each pool.
+		 */
+		GeometryArena(Engine *engine, std::uint32_t mesh_vertices_capacity = 1u << 18, std::uint32_t mesh_indices_capacity = 1u << 20);
+		~GeometryArena();
+
+		/**
+		 * @return a pool with a single stream of vertices with the given stride, created on first use
+		 */
+		PoolId GetVertexPool(vk::DeviceSize stride);
+
+		/**
+		 * Allocate count elements, growing the pool if necessary.
+		 */
+		Allocation *Allocate(PoolId pool, std::uint32_t count);
+		void Free(Allocation *allocation);
+
+		/**
+		 * Copy allocation->count elements of data to stream of the allocation through a staging buffer.
+		 * The copy is submitted immediately, but not waited for.
+		 */
+		void Upload(const Allocation *allocation, std::uint32_t stream, const void *data);
+
+		/**
+		 * @return a null handle if nothing was allocated from pool yet
+		 */
+		vk::Buffer GetVkBuffer(PoolId pool, std::uint32_t stream = 0) const;
+
+		/**
+		 * @return the size of the device memory reserved by pool
+		 */
+		vk::DeviceSize GetPoolSize(PoolId pool) const;
+
+		/**
+		 * @return the size in bytes of allocation in all of its streams
+		 */
+		vk::DeviceSize GetAllocationSize(const Allocation *allocation) const;
+
+		/**
+		 * @return 0 if all free elements of pool form a single range, approaching 1 the more they are scattered
+		 */
+		float GetFragmentation(PoolId pool) const;
+
+		/**
+		 * Pools whose fragmentation exceeds threshold are compacted by RecordDefragmentation().
+		 */
+		void SetDefragmentationThreshold(float threshold)		{ defragmentation_threshold = threshold; }
+
+		/**
+		 * Record the compaction of at most one fragmented pool to command_buffer, outside of any render pass and
+		 * before any draws using the arena. Called once per frame. The replaced buffers are released once
+		 * command_buffer has finished.
+		 */
+		void RecordDefragmentation(vk::CommandBuffer command_buffer);
+};
+
+}
+
+#endif //LAVOS_GEOMETRY_ARENA_H
@@ -3,22 +3,47 @@
 #define LAVOS_LIGHT_COLLECTION_H
 
 #include <vector>
+#include <cstdint>
 
 namespace lavos
 {
 
+class Component;
 class DirectionalLight;
 class SpotLight;
+class PointLight;
 class Scene;
 
 /**
  * Accumulates all the lights used for rendering,
  * could also be local to a cluster for example.
+ *
+ * Each Scene maintains one with all of its lights, which is updated
+ * whenever light components are added to or removed from its nodes.
  */
 struct LightCollection
 {
-	DirectionalLight *dir_light;
+	DirectionalLight *dir_light = nullptr;
 	std::vector<SpotLight *> spot_lights;
+	std::vector<PointLight *> point_lights;
+
+	/**
+	 * Incremented whenever lights are added or removed or their shadows change,
+	 * so data depending only on these, like shadow descriptors, can be kept otherwise.
+	 */
+	std::uint64_t version = 0;
+
+	/**
+	 * Adds component if it is a light, does nothing otherwise.
+	 */
+	void AddLight(Component *component);
+
+	/**
+	 * Removes component if it is a light in the collection, does nothing otherwise.
+	 */
+	void RemoveLight(Component *component);
+
+	void MarkChanged()		{ version++; }
 
 	static LightCollection EverythingInScene(Scene *scene);
 };
@@ -0,0 +1,147 @@
+
+#ifndef LAVOS_LIGHT_GRID_H
+#define LAVOS_LIGHT_GRID_H
+
+#include <cstdint>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include "glm_config.h"
+#include <glm/ext/vector_float2.hpp>
+#include <glm/ext/vector_float3.hpp>
+#include <glm/ext/vector_uint3.hpp>
+#include <glm/ext/matrix_float4x4.hpp>
+
+namespace lavos
+{
+
+class Engine;
+class Buffer;
+class Camera;
+
+struct LightingStorageBufferSpotLight
+{
+	glm::vec3 position;
+	float angle_cos;
+	glm::vec3 direction;
+	float range;
+	std::uint32_t shadow_mode;
+	std::uint8_t unused[12];
+	glm::mat4 shadow_mvp_matrix;
+};
+
+static_assert(sizeof(LightingStorageBufferSpotLight) == 112, "LightingStorageBufferSpotLight memory layout");
+
+/**
+ * Clustered light assignment for forward shading.
+ *
+ * The view frustum is divided into screen-space tiles and exponentially distributed depth slices.
+ * Every frame, each light is assigned to the clusters its range intersects on the CPU, so fragment shaders
+ * only evaluate the lights of their own cluster instead of all lights in the scene.
+ *
+ * Both the lights and the cluster lists live in storage buffers that grow as needed, with a copy for every
+ * frame in flight so an update never overwrites data a previous frame is still reading.
+ * The cluster buffer starts with an (offset, count) pair per cluster, followed by the light indices.
+ */
+class LightGrid
+{
+	private:
+		Engine * const engine;
+
+		const glm::uvec3 cluster_count;
+
+		struct FrameBuffers
+		{
+			lavos::Buffer *light_buffer = nullptr;
+			std::size_t light_capacity = 0;
+
+			lavos::Buffer *cluster_buffer = nullptr;
+			std::size_t cluster_buffer_capacity = 0; // in uints
+		};
+
+		/**
+		 * Indexed by the frame_index passed to Update()
+		 */
+		std::vector<FrameBuffers> frames;
+
+		glm::vec2 tile_size = glm::vec2(1.0f);
+		float z_scale = 0.0f;
+		float z_bias = 0.0f;
+
+		/**
+		 * Set by UpdateSingleCluster(), all lights are in cluster 0 then
+		 */
+		bool single_cluster = false;
+
+		std::vector<std::uint32_t> cluster_data;
+		std::vector<std::pair<std::uint32_t, std::uint32_t>> assignments;
+		std::vector<glm::vec3> cluster_bounds_min;
+		std::vector<glm::vec3> cluster_bounds_max;
+
+		std::size_t GetClusterCountTotal() const	{ return cluster_count.x * cluster_count.y * cluster_count.z; }
+
+		void CalculateClusterBounds(const glm::mat4 &projection, vk::Extent2D extent, float near_clip, float far_clip);
+		void AssignLights(const std::vector<LightingStorageBufferSpotLight> &spot_lights, std::size_t first_clustered,
+				const glm::mat4 &modelview, float near_clip, float far_clip);
+
+		/**
+		 * @return true if a buffer had to be recreated
+		 */
+		bool EnsureCapacity(FrameBuffers &frame, std::size_t lights, std::size_t cluster_uints);
+
+		/**
+		 * Write spot_lights and cluster_data into the buffers of frame_index, shared by both kinds of updates.
+		 * @return true if a buffer had to be recreated
+		 */
+		bool Upload(std::uint32_t frame_index, const std::vector<LightingStorageBufferSpotLight> &spot_lights);
+
+	public:
+		/**
+		 * @param frames_count number of frames in flight, each with its own buffers
+		 * @param cluster_count number of tiles in x and y and number of depth slices
+		 */
+		LightGrid(Engine *engine, std::uint32_t frames_count, glm::uvec3 cluster_count = glm::uvec3(16, 9, 24));
+		~LightGrid();
+
+		/**
+		 * Upload spot_lights and rebuild the light lists of all clusters for the current view of camera.
+		 *
+		 * @param frame_index selects the buffers to write, which must not be used by a pending submission anymore
+		 * @param first_clustered lights before this index are uploaded, but not assigned to any cluster
+		 * @return true if the buffers of frame_index were recreated and descriptors referencing them must be rewritten
+		 */
+		bool Update(std::uint32_t frame_index, const std::vector<LightingStorageBufferSpotLight> &spot_lights,
+				std::size_t first_clustered, Camera *camera, vk::Extent2D extent);
+
+		/**
+		 * Like Update(), but assign all lights to a single cluster independent of any view,
+		 * e.g. for multiple views sharing the same buffers. Writes the buffers of frame_index just like Update().
+		 */
+		bool UpdateSingleCluster(std::uint32_t frame_index, const std::vector<LightingStorageBufferSpotLight> &spot_lights,
+				std::size_t first_clustered);
+
+		/**
+		 * @return the cluster count of the last update, (1, 1, 1) after UpdateSingleCluster()
+		 */
+		glm::uvec3 GetClusterCount() const				{ return single_cluster ? glm::uvec3(1) : cluster_count; }
+		glm::vec2 GetTileSize() const					{ return tile_size; }
+
+		/**
+		 * The depth slice of a fragment is floor(log(depth) * z_scale + z_bias).
+		 */
+		float GetZScale() const							{ return z_scale; }
+		float GetZBias() const							{ return z_bias; }
+
+		vk::Buffer GetLightBuffer(std::uint32_t frame_index) const;
+		vk::DeviceSize GetLightBufferSize(std::uint32_t frame_index) const
+				{ return frames[frame_index].light_capacity * sizeof(LightingStorageBufferSpotLight); }
+
+		vk::Buffer GetClusterBuffer(std::uint32_t frame_index) const;
+		vk::DeviceSize GetClusterBufferSize(std::uint32_t frame_index) const
+				{ return frames[frame_index].cluster_buffer_capacity * sizeof(std::uint32_t); }
+};
+
+}
+
+#endif //LAVOS_LIGHT_GRID_H
@@ -4,10 +4,12 @@
 
 #include <vulkan/vulkan.hpp>
 
+#include <cstdint>
 #include <map>
 
 #include "../texture.h"
 #include "../buffer.h"
+#include "material_parameter_arena.h"
 
 namespace lavos
 {
@@ -39,12 +41,37 @@ class Material
 		enum DefaultRenderMode : RenderMode {
 			ColorForward = 0,
 			Shadow,
+			ShadowMultiview,
+			DepthPrepass,
+			GBuffer,
 			User0
 		};
 
 		using DescriptorSetId = int;
 		using InstanceDataId = int;
 
+		/**
+		 * Feature bits selecting a specialized variant of the pipeline of a Material, see GetVariantKey().
+		 * Variant 0 is always valid.
+		 */
+		using VariantKey = std::uint32_t;
+
+		/**
+		 * Bits describing the lights in the scene, so lighting code of unused features can be specialized away.
+		 */
+		enum LightingFeature : std::uint32_t {
+			LightingFeatureDirectionalLight = 1u << 0,
+			LightingFeatureSpotLightShadowDepth = 1u << 1,
+			LightingFeatureSpotLightShadowMSM = 1u << 2,
+			LightingFeatureClusteredSpotLights = 1u << 3,
+
+			// bucket of the number of point lights in two bits, see GetLightingFeaturesPointLights()
+			LightingFeaturePointLightsShift = 4,
+			LightingFeaturePointLightsMask = 3u << LightingFeaturePointLightsShift,
+
+			LightingFeaturesAll = (1u << 6) - 1
+		};
+
 		using TextureSlot = unsigned int;
 		using ParameterSlot = unsigned int;
 
@@ -53,6 +80,11 @@ class Material
 
 		static const ParameterSlot parameter_slot_base_color_factor = 0;
 
+		/**
+		 * Enables alpha masking with the given cutoff if set.
+		 */
+		static const ParameterSlot parameter_slot_alpha_cutoff = 1;
+
 		struct DescriptorSetLayout
 		{
 			vk::DescriptorSetLayout layout;
@@ -67,12 +99,25 @@ class Material
 
 		void CreateDescriptorSetLayout(DescriptorSetId id, const std::vector<vk::DescriptorSetLayoutBinding> &bindings);
 
+		/**
+		 * Append the values of the lighting specialization constants, SPECIALIZATION_CONSTANT_LIGHTING_*
+		 * in common_glsl_cpp.h, which must be the first constant ids of the shaders.
+		 */
+		static void AppendLightingSpecializationConstants(std::uint32_t lighting_features, std::vector<std::uint32_t> &constants);
+
+		/**
+		 * Uniform parameters of one instance, suballocated from the Engine's MaterialParameterArena.
+		 */
 		struct UBOInstanceData
 		{
-			lavos::Buffer *uniform_buffer;
+			MaterialParameterArena * const arena;
+			const MaterialParameterArena::Allocation allocation;
 
-			UBOInstanceData(lavos::Buffer *uniform_buffer);
+			UBOInstanceData(MaterialParameterArena *arena, vk::DeviceSize size);
 			~UBOInstanceData();
+
+			void Write(const void *data, vk::DeviceSize size)			{ arena->Write(allocation, data, size); }
+			vk::DescriptorBufferInfo GetDescriptorBufferInfo() const	{ return arena->GetDescriptorBufferInfo(allocation); }
 		};
 
 	public:
@@ -87,9 +132,43 @@ class Material
 
 		virtual std::vector<vk::PipelineShaderStageCreateInfo> GetShaderStageCreateInfos(RenderMode render_mode) const =0;
 
+		/**
+		 * @param lighting_features LightingFeature bits of the scene that is rendered
+		 * @return the variant that instance should be rendered with in render_mode
+		 */
+		virtual VariantKey GetVariantKey(RenderMode render_mode, MaterialInstance *instance, std::uint32_t lighting_features) const	{ return 0; }
+
+		/**
+		 * Values of the specialization constants for all shader stages of a variant,
+		 * the constant with constant_id i is set to the i-th value.
+		 */
+		virtual std::vector<std::uint32_t> GetSpecializationConstants(RenderMode render_mode, VariantKey variant) const				{ return {}; }
+
+		/**
+		 * @param variant key of DefaultRenderMode::DepthPrepass or of a mode rendered after it
+		 * @return false if primitives of variant are left out of the depth prepass, e.g. because they discard fragments
+		 */
+		virtual bool GetVariantDepthPrepassSupport(VariantKey variant) const												{ return true; }
+
+		/**
+		 * @return the LightingFeature bits for point_lights_count point lights
+		 */
+		static std::uint32_t GetLightingFeaturesPointLights(std::size_t point_lights_count);
+
 		virtual DescriptorSetId GetDescriptorSetId(RenderMode render_mode) const 					{ return render_mode; };
 		virtual void WriteDescriptorSet(DescriptorSetId id, vk::DescriptorSet descriptor_set, MaterialInstance *instance) =0;
 
+		/**
+		 * @return true if instances are rendered in render_mode through the MaterialTable of the Engine
+		 * 			instead of descriptor sets of their own, see GetMaterialTableIndex()
+		 */
+		virtual bool GetMaterialTableUsage(RenderMode render_mode) const							{ return false; }
+
+		/**
+		 * @return the parameter block of instance in the MaterialTable, passed to shaders as TransformPushConstant::material_index
+		 */
+		virtual std::uint32_t GetMaterialTableIndex(RenderMode render_mode, MaterialInstance *instance) const	{ return 0; }
+
 		virtual InstanceDataId GetInstanceDataId(RenderMode render_mode)							{ return render_mode; }
 		virtual void *CreateInstanceData(InstanceDataId id)											{ return nullptr; }
 		virtual void DestroyInstanceData(InstanceDataId id, void *data)								{}
@@ -4,6 +4,7 @@
 
 #include <map>
 #include <unordered_map>
+#include <vector>
 
 #include "../texture.h"
 #include "../buffer.h"
@@ -50,6 +51,13 @@ class MaterialInstance
 		std::map<Material::DescriptorSetId, vk::DescriptorSet> descriptor_sets;
 		std::map<Material::InstanceDataId, void *> instance_data;
 
+		/**
+		 * Sets replaced by RenewDescriptorSets(), with the submission value after which they are not used anymore
+		 */
+		std::vector<std::pair<std::uint64_t, vk::DescriptorSet>> retired_descriptor_sets;
+
+		void FreeRetiredDescriptorSets(std::uint64_t completed_value);
+
 		void CreateDescriptorSet(Material::DescriptorSetId id);
 		void CreateInstanceData(Material::InstanceDataId id);
 
@@ -64,12 +72,25 @@ class MaterialInstance
 
 		void WriteAllData();
 
-		vk::DescriptorSet GetDescriptorSet(Material::RenderMode render_mode) const	{ auto it = descriptor_sets.find(render_mode); return it == descriptor_sets.end() ? vk::DescriptorSet() : it->second; }
-		void *GetInstanceData(Material::RenderMode render_mode) const				{ auto it = instance_data.find(render_mode); return it == instance_data.end() ? nullptr : it->second; }
+		/**
+		 * Like WriteAllData(), but write the descriptors to newly allocated sets instead of the current ones,
+		 * which may still be used by submitted frames and are freed once those have finished.
+		 * The descriptor pool needs room for the additional sets, otherwise this waits for the oldest replaced ones.
+		 */
+		void RenewDescriptorSets();
+
+		vk::DescriptorSet GetDescriptorSet(Material::DescriptorSetId id) const		{ auto it = descriptor_sets.find(id); return it == descriptor_sets.end() ? vk::DescriptorSet() : it->second; }
+		void *GetInstanceData(Material::InstanceDataId id) const					{ auto it = instance_data.find(id); return it == instance_data.end() ? nullptr : it->second; }
 
+		/**
+		 * The texture stays owned by the caller and must outlive the MaterialInstance.
+		 */
 		void SetTexture(Material::TextureSlot slot, Texture texture);
 		Texture *GetTexture(Material::TextureSlot slot);
 
+		/**
+		 * Set the parameter and update the instance data immediately, no WriteAllData() is necessary.
+		 */
 		void SetParameter(Material::ParameterSlot slot, Parameter parameter);
 		Parameter *GetParameter(Material::ParameterSlot slot);
 		float GetParameter(Material::ParameterSlot slot, float default_value);
@@ -0,0 +1,110 @@
+
+#ifndef LAVOS_MATERIAL_PARAMETER_ARENA_H
+#define LAVOS_MATERIAL_PARAMETER_ARENA_H
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+namespace lavos
+{
+
+class Engine;
+class Buffer;
+
+/**
+ * Shared storage for the uniform parameters of all MaterialInstances, owned by the Engine.
+ *
+ * Parameters are suballocated from a few large device local pages instead of one buffer per instance.
+ * Writes only go to a host copy of the page and mark the written range as dirty,
+ * the dirty ranges are then uploaded once per frame by RecordUpload().
+ * Writes to other buffers read by materials, like the MaterialTable, can be staged the same way with WriteBuffer().
+ */
+class MaterialParameterArena
+{
+	public:
+		struct Allocation
+		{
+			std::uint32_t page;
+			vk::DeviceSize offset;
+			vk::DeviceSize size;
+		};
+
+	private:
+		struct Page
+		{
+			lavos::Buffer *buffer;
+			std::vector<std::uint8_t> data;
+			vk::DeviceSize used;
+
+			/**
+			 * Range [dirty_begin, dirty_end) that has not been uploaded yet, empty if dirty_begin >= dirty_end
+			 */
+			vk::DeviceSize dirty_begin;
+			vk::DeviceSize dirty_end;
+		};
+
+		struct BufferWrite
+		{
+			vk::Buffer buffer;
+			vk::DeviceSize offset;
+			std::vector<std::uint8_t> data;
+		};
+
+		Engine * const engine;
+
+		const vk::DeviceSize page_size;
+		vk::DeviceSize alignment;
+
+		std::vector<Page> pages;
+
+		/**
+		 * Freed allocations by their aligned size
+		 */
+		std::map<vk::DeviceSize, std::vector<Allocation>> free_allocations;
+
+		/**
+		 * Staged by WriteBuffer(), in the order they were made
+		 */
+		std::vector<BufferWrite> buffer_writes;
+
+		bool dirty = false;
+
+		vk::DeviceSize GetAlignedSize(vk::DeviceSize size) const	{ return (size + alignment - 1) / alignment * alignment; }
+
+		void AddPage();
+
+	public:
+		MaterialParameterArena(Engine *engine, vk::DeviceSize page_size = 65536);
+		~MaterialParameterArena();
+
+		Allocation Allocate(vk::DeviceSize size);
+		void Free(const Allocation &allocation);
+
+		/**
+		 * @param size at most allocation.size
+		 */
+		void Write(const Allocation &allocation, const void *data, vk::DeviceSize size);
+
+		/**
+		 * Stage a write to buffer that is uploaded by the next RecordUpload() together with the parameters,
+		 * so frames still reading the buffer are not affected.
+		 * @param buffer created with eTransferDst, must stay alive until the upload was recorded
+		 * @param offset multiple of 4
+		 */
+		void WriteBuffer(vk::Buffer buffer, vk::DeviceSize offset, const void *data, vk::DeviceSize size);
+
+		vk::DescriptorBufferInfo GetDescriptorBufferInfo(const Allocation &allocation) const;
+
+		/**
+		 * Record the upload of all dirty ranges and staged buffer writes to command_buffer, outside of any render pass.
+		 * Includes the barriers against previous uniform and storage reads and for following ones.
+		 */
+		void RecordUpload(vk::CommandBuffer command_buffer);
+};
+
+}
+
+#endif //LAVOS_MATERIAL_PARAMETER_ARENA_H
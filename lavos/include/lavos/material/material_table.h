@@ -0,0 +1,100 @@
+
+#ifndef LAVOS_MATERIAL_TABLE_H
+#define LAVOS_MATERIAL_TABLE_H
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include "../texture.h"
+
+namespace lavos
+{
+
+class Engine;
+class Buffer;
+
+/**
+ * Global table of material textures and parameters for bindless rendering, requires VK_EXT_descriptor_indexing.
+ * Owned by the Engine if Engine::CreateInfo::enable_descriptor_indexing is set.
+ *
+ * All textures are part of one runtime sized array and all parameters live in fixed size blocks
+ * of one storage buffer, both in a single descriptor set that is bound once for all materials using it.
+ * Shaders select their block through TransformPushConstant::material_index and their textures
+ * through indices stored in the block.
+ */
+class MaterialTable
+{
+	public:
+		using TextureIndex = std::uint32_t;
+		using BlockIndex = std::uint32_t;
+
+		/**
+		 * Size in bytes of one parameter block, MATERIAL_TABLE_BLOCK_SIZE in common_glsl_cpp.h.
+		 */
+		static const std::size_t block_size;
+
+	private:
+		Engine * const engine;
+
+		const std::uint32_t texture_capacity;
+		const std::uint32_t block_capacity;
+
+		vk::DescriptorSetLayout descriptor_set_layout;
+		vk::DescriptorPool descriptor_pool;
+		vk::DescriptorSet descriptor_set;
+
+		lavos::Buffer *parameter_buffer;
+
+		struct TextureEntry
+		{
+			vk::ImageView image_view;
+			vk::Sampler sampler;
+			unsigned int references;
+		};
+
+		std::vector<TextureEntry> textures;
+		std::vector<TextureIndex> free_textures;
+		std::map<std::pair<VkImageView, VkSampler>, TextureIndex> texture_indices;
+
+		std::vector<BlockIndex> free_blocks;
+		BlockIndex blocks_count = 0;
+
+		void CreateDescriptorSetLayout();
+		void CreateDescriptorPool();
+		void CreateDescriptorSet();
+		void CreateParameterBuffer();
+
+	public:
+		MaterialTable(Engine *engine, std::uint32_t texture_capacity, std::uint32_t block_capacity);
+		~MaterialTable();
+
+		/**
+		 * Add a reference to texture, adding it to the table if it is not part of it yet.
+		 * The texture itself stays owned by the caller and must outlive the reference.
+		 */
+		TextureIndex AddTexture(const Texture &texture);
+
+		/**
+		 * Remove a reference to the texture. Its slot is reused only after all submissions made so far have finished.
+		 */
+		void RemoveTexture(TextureIndex index);
+
+		BlockIndex AllocateBlock();
+		void FreeBlock(BlockIndex index);
+
+		/**
+		 * Stage a write to the block, uploaded by MaterialParameterArena::RecordUpload() at the start of the next frame.
+		 * @param size at most block_size
+		 */
+		void WriteBlock(BlockIndex index, const void *data, std::size_t size);
+
+		vk::DescriptorSetLayout GetDescriptorSetLayout() const		{ return descriptor_set_layout; }
+		vk::DescriptorSet GetDescriptorSet() const					{ return descriptor_set; }
+};
+
+}
+
+#endif //LAVOS_MATERIAL_TABLE_H
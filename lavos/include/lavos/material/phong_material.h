@@ -3,6 +3,7 @@
 #define LAVOS_PHONG_MATERIAL_H
 
 #include "material.h"
+#include "material_table.h"
 
 namespace lavos
 {
@@ -14,8 +15,45 @@ class PhongMaterial: public Material
 		{
 			glm::vec4 color_factor;
 			float specular_exponent;
+			std::uint8_t unused[12];
+			float alpha_cutoff;
 		};
 
+		/**
+		 * Bits of the VariantKey, the LightingFeature bits follow at variant_lighting_features_shift.
+		 */
+		enum : Material::VariantKey {
+			VariantBaseColorTexture = 1u << 0,
+			VariantNormalTexture = 1u << 1,
+			VariantAlphaMask = 1u << 2
+		};
+
+		static const int variant_lighting_features_shift = 8;
+
+		/**
+		 * Layout of a parameter block in the MaterialTable, must match PhongMaterialTableBlock in phong_surface.glsl.
+		 */
+		struct MaterialTableBlock
+		{
+			glm::vec4 color_factor;
+			float specular_exponent;
+			float alpha_cutoff;
+			std::uint32_t base_color_texture;
+			std::uint32_t normal_texture;
+		};
+
+		struct MaterialTableInstanceData
+		{
+			MaterialTable::BlockIndex block;
+			MaterialTable::TextureIndex base_color_texture;
+			MaterialTable::TextureIndex normal_texture;
+		};
+
+		/**
+		 * nullptr if the Engine has no MaterialTable, instances use descriptor sets of their own then.
+		 */
+		MaterialTable * const material_table;
+
 		enum : Material::DescriptorSetId {
 			DescriptorSetLayoutIdDefault,
 			DescriptorSetLayoutIdShadow
@@ -23,13 +61,19 @@ class PhongMaterial: public Material
 
 		vk::ShaderModule vert_shader_module;
 		vk::ShaderModule frag_shader_module;
+		vk::ShaderModule gbuffer_frag_shader_module;
 
 		vk::ShaderModule shadow_vert_shader_module;
 		vk::ShaderModule shadow_frag_shader_module;
+		vk::ShaderModule shadow_multiview_vert_shader_module;
+		vk::ShaderModule depth_prepass_vert_shader_module;
 
 		Texture texture_default_base_color;
 		Texture texture_default_normal;
 
+		MaterialTable::TextureIndex texture_default_base_color_index;
+		MaterialTable::TextureIndex texture_default_normal_index;
+
 		void CreateDescriptorSetLayouts();
 
 	public:
@@ -41,11 +85,42 @@ class PhongMaterial: public Material
 		bool GetRenderModeSupport(RenderMode render_mode) const override
 		{
 			return render_mode == DefaultRenderMode::ColorForward
-					|| render_mode == DefaultRenderMode::Shadow;
+					|| render_mode == DefaultRenderMode::Shadow
+					|| (render_mode == DefaultRenderMode::ShadowMultiview && shadow_multiview_vert_shader_module)
+					|| render_mode == DefaultRenderMode::DepthPrepass
+					|| render_mode == DefaultRenderMode::GBuffer;
+		}
+
+		// multiview shadows and the depth prepass use the same (empty) resources as regular shadows,
+		// the G-buffer pass the same as forward
+		DescriptorSetId GetDescriptorSetId(RenderMode render_mode) const override
+		{
+			if(render_mode == DefaultRenderMode::ShadowMultiview || render_mode == DefaultRenderMode::DepthPrepass)
+				return DefaultRenderMode::Shadow;
+			if(render_mode == DefaultRenderMode::GBuffer)
+				return DefaultRenderMode::ColorForward;
+			return render_mode;
+		}
+
+		bool GetMaterialTableUsage(RenderMode render_mode) const override
+		{
+			return material_table
+					&& (render_mode == DefaultRenderMode::ColorForward || render_mode == DefaultRenderMode::GBuffer);
+		}
+
+		std::uint32_t GetMaterialTableIndex(RenderMode render_mode, MaterialInstance *instance) const override;
+
+		InstanceDataId GetInstanceDataId(RenderMode render_mode) override
+		{
+			return GetDescriptorSetId(render_mode);
 		}
 
 		virtual std::vector<vk::PipelineShaderStageCreateInfo> GetShaderStageCreateInfos(Material::RenderMode render_mode) const override;
 
+		VariantKey GetVariantKey(RenderMode render_mode, MaterialInstance *instance, std::uint32_t lighting_features) const override;
+		std::vector<std::uint32_t> GetSpecializationConstants(RenderMode render_mode, VariantKey variant) const override;
+		bool GetVariantDepthPrepassSupport(VariantKey variant) const override	{ return !(variant & VariantAlphaMask); }
+
 		virtual void WriteDescriptorSet(DescriptorSetId id, vk::DescriptorSet descriptor_set, MaterialInstance *instance) override;
 
 		virtual void *CreateInstanceData(InstanceDataId id) override;
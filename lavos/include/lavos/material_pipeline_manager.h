@@ -17,6 +17,7 @@ class Renderer;
 struct MaterialPipeline
 {
 	Material *material;
+	Material::VariantKey variant;
 
 	vk::PipelineLayout pipeline_layout;
 	vk::Pipeline pipeline;
@@ -24,8 +25,13 @@ struct MaterialPipeline
 	int renderer_descriptor_set_index;
 	int material_descriptor_set_index;
 
-	MaterialPipeline(Material *material) :
-			material(material) {}
+	/**
+	 * The set at material_descriptor_set_index is the one of the MaterialTable, not of the MaterialInstances.
+	 */
+	bool material_table = false;
+
+	MaterialPipeline(Material *material, Material::VariantKey variant) :
+			material(material), variant(variant) {}
 };
 
 struct MaterialPipelineConfiguration
@@ -36,26 +42,76 @@ struct MaterialPipelineConfiguration
 	vk::RenderPass render_pass;
 	Material::RenderMode render_mode;
 	vk_util::PipelineColorBlendStateCreateInfo color_blend_state_info;
+	std::vector<vk::DynamicState> dynamic_states;
+
+	/**
+	 * Only use the vertex stage of the material, e.g. for depth-only shadows.
+	 */
+	bool depth_only;
+
+	/**
+	 * Winding of front faces in framebuffer space, clockwise for mirrored projections such as cube map faces.
+	 */
+	vk::FrontFace front_face;
+
+	/**
+	 * Subpass of render_pass the pipelines are used in.
+	 */
+	std::uint32_t subpass = 0;
+
+	/**
+	 * Read vertices from a single stream of vec3 positions at binding 0, see Renderable::BindPositionBuffers().
+	 */
+	bool position_only = false;
+
+	/**
+	 * Depth has already been written by a depth prepass for all materials supporting
+	 * Material::DefaultRenderMode::DepthPrepass. Their pipelines test with eEqual and do not write depth.
+	 */
+	bool depth_prepass = false;
+
+	/**
+	 * Attachment formats and view mask for VK_KHR_dynamic_rendering, only used if render_pass is null.
+	 */
+	std::vector<vk::Format> color_formats;
+	vk::Format depth_format = vk::Format::eUndefined;
+	std::uint32_t view_mask = 0;
 
 	MaterialPipelineConfiguration(vk::Extent2D extent,
 			vk::SampleCountFlagBits samples,
 			vk::DescriptorSetLayout renderer_descriptor_set_layout,
 			vk::RenderPass render_pass,
 			Material::RenderMode render_mode,
-			const vk_util::PipelineColorBlendStateCreateInfo &color_blend_state_info)
+			const vk_util::PipelineColorBlendStateCreateInfo &color_blend_state_info,
+			const std::vector<vk::DynamicState> &dynamic_states = {},
+			bool depth_only = false,
+			vk::FrontFace front_face = vk::FrontFace::eCounterClockwise)
 			: extent(extent),
 			samples(samples),
 			renderer_descriptor_set_layout(renderer_descriptor_set_layout),
 			render_pass(render_pass),
 			render_mode(render_mode),
-			color_blend_state_info(color_blend_state_info) {}
+			color_blend_state_info(color_blend_state_info),
+			dynamic_states(dynamic_states),
+			depth_only(depth_only),
+			front_face(front_face) {}
 };
 
 static inline bool operator==(const MaterialPipelineConfiguration &a, const MaterialPipelineConfiguration &b)
 {
 	return a.extent == b.extent
+		&& a.samples == b.samples
 		&& a.renderer_descriptor_set_layout == b.renderer_descriptor_set_layout
-		&& a.render_pass == b.render_pass;
+		&& a.render_pass == b.render_pass
+		&& a.dynamic_states == b.dynamic_states
+		&& a.depth_only == b.depth_only
+		&& a.front_face == b.front_face
+		&& a.subpass == b.subpass
+		&& a.position_only == b.position_only
+		&& a.depth_prepass == b.depth_prepass
+		&& a.color_formats == b.color_formats
+		&& a.depth_format == b.depth_format
+		&& a.view_mask == b.view_mask;
 }
 
 class MaterialPipelineManager
@@ -65,13 +121,20 @@ class MaterialPipelineManager
 
 		MaterialPipelineConfiguration config;
 
+		/**
+		 * Materials supporting config.render_mode.
+		 */
+		std::vector<Material *> materials;
+
+		/**
+		 * Pipelines of all variants of materials that have been requested so far.
+		 */
 		std::vector<MaterialPipeline> material_pipelines;
 
-		MaterialPipeline CreateMaterialPipeline(Material *material, Material::RenderMode render_mode);
+		MaterialPipeline CreateMaterialPipeline(Material *material, Material::RenderMode render_mode, Material::VariantKey variant);
 		void DestroyMaterialPipeline(const MaterialPipeline &material_pipeline);
 
 		void DestroyAllMaterialPipelines();
-		void RecreateAllMaterialPipelines();
 
 	public:
 		MaterialPipelineManager(Engine *engine, const MaterialPipelineConfiguration &config);
@@ -81,8 +144,15 @@ class MaterialPipelineManager
 		void RemoveMaterial(Material *material);
 
 		void SetConfiguration(const MaterialPipelineConfiguration &config);
-
-		MaterialPipeline *GetMaterialPipeline(Material *material);
+		const MaterialPipelineConfiguration &GetConfiguration() const	{ return config; }
+
+		/**
+		 * Get the pipeline of a variant of material, creating it on first use.
+		 * The returned pointer is only valid until the next call.
+		 *
+		 * @return nullptr if material has not been added or does not support the render mode
+		 */
+		MaterialPipeline *GetMaterialPipeline(Material *material, Material::VariantKey variant = 0);
 };
 
 }
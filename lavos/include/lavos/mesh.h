@@ -7,7 +7,7 @@
 #include <memory>
 
 #include "vertex.h"
-#include "buffer.h"
+#include "geometry_arena.h"
 #include "renderable.h"
 #include "material/material_instance.h"
 
@@ -22,6 +22,7 @@ class Mesh
 	public:
 		struct Primitive: public Renderable::Primitive
 		{
+			Mesh *mesh;
 			MaterialInstance *material_instance;
 			uint32_t indices_count;
 			uint32_t indices_offset;
@@ -34,8 +35,22 @@ class Mesh
 		std::vector<uint16_t> indices;
 		std::vector<Primitive> primitives;
 
-		lavos::Buffer *vertex_buffer = nullptr;
-		lavos::Buffer *index_buffer = nullptr;
+		/**
+		 * Allocation in GeometryArena::pool_mesh_vertices, which also holds the positions of all vertices only
+		 * for depth-only passes.
+		 */
+		GeometryArena::Allocation *vertex_allocation = nullptr;
+
+		/**
+		 * Allocation in GeometryArena::pool_mesh_indices.
+		 */
+		GeometryArena::Allocation *index_allocation = nullptr;
+
+		/**
+		 * Axis-aligned bounding box of all vertices, updated by CalculateBounds().
+		 */
+		glm::vec3 bounds_min = glm::vec3(0.0f);
+		glm::vec3 bounds_max = glm::vec3(0.0f);
 
 		Mesh(Engine *engine);
 		~Mesh();
@@ -43,6 +58,11 @@ class Mesh
 		void CreateVertexBuffer();
 		void CreateIndexBuffer();
 		void CreateBuffers();
+		void CalculateBounds();
+
+		vk::Buffer GetVkVertexBuffer() const;
+		vk::Buffer GetVkPositionBuffer() const;
+		vk::Buffer GetVkIndexBuffer() const;
 };
 
 }
@@ -11,6 +11,7 @@ namespace lavos
 {
 
 class TransformComp;
+class Scene;
 
 class Node
 {
@@ -20,11 +21,18 @@ class Node
 		bool is_root = false;
 		Node *parent = nullptr;
 
+		/**
+		 * Scene this node is (indirectly) attached to, nullptr if detached.
+		 */
+		Scene *scene = nullptr;
+
 		std::vector<Component *> components;
 		std::vector<Node *> children;
 
 		TransformComp *transform_component = nullptr;
 
+		void SetScene(Scene *scene);
+
 	public:
 		Node();
 		~Node();
@@ -47,6 +55,7 @@ class Node
 		const std::vector<Node *> &GetChildren() const		{ return children; }
 
 		Node *GetParent() const 							{ return parent; }
+		Scene *GetScene() const 							{ return scene; }
 
 		void AddComponent(Component *component);
 		void RemoveComponent(Component *component);
@@ -0,0 +1,146 @@
+
+#ifndef LAVOS_OFFSCREEN_RENDER_TARGET_H
+#define LAVOS_OFFSCREEN_RENDER_TARGET_H
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <vector>
+
+#include "render_target.h"
+
+namespace lavos
+{
+
+class Buffer;
+
+/**
+ * A {@link ColorRenderTarget} backed by images in device memory instead of a window, e.g. to render on a server.
+ *
+ * The images form a ring, each with a host visible readback buffer. After a frame was drawn into an image,
+ * SubmitReadback() copies it into the buffer without waiting for it. Finished copies are passed to the
+ * ReadbackCallback in the order of their frames by CollectReadbacks(), so the host only stalls if it reuses an
+ * image whose copy has not finished yet, i.e. if the GPU is more than GetImageCount() frames behind.
+ *
+ * Usage per frame:
+ * 		auto image_index = render_target->AcquireImage();
+ * 		renderer->DrawFrame(image_index, {}, {}, {});
+ * 		render_target->SubmitReadback(image_index);
+ * 		render_target->CollectReadbacks();
+ */
+class OffscreenRenderTarget : public ColorRenderTarget
+{
+	public:
+		struct Readback
+		{
+			/**
+			 * Counts the calls of SubmitReadback(), starting at 0.
+			 */
+			std::uint64_t frame;
+
+			vk::Extent2D extent;
+
+			/**
+			 * Tightly packed rows in the format of the render target, only valid during the ReadbackCallback.
+			 */
+			const void *pixels;
+			vk::DeviceSize row_pitch;
+		};
+
+		using ReadbackCallback = std::function<void(const Readback &readback)>;
+
+	private:
+		struct Slot
+		{
+			lavos::Image image;
+			vk::ImageView image_view;
+			lavos::Buffer *readback_buffer;
+
+			std::uint64_t frame = 0;
+
+			/**
+			 * Submission value of the copy into readback_buffer
+			 */
+			std::uint64_t value = 0;
+		};
+
+		Engine * const engine;
+
+		const vk::Format format;
+		const vk::DeviceSize pixel_size;
+		vk::Extent2D extent;
+
+		std::vector<Slot> slots;
+		std::uint32_t next_slot = 0;
+
+		/**
+		 * Slots with a submitted readback that was not passed to the callback yet, oldest first
+		 */
+		std::deque<std::uint32_t> pending_slots;
+
+		std::uint64_t frame_count = 0;
+
+		ReadbackCallback readback_callback;
+
+		static vk::DeviceSize GetPixelSize(vk::Format format);
+
+		void CreateResources(std::uint32_t image_count);
+		void CleanupResources();
+
+		void DeliverReadback(const Slot &slot);
+
+	public:
+		/**
+		 * @param format a format with 8, 16 or 32 bit components that can be rendered into
+		 * @param image_count number of images and readback buffers, more than Renderer::frames_in_flight
+		 * 			lets the host record the next frames while earlier readbacks are still being copied
+		 */
+		OffscreenRenderTarget(Engine *engine, vk::Extent2D extent, vk::Format format = vk::Format::eR8G8B8A8Unorm,
+				std::uint32_t image_count = 3);
+		~OffscreenRenderTarget() override;
+
+		/**
+		 * Recreate all images. Readbacks that are still pending are collected first.
+		 */
+		void Resize(vk::Extent2D extent);
+
+		void SetReadbackCallback(ReadbackCallback callback)		{ readback_callback = std::move(callback); }
+
+		/**
+		 * @return the index of the image to draw the next frame into. If the readback of its previous frame
+		 * 			is still pending, it is waited for and collected together with all readbacks before it.
+		 */
+		std::uint32_t AcquireImage();
+
+		/**
+		 * Copy image_index into its readback buffer after everything submitted before, i.e. after the frame
+		 * drawn into it. Does not wait for the copy.
+		 * @return the submission value of the copy
+		 */
+		std::uint64_t SubmitReadback(std::uint32_t image_index);
+
+		/**
+		 * Pass all finished readbacks to the ReadbackCallback without waiting for the pending ones.
+		 * @return the number of readbacks passed
+		 */
+		std::uint32_t CollectReadbacks();
+
+		/**
+		 * Wait for all pending readbacks and pass them to the ReadbackCallback.
+		 */
+		void FlushReadbacks();
+
+		std::uint32_t GetImageCount() const						{ return static_cast<std::uint32_t>(slots.size()); }
+		std::size_t GetPendingReadbackCount() const				{ return pending_slots.size(); }
+		vk::DeviceSize GetRowPitch() const						{ return pixel_size * extent.width; }
+
+		vk::Extent2D GetExtent() const override					{ return extent; }
+		vk::Format GetFormat() const override					{ return format; }
+		std::vector<vk::ImageView> GetImageViews() const override;
+		std::vector<vk::Image> GetImages() const override;
+		vk::ImageLayout GetFinalLayout() const override			{ return vk::ImageLayout::eTransferSrcOptimal; }
+};
+
+}
+
+#endif //LAVOS_OFFSCREEN_RENDER_TARGET_H
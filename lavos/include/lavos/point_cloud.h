@@ -7,7 +7,7 @@
 
 #include "engine.h"
 #include "vertex.h"
-#include "buffer.h"
+#include "geometry_arena.h"
 #include "material/material_instance.h"
 
 namespace lavos
@@ -22,13 +22,18 @@ class PointCloud
 	public:
 		std::vector<Point> points;
 
-		lavos::Buffer *vertex_buffer = nullptr;
+		/**
+		 * Allocation in the vertex pool of the GeometryArena for the size of Point.
+		 */
+		GeometryArena::Allocation *vertex_allocation = nullptr;
 
 		explicit PointCloud(Engine *engine);
 		~PointCloud();
 
 		void CreateVertexBuffer();
 		void CreateBuffers();
+
+		vk::Buffer GetVkVertexBuffer() const;
 };
 
 
@@ -41,24 +46,16 @@ inline PointCloud<Point>::PointCloud(Engine *engine)
 template<class Point>
 inline PointCloud<Point>::~PointCloud()
 {
-	delete vertex_buffer;
+	if(vertex_allocation)
+		engine->GetGeometryArena()->Free(vertex_allocation);
 }
 
 template<class Point>
 inline void PointCloud<Point>::CreateVertexBuffer()
 {
-	vk::DeviceSize size = sizeof(points[0]) * points.size();
-
-	auto staging_buffer = engine->CreateBuffer(size, vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_CPU_ONLY);
-	memcpy(staging_buffer->Map(), points.data(), size);
-	staging_buffer->UnMap();
-
-	vertex_buffer = engine->CreateBuffer(size, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eVertexBuffer,
-										 VMA_MEMORY_USAGE_GPU_ONLY);
-
-	engine->CopyBuffer(staging_buffer->GetVkBuffer(), vertex_buffer->GetVkBuffer(), size);
-
-	delete staging_buffer;
+	auto geometry_arena = engine->GetGeometryArena();
+	vertex_allocation = geometry_arena->Allocate(geometry_arena->GetVertexPool(sizeof(Point)), static_cast<std::uint32_t>(points.size()));
+	geometry_arena->Upload(vertex_allocation, 0, points.data());
 }
 
 template<class Point>
@@ -67,6 +64,12 @@ inline void PointCloud<Point>::CreateBuffers()
 	CreateVertexBuffer();
 }
 
+template<class Point>
+inline vk::Buffer PointCloud<Point>::GetVkVertexBuffer() const
+{
+	return engine->GetGeometryArena()->GetVkBuffer(vertex_allocation->pool);
+}
+
 
 }
 
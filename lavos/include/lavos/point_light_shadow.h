@@ -0,0 +1,104 @@
+
+#ifndef LAVOS_POINT_LIGHT_SHADOW_H
+#define LAVOS_POINT_LIGHT_SHADOW_H
+
+#include "image.h"
+#include "buffer.h"
+#include "render_graph.h"
+
+#include "glm_config.h"
+#include <glm/ext/matrix_float4x4.hpp>
+
+namespace lavos
+{
+
+class PointLight;
+class Renderer;
+class PointLightShadowRenderer;
+
+/**
+ * Depth cube map of a PointLight.
+ */
+class PointLightShadow
+{
+	private:
+		Engine * const engine;
+		PointLight * const light;
+		PointLightShadowRenderer * const renderer;
+
+		float near_clip;
+		float far_clip;
+
+		float depth_bias_constant;
+		float depth_bias_slope;
+
+		Image depth_image;
+
+		/**
+		 * 2D array view of all faces, used as the multiview attachment.
+		 */
+		vk::ImageView depth_image_view;
+
+		/**
+		 * Cube view of the same image for sampling.
+		 */
+		vk::ImageView cube_image_view;
+
+		vk::Sampler sampler;
+
+		vk::Framebuffer framebuffer;
+
+		/**
+		 * One buffer and descriptor set per frame in flight of the Renderer, indexed by Renderer::GetFrameIndex()
+		 */
+		std::vector<lavos::Buffer *> matrix_uniform_buffers;
+		vk::DescriptorPool descriptor_pool;
+		std::vector<vk::DescriptorSet> descriptor_sets;
+
+		void CreateImage();
+		void CreateSampler();
+		void CreateFramebuffer();
+		void CreateUniformBuffer();
+		void CreateDescriptorPool();
+		void CreateDescriptorSet();
+		void UpdateMatrixUniformBuffer(std::uint32_t frame_index, const glm::mat4 *face_matrices);
+
+	public:
+		PointLightShadow(Engine *engine, PointLight *light, PointLightShadowRenderer *renderer, float near_clip, float far_clip);
+		~PointLightShadow();
+
+		/**
+		 * Render all six faces in a single pass. Casters are culled against each face individually.
+		 */
+		void Render(vk::CommandBuffer cmd, Renderer *renderer);
+
+		/**
+		 * Add a pass rendering the cube map.
+		 * @return the cube map in graph
+		 */
+		RenderGraph::ResourceId AddPass(RenderGraph &graph, Renderer *renderer);
+
+		PointLight *GetLight() const					{ return light; }
+		PointLightShadowRenderer *GetRenderer() const	{ return renderer; }
+
+		float GetNearClip() const 					{ return near_clip; }
+		float GetFarClip() const 					{ return far_clip; }
+
+		void SetDepthBias(float constant_factor, float slope_factor)
+			{ depth_bias_constant = constant_factor; depth_bias_slope = slope_factor; }
+		float GetDepthBiasConstant() const			{ return depth_bias_constant; }
+		float GetDepthBiasSlope() const				{ return depth_bias_slope; }
+
+		/**
+		 * View-projection matrix of a face, laid out so that rendering it matches sampling the cube map.
+		 * @param face index in Vulkan cube map order: +X, -X, +Y, -Y, +Z, -Z
+		 */
+		glm::mat4 GetFaceViewProjectionMatrix(unsigned int face);
+
+		vk::ImageView GetCubeImageView() const		{ return cube_image_view; }
+		vk::Sampler GetSampler() const				{ return sampler; }
+};
+
+}
+
+#endif //LAVOS_POINT_LIGHT_SHADOW_H
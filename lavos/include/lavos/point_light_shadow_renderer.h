@@ -0,0 +1,74 @@
+
+#ifndef LAVOS_POINT_LIGHT_SHADOW_RENDERER_H
+#define LAVOS_POINT_LIGHT_SHADOW_RENDERER_H
+
+#include "sub_renderer.h"
+#include "material_pipeline_manager.h"
+
+#include <cstdint>
+#include <vulkan/vulkan.hpp>
+
+namespace lavos
+{
+
+class Engine;
+
+/**
+ * Renders depth cube maps for PointLightShadows.
+ * All six faces of a cube map are rendered in a single pass using multiview,
+ * so Engine::CreateInfo::enable_multiview is required.
+ */
+class PointLightShadowRenderer : public SubRenderer
+{
+	private:
+		std::uint32_t resolution;
+		vk::Format depth_format;
+
+		float depth_bias_constant = 1.25f;
+		float depth_bias_slope = 1.75f;
+
+		vk::DescriptorSetLayout descriptor_set_layout;
+		vk::RenderPass render_pass;
+
+		MaterialPipelineManager *material_pipeline_manager;
+
+		MaterialPipelineConfiguration CreateMaterialPipelineConfiguration();
+
+		void CreateRenderPass();
+		void CreateDescriptorSetLayout();
+
+	public:
+		static const std::uint32_t face_count = 6;
+
+		/**
+		 * @param resolution width and height of each face of the cube maps
+		 */
+		PointLightShadowRenderer(lavos::Engine *engine, std::uint32_t resolution);
+		~PointLightShadowRenderer() override;
+
+		std::uint32_t GetResolution() const						{ return resolution; }
+		vk::Format GetDepthFormat() const						{ return depth_format; }
+
+		/**
+		 * @return null with dynamic rendering
+		 */
+		vk::RenderPass GetRenderPass() const					{ return render_pass; }
+		vk::DescriptorSetLayout GetDescriptorSetLayout() const	{ return descriptor_set_layout; }
+
+		MaterialPipelineManager *GetMaterialPipelineManager() const { return material_pipeline_manager; }
+
+		/**
+		 * Default depth bias for new PointLightShadows.
+		 */
+		void SetDefaultDepthBias(float constant_factor, float slope_factor)
+			{ depth_bias_constant = constant_factor; depth_bias_slope = slope_factor; }
+		float GetDefaultDepthBiasConstant() const				{ return depth_bias_constant; }
+		float GetDefaultDepthBiasSlope() const					{ return depth_bias_slope; }
+
+		void AddMaterial(Material *material) override;
+		void RemoveMaterial(Material *material) override;
+};
+
+}
+
+#endif //LAVOS_POINT_LIGHT_SHADOW_RENDERER_H
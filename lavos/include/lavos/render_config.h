@@ -13,21 +13,72 @@ class RenderConfig
 {
 	friend class RenderConfigBuilder;
 
+	public:
+		enum class TextureQuality
+		{
+			Low,
+			Medium,
+			High
+		};
+
 	private:
 		std::vector<Material::RenderMode> material_render_modes;
+		bool depth_prepass_enabled = false;
+		bool deferred_enabled = false;
+		TextureQuality texture_quality = TextureQuality::Medium;
+		vk::SampleCountFlagBits sample_count = vk::SampleCountFlagBits::e1;
 
 	public:
 		const std::vector<Material::RenderMode> &GetMaterialRenderModes() const 	{ return material_render_modes; }
+		bool GetDepthPrepassEnabled() const 										{ return depth_prepass_enabled; }
+		bool GetDeferredEnabled() const 											{ return deferred_enabled; }
+		TextureQuality GetTextureQuality() const 									{ return texture_quality; }
+		vk::SampleCountFlagBits GetSampleCount() const 								{ return sample_count; }
+
+		/**
+		 * @return the anisotropy for material textures at the texture quality, 1.0 for no anisotropic filtering.
+		 * 			Still to be limited by the device and Engine::CreateInfo::enable_anisotropy.
+		 */
+		float GetMaxAnisotropy() const;
 };
 
 class RenderConfigBuilder
 {
 	private:
 		bool shadow_enabled = false;
+		bool depth_prepass_enabled = false;
+		bool deferred_enabled = false;
+		RenderConfig::TextureQuality texture_quality = RenderConfig::TextureQuality::Medium;
+		vk::SampleCountFlagBits sample_count = vk::SampleCountFlagBits::e1;
 
 	public:
 		RenderConfigBuilder &SetShadowEnabled(bool enabled)		{ shadow_enabled = enabled; return *this; }
 
+		/**
+		 * Render depth of all materials supporting Material::DefaultRenderMode::DepthPrepass
+		 * in a separate subpass first, so their color pass only shades visible fragments.
+		 */
+		RenderConfigBuilder &SetDepthPrepassEnabled(bool enabled)	{ depth_prepass_enabled = enabled; return *this; }
+
+		/**
+		 * Shade with a G-buffer and a fullscreen lighting pass instead of forward shading.
+		 * Only materials supporting Material::DefaultRenderMode::GBuffer are rendered.
+		 * Not supported together with the depth prepass.
+		 */
+		RenderConfigBuilder &SetDeferredEnabled(bool enabled)		{ deferred_enabled = enabled; return *this; }
+
+		/**
+		 * Quality preset for sampling material textures, currently selecting the anisotropic filtering level.
+		 */
+		RenderConfigBuilder &SetTextureQuality(RenderConfig::TextureQuality quality)	{ texture_quality = quality; return *this; }
+
+		/**
+		 * Render the main pass with multisampling into transient color and depth attachments, which are resolved
+		 * into the color render target at the end of the pass. Limited to the sample counts of the device.
+		 * Not supported together with deferred rendering.
+		 */
+		RenderConfigBuilder &SetSampleCount(vk::SampleCountFlagBits count)			{ sample_count = count; return *this; }
+
 		RenderConfig Build();
 };
 
@@ -0,0 +1,233 @@
+
+#ifndef LAVOS_RENDER_GRAPH_H
+#define LAVOS_RENDER_GRAPH_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+#include <vk_mem_alloc.h>
+
+namespace lavos
+{
+
+class Engine;
+
+/**
+ * Schedules the passes of a frame from the images they declare to read and write.
+ *
+ * Passes are added in execution order together with their uses of images. Compile() culls passes whose results
+ * are never used, derives all layout transitions and pipeline barriers between the passes and places transient
+ * images in memory, letting images whose lifetimes don't overlap share the same allocation.
+ * Execute() then records the barriers and passes into a command buffer.
+ *
+ * Images used by the graph are either imported, i.e. owned by someone else, like shadow maps, or transient,
+ * i.e. created by the graph and only valid during its execution, like the intermediate attachments of shadow passes. The graph owns all layout transitions of
+ * the images it tracks, so render passes recording into them must use the layout of the declared access as
+ * initial and final layout of the attachment.
+ *
+ * The graph is meant to be rebuilt every frame with Reset(). Transient images and their memory are kept
+ * as long as the following frames declare the same transient images with the same lifetimes.
+ */
+class RenderGraph
+{
+	public:
+		using ResourceId = std::uint32_t;
+		using PassId = std::uint32_t;
+		using RecordFunction = std::function<void(vk::CommandBuffer)>;
+
+		enum class Access
+		{
+			ColorAttachment,
+			DepthAttachment,
+			DepthAttachmentRead,
+			FragmentShaderRead,
+			TransferRead,
+			TransferWrite
+		};
+
+		struct ImageDesc
+		{
+			vk::Format format;
+			vk::Extent2D extent;
+			vk::ImageUsageFlags usage;
+			vk::SampleCountFlagBits samples = vk::SampleCountFlagBits::e1;
+			std::uint32_t layers = 1;
+
+			bool operator==(const ImageDesc &other) const
+			{
+				return format == other.format
+					   && extent == other.extent
+					   && usage == other.usage
+					   && samples == other.samples
+					   && layers == other.layers;
+			}
+		};
+
+	private:
+		struct ResourceState
+		{
+			vk::ImageLayout layout = vk::ImageLayout::eUndefined;
+			vk::PipelineStageFlags write_stages;
+			vk::AccessFlags write_access;
+
+			/**
+			 * Stages and accesses that read the image since the last write and already see its result.
+			 */
+			vk::PipelineStageFlags read_stages;
+			vk::AccessFlags read_access;
+		};
+
+		struct Resource
+		{
+			std::string name;
+			bool transient;
+			ImageDesc desc;
+			vk::Image image;
+			vk::ImageView image_view;
+			vk::ImageSubresourceRange range;
+			ResourceState initial_state;
+
+			/**
+			 * Index into transient_images, only for transient resources used by any pass.
+			 */
+			std::uint32_t transient_index = 0;
+		};
+
+		struct Use
+		{
+			ResourceId resource;
+			Access access;
+			bool write;
+			bool discard;
+		};
+
+		struct Pass
+		{
+			std::string name;
+			RecordFunction record;
+			std::vector<Use> uses;
+			bool side_effects = false;
+			bool culled = false;
+
+			vk::PipelineStageFlags src_stages;
+			vk::PipelineStageFlags dst_stages;
+			std::vector<vk::ImageMemoryBarrier> barriers;
+		};
+
+		struct TransientImage
+		{
+			ImageDesc desc;
+			std::uint32_t first_pass;
+			std::uint32_t last_pass;
+
+			vk::Image image;
+			vk::ImageView image_view;
+			std::uint32_t memory_index;
+		};
+
+		Engine * const engine;
+
+		std::vector<Resource> resources;
+		std::vector<Pass> passes;
+		bool compiled = false;
+
+		std::vector<TransientImage> transient_images;
+		std::vector<VmaAllocation> transient_memory;
+		vk::DeviceSize transient_memory_size = 0;
+		std::uint64_t transient_generation = 0;
+
+		void Cull();
+
+		/**
+		 * Assign transient images to memory and (re)create them if their layout changed since the last Compile().
+		 */
+		void PlaceTransientImages();
+		void CreateTransientImages(std::vector<TransientImage> &images);
+		static void DestroyTransientImages(Engine *engine, std::vector<TransientImage> &images, std::vector<VmaAllocation> &memory);
+
+		/**
+		 * @return the transient image that used the memory of image index last before it, or the last one using it
+		 * 			in the previous frame if there is none
+		 */
+		std::uint32_t GetPreviousTransientImage(std::uint32_t index) const;
+
+		void DeriveBarriers();
+
+	public:
+		explicit RenderGraph(Engine *engine);
+		~RenderGraph();
+
+		/**
+		 * Remove all passes and resources to build the graph of a new frame.
+		 */
+		void Reset();
+
+		/**
+		 * @param layout layout of the image before the graph, eUndefined if its content is not needed
+		 * @param last_stages stages that used the image before the graph and have to finish before it is written
+		 */
+		ResourceId ImportImage(std::string name, vk::Image image, vk::ImageSubresourceRange range,
+				vk::ImageLayout layout = vk::ImageLayout::eUndefined,
+				vk::PipelineStageFlags last_stages = vk::PipelineStageFlagBits::eAllCommands);
+
+		/**
+		 * Declare an image that only lives during the graph. Its content is undefined before its first write.
+		 */
+		ResourceId CreateImage(std::string name, const ImageDesc &desc);
+
+		PassId AddPass(std::string name, RecordFunction record);
+
+		/**
+		 * Keep pass even if none of its results are used by other passes, e.g. because it presents.
+		 * Passes writing imported images are always kept.
+		 */
+		void SetSideEffects(PassId pass)				{ passes[pass].side_effects = true; }
+
+		void Read(PassId pass, ResourceId resource, Access access);
+
+		/**
+		 * @param discard the previous content of resource is not needed, e.g. because the pass clears it
+		 */
+		void Write(PassId pass, ResourceId resource, Access access, bool discard = false);
+
+		/**
+		 * Cull unused passes, derive barriers and place transient images.
+		 * Must be called after all passes were added and before any image of a transient resource is requested.
+		 */
+		void Compile();
+
+		/**
+		 * Record all passes that were not culled together with their barriers.
+		 */
+		void Execute(vk::CommandBuffer command_buffer);
+
+		/**
+		 * Only valid after Compile(), also for transient resources.
+		 */
+		vk::Image GetImage(ResourceId resource) const			{ return resources[resource].image; }
+
+		/**
+		 * @return a view of the whole image, only for transient resources and only valid after Compile()
+		 */
+		vk::ImageView GetImageView(ResourceId resource) const	{ return resources[resource].image_view; }
+
+		bool GetPassCulled(PassId pass) const					{ return passes[pass].culled; }
+
+		/**
+		 * @return the size of the memory shared by all transient images
+		 */
+		vk::DeviceSize GetTransientMemorySize() const			{ return transient_memory_size; }
+
+		/**
+		 * @return a number that changes whenever the transient images are recreated, so objects referencing their views,
+		 * 			like framebuffers, know when they have to be recreated too
+		 */
+		std::uint64_t GetTransientGeneration() const			{ return transient_generation; }
+};
+
+}
+
+#endif //LAVOS_RENDER_GRAPH_H
@@ -63,6 +63,16 @@ class ColorRenderTarget : public RenderTarget
 		~ColorRenderTarget() override = default;
 		virtual vk::Format GetFormat() const =0;
 		virtual std::vector<vk::ImageView> GetImageViews() const =0;
+
+		/**
+		 * Images of GetImageViews() in the same order, for barriers with dynamic rendering.
+		 */
+		virtual std::vector<vk::Image> GetImages() const =0;
+
+		/**
+		 * Layout the images are left in after a frame was drawn, eTransferSrcOptimal to copy them afterwards.
+		 */
+		virtual vk::ImageLayout GetFinalLayout() const		{ return vk::ImageLayout::ePresentSrcKHR; }
 };
 
 
@@ -88,6 +98,8 @@ class ManagedDepthRenderTarget : public DepthRenderTarget, RenderTarget::Changed
 		Engine * const engine;
 		ColorRenderTarget * const color_render_target;
 
+		const bool transient;
+
 		vk::Format format;
 		lavos::Image image;
 		vk::ImageView image_view;
@@ -99,7 +111,11 @@ class ManagedDepthRenderTarget : public DepthRenderTarget, RenderTarget::Changed
 		void RenderTargetChanged(RenderTarget *render_target) override;
 
 	public:
-		ManagedDepthRenderTarget(Engine *engine, ColorRenderTarget *color_render_target);
+		/**
+		 * @param transient whether the depth is only needed during rendering and never read afterwards.
+		 * 			If so, the image is created as a transient attachment, which may use lazily allocated memory.
+		 */
+		ManagedDepthRenderTarget(Engine *engine, ColorRenderTarget *color_render_target, bool transient = true);
 		~ManagedDepthRenderTarget() override;
 
 		vk::Extent2D GetExtent() const override			{ return color_render_target->GetExtent(); }
@@ -5,6 +5,9 @@
 #include "component/component.h"
 #include "material/material_instance.h"
 
+#include "glm_config.h"
+#include <glm/ext/vector_float3.hpp>
+
 namespace lavos
 {
 
@@ -28,6 +31,20 @@ class Renderable
 				virtual void Draw(vk::CommandBuffer command_buffer) =0;
 		};
 
+		/**
+		 * Vertex and index buffers bound at offset 0 by BindBuffers() or BindPositionBuffers().
+		 */
+		struct BufferBinding
+		{
+			vk::Buffer vertex_buffer;
+			vk::Buffer index_buffer;
+
+			bool operator==(const BufferBinding &other) const
+			{
+				return vertex_buffer == other.vertex_buffer && index_buffer == other.index_buffer;
+			}
+		};
+
 		virtual ~Renderable() = default;
 
 		/**
@@ -35,12 +52,32 @@ class Renderable
 		 */
 		virtual bool GetCurrentlyRenderable() const		{ return true; }
 
+		/**
+		 * Axis-aligned bounding box in the local space of the node, used for culling.
+		 * @return false if no bounds are known, in which case the Renderable is never culled.
+		 */
+		virtual bool GetBounds(glm::vec3 &min, glm::vec3 &max)	{ return false; }
+
 		/**
 		 * Bind Vertex, Index, etc. buffers
 		 * @param command_buffer
 		 */
 		virtual void BindBuffers(vk::CommandBuffer command_buffer) =0;
 
+		/**
+		 * Bind a vertex buffer containing only tightly packed vec3 positions to binding 0 and the index buffer,
+		 * used for depth-only passes such as the depth prepass.
+		 * @return false if no position buffer is available, in which case the Renderable is skipped in these passes
+		 */
+		virtual bool BindPositionBuffers(vk::CommandBuffer command_buffer)	{ return false; }
+
+		/**
+		 * Buffers that BindBuffers() or, if position_only, BindPositionBuffers() would bind, so binding them
+		 * can be skipped for consecutive Renderables sharing them, e.g. through the GeometryArena.
+		 * @return false if unknown, in which case the buffers are always bound
+		 */
+		virtual bool GetBufferBinding(bool position_only, BufferBinding &binding)	{ return false; }
+
 		virtual unsigned int GetPrimitivesCount() =0;
 		virtual Primitive *GetPrimitive(unsigned int i) =0;
 };
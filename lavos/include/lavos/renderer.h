@@ -2,8 +2,11 @@
 #ifndef LAVOS_RENDERER_H
 #define LAVOS_RENDERER_H
 
+#include <array>
+#include <functional>
 #include <map>
 #include <memory>
+#include <set>
 
 #include "lavos/component/camera.h"
 #include "engine.h"
@@ -13,6 +16,9 @@
 #include "render_target.h"
 #include "render_config.h"
 #include "material_pipeline_manager.h"
+#include "light_grid.h"
+#include "uniform_ring_buffer.h"
+#include "render_graph.h"
 
 namespace lavos
 {
@@ -21,6 +27,7 @@ class SpotLight;
 class SpotLightShadow;
 class SubRenderer;
 class LightCollection;
+class GBuffer;
 
 struct MatrixUniformBuffer
 {
@@ -38,36 +45,78 @@ struct LightingUniformBufferFixed
 	glm::vec3 directional_light_dir;
 	std::uint8_t unused_2[4];
 	glm::vec3 directional_light_intensity;
-	std::uint32_t spot_lights_count;
+	std::uint32_t shadowed_spot_lights_count;
+	glm::uvec3 cluster_count;
+	float cluster_z_scale;
+	glm::vec2 cluster_tile_size;
+	float cluster_z_bias;
+	std::uint32_t point_lights_count;
 };
 
-struct LightingUniformBufferSpotLight
+struct LightingUniformBufferPointLight
 {
 	glm::vec3 position;
-	float angle_cos;
-	glm::vec3 direction;
-	float unused;
-	glm::mat4 shadow_mvp_matrix;
+	float shadow_near_clip;
+	glm::vec3 intensity;
+	float shadow_far_clip;
+	std::uint32_t shadow_mode;
+	std::uint8_t unused[12];
 };
 
-static_assert(sizeof(LightingUniformBufferFixed) == 48, "LightingUniformBufferFixed memory layout");
-static_assert(sizeof(LightingUniformBufferSpotLight) == 96, "LightingUniformBufferSpotLight memory layout");
+static_assert(sizeof(LightingUniformBufferFixed) == 80, "LightingUniformBufferFixed memory layout");
+static_assert(sizeof(LightingUniformBufferPointLight) == 48, "LightingUniformBufferPointLight memory layout");
 
 
 struct CameraUniformBuffer
 {
 	glm::vec3 position;
+	std::uint8_t unused[4];
+	glm::vec3 direction;
+	std::uint8_t unused_2[4];
+
+	/**
+	 * Maps (framebuffer coordinates, depth, 1) to homogeneous world space, for reconstructing positions from depth.
+	 */
+	glm::mat4 screen_to_world;
 };
 
-static_assert(sizeof(CameraUniformBuffer) == 12, "CameraUniformBuffer memory layout");
+static_assert(sizeof(CameraUniformBuffer) == 96, "CameraUniformBuffer memory layout");
 
 
 struct TransformPushConstant
 {
 	glm::mat4 transform;
+
+	/**
+	 * Bit i is set if the object is visible in view i, only evaluated by multiview shaders.
+	 */
+	std::uint32_t view_mask;
+
+	/**
+	 * Bit i is set if shadowed spot light i may reach the object, only evaluated by forward shading.
+	 */
+	std::uint32_t spot_light_mask;
+
+	/**
+	 * Parameter block in the MaterialTable, only evaluated by pipelines using it.
+	 */
+	std::uint32_t material_index;
 };
 
-static_assert(sizeof(TransformPushConstant) == 64, "TransformPushConstant memory layout");
+static_assert(sizeof(TransformPushConstant) == 76, "TransformPushConstant memory layout");
+
+
+/**
+ * Pipeline statistics of the main render pass (including the depth prepass) of the last finished frame.
+ * Only collected if Engine::CreateInfo::enable_pipeline_statistics is set.
+ */
+struct RenderStatistics
+{
+	bool available = false;
+	std::uint64_t vertex_shader_invocations = 0;
+	std::uint64_t clipping_primitives = 0;
+	std::uint64_t fragment_shader_invocations = 0;
+};
 
 
 
@@ -75,6 +124,21 @@ class Renderer: public ColorRenderTarget::ChangedCallback
 {
 	friend class MaterialPipelineManager;
 
+	public:
+		/**
+		 * Returns a mask of the multiview views renderable is visible in, or 0 to skip it entirely.
+		 */
+		typedef std::function<std::uint32_t (Node *node, Renderable *renderable)> ViewMaskFunction;
+
+		/**
+		 * A camera and the area of the color render target it is rendered into, e.g. a tile of an atlas.
+		 */
+		struct View
+		{
+			Camera *camera;
+			vk::Rect2D region;
+		};
+
 	private:
 		Engine * const engine;
 
@@ -85,33 +149,171 @@ class Renderer: public ColorRenderTarget::ChangedCallback
 
 		bool auto_set_camera_aspect = true;
 
-		vk::CommandBuffer render_command_buffer;
+		/**
+		 * One command buffer per frame in flight, indexed by frame_index, with the Engine submission value of its last use.
+		 */
+		std::vector<vk::CommandBuffer> render_command_buffers;
+		std::vector<std::uint64_t> render_submissions;
+		std::uint32_t frame_index = 0;
 
 		ColorRenderTarget *color_render_target;
 		DepthRenderTarget *depth_render_target;
 
 		std::vector<vk::Framebuffer> dst_framebuffers;
 
+		/**
+		 * Sample count of the main pass, RenderConfig::GetSampleCount() limited to the device.
+		 */
+		vk::SampleCountFlagBits samples = vk::SampleCountFlagBits::e1;
+
+		/**
+		 * Transient attachments of the main pass with multisampling, resolved into color_render_target.
+		 * depth_render_target is not used by the main pass then.
+		 */
+		lavos::Image multisample_color_image;
+		vk::ImageView multisample_color_image_view;
+		lavos::Image multisample_depth_image;
+		vk::ImageView multisample_depth_image_view;
+
 		MaterialPipelineManager *material_pipeline_manager;
+		MaterialPipelineManager *depth_prepass_pipeline_manager = nullptr;
+
+		/**
+		 * only used with deferred rendering
+		 */
+		GBuffer *gbuffer = nullptr;
 
 		Texture spot_light_shadow_default;
+		Texture spot_light_shadow_depth_default;
+		Texture point_light_shadow_default;
 
+		/**
+		 * null if the main pass uses dynamic rendering
+		 */
 		vk::RenderPass render_pass;
 
+		/**
+		 * One query per frame in flight, indexed by frame_index.
+		 */
+		vk::QueryPool statistics_query_pool;
+		std::vector<bool> statistics_query_submitted;
+		RenderStatistics statistics;
+
 		vk::DescriptorPool descriptor_pool;
 
 		vk::DescriptorSetLayout descriptor_set_layout;
-		vk::DescriptorSet descriptor_set;
 
-		lavos::Buffer *matrix_uniform_buffer;
-		lavos::Buffer *lighting_uniform_buffer;
-		lavos::Buffer *camera_uniform_buffer;
+		/**
+		 * One set per frame in flight, indexed by frame_index, so the storage buffers and shadow textures
+		 * can be rewritten while the previous frame is still reading its own set.
+		 */
+		std::vector<vk::DescriptorSet> descriptor_sets;
+
+		/**
+		 * Holds the matrix, lighting and camera uniform buffers of every frame in flight.
+		 */
+		UniformRingBuffer *uniform_ring_buffer;
+
+		/**
+		 * Offsets of the matrix, lighting and camera uniform buffers of the current frame in uniform_ring_buffer,
+		 * in binding order to be passed when binding descriptor_sets[frame_index].
+		 */
+		std::array<std::uint32_t, 3> descriptor_set_dynamic_offsets;
+
+		/**
+		 * A view of the current frame with the offsets of its own matrix and camera uniform buffers.
+		 */
+		struct FrameView
+		{
+			View view;
+			std::uint32_t matrix_offset;
+			std::uint32_t camera_offset;
+		};
+
+		/**
+		 * Views of the current frame, a single one covering the whole color render target for DrawFrame().
+		 */
+		std::vector<FrameView> frame_views;
+
+		/**
+		 * Whether renderables are culled against frame_views, with the masks of the views they are visible in.
+		 */
+		bool frame_views_culled = false;
+		std::map<Renderable *, std::uint32_t> frame_view_masks;
+
+		/**
+		 * View-projection matrices of frame_views, computed once per frame for GetFrameViewMask().
+		 */
+		std::vector<glm::mat4> frame_view_projections;
+
+		LightGrid *light_grid;
+
+		/**
+		 * Rebuilt every frame from the shadow passes and the main pass.
+		 */
+		RenderGraph *render_graph;
+
+		/**
+		 * Shadowed spot lights of the current frame, in the order of the bits of TransformPushConstant::spot_light_mask.
+		 */
+		std::vector<LightingStorageBufferSpotLight> shadowed_spot_lights;
+
+		/**
+		 * Whether the point lights beyond max_point_lights have already been warned about.
+		 */
+		bool point_lights_dropped_warned = false;
+
+		/**
+		 * Material::LightingFeature bits of the current frame, selecting the material variants.
+		 */
+		std::uint32_t lighting_features = Material::LightingFeaturesAll;
+
+		/**
+		 * LightCollection and its version the shadow descriptors of each set in descriptor_sets were last written for.
+		 */
+		std::vector<const LightCollection *> shadow_descriptors_light_collections;
+		std::vector<std::uint64_t> shadow_descriptors_versions;
 
 		std::vector<Material *> materials;
 		std::vector<SubRenderer *> sub_renderers;
 
+		/**
+		 * Renderables of the scene grouped by their pipelines for a render mode, see CollectRenderables().
+		 */
+		struct RenderableList
+		{
+			std::map<std::pair<Material *, Material::VariantKey>, std::set<std::pair<Node *, Renderable *>>> material_primitives;
+			std::map<Renderable *, std::uint32_t> view_masks;
+		};
+
 
 		MaterialPipelineConfiguration CreateMaterialPipelineConfiguration();
+		MaterialPipelineConfiguration CreateDepthPrepassPipelineConfiguration();
+
+		/**
+		 * Make viewport and scissor of pipeline_config dynamic, so they can be set per view.
+		 */
+		void SetDynamicViewportConfiguration(MaterialPipelineConfiguration &pipeline_config);
+
+		/**
+		 * Replace the render pass of pipeline_config by the formats of the render targets for dynamic rendering.
+		 */
+		void SetDynamicRenderingConfiguration(MaterialPipelineConfiguration &pipeline_config, bool color);
+
+		std::uint32_t CalculateSpotLightMask(Node *node, Renderable *renderable) const;
+
+		/**
+		 * @return the highest sample count supported for both color and depth attachments, not above requested
+		 */
+		vk::SampleCountFlagBits ChooseSampleCount(vk::SampleCountFlagBits requested) const;
+
+		void CreateMultisampleAttachments();
+		void CleanupMultisampleAttachments();
+
+		/**
+		 * @return the depth attachment of the main pass
+		 */
+		vk::ImageView GetDepthImageView() const;
 
 		void CreateFramebuffers();
 
@@ -120,31 +322,81 @@ class Renderer: public ColorRenderTarget::ChangedCallback
 
 		void CreateDescriptorSetLayout();
 		void CreateDescriptorSet();
+		void WriteLightGridDescriptors(std::uint32_t frame);
 
 		size_t GetLightingUniformBufferSize();
 
 		void CreateUniformBuffers();
+		void CreateShadowDepthDefaultTexture();
+		void CreatePointLightShadowDefaultTexture();
 
 		void CreateRenderPasses();
 		void CleanupRenderPasses();
 
-		void CreateRenderCommandBuffer();
-		void CleanupRenderCommandBuffer();
+		void CreateRenderCommandBuffers();
+		void CleanupRenderCommandBuffers();
+
+		void CreateStatisticsQueryPool();
+		void ReadStatistics();
+
+		std::uint64_t DrawFrameViews(std::uint32_t image_index,
+				std::vector<vk::Semaphore> wait_semaphores,
+				std::vector<vk::PipelineStageFlags> wait_stages,
+				std::vector<vk::Semaphore> signal_semaphores);
+
+		/**
+		 * @return the mask of frame_views renderable may be visible in, computed once per frame
+		 */
+		std::uint32_t GetFrameViewMask(Node *node, Renderable *renderable);
+
+		RenderableList CollectRenderables(Material::RenderMode render_mode, const ViewMaskFunction &view_mask_function);
+
+		/**
+		 * @param view_filter only renderables with a view mask intersecting view_filter are drawn
+		 */
+		void RecordRenderables(vk::CommandBuffer command_buffer,
+							   const RenderableList &renderables,
+							   Material::RenderMode render_mode,
+							   MaterialPipelineManager *material_pipeline_manager,
+							   vk::DescriptorSet renderer_descriptor_set,
+							   std::uint32_t view_filter);
+
+		/**
+		 * Record the renderables of render_mode once for every view in frame_views, with its viewport and uniform buffers.
+		 */
+		void RecordFrameViews(vk::CommandBuffer command_buffer,
+							  Material::RenderMode render_mode,
+							  MaterialPipelineManager *material_pipeline_manager);
 
 	protected:
 		void RenderTargetChanged(RenderTarget *render_target) override;
 
 	public:
-		static const unsigned int max_spot_lights = 16;
+		static const unsigned int max_point_lights = 4;
+
+		/**
+		 * Number of frames the CPU may record ahead of the GPU.
+		 */
+		static const unsigned int frames_in_flight = 2;
+
+		/**
+		 * Maximum number of views of DrawViews(), one bit of a view mask each.
+		 */
+		static const unsigned int max_views = 32;
 
 		Renderer(Engine *engine, const RenderConfig &config, ColorRenderTarget *color_render_target, DepthRenderTarget *depth_render_target);
 		~Renderer();
 
 		Engine *GetEngine() const 							{ return engine; }
 
+		/**
+		 * Index of the frame in flight currently being recorded, for per-frame resources of shadows and sub renderers.
+		 */
+		std::uint32_t GetFrameIndex() const					{ return frame_index; }
+
 		//vk::DescriptorPool GetDescriptorPool() const 		{ return descriptor_pool; }
 
-		void SetScene(Scene *scene)							{ this->scene = scene; }
+		void SetScene(Scene *scene)							{ this->scene = scene; shadow_descriptors_light_collections.assign(frames_in_flight, nullptr); }
 		void SetCamera(Camera *camera)				{ this->camera = camera; }
 
 		/**
@@ -162,28 +414,64 @@ class Renderer: public ColorRenderTarget::ChangedCallback
 		void AddMaterial(Material *material);
 		void RemoveMaterial(Material *material);
 
-		void UpdateMatrixUniformBuffer();
-		void UpdateCameraUniformBuffer();
+		/**
+		 * The uniform buffers are written to the region of the current frame in uniform_ring_buffer.
+		 */
+		void UpdateMatrixUniformBuffer(FrameView &view);
+		void UpdateCameraUniformBuffer(FrameView &view);
 		void UpdateLightingUniformBuffer(LightCollection *light_collection);
+		void UpdateShadowResolutions(LightCollection *light_collection);
 		void UpdateShadowDescriptors(LightCollection *light_collection);
 
 		//MaterialPipeline GetMaterialPipeline(int index)		{ return material_pipelines[index]; }
 
 		vk::RenderPass GetRenderPass() const				{ return render_pass; }
 
+		const RenderStatistics &GetStatistics() const		{ return statistics; }
+
 		bool GetAutoSetCameraAspect() const 				{ return auto_set_camera_aspect; }
 		void SetAutoSetCameraAspect(bool enabled)			{ auto_set_camera_aspect = enabled; }
 
-		void DrawFrame(std::uint32_t image_index,
+		/**
+		 * @return the Engine submission value of the frame, e.g. to wait for it with Engine::WaitForValue()
+		 */
+		std::uint64_t DrawFrame(std::uint32_t image_index,
 					   std::vector<vk::Semaphore> wait_semaphores,
 					   std::vector<vk::PipelineStageFlags> wait_stages,
 					   std::vector<vk::Semaphore> signal_semaphores);
 
-		void DrawFrameRecord(vk::CommandBuffer command_buffer, vk::Framebuffer dst_framebuffer);
+		/**
+		 * Render the scene from multiple cameras into regions of the same image in a single submission,
+		 * e.g. the tiles of a thumbnail atlas. Shadows, lighting and the traversal of the scene are shared
+		 * by all views, every view only draws the renderables culled against its own frustum.
+		 *
+		 * The whole image is cleared, regions should not overlap. Views not covering the whole image shade
+		 * all unshadowed spot lights instead of only those of their light cluster. Shadow resolutions are
+		 * chosen for the first view. Only supported with forward shading.
+		 *
+		 * @param views at most max_views, the camera set with SetCamera() is not used
+		 * @return the Engine submission value of the frame
+		 */
+		std::uint64_t DrawViews(std::uint32_t image_index,
+					   const std::vector<View> &views,
+					   std::vector<vk::Semaphore> wait_semaphores,
+					   std::vector<vk::PipelineStageFlags> wait_stages,
+					   std::vector<vk::Semaphore> signal_semaphores);
+
+		void DrawFrameRecord(vk::CommandBuffer command_buffer, std::uint32_t image_index);
+		void RecordRenderPass(vk::CommandBuffer command_buffer, vk::Framebuffer dst_framebuffer);
+
+		/**
+		 * Main pass with VK_KHR_dynamic_rendering instead of render_pass, only for forward rendering.
+		 * depth_render_target must already be in eDepthStencilAttachmentOptimal.
+		 */
+		void RecordDynamicRendering(vk::CommandBuffer command_buffer, std::uint32_t image_index);
+
 		void RecordRenderables(vk::CommandBuffer command_buffer,
 							   Material::RenderMode render_mode,
 							   MaterialPipelineManager *material_pipeline_manager,
-							   vk::DescriptorSet renderer_descriptor_set);
+							   vk::DescriptorSet renderer_descriptor_set,
+							   const ViewMaskFunction &view_mask_function = nullptr);
 };
 
 }
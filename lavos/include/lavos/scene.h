@@ -6,13 +6,19 @@
 #include <glm/ext/vector_float3.hpp>
 
 #include "node.h"
+#include "light_collection.h"
 
 namespace lavos
 {
 
 class Scene
 {
+	friend class Node;
+
 	private:
+		// declared before root_node, so it outlives the nodes unregistering from it
+		LightCollection light_collection;
+
 		Node root_node;
 
 		glm::vec3 ambient_light_intensity;
@@ -23,10 +29,23 @@ class Scene
 
 		Node *GetRootNode()									{ return &root_node; }
 
+		/**
+		 * All lights in the scene, maintained as light components are added to and removed from its nodes.
+		 */
+		LightCollection *GetLightCollection()				{ return &light_collection; }
+
 		glm::vec3 GetAmbientLightIntensity() const 			{ return ambient_light_intensity; }
 		void SetAmbientLightIntensity(glm::vec3 intensity)	{ ambient_light_intensity = intensity; }
 
 		void Update(float delta_time)						{ root_node.Update(delta_time); }
+
+	protected:
+		/**
+		 * Called by Node whenever component enters or leaves the scene,
+		 * either directly or because its node was attached to or detached from it.
+		 */
+		void ComponentAdded(Component *component);
+		void ComponentRemoved(Component *component);
 };
 
 
@@ -4,6 +4,8 @@
 
 #include "image.h"
 #include "buffer.h"
+#include "render_graph.h"
+#include "spot_light_shadow_renderer.h"
 
 #include "glm_config.h"
 #include <glm/ext/matrix_float4x4.hpp>
@@ -13,10 +15,12 @@ namespace lavos
 
 class SpotLight;
 class Renderer;
-class SpotLightShadowRenderer;
+class SpotLightShadowBatch;
 
 class SpotLightShadow
 {
+	friend 	friend class SpotLightShadowBatch;
+
 	private:
 		Engine * const engine;
 		SpotLight * const light;
@@ -25,41 +29,100 @@ class SpotLightShadow
 		float near_clip;
 		float far_clip;
 
+		/**
+		 * The shadow map size is the size of the renderer divided by 2^resolution_level.
+		 */
+		unsigned int resolution_level = 0;
+
+		/**
+		 * Number of consecutive updates in which SpotLightShadowRenderer requested a lower resolution.
+		 */
+		unsigned int downscale_frames = 0;
+
 		vk::Filter mag_filter;
 		vk::Filter min_filter;
 
-		Image depth_image;
-		vk::ImageView depth_image_view;
-
-		Image shadow_image;
-		vk::ImageView shadow_image_view;
+		float depth_bias_constant;
+		float depth_bias_slope;
 
-		Image resolve_image;
-		vk::ImageView resolve_image_view;
+		/**
+		 * The image that is sampled, the other attachments are transient images of the RenderGraph,
+		 * see SpotLightShadowRenderer::AddShadowPass()
+		 */
+		Image final_image;
+		vk::ImageView final_image_view;
 
 		vk::Sampler sampler;
 
-		vk::Framebuffer framebuffer;
+		/**
+		 * Only for multiview renderers: the shadow map is the layer batch_layer of the batch's image
+		 * and no images, framebuffer or descriptors of its own are created.
+		 */
+		SpotLightShadowBatch *batch = nullptr;
+		std::uint32_t batch_layer = 0;
+		vk::ImageView batch_layer_view;
 
-		lavos::Buffer *matrix_uniform_buffer = nullptr;
+		SpotLightShadowRenderer::ShadowFramebuffer framebuffer;
+
+		/**
+		 * One buffer and descriptor set per frame in flight of the Renderer, indexed by Renderer::GetFrameIndex()
+		 */
+		std::vector<lavos::Buffer *> matrix_uniform_buffers;
 		vk::DescriptorPool descriptor_pool; // TODO: can we make this more global?
-		vk::DescriptorSet descriptor_set;
+		std::vector<vk::DescriptorSet> descriptor_sets;
 
 		glm::mat4 GetModelViewMatrix();
 		glm::mat4 GetProjectionMatrix();
 
 		void CreateImage();
-		void CreateFramebuffer();
+		void CreateSampler();
+		void CreateBatchLayerView();
+		void CleanupImage();
 		void CreateUniformBuffer();
 		void CreateDescriptorPool();
 		void CreateDescriptorSet();
-		void UpdateMatrixUniformBuffer();
+		void UpdateMatrixUniformBuffer(std::uint32_t frame_index);
 
 	public:
 		SpotLightShadow(Engine *engine, SpotLight *light, SpotLightShadowRenderer *renderer, float near_clip, float far_clip);
 		~SpotLightShadow();
 
-		void Render(vk::CommandBuffer cmd, Renderer *renderer);
+		void Render(vk::CommandBuffer cmd, Renderer *renderer, const SpotLightShadowRenderer::ShadowAttachments &attachments);
+
+		/**
+		 * Add a pass rendering this shadow. Only for shadows without batch, those are added by SpotLightShadowRenderer::AddPasses().
+		 * @return the final image in graph
+		 */
+		RenderGraph::ResourceId AddPass(RenderGraph &graph, Renderer *renderer);
+
+		SpotLight *GetLight() const					{ return light; }
+		SpotLightShadowRenderer *GetRenderer() const	{ return renderer; }
+
+		float GetNearClip() const 					{ return near_clip; }
+		float GetFarClip() const 					{ return far_clip; }
+
+		/**
+		 * Slope-scaled depth bias applied while rendering the shadow map, only used with ShadowMode::Depth.
+		 * Shadows in the same multiview batch share the largest bias of the batch.
+		 */
+		void SetDepthBias(float constant_factor, float slope_factor)
+			{ depth_bias_constant = constant_factor; depth_bias_slope = slope_factor; }
+		float GetDepthBiasConstant() const			{ return depth_bias_constant; }
+		float GetDepthBiasSlope() const				{ return depth_bias_slope; }
+
+		unsigned int GetResolutionLevel() const		{ return resolution_level; }
+
+		SpotLightShadowBatch *GetBatch() const		{ return batch; }
+		std::uint32_t GetBatchLayer() const			{ return batch_layer; }
+
+		/**
+		 * Recreates the shadow map with the size of the renderer divided by 2^level.
+		 * The old image is destroyed once the frames already submitted have finished.
+		 */
+		void SetResolutionLevel(unsigned int level);
+
+		std::uint32_t GetWidth() const;
+		std::uint32_t GetHeight() const;
 
 		glm::mat4 GetModelViewProjectionMatrix()	{ return GetProjectionMatrix() * GetModelViewMatrix(); }
 		Image GetFinalImage();
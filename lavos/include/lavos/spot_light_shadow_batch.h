@@ -0,0 +1,84 @@
+
+#ifndef LAVOS_SPOT_LIGHT_SHADOW_BATCH_H
+#define LAVOS_SPOT_LIGHT_SHADOW_BATCH_H
+
+#include "image.h"
+#include "buffer.h"
+#include "render_graph.h"
+#include "spot_light_shadow_renderer.h"
+
+#include <vector>
+
+namespace lavos
+{
+
+class Engine;
+class Renderer;
+class SpotLightShadow;
+
+/**
+ * Layered shadow map shared by multiple SpotLightShadows of a multiview SpotLightShadowRenderer.
+ * Each shadow occupies one array layer and all layers are rendered in a single render pass,
+ * using one view per layer.
+ */
+class SpotLightShadowBatch
+{
+	private:
+		Engine * const engine;
+		SpotLightShadowRenderer * const renderer;
+
+		/**
+		 * One entry per layer, nullptr for unused layers.
+		 */
+		std::vector<SpotLightShadow *> shadows;
+
+		/**
+		 * The layered image that is sampled, the other attachments are transient images of the RenderGraph,
+		 * see SpotLightShadowRenderer::AddShadowPass()
+		 */
+		Image final_image;
+		vk::ImageView final_image_view;
+
+		SpotLightShadowRenderer::ShadowFramebuffer framebuffer;
+
+		/**
+		 * One buffer and descriptor set per frame in flight of the Renderer, indexed by Renderer::GetFrameIndex()
+		 */
+		std::vector<lavos::Buffer *> matrix_uniform_buffers;
+		vk::DescriptorPool descriptor_pool;
+		std::vector<vk::DescriptorSet> descriptor_sets;
+
+		void CreateImage();
+		void CreateUniformBuffer();
+		void CreateDescriptorPool();
+		void CreateDescriptorSet();
+		void UpdateMatrixUniformBuffer(std::uint32_t frame_index);
+
+	public:
+		SpotLightShadowBatch(Engine *engine, SpotLightShadowRenderer *renderer);
+		~SpotLightShadowBatch();
+
+		/**
+		 * @return the layer assigned to shadow or -1 if the batch is full
+		 */
+		int AddShadow(SpotLightShadow *shadow);
+		void RemoveShadow(SpotLightShadow *shadow);
+		bool IsEmpty() const;
+
+		void Render(vk::CommandBuffer cmd, Renderer *renderer, const SpotLightShadowRenderer::ShadowAttachments &attachments);
+
+		/**
+		 * Add a pass rendering the batch, writing all layers of the final image.
+		 * @return the final image in graph
+		 */
+		RenderGraph::ResourceId AddPass(RenderGraph &graph, Renderer *renderer);
+
+		/**
+		 * @return the layered image that is sampled from, with one layer per shadow
+		 */
+		Image GetFinalImage();
+};
+
+}
+
+#endif //LAVOS_SPOT_LIGHT_SHADOW_BATCH_H
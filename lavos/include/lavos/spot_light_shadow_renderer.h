@@ -4,48 +4,223 @@
 
 #include "sub_renderer.h"
 #include "material_pipeline_manager.h"
+#include "render_graph.h"
+#include "image.h"
 
 #include <cstdint>
+#include <functional>
+#include <vector>
 #include <vulkan/vulkan.hpp>
 
 namespace lavos
 {
 
 class Engine;
+class Camera;
+class Renderer;
+class SpotLightShadow;
+class SpotLightShadowBatch;
+
+/**
+ * How spot light shadows are rendered and sampled.
+ */
+enum class ShadowMode
+{
+	/**
+	 * Depth-only rendering without fragment shader and colour attachment,
+	 * sampled with a comparison sampler (hardware PCF). Cheapest option, no multisampling.
+	 */
+	Depth,
+
+	/**
+	 * Moment shadow maps, rendered into an additional RGBA32F attachment that can be multisampled.
+	 */
+	MSM
+};
 
 class SpotLightShadowRenderer : public SubRenderer
 {
+	public:
+		/**
+		 * Views of all attachments of a shadow pass, null if not used by the shadow mode.
+		 * Only the final one belongs to the shadow, the others are transient images of the RenderGraph.
+		 */
+		struct ShadowAttachments
+		{
+			vk::ImageView depth_image_view;
+			vk::ImageView shadow_image_view;
+			vk::ImageView resolve_image_view;
+
+			/**
+			 * See RenderGraph::GetTransientGeneration()
+			 */
+			std::uint64_t transient_generation = 0;
+
+			bool operator==(const ShadowAttachments &other) const
+			{
+				return depth_image_view == other.depth_image_view
+					   && shadow_image_view == other.shadow_image_view
+					   && resolve_image_view == other.resolve_image_view
+					   && transient_generation == other.transient_generation;
+			}
+		};
+
+		/**
+		 * Framebuffer of a SpotLightShadow or SpotLightShadowBatch for the render pass.
+		 * BeginRendering() recreates it whenever the attachments or the extent change.
+		 */
+		struct ShadowFramebuffer
+		{
+			vk::Framebuffer framebuffer;
+			ShadowAttachments attachments;
+			vk::Extent2D extent;
+		};
+
+		using ShadowRecordFunction = std::function<void(vk::CommandBuffer, const ShadowAttachments &)>;
+
 	private:
+		ShadowMode mode;
 		std::uint32_t width;
 		std::uint32_t height;
 		vk::SampleCountFlagBits samples;
+		std::uint32_t view_count;
 		vk::Format depth_format;
 		vk::Format shadow_format;
 
+		bool adaptive_resolution = false;
+		std::uint32_t min_resolution = 128;
+		vk::DeviceSize memory_budget = 0;
+
+		/**
+		 * Number of consecutive UpdateResolutions() calls a SpotLightShadow has to request a lower
+		 * resolution before it is actually reduced, to avoid reallocating on every small camera movement.
+		 */
+		static const unsigned int downscale_delay = 30;
+
+		float depth_bias_constant = 1.25f;
+		float depth_bias_slope = 1.75f;
+
 		vk::DescriptorSetLayout descriptor_set_layout; // TODO: scope of this could be higher (common for all SpotLightShadowRenderers)
 		vk::RenderPass render_pass; // TODO: scope of this could be higher (depends only on format)
 
 		MaterialPipelineManager *material_pipeline_manager;
 
+		std::vector<SpotLightShadowBatch *> batches;
+
 		MaterialPipelineConfiguration CreateMaterialPipelineConfiguration();
 
 		void CreateRenderPass();
 		void CreateDescriptorSetLayout();
 
+		void UpdateFramebuffer(ShadowFramebuffer &framebuffer, vk::Extent2D extent, const ShadowAttachments &attachments);
+
 	public:
-		SpotLightShadowRenderer(lavos::Engine *engine, std::uint32_t width, std::uint32_t height, vk::SampleCountFlagBits samples);
+		/**
+		 * @param view_count if greater than 1, up to this many shadows are rendered into the layers of a
+		 * 			shared image in a single pass using multiview. Requires Engine::CreateInfo::enable_multiview.
+		 */
+		SpotLightShadowRenderer(lavos::Engine *engine, std::uint32_t width, std::uint32_t height, vk::SampleCountFlagBits samples,
+				std::uint32_t view_count = 1, ShadowMode mode = ShadowMode::MSM);
 		~SpotLightShadowRenderer() override;
 
+		/**
+		 * Maximum width of the shadow maps. If adaptive resolution is disabled, all shadow maps use exactly this size.
+		 */
 		std::uint32_t GetWidth() const							{ return width; }
+
+		/**
+		 * Maximum height of the shadow maps. If adaptive resolution is disabled, all shadow maps use exactly this size.
+		 */
 		std::uint32_t GetHeight() const							{ return height; }
 		vk::SampleCountFlagBits GetSamples() const 				{ return samples; }
+		ShadowMode GetShadowMode() const						{ return mode; }
+		std::uint32_t GetViewCount() const						{ return view_count; }
+		bool GetMultiviewEnabled() const						{ return view_count > 1; }
 		vk::Format GetDepthFormat() const						{ return depth_format; }
 		vk::Format GetShadowFormat() const						{ return shadow_format; }
+
+		/**
+		 * @return null with dynamic rendering
+		 */
 		vk::RenderPass GetRenderPass() const					{ return render_pass; }
 		vk::DescriptorSetLayout GetDescriptorSetLayout() const	{ return descriptor_set_layout; }
 
 		MaterialPipelineManager *GetMaterialPipelineManager() const { return material_pipeline_manager; }
 
+		/**
+		 * Default depth bias for new SpotLightShadows, only used with ShadowMode::Depth.
+		 */
+		void SetDefaultDepthBias(float constant_factor, float slope_factor)
+			{ depth_bias_constant = constant_factor; depth_bias_slope = slope_factor; }
+		float GetDefaultDepthBiasConstant() const				{ return depth_bias_constant; }
+		float GetDefaultDepthBiasSlope() const					{ return depth_bias_slope; }
+
+		/**
+		 * Enable selecting the resolution of each SpotLightShadow every frame,
+		 * based on the screen coverage of its light.
+		 * Resolutions are chosen from the pool width >> level, height >> level.
+		 * Not available with multiview, because all layers of a batch share the same size.
+		 *
+		 * @param min_resolution smallest width or height a shadow map may be reduced to
+		 * @param memory_budget maximum memory in bytes for all shadow maps of this renderer, 0 for unlimited
+		 */
+		void SetAdaptiveResolution(bool enabled, std::uint32_t min_resolution = 128, vk::DeviceSize memory_budget = 0);
+		bool GetAdaptiveResolutionEnabled() const				{ return adaptive_resolution; }
+		vk::DeviceSize GetMemoryBudget() const					{ return memory_budget; }
+
+		unsigned int GetMaxResolutionLevel() const;
+		vk::Extent2D GetResolution(unsigned int level) const	{ return vk::Extent2D(width >> level, height >> level); }
+
+		/**
+		 * @return the approximate amount of memory used by the final image of a single shadow at the given resolution level,
+		 * 			the intermediate attachments are shared by all shadows, see AddShadowPass()
+		 */
+		vk::DeviceSize GetMemoryRequirement(unsigned int level) const;
+
+		/**
+		 * Select and apply a resolution level for each of the given shadows,
+		 * based on the coverage of their light on the screen of camera.
+		 */
+		void UpdateResolutions(const std::vector<SpotLightShadow *> &shadows, Camera *camera, vk::Extent2D screen_extent);
+
+		/**
+		 * Assign shadow to a layer of a batch, creating a new batch if all existing ones are full.
+		 * Only for multiview.
+		 *
+		 * @param layer receives the layer of the returned batch used by shadow
+		 */
+		SpotLightShadowBatch *AddToBatch(SpotLightShadow *shadow, std::uint32_t *layer);
+		void RemoveFromBatch(SpotLightShadow *shadow, SpotLightShadowBatch *batch);
+
+		/**
+		 * Add a pass to graph that renders into final_image of a SpotLightShadow or SpotLightShadowBatch with record.
+		 * The depth attachment with ShadowMode::MSM and the multisampled shadow attachment are only needed during
+		 * the pass, so they are transient images of graph and share their memory with those of the other shadow passes.
+		 *
+		 * @param final_image the image that is sampled: the depth image with ShadowMode::Depth, else the shadow image
+		 * 			or its resolve image with multisampling
+		 * @return the final image in graph
+		 */
+		RenderGraph::ResourceId AddShadowPass(RenderGraph &graph, const char *name, vk::Extent2D extent,
+				const Image &final_image, vk::ImageView final_image_view, ShadowRecordFunction record);
+
+		/**
+		 * Begin render_pass with framebuffer or, with dynamic rendering, begin rendering into attachments.
+		 */
+		void BeginRendering(vk::CommandBuffer cmd, ShadowFramebuffer &framebuffer, vk::Extent2D extent,
+				const ShadowAttachments &attachments);
+		void EndRendering(vk::CommandBuffer cmd);
+
+		/**
+		 * Destroy framebuffer after all submitted frames have finished.
+		 */
+		void DestroyFramebuffer(ShadowFramebuffer &framebuffer);
+
+		/**
+		 * Add one pass for each multiview batch.
+		 */
+		void AddPasses(RenderGraph &graph, Renderer *renderer, std::vector<RenderGraph::ResourceId> &sampled) override;
+
 		void AddMaterial(Material *material) override;
 		void RemoveMaterial(Material *material) override;
 };
@@ -2,11 +2,16 @@
 #ifndef LAVOS_SUB_RENDERER_H
 #define LAVOS_SUB_RENDERER_H
 
+#include <vector>
+
+#include "render_graph.h"
+
 namespace lavos
 {
 
 class Engine;
 class Material;
+class Renderer;
 
 class SubRenderer
 {
@@ -19,6 +24,13 @@ class SubRenderer
 
 		virtual void AddMaterial(Material *material) {}
 		virtual void RemoveMaterial(Material *material) {}
+
+		/**
+		 * Add the passes of this SubRenderer to the graph of the current frame, before the main pass of renderer.
+		 *
+		 * @param sampled receives the resources that are sampled in the fragment shaders of the main pass
+		 */
+		virtual void AddPasses(RenderGraph &graph, Renderer *renderer, std::vector<RenderGraph::ResourceId> &sampled) {}
 };
 
 }
@@ -50,6 +50,7 @@ class Swapchain : public ColorRenderTarget
 		vk::Extent2D GetExtent() const override;     			//	{ return extent; } // TODO: should be desired_extent?
 		vk::Format GetFormat() const override; 					//	{ return format; }
 		std::vector<vk::ImageView> GetImageViews() const override;// 	{ return image_views; }
+		std::vector<vk::Image> GetImages() const override			{ return images; }
 };
 
 }
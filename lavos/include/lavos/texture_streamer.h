@@ -0,0 +1,170 @@
+
+#ifndef LAVOS_TEXTURE_STREAMER_H
+#define LAVOS_TEXTURE_STREAMER_H
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include "texture.h"
+#include "material/material.h"
+
+namespace lavos
+{
+
+class Engine;
+class MaterialInstance;
+class Scene;
+class Camera;
+
+/**
+ * Keeps the mip levels of textures resident on the device according to their projected size on screen,
+ * within a fixed budget of device memory.
+ *
+ * All levels of a streamed texture stay in host memory, while the device image only contains the levels from
+ * the resident one down to 1x1. The levels of at most min_resident_size texels are always resident,
+ * so every texture can be sampled immediately after it was added. Update() makes finer levels resident
+ * for visible objects and evicts the least recently used textures back to what they currently need
+ * when the budget would be exceeded.
+ */
+class TextureStreamer
+{
+	public:
+		/**
+		 * Largest dimension of the levels that are always resident.
+		 */
+		static const std::uint32_t min_resident_size = 64;
+
+		/**
+		 * Additional descriptor sets per MaterialInstance that the pools of streamed instances should have room for.
+		 * Changed levels are written to new sets with MaterialInstance::RenewDescriptorSets(), while the replaced ones
+		 * stay allocated until the frames submitted with them have finished.
+		 */
+		static const std::uint32_t renewed_descriptor_sets_count = 3;
+
+		class StreamedTexture
+		{
+			friend class TextureStreamer;
+
+			private:
+				struct User
+				{
+					MaterialInstance *material_instance;
+					Material::TextureSlot slot;
+					vk::Sampler sampler;
+				};
+
+				std::uint32_t width;
+				std::uint32_t height;
+
+				/**
+				 * Host copies of all levels in R8G8B8A8, level 0 is the full resolution.
+				 */
+				std::vector<std::vector<std::uint8_t>> levels;
+
+				/**
+				 * Image containing the levels from resident_level on, without sampler.
+				 */
+				Texture texture;
+
+				std::uint32_t resident_level;
+				std::uint32_t fallback_level;
+				std::uint32_t requested_level;
+				std::uint64_t last_used_frame = 0;
+
+				std::vector<User> users;
+
+			public:
+				const Texture &GetTexture() const				{ return texture; }
+				std::uint32_t GetLevelsCount() const			{ return static_cast<std::uint32_t>(levels.size()); }
+				std::uint32_t GetResidentLevel() const			{ return resident_level; }
+		};
+
+	private:
+		Engine * const engine;
+
+		vk::DeviceSize budget;
+		const std::uint32_t max_uploads_per_update;
+
+		std::vector<StreamedTexture *> textures;
+		std::map<MaterialInstance *, std::vector<StreamedTexture *>> instance_textures;
+
+		vk::DeviceSize resident_size = 0;
+		std::uint64_t frame = 0;
+
+		/**
+		 * Users of textures whose image was replaced during the current Update()
+		 */
+		std::set<MaterialInstance *> changed_instances;
+
+		/**
+		 * @return the size in bytes of the levels from level on
+		 */
+		static vk::DeviceSize GetLevelsSize(const StreamedTexture *texture, std::uint32_t level);
+
+		/**
+		 * Replace the image of texture by one containing the levels from level on, without waiting for the upload.
+		 * The previous image is destroyed once the submitted frames have finished, its users are marked as changed.
+		 */
+		void SetResidentLevel(StreamedTexture *texture, std::uint32_t level);
+
+		/**
+		 * Write the descriptors of all changed users, see MaterialInstance::RenewDescriptorSets().
+		 */
+		void RenewUsers();
+
+		void RequestLevel(StreamedTexture *texture, float projected_size);
+
+		/**
+		 * Evict least recently used textures until size more bytes fit into the budget.
+		 * @return false if not enough textures could be evicted
+		 */
+		bool MakeRoom(vk::DeviceSize size, StreamedTexture *keep);
+
+	public:
+		/**
+		 * @param budget device memory in bytes for all streamed levels, the always resident levels are included but never evicted
+		 * @param max_uploads_per_update number of textures whose resident levels are increased by one call to Update() at most
+		 */
+		TextureStreamer(Engine *engine, vk::DeviceSize budget, std::uint32_t max_uploads_per_update = 4);
+		~TextureStreamer();
+
+		/**
+		 * Add a texture from 8 bit pixel data, which is expanded to R8G8B8A8 and copied together with all generated mip levels.
+		 * Only the levels of at most min_resident_size texels are uploaded immediately.
+		 */
+		StreamedTexture *AddTexture(std::uint32_t width, std::uint32_t height, std::uint32_t components, const std::uint8_t *pixels);
+
+		/**
+		 * Destroy texture. Its users must not be rendered anymore.
+		 */
+		void RemoveTexture(StreamedTexture *texture);
+
+		/**
+		 * Set texture to slot of material_instance and keep it updated whenever the resident levels change.
+		 * Like MaterialInstance::SetTexture(), WriteAllData() of the instance must be called afterwards.
+		 */
+		void Bind(StreamedTexture *texture, MaterialInstance *material_instance, Material::TextureSlot slot, vk::Sampler sampler);
+
+		/**
+		 * Request levels for the textures of all visible renderables in scene and upload or evict levels accordingly.
+		 * Must be called outside of recording a frame. Nothing is waited for: the uploads are ordered before the
+		 * frames submitted afterwards, and the replaced images and descriptor sets are released once the frames
+		 * submitted before have finished.
+		 *
+		 * @param viewport_height height in pixels of the view rendered with camera
+		 */
+		void Update(Scene *scene, Camera *camera, float viewport_height);
+
+		vk::DeviceSize GetBudget() const				{ return budget; }
+		void SetBudget(vk::DeviceSize budget)			{ this->budget = budget; }
+
+		vk::DeviceSize GetResidentSize() const			{ return resident_size; }
+};
+
+}
+
+#endif //LAVOS_TEXTURE_STREAMER_H
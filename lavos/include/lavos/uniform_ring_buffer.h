@@ -0,0 +1,64 @@
+
+#ifndef LAVOS_UNIFORM_RING_BUFFER_H
+#define LAVOS_UNIFORM_RING_BUFFER_H
+
+#include <cstdint>
+
+#include <vulkan/vulkan.hpp>
+
+namespace lavos
+{
+
+class Engine;
+class Buffer;
+
+/**
+ * Persistently mapped buffer for uniform data that is rewritten every frame.
+ *
+ * The buffer is split into one region per frame in flight. Within a frame, allocations are bumped
+ * linearly through the region of that frame and addressed with dynamic offsets, so writing them never
+ * touches data the GPU may still read for another frame.
+ */
+class UniformRingBuffer
+{
+	private:
+		Engine * const engine;
+
+		const std::uint32_t frames_count;
+
+		vk::DeviceSize alignment;
+		vk::DeviceSize frame_size;
+
+		lavos::Buffer *buffer;
+		std::uint8_t *map;
+
+		vk::DeviceSize frame_begin = 0;
+		vk::DeviceSize frame_offset = 0;
+
+	public:
+		/**
+		 * @param frame_size bytes available per frame, every allocation is padded to minUniformBufferOffsetAlignment
+		 */
+		UniformRingBuffer(Engine *engine, vk::DeviceSize frame_size, std::uint32_t frames_count);
+		~UniformRingBuffer();
+
+		/**
+		 * Start allocating from the region of frame_index, discarding its previous allocations.
+		 * The GPU must have finished the last frame that used this region.
+		 */
+		void BeginFrame(std::uint32_t frame_index);
+
+		/**
+		 * @param data receives the pointer to write the allocated size bytes to
+		 * @return the offset in the buffer, to be used as dynamic offset
+		 */
+		std::uint32_t Allocate(vk::DeviceSize size, void **data);
+
+		std::uint32_t Write(const void *data, vk::DeviceSize size);
+
+		vk::Buffer GetVkBuffer() const;
+};
+
+}
+
+#endif //LAVOS_UNIFORM_RING_BUFFER_H
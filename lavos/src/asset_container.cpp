@@ -8,6 +8,7 @@
 #include <tiny_gltf.h>
 #include <iostream>
 #include <algorithm>
+#include <cstring>
 
 #include "lavos/glm_config.h"
 #include <glm/gtx/quaternion.hpp>
@@ -16,8 +17,8 @@
 
 using namespace lavos;
 
-AssetContainer::AssetContainer(Engine *engine, const RenderConfig &render_config)
-	: engine(engine), render_config(render_config)
+AssetContainer::AssetContainer(Engine *engine, const RenderConfig &render_config, TextureStreamer *texture_streamer)
+	: engine(engine), render_config(render_config), texture_streamer(texture_streamer)
 {
 }
 
@@ -32,8 +33,48 @@ AssetContainer::~AssetContainer()
 	for(auto material_instance : material_instances)
 		delete material_instance;
 
+	for(const auto &entry : textures)
+		engine->ReleaseSharedTexture(entry.first, this);
+
+	for(auto texture : streamed_textures)
+		texture_streamer->RemoveTexture(texture);
+
+	// submitted frames may still bind the sets of the material instances, which are freed after them as well
 	if(descriptor_pool)
-		engine->GetVkDevice().destroyDescriptorPool(descriptor_pool);
+	{
+		auto device = engine->GetVkDevice();
+		auto pool = descriptor_pool;
+		engine->DestroyAfter(engine->GetSubmittedValue(), [device, pool]() {
+			device.destroyDescriptorPool(pool);
+		});
+	}
+}
+
+vk::DeviceSize AssetContainer::GetMemoryUsage() const
+{
+	vk::DeviceSize usage = 0;
+
+	// shared textures are accounted for by only one of the containers holding them
+	for(const auto &entry : textures)
+	{
+		if(engine->GetSharedTextureOwner(entry.first) == this)
+			usage += engine->GetAllocationSize(entry.second.image.allocation);
+	}
+
+	for(auto texture : streamed_textures)
+		usage += engine->GetAllocationSize(texture->GetTexture().image.allocation);
+
+	auto geometry_arena = engine->GetGeometryArena();
+	for(auto mesh : meshes)
+	{
+		for(auto allocation : { mesh->vertex_allocation, mesh->index_allocation })
+		{
+			if(allocation)
+				usage += geometry_arena->GetAllocationSize(allocation);
+		}
+	}
+
+	return usage;
 }
 
 
@@ -43,28 +84,28 @@ AssetContainer::~AssetContainer()
 // ---------------------------------------
 
 
-static Image LoadImage(AssetContainer &container, tinygltf::Model &model, int index)
+static vk::Format GetImageFormat(const tinygltf::Image &gltf_image)
 {
-	auto gltf_image = model.images[index];
-
-	vk::Format format;
 	switch(gltf_image.component)
 	{
 		case 1:
-			format = vk::Format::eR8Unorm;
-			break;
+			return vk::Format::eR8Unorm;
 		case 2:
-			format = vk::Format::eR8G8Unorm;
-			break;
+			return vk::Format::eR8G8Unorm;
 		case 3:
-			format = vk::Format::eR8G8B8Unorm;
-			break;
+			return vk::Format::eR8G8B8Unorm;
 		case 4:
-			format = vk::Format::eR8G8B8A8Unorm;
-			break;
+			return vk::Format::eR8G8B8A8Unorm;
 		default:
 			throw std::runtime_error("invalid component count for image.");
 	}
+}
+
+static Image LoadImage(AssetContainer &container, tinygltf::Model &model, int index)
+{
+	const auto &gltf_image = model.images[index];
+
+	vk::Format format = GetImageFormat(gltf_image);
 
 	return Image::LoadFromPixelData(container.engine, format,
 										   static_cast<uint32_t>(gltf_image.width),
@@ -72,49 +113,169 @@ static Image LoadImage(AssetContainer &container, tinygltf::Model &model, int in
 										   gltf_image.image.data());
 }
 
-static Texture LoadTexture(AssetContainer &container, tinygltf::Model &model, int index)
+static vk::Filter GetFilterFromGLTF(int filter)
 {
-	auto gltf_texture = model.textures[index];
-
-	auto device = container.engine->GetVkDevice();
-
-	auto image = LoadImage(container, model, gltf_texture.source);
+	switch(filter)
+	{
+		case TINYGLTF_TEXTURE_FILTER_NEAREST:
+		case TINYGLTF_TEXTURE_FILTER_NEAREST_MIPMAP_NEAREST:
+		case TINYGLTF_TEXTURE_FILTER_NEAREST_MIPMAP_LINEAR:
+			return vk::Filter::eNearest;
+		default:
+			return vk::Filter::eLinear;
+	}
+}
 
-	if(image == nullptr)
-		return nullptr;
+static vk::SamplerAddressMode GetAddressModeFromGLTF(int wrap)
+{
+	switch(wrap)
+	{
+		case TINYGLTF_TEXTURE_WRAP_CLAMP_TO_EDGE:
+			return vk::SamplerAddressMode::eClampToEdge;
+		case TINYGLTF_TEXTURE_WRAP_MIRRORED_REPEAT:
+			return vk::SamplerAddressMode::eMirroredRepeat;
+		default:
+			return vk::SamplerAddressMode::eRepeat;
+	}
+}
 
+/**
+ * @param index glTF sampler index or -1 for the default sampler
+ */
+static vk::SamplerCreateInfo CreateSamplerCreateInfo(AssetContainer &container, tinygltf::Model &model, int index)
+{
+	int min_filter = TINYGLTF_TEXTURE_FILTER_LINEAR_MIPMAP_LINEAR;
+	int mag_filter = TINYGLTF_TEXTURE_FILTER_LINEAR;
+	int wrap_s = TINYGLTF_TEXTURE_WRAP_RPEAT;
+	int wrap_t = TINYGLTF_TEXTURE_WRAP_RPEAT;
 
-	auto image_view_info = vk::ImageViewCreateInfo()
-		.setImage(image.image)
-		.setViewType(vk::ImageViewType::e2D)
-		.setFormat(image.format)
-		.setSubresourceRange(vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1));
+	if(index >= 0)
+	{
+		const auto &gltf_sampler = model.samplers[index];
+		min_filter = gltf_sampler.minFilter;
+		mag_filter = gltf_sampler.magFilter;
+		wrap_s = gltf_sampler.wrapS;
+		wrap_t = gltf_sampler.wrapT;
+	}
 
-	auto image_view = device.createImageView(image_view_info);
+	bool mipmaps = min_filter != TINYGLTF_TEXTURE_FILTER_NEAREST && min_filter != TINYGLTF_TEXTURE_FILTER_LINEAR;
+	bool mipmap_nearest = min_filter == TINYGLTF_TEXTURE_FILTER_NEAREST_MIPMAP_NEAREST
+			|| min_filter == TINYGLTF_TEXTURE_FILTER_LINEAR_MIPMAP_NEAREST;
 
+	vk::Filter vk_min_filter = GetFilterFromGLTF(min_filter);
 
-	//auto gltf_sampler = model.samplers[gltf_texture.sampler];
+	// textures asking for nearest filtering should stay sharp, so no anisotropy for them
+	float max_anisotropy = 1.0f;
+	if(container.engine->GetAnisotropyEnabled() && vk_min_filter == vk::Filter::eLinear)
+	{
+		max_anisotropy = std::min(container.render_config.GetMaxAnisotropy(),
+				container.engine->GetVkPhysicalDevice().getProperties().limits.maxSamplerAnisotropy);
+	}
 
-	auto create_info = vk::SamplerCreateInfo()
-		.setMagFilter(vk::Filter::eLinear)
-		.setMinFilter(vk::Filter::eLinear)
-		.setAddressModeU(vk::SamplerAddressMode::eRepeat)
-		.setAddressModeV(vk::SamplerAddressMode::eRepeat)
+	return vk::SamplerCreateInfo()
+		.setMagFilter(GetFilterFromGLTF(mag_filter))
+		.setMinFilter(vk_min_filter)
+		.setAddressModeU(GetAddressModeFromGLTF(wrap_s))
+		.setAddressModeV(GetAddressModeFromGLTF(wrap_t))
 		.setAddressModeW(vk::SamplerAddressMode::eRepeat)
-		.setAnisotropyEnable(container.engine->GetAnisotropyEnabled() ? VK_TRUE : VK_FALSE) // TODO: make this adjustable somehow
-		.setMaxAnisotropy(16)
+		.setAnisotropyEnable(max_anisotropy > 1.0f ? VK_TRUE : VK_FALSE)
+		.setMaxAnisotropy(max_anisotropy)
 		.setBorderColor(vk::BorderColor::eIntOpaqueBlack)
 		.setUnnormalizedCoordinates(VK_FALSE)
 		.setCompareEnable(VK_FALSE)
 		.setCompareOp(vk::CompareOp::eAlways)
-		.setMipmapMode(vk::SamplerMipmapMode::eLinear)
+		.setMipmapMode(mipmap_nearest ? vk::SamplerMipmapMode::eNearest : vk::SamplerMipmapMode::eLinear)
 		.setMipLodBias(0.0f)
 		.setMinLod(0.0f)
-		.setMaxLod(0.0f);
+		.setMaxLod(mipmaps ? VK_LOD_CLAMP_NONE : 0.0f);
+}
 
-	auto sampler = device.createSampler(create_info);
+/**
+ * @return the key of the texture of a glTF image for Engine::AcquireSharedTexture(), from its size, format and a hash of its pixel data
+ */
+static Engine::SharedTextureKey GetImageKey(const tinygltf::Image &gltf_image)
+{
+	const unsigned char *data = gltf_image.image.data();
+	std::size_t size = gltf_image.image.size();
 
-	return Texture(image, image_view, sampler);
+	// FNV-1a over 64 bit words instead of bytes, as every loaded image is hashed in full
+	std::uint64_t hash = 14695981039346656037ull;
+	std::size_t i = 0;
+	for(; i + sizeof(std::uint64_t) <= size; i += sizeof(std::uint64_t))
+	{
+		std::uint64_t word;
+		memcpy(&word, data + i, sizeof(word));
+		hash ^= word;
+		hash *= 1099511628211ull;
+		hash ^= hash >> 32;
+	}
+	for(; i<size; i++)
+	{
+		hash ^= data[i];
+		hash *= 1099511628211ull;
+	}
+
+	Engine::SharedTextureKey key;
+	key.hash = hash;
+	key.width = static_cast<std::uint32_t>(gltf_image.width);
+	key.height = static_cast<std::uint32_t>(gltf_image.height);
+	key.format = GetImageFormat(gltf_image);
+	return key;
+}
+
+/**
+ * @param image_textures already loaded images by glTF image index, without sampler
+ */
+static Texture LoadTexture(AssetContainer &container, tinygltf::Model &model, std::map<int, Texture> &image_textures, int index)
+{
+	const auto &gltf_texture = model.textures[index];
+
+	Texture texture;
+
+	auto image_it = image_textures.find(gltf_texture.source);
+	if(image_it != image_textures.end())
+	{
+		texture = image_it->second;
+	}
+	else
+	{
+		// images with the same content are only loaded once, also across multiple AssetContainers
+		auto key = GetImageKey(model.images[gltf_texture.source]);
+		auto container_it = container.textures.find(key);
+		if(container_it != container.textures.end())
+		{
+			texture = container_it->second;
+		}
+		else
+		{
+			texture = container.engine->AcquireSharedTexture(key, &container, [&container, &model, &gltf_texture]() -> Texture {
+				auto image = LoadImage(container, model, gltf_texture.source);
+
+				if(image == nullptr)
+					return nullptr;
+
+				auto image_view_info = vk::ImageViewCreateInfo()
+					.setImage(image.image)
+					.setViewType(vk::ImageViewType::e2D)
+					.setFormat(image.format)
+					.setSubresourceRange(vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1));
+
+				auto image_view = container.engine->GetVkDevice().createImageView(image_view_info);
+				return Texture(image, image_view, nullptr);
+			});
+
+			if(texture.image == nullptr)
+				return nullptr;
+
+			container.textures[key] = texture;
+		}
+
+		image_textures[gltf_texture.source] = texture;
+	}
+
+	texture.sampler = container.engine->GetSampler(CreateSamplerCreateInfo(container, model, gltf_texture.sampler));
+
+	return texture;
 }
 
 
@@ -150,31 +311,83 @@ static bool GetParameter(const tinygltf::ParameterMap &params, std::string name,
 	return i == 4;
 }
 
-static Texture LoadSubParameterTexture(AssetContainer &container, tinygltf::Model &model, const tinygltf::ParameterMap &params, std::string name, std::string subname)
+/**
+ * @param streamed_images already added images by glTF image index
+ */
+static TextureStreamer::StreamedTexture *LoadStreamedTexture(AssetContainer &container, tinygltf::Model &model,
+		std::map<int, TextureStreamer::StreamedTexture *> &streamed_images, int index)
+{
+	int source = model.textures[index].source;
+
+	auto it = streamed_images.find(source);
+	if(it != streamed_images.end())
+		return it->second;
+
+	const auto &gltf_image = model.images[source];
+	auto texture = container.texture_streamer->AddTexture(static_cast<uint32_t>(gltf_image.width),
+			static_cast<uint32_t>(gltf_image.height),
+			static_cast<uint32_t>(gltf_image.component),
+			gltf_image.image.data());
+
+	streamed_images[source] = texture;
+	container.streamed_textures.push_back(texture);
+	return texture;
+}
+
+struct GLTFImages
+{
+	std::map<int, Texture> textures;
+	std::map<int, TextureStreamer::StreamedTexture *> streamed_textures;
+};
+
+static void SetSubParameterTexture(AssetContainer &container, tinygltf::Model &model, GLTFImages &images,
+		MaterialInstance *material_instance, Material::TextureSlot slot,
+		const tinygltf::ParameterMap &params, std::string name, std::string subname)
 {
 	int index;
 	if(!GetSubParameter(params, name, subname, index))
-		return nullptr;
+		return;
+
+	if(!container.texture_streamer)
+	{
+		material_instance->SetTexture(slot, LoadTexture(container, model, images.textures, index));
+		return;
+	}
 
-	return LoadTexture(container, model, index);
+	auto texture = LoadStreamedTexture(container, model, images.streamed_textures, index);
+	auto sampler = container.engine->GetSampler(CreateSamplerCreateInfo(container, model, model.textures[index].sampler));
+	container.texture_streamer->Bind(texture, material_instance, slot, sampler);
 }
 
 static void LoadMaterialInstances(AssetContainer &container, Material *material, tinygltf::Model &model)
 {
+	// images shared by multiple materials are only looked up once
+	GLTFImages images;
+
 	for(const auto &gltf_material : model.materials)
 	{
 		auto material_instance = new MaterialInstance(material, container.GetRenderConfig(), container.descriptor_pool);
 
-		material_instance->SetTexture(Material::texture_slot_base_color,
-									  LoadSubParameterTexture(container, model, gltf_material.values, "baseColorTexture", "index"));
+		SetSubParameterTexture(container, model, images, material_instance, Material::texture_slot_base_color,
+				gltf_material.values, "baseColorTexture", "index");
 
-		material_instance->SetTexture(Material::texture_slot_normal,
-									  LoadSubParameterTexture(container, model, gltf_material.additionalValues, "normalTexture", "index"));
+		SetSubParameterTexture(container, model, images, material_instance, Material::texture_slot_normal,
+				gltf_material.additionalValues, "normalTexture", "index");
 
 		glm::vec4 base_color(1.0f);
 		GetParameter(gltf_material.values, "baseColorFactor", base_color);
 		material_instance->SetParameter(Material::parameter_slot_base_color_factor, base_color);
 
+		auto alpha_mode_it = gltf_material.additionalValues.find("alphaMode");
+		if(alpha_mode_it != gltf_material.additionalValues.end() && alpha_mode_it->second.string_value == "MASK")
+		{
+			float alpha_cutoff = 0.5f;
+			auto alpha_cutoff_it = gltf_material.additionalValues.find("alphaCutoff");
+			if(alpha_cutoff_it != gltf_material.additionalValues.end() && !alpha_cutoff_it->second.number_array.empty())
+				alpha_cutoff = static_cast<float>(alpha_cutoff_it->second.number_array[0]);
+			material_instance->SetParameter(Material::parameter_slot_alpha_cutoff, alpha_cutoff);
+		}
+
 		material_instance->WriteAllData();
 		container.material_instances.push_back(material_instance);
 	}
@@ -296,6 +509,7 @@ static void LoadMeshes(AssetContainer &container, tinygltf::Model &model)
 
 
 			Mesh::Primitive primitive;
+			primitive.mesh = mesh;
 			primitive.material_instance = container.material_instances[gltf_primitive.material]; // TODO: gltf_primitive could have no material
 			primitive.indices_offset = static_cast<uint32_t>(indices_base);
 			primitive.indices_count = static_cast<uint32_t>(index_accessor.count);
@@ -406,31 +620,42 @@ static void LoadScenes(AssetContainer &container, tinygltf::Model &model)
 }
 
 
-static vk::DescriptorPool CreateDescriptorPoolForGLTF(Engine *engine, Material *material, tinygltf::Model &model)
+static vk::DescriptorPool CreateDescriptorPoolForGLTF(Engine *engine, Material *material, tinygltf::Model &model,
+		TextureStreamer *texture_streamer)
 {
-	auto sizes = material->GetDescriptorSetLayout(Material::DefaultRenderMode::ColorForward)->pool_sizes;
+	// materials using the MaterialTable have no descriptor sets per instance
+	auto layout = material->GetDescriptorSetLayout(material->GetDescriptorSetId(Material::DefaultRenderMode::ColorForward));
+	if(!layout)
+		return nullptr;
+
+	auto sizes = layout->pool_sizes;
 
 	if(sizes.empty())
 		return nullptr;
 
-	auto material_instances_count = model.materials.size();
+	// streamed textures replace the sets of their instances, see TextureStreamer::renewed_descriptor_sets_count
+	auto sets_count = model.materials.size();
+	if(texture_streamer)
+		sets_count *= 1 + TextureStreamer::renewed_descriptor_sets_count;
+
 	for(auto &size : sizes)
-		size.descriptorCount *= material_instances_count;
+		size.descriptorCount *= sets_count;
 
 	auto create_info = vk::DescriptorPoolCreateInfo()
 		.setFlags(vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet)
 		.setPoolSizeCount(static_cast<uint32_t>(sizes.size()))
 		.setPPoolSizes(sizes.data())
-		.setMaxSets(static_cast<uint32_t>(material_instances_count));
+		.setMaxSets(static_cast<uint32_t>(sets_count));
 
 	return engine->GetVkDevice().createDescriptorPool(create_info);
 }
 
 
-static AssetContainer *LoadGLTF(Engine *engine, const RenderConfig &render_config, Material *material, tinygltf::Model &model)
+static AssetContainer *LoadGLTF(Engine *engine, const RenderConfig &render_config, Material *material, tinygltf::Model &model,
+		TextureStreamer *texture_streamer)
 {
-	AssetContainer *container = new AssetContainer(engine, render_config);
-	container->descriptor_pool = CreateDescriptorPoolForGLTF(engine, material, model);
+	AssetContainer *container = new AssetContainer(engine, render_config, texture_streamer);
+	container->descriptor_pool = CreateDescriptorPoolForGLTF(engine, material, model, texture_streamer);
 
 	try
 	{
@@ -452,7 +677,8 @@ static AssetContainer *LoadGLTF(Engine *engine, const RenderConfig &render_confi
 #include <android_common.h>
 #endif
 
-AssetContainer *AssetContainer::LoadFromGLTF(Engine *engine, const RenderConfig &render_config, Material *material, std::string filename)
+AssetContainer *AssetContainer::LoadFromGLTF(Engine *engine, const RenderConfig &render_config, Material *material, std::string filename,
+		TextureStreamer *texture_streamer)
 {
 	tinygltf::TinyGLTF loader;
 	tinygltf::Model model;
@@ -473,5 +699,5 @@ AssetContainer *AssetContainer::LoadFromGLTF(Engine *engine, const RenderConfig
 	if(!success)
 		throw std::runtime_error("Failed to load glTF file.");
 
-	return LoadGLTF(engine, render_config, material, model);
+	return LoadGLTF(engine, render_config, material, model, texture_streamer);
 }
@@ -0,0 +1,10 @@
+
+#include "lavos/component/component.h"
+#include "lavos/node.h"
+
+using namespace lavos;
+
+Scene *Component::GetScene() const
+{
+	return node ? node->GetScene() : nullptr;
+}
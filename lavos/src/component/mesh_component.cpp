@@ -6,10 +6,33 @@ lavos::MeshComp::MeshComp(lavos::Mesh *mesh)
 	SetMesh(mesh);
 }
 
+bool lavos::MeshComp::GetBounds(glm::vec3 &min, glm::vec3 &max)
+{
+	if(mesh == nullptr)
+		return false;
+	min = mesh->bounds_min;
+	max = mesh->bounds_max;
+	return true;
+}
+
 void lavos::MeshComp::BindBuffers(vk::CommandBuffer command_buffer)
 {
-	command_buffer.bindVertexBuffers(0, { mesh->vertex_buffer->GetVkBuffer() }, { 0 });
-	command_buffer.bindIndexBuffer(mesh->index_buffer->GetVkBuffer(), 0, vk::IndexType::eUint16);
+	command_buffer.bindVertexBuffers(0, { mesh->GetVkVertexBuffer() }, { 0 });
+	command_buffer.bindIndexBuffer(mesh->GetVkIndexBuffer(), 0, vk::IndexType::eUint16);
+}
+
+bool lavos::MeshComp::BindPositionBuffers(vk::CommandBuffer command_buffer)
+{
+	command_buffer.bindVertexBuffers(0, { mesh->GetVkPositionBuffer() }, { 0 });
+	command_buffer.bindIndexBuffer(mesh->GetVkIndexBuffer(), 0, vk::IndexType::eUint16);
+	return true;
+}
+
+bool lavos::MeshComp::GetBufferBinding(bool position_only, BufferBinding &binding)
+{
+	binding.vertex_buffer = position_only ? mesh->GetVkPositionBuffer() : mesh->GetVkVertexBuffer();
+	binding.index_buffer = mesh->GetVkIndexBuffer();
+	return true;
 }
 
 unsigned int lavos::MeshComp::GetPrimitivesCount()
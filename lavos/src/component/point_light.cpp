@@ -0,0 +1,48 @@
+
+#include "lavos/component/point_light.h"
+#include "lavos/point_light_shadow.h"
+#include "lavos/node.h"
+#include "lavos/scene.h"
+#include "lavos/component/transform_component.h"
+
+using namespace lavos;
+
+PointLight::PointLight(glm::vec3 intensity)
+		: intensity(intensity)
+{
+}
+
+PointLight::~PointLight()
+{
+	DestroyShadow();
+}
+
+glm::vec3 PointLight::GetPositionWorld()
+{
+	auto transform_component = GetNode()->GetTransformComp();
+	if(transform_component == nullptr)
+		throw std::runtime_error("node with a point light component does not have a transform component.");
+
+	return transform_component->GetMatrixWorld() * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+}
+
+void PointLight::InitShadow(Engine *engine, PointLightShadowRenderer *renderer, float near_clip, float far_clip)
+{
+	DestroyShadow();
+	shadow = new PointLightShadow(engine, this, renderer, near_clip, far_clip);
+
+	if(auto scene = GetScene())
+		scene->GetLightCollection()->MarkChanged();
+}
+
+void PointLight::DestroyShadow()
+{
+	if(!shadow)
+		return;
+
+	delete shadow;
+	shadow = nullptr;
+
+	if(auto scene = GetScene())
+		scene->GetLightCollection()->MarkChanged();
+}
@@ -2,8 +2,12 @@
 #include "lavos/component/spot_light.h"
 #include "lavos/spot_light_shadow.h"
 #include "lavos/node.h"
+#include "lavos/scene.h"
 #include "lavos/component/transform_component.h"
 
+#include <algorithm>
+#include <cmath>
+
 using namespace lavos;
 
 SpotLight::SpotLight(glm::vec3 intensity, float angle)
@@ -16,13 +20,34 @@ SpotLight::~SpotLight()
 	DestroyShadow();
 }
 
+float SpotLight::GetEffectiveRange() const
+{
+	if(range > 0.0f)
+		return range;
+
+	float max_intensity = std::max(intensity.r, std::max(intensity.g, intensity.b));
+
+	// a light without any intensity must not end up with the unlimited range of 0
+	return std::max(std::sqrt(max_intensity / range_cutoff_intensity), 1e-3f);
+}
+
 void SpotLight::InitShadow(Engine *engine, SpotLightShadowRenderer *renderer, float near_clip, float far_clip)
 {
 	DestroyShadow();
 	shadow = new SpotLightShadow(engine, this, renderer, near_clip, far_clip);
+
+	if(auto scene = GetScene())
+		scene->GetLightCollection()->MarkChanged();
 }
 
 void SpotLight::DestroyShadow()
 {
+	if(!shadow)
+		return;
+
 	delete shadow;
+	shadow = nullptr;
+
+	if(auto scene = GetScene())
+		scene->GetLightCollection()->MarkChanged();
 }
@@ -0,0 +1,102 @@
+
+#include "lavos/culling.h"
+#include "lavos/node.h"
+#include "lavos/renderable.h"
+#include "lavos/component/transform_component.h"
+
+#include <glm/ext/vector_float4.hpp>
+#include <glm/ext/matrix_float3x3.hpp>
+#include <glm/geometric.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+using namespace lavos;
+
+bool lavos::BoxIntersectsFrustum(const glm::mat4 &model_view_projection, const glm::vec3 &min, const glm::vec3 &max)
+{
+	glm::vec4 corners[8];
+	for(int i=0; i<8; i++)
+	{
+		glm::vec3 corner((i & 1) ? max.x : min.x,
+						 (i & 2) ? max.y : min.y,
+						 (i & 4) ? max.z : min.z);
+		corners[i] = model_view_projection * glm::vec4(corner, 1.0f);
+	}
+
+	// -w <= x <= w, -w <= y <= w, 0 <= z <= w
+	int outside[6] = { 0, 0, 0, 0, 0, 0 };
+	for(const auto &c : corners)
+	{
+		outside[0] += c.x < -c.w ? 1 : 0;
+		outside[1] += c.x > c.w ? 1 : 0;
+		outside[2] += c.y < -c.w ? 1 : 0;
+		outside[3] += c.y > c.w ? 1 : 0;
+		outside[4] += c.z < 0.0f ? 1 : 0;
+		outside[5] += c.z > c.w ? 1 : 0;
+	}
+
+	for(int count : outside)
+	{
+		if(count == 8)
+			return false;
+	}
+	return true;
+}
+
+std::uint32_t lavos::CalculateViewMask(Node *node, Renderable *renderable, const glm::mat4 *view_projections, std::uint32_t view_count)
+{
+	std::uint32_t all_views = view_count >= 32 ? ~0u : (1u << view_count) - 1;
+
+	glm::vec3 min, max;
+	if(!renderable->GetBounds(min, max))
+		return all_views;
+
+	auto transform_component = node->GetTransformComp();
+	glm::mat4 transform = transform_component != nullptr ? transform_component->GetMatrixWorld() : glm::mat4(1.0f);
+
+	std::uint32_t mask = 0;
+	for(std::uint32_t i=0; i<view_count; i++)
+	{
+		if(BoxIntersectsFrustum(view_projections[i] * transform, min, max))
+			mask |= 1u << i;
+	}
+	return mask;
+}
+
+bool lavos::SphereIntersectsSpotLight(const glm::vec3 &center, float radius,
+		const glm::vec3 &light_position, const glm::vec3 &light_direction, float angle_cos, float range)
+{
+	glm::vec3 v = center - light_position;
+	float distance_sq = glm::dot(v, v);
+
+	if(range > 0.0f && distance_sq > (range + radius) * (range + radius))
+		return false;
+
+	// distance along the axis of the cone, negative behind the light
+	float axis_distance = glm::dot(v, glm::normalize(light_direction));
+	if(angle_cos >= 0.0f && axis_distance < -radius)
+		return false;
+
+	// distance from the center to the surface of the cone
+	float angle_sin = std::sqrt(std::max(1.0f - angle_cos * angle_cos, 0.0f));
+	float radial_distance = std::sqrt(std::max(distance_sq - axis_distance * axis_distance, 0.0f));
+	return angle_cos * radial_distance - angle_sin * axis_distance <= radius;
+}
+
+bool lavos::CalculateBoundingSphere(Node *node, Renderable *renderable, glm::vec3 &center, float &radius)
+{
+	glm::vec3 min, max;
+	if(!renderable->GetBounds(min, max))
+		return false;
+
+	auto transform_component = node->GetTransformComp();
+	glm::mat4 transform = transform_component != nullptr ? transform_component->GetMatrixWorld() : glm::mat4(1.0f);
+
+	float scale = std::max(glm::length(glm::vec3(transform[0])),
+			std::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+
+	center = transform * glm::vec4((min + max) * 0.5f, 1.0f);
+	radius = glm::length(max - min) * 0.5f * scale;
+	return true;
+}
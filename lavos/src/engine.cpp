@@ -2,6 +2,12 @@
 #include "lavos/engine.h"
 #include "lavos/log.h"
 #include "lavos/vk_util.h"
+#include "lavos/material/material_table.h"
+#include "lavos/material/material_parameter_arena.h"
+#include "lavos/geometry_arena.h"
+
+#include <algorithm>
+#include <limits>
 
 using namespace lavos;
 
@@ -107,6 +113,18 @@ Engine::Engine(const CreateInfo &info)
 
 Engine::~Engine()
 {
+	CleanupSubmissionTracking();
+
+	delete material_table;
+	delete material_parameter_arena;
+	delete geometry_arena;
+
+	for(const auto &entry : shared_textures)
+		DestroyTexture(entry.second.texture);
+
+	for(const auto &entry : samplers)
+		device.destroySampler(entry.second);
+
 	device.destroy(render_command_pool);
 	device.destroy(transient_command_pool);
 
@@ -131,6 +149,11 @@ std::vector<const char *> Engine::GetRequiredInstanceExtensions()
 	if(info.enable_validation_layers)
 		extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
 
+	if((info.enable_multiview || info.enable_descriptor_indexing || info.enable_memory_budget || info.enable_dynamic_rendering
+			|| info.enable_timeline_semaphore)
+		&& info.required_instance_extensions.find(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME) == info.required_instance_extensions.end())
+		extensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+
 	return extensions;
 }
 
@@ -141,6 +164,40 @@ std::vector<const char *> Engine::GetRequiredDeviceExtensions()
 	for(const auto &extension : info.required_device_extensions)
 		extensions.push_back(extension.c_str());
 
+	if(info.enable_multiview
+		&& info.required_device_extensions.find(VK_KHR_MULTIVIEW_EXTENSION_NAME) == info.required_device_extensions.end())
+		extensions.push_back(VK_KHR_MULTIVIEW_EXTENSION_NAME);
+
+	if(info.enable_descriptor_indexing)
+	{
+		for(const char *extension : { VK_KHR_MAINTENANCE3_EXTENSION_NAME, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME })
+		{
+			if(info.required_device_extensions.find(extension) == info.required_device_extensions.end())
+				extensions.push_back(extension);
+		}
+	}
+
+	if(info.enable_memory_budget
+		&& info.required_device_extensions.find(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == info.required_device_extensions.end())
+		extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
+	if(info.enable_dynamic_rendering)
+	{
+		// with all extensions VK_KHR_dynamic_rendering depends on
+		for(const char *extension : { VK_KHR_MULTIVIEW_EXTENSION_NAME, VK_KHR_MAINTENANCE2_EXTENSION_NAME,
+				VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME, VK_KHR_DEPTH_STENCIL_RESOLVE_EXTENSION_NAME,
+				VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME })
+		{
+			if(info.required_device_extensions.find(extension) == info.required_device_extensions.end()
+				&& std::find_if(extensions.begin(), extensions.end(), [extension](const char *e) { return strcmp(e, extension) == 0; }) == extensions.end())
+				extensions.push_back(extension);
+		}
+	}
+
+	if(info.enable_timeline_semaphore
+		&& info.required_device_extensions.find(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME) == info.required_device_extensions.end())
+		extensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+
 	return extensions;
 }
 
@@ -281,7 +338,13 @@ void Engine::InitializeForSurface(vk::SurfaceKHR surface)
 	PickPhysicalDevice(surface);
 	CreateLogicalDevice();
 	CreateAllocator();
+	LoadDeviceFunctions();
+	DetectLazilyAllocatedMemory();
 	CreateGlobalCommandPools();
+	CreateSubmissionTracking();
+	CreateMaterialTable();
+	CreateMaterialParameterArena();
+	CreateGeometryArena();
 }
 
 void Engine::InitializeWithPhysicalDevice(vk::PhysicalDevice physical_device)
@@ -289,7 +352,13 @@ void Engine::InitializeWithPhysicalDevice(vk::PhysicalDevice physical_device)
 	this->physical_device = physical_device;
 	CreateLogicalDevice();
 	CreateAllocator();
+	LoadDeviceFunctions();
+	DetectLazilyAllocatedMemory();
 	CreateGlobalCommandPools();
+	CreateSubmissionTracking();
+	CreateMaterialTable();
+	CreateMaterialParameterArena();
+	CreateGeometryArena();
 }
 
 void Engine::InitializeWithPhysicalDeviceIndex(unsigned int index)
@@ -307,7 +376,13 @@ void Engine::InitializeWithDevice(vk::PhysicalDevice physical_device, vk::Device
 	queue_family_indices = FindQueueFamilies(physical_device);
 
 	CreateAllocator();
+	LoadDeviceFunctions();
+	DetectLazilyAllocatedMemory();
 	CreateGlobalCommandPools();
+	CreateSubmissionTracking();
+	CreateMaterialTable();
+	CreateMaterialParameterArena();
+	CreateGeometryArena();
 }
 
 bool Engine::IsPhysicalDeviceSuitable(vk::PhysicalDevice physical_device, vk::SurfaceKHR surface)
@@ -319,11 +394,23 @@ bool Engine::IsPhysicalDeviceSuitable(vk::PhysicalDevice physical_device, vk::Su
 	if(info.enable_anisotropy && !features.samplerAnisotropy)
 		return false;
 
+	if(info.enable_pipeline_statistics && !features.pipelineStatisticsQuery)
+		return false;
+
 	// extensions
 
 	if(!CheckDeviceExtensionSupport(physical_device))
 		return false;
 
+	if(info.enable_descriptor_indexing && !GetDescriptorIndexingSupport(physical_device))
+		return false;
+
+	if(info.enable_dynamic_rendering && !GetDynamicRenderingSupport(physical_device))
+		return false;
+
+	if(info.enable_timeline_semaphore && !GetTimelineSemaphoreSupport(physical_device))
+		return false;
+
 
 	// surface
 
@@ -385,6 +472,65 @@ Engine::QueueFamilyIndices Engine::FindQueueFamilies(vk::PhysicalDevice physical
 	return indices;
 }
 
+bool Engine::GetDescriptorIndexingSupport(vk::PhysicalDevice physical_device, vk::PhysicalDeviceDescriptorIndexingPropertiesEXT *properties)
+{
+	auto get_features_2 = (PFN_vkGetPhysicalDeviceFeatures2KHR) vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceFeatures2KHR");
+	auto get_properties_2 = (PFN_vkGetPhysicalDeviceProperties2KHR) vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceProperties2KHR");
+	if(!get_features_2 || !get_properties_2)
+		return false;
+
+	// stays all false if the extension is not available
+	vk::PhysicalDeviceDescriptorIndexingFeaturesEXT descriptor_indexing_features;
+	vk::PhysicalDeviceFeatures2 features_2;
+	features_2.setPNext(&descriptor_indexing_features);
+	get_features_2(physical_device, reinterpret_cast<VkPhysicalDeviceFeatures2 *>(&features_2));
+
+	if(!descriptor_indexing_features.runtimeDescriptorArray
+		|| !descriptor_indexing_features.descriptorBindingPartiallyBound
+		|| !descriptor_indexing_features.descriptorBindingSampledImageUpdateAfterBind
+		|| !descriptor_indexing_features.descriptorBindingUpdateUnusedWhilePending)
+		return false;
+
+	if(properties)
+	{
+		vk::PhysicalDeviceProperties2 properties_2;
+		properties_2.setPNext(properties);
+		get_properties_2(physical_device, reinterpret_cast<VkPhysicalDeviceProperties2 *>(&properties_2));
+	}
+
+	return true;
+}
+
+bool Engine::GetDynamicRenderingSupport(vk::PhysicalDevice physical_device)
+{
+	auto get_features_2 = (PFN_vkGetPhysicalDeviceFeatures2KHR) vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceFeatures2KHR");
+	if(!get_features_2)
+		return false;
+
+	// stays false if the extension is not available
+	vk::PhysicalDeviceDynamicRenderingFeaturesKHR dynamic_rendering_features;
+	vk::PhysicalDeviceFeatures2 features_2;
+	features_2.setPNext(&dynamic_rendering_features);
+	get_features_2(physical_device, reinterpret_cast<VkPhysicalDeviceFeatures2 *>(&features_2));
+
+	return dynamic_rendering_features.dynamicRendering == VK_TRUE;
+}
+
+bool Engine::GetTimelineSemaphoreSupport(vk::PhysicalDevice physical_device)
+{
+	auto get_features_2 = (PFN_vkGetPhysicalDeviceFeatures2KHR) vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceFeatures2KHR");
+	if(!get_features_2)
+		return false;
+
+	// stays false if the extension is not available
+	vk::PhysicalDeviceTimelineSemaphoreFeaturesKHR timeline_semaphore_features;
+	vk::PhysicalDeviceFeatures2 features_2;
+	features_2.setPNext(&timeline_semaphore_features);
+	get_features_2(physical_device, reinterpret_cast<VkPhysicalDeviceFeatures2 *>(&features_2));
+
+	return timeline_semaphore_features.timelineSemaphore == VK_TRUE;
+}
+
 int Engine::FindPresentQueueFamily(vk::SurfaceKHR surface)
 {
 	auto queue_families = physical_device.getQueueFamilyProperties();
@@ -401,6 +547,33 @@ int Engine::FindPresentQueueFamily(vk::SurfaceKHR surface)
 }
 
 
+void Engine::CreateMaterialTable()
+{
+	if(!info.enable_descriptor_indexing)
+		return;
+
+	vk::PhysicalDeviceDescriptorIndexingPropertiesEXT properties;
+	if(!GetDescriptorIndexingSupport(physical_device, &properties))
+		throw std::runtime_error("Descriptor indexing enabled, but not supported by the device.");
+
+	std::uint32_t texture_capacity = std::min({ info.material_table_texture_capacity,
+			properties.maxPerStageDescriptorUpdateAfterBindSamplers,
+			properties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+			properties.maxDescriptorSetUpdateAfterBindSampledImages });
+
+	material_table = new MaterialTable(this, texture_capacity, info.material_table_block_capacity);
+}
+
+void Engine::CreateMaterialParameterArena()
+{
+	material_parameter_arena = new MaterialParameterArena(this);
+}
+
+void Engine::CreateGeometryArena()
+{
+	geometry_arena = new GeometryArena(this, info.geometry_mesh_vertices_capacity, info.geometry_mesh_indices_capacity);
+}
+
 void Engine::CreateLogicalDevice()
 {
 	queue_family_indices = FindQueueFamilies(physical_device);
@@ -421,7 +594,46 @@ void Engine::CreateLogicalDevice()
 	}
 
 	auto features = vk::PhysicalDeviceFeatures()
-		.setSamplerAnisotropy(info.enable_anisotropy ? VK_TRUE : VK_FALSE);
+		.setSamplerAnisotropy(info.enable_anisotropy ? VK_TRUE : VK_FALSE)
+		.setPipelineStatisticsQuery(info.enable_pipeline_statistics ? VK_TRUE : VK_FALSE);
+
+	auto multiview_features = vk::PhysicalDeviceMultiviewFeatures()
+		.setMultiview(VK_TRUE);
+
+	// see GetDescriptorIndexingSupport()
+	auto descriptor_indexing_features = vk::PhysicalDeviceDescriptorIndexingFeaturesEXT()
+		.setRuntimeDescriptorArray(VK_TRUE)
+		.setDescriptorBindingPartiallyBound(VK_TRUE)
+		.setDescriptorBindingSampledImageUpdateAfterBind(VK_TRUE)
+		.setDescriptorBindingUpdateUnusedWhilePending(VK_TRUE);
+
+	auto dynamic_rendering_features = vk::PhysicalDeviceDynamicRenderingFeaturesKHR()
+		.setDynamicRendering(VK_TRUE);
+
+	auto timeline_semaphore_features = vk::PhysicalDeviceTimelineSemaphoreFeaturesKHR()
+		.setTimelineSemaphore(VK_TRUE);
+
+	void *features_next = nullptr;
+	if(info.enable_multiview)
+	{
+		multiview_features.setPNext(features_next);
+		features_next = &multiview_features;
+	}
+	if(info.enable_descriptor_indexing)
+	{
+		descriptor_indexing_features.setPNext(features_next);
+		features_next = &descriptor_indexing_features;
+	}
+	if(info.enable_dynamic_rendering)
+	{
+		dynamic_rendering_features.setPNext(features_next);
+		features_next = &dynamic_rendering_features;
+	}
+	if(info.enable_timeline_semaphore)
+	{
+		timeline_semaphore_features.setPNext(features_next);
+		features_next = &timeline_semaphore_features;
+	}
 
 
 	std::vector<const char *> device_extensions = GetRequiredDeviceExtensions();
@@ -433,6 +645,8 @@ void Engine::CreateLogicalDevice()
 			.setEnabledExtensionCount(static_cast<uint32_t>(device_extensions.size()))
 			.setPpEnabledExtensionNames(device_extensions.data());
 
+	create_info.setPNext(features_next);
+
 	if(info.enable_validation_layers)
 	{
 		create_info
@@ -455,11 +669,37 @@ void Engine::CreateAllocator()
 	VmaAllocatorCreateInfo create_info = {};
 	create_info.physicalDevice = physical_device;
 	create_info.device = device;
+	create_info.instance = instance;
+
+	if(info.enable_memory_budget)
+		create_info.flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
 
 	VkResult result = vmaCreateAllocator(&create_info, &allocator);
 
 	if(result != VK_SUCCESS)
 		throw std::runtime_error("failed to create allocator.");
+
+	heaps_over_budget.assign(physical_device.getMemoryProperties().memoryHeapCount, false);
+}
+
+
+void Engine::DetectLazilyAllocatedMemory()
+{
+	auto memory_properties = physical_device.getMemoryProperties();
+
+	lazily_allocated_memory_available = false;
+	for(uint32_t i=0; i<memory_properties.memoryTypeCount; i++)
+	{
+		if(memory_properties.memoryTypes[i].propertyFlags & vk::MemoryPropertyFlagBits::eLazilyAllocated)
+		{
+			lazily_allocated_memory_available = true;
+			break;
+		}
+	}
+
+	LAVOS_LOGF(LogLevel::Debug, "Lazily allocated memory %s, transient attachments will %sbe allocated lazily.",
+			lazily_allocated_memory_available ? "available" : "not available",
+			lazily_allocated_memory_available ? "" : "not ");
 }
 
 
@@ -476,6 +716,190 @@ void Engine::CreateGlobalCommandPools()
 					.setQueueFamilyIndex(static_cast<uint32_t>(queue_family_indices.graphics_family)));
 }
 
+void Engine::CreateSubmissionTracking()
+{
+	if(!info.enable_timeline_semaphore)
+		return;
+
+	auto type_create_info = vk::SemaphoreTypeCreateInfoKHR()
+			.setSemaphoreType(vk::SemaphoreType::eTimeline)
+			.setInitialValue(0);
+
+	timeline_semaphore = device.createSemaphore(vk::SemaphoreCreateInfo().setPNext(&type_create_info));
+	vk_util::SetDebugUtilsObjectName(device, timeline_semaphore, "Engine Timeline");
+}
+
+void Engine::CleanupSubmissionTracking()
+{
+	WaitForValue(submitted_value);
+
+	// never submitted, so nothing can use their resources anymore
+	for(auto &pending : pending_destructions)
+		pending.second();
+	pending_destructions.clear();
+
+	RunDeferredDestructions();
+
+	for(auto &fence : free_fences)
+		device.destroyFence(fence);
+	free_fences.clear();
+
+	device.destroySemaphore(timeline_semaphore);
+	timeline_semaphore = nullptr;
+}
+
+std::uint64_t Engine::Submit(vk::CommandBuffer command_buffer,
+		const std::vector<vk::Semaphore> &wait_semaphores,
+		const std::vector<vk::PipelineStageFlags> &wait_stages,
+		const std::vector<vk::Semaphore> &signal_semaphores)
+{
+	std::uint64_t value = submitted_value + 1;
+
+	auto submit_info = vk::SubmitInfo()
+			.setWaitSemaphoreCount(static_cast<uint32_t>(wait_semaphores.size()))
+			.setPWaitSemaphores(wait_semaphores.data())
+			.setPWaitDstStageMask(wait_stages.data())
+			.setCommandBufferCount(1)
+			.setPCommandBuffers(&command_buffer);
+
+	// values for binary semaphores are ignored, but the arrays must match the semaphores
+	std::vector<vk::Semaphore> all_signal_semaphores = signal_semaphores;
+	std::vector<std::uint64_t> wait_values(wait_semaphores.size(), 0);
+	std::vector<std::uint64_t> signal_values(signal_semaphores.size(), 0);
+	vk::TimelineSemaphoreSubmitInfoKHR timeline_submit_info;
+
+	vk::Fence fence;
+
+	if(timeline_semaphore)
+	{
+		all_signal_semaphores.push_back(timeline_semaphore);
+		signal_values.push_back(value);
+
+		timeline_submit_info
+				.setWaitSemaphoreValueCount(static_cast<uint32_t>(wait_values.size()))
+				.setPWaitSemaphoreValues(wait_values.data())
+				.setSignalSemaphoreValueCount(static_cast<uint32_t>(signal_values.size()))
+				.setPSignalSemaphoreValues(signal_values.data());
+
+		submit_info.setPNext(&timeline_submit_info);
+	}
+	else
+	{
+		if(free_fences.empty())
+		{
+			fence = device.createFence(vk::FenceCreateInfo());
+		}
+		else
+		{
+			fence = free_fences.back();
+			free_fences.pop_back();
+			device.resetFences(fence);
+		}
+	}
+
+	submit_info
+			.setSignalSemaphoreCount(static_cast<uint32_t>(all_signal_semaphores.size()))
+			.setPSignalSemaphores(all_signal_semaphores.data());
+
+	graphics_queue.submit(submit_info, fence);
+
+	submitted_value = value;
+	if(fence)
+		submission_fences.emplace_back(value, fence);
+
+	// destructions waiting for this command buffer now know their value
+	pending_destructions.erase(std::remove_if(pending_destructions.begin(), pending_destructions.end(),
+			[this, command_buffer, value](std::pair<vk::CommandBuffer, std::function<void()>> &pending) {
+		if(pending.first != command_buffer)
+			return false;
+		deferred_destructions.push_back({ value, std::move(pending.second) });
+		return true;
+	}), pending_destructions.end());
+
+	RunDeferredDestructions();
+
+	return value;
+}
+
+std::uint64_t Engine::GetCompletedValue()
+{
+	if(timeline_semaphore)
+	{
+		std::uint64_t value;
+		if(get_semaphore_counter_value(device, timeline_semaphore, &value) != VK_SUCCESS)
+			throw std::runtime_error("failed to get timeline semaphore value.");
+		completed_value = value;
+		return completed_value;
+	}
+
+	// fences finish in submission order
+	while(!submission_fences.empty() && device.getFenceStatus(submission_fences.front().second) == vk::Result::eSuccess)
+	{
+		completed_value = submission_fences.front().first;
+		free_fences.push_back(submission_fences.front().second);
+		submission_fences.pop_front();
+	}
+
+	return completed_value;
+}
+
+void Engine::WaitForValue(std::uint64_t value)
+{
+	if(value <= completed_value)
+		return;
+
+	if(timeline_semaphore)
+	{
+		auto wait_info = vk::SemaphoreWaitInfoKHR()
+				.setSemaphoreCount(1)
+				.setPSemaphores(&timeline_semaphore)
+				.setPValues(&value);
+
+		if(wait_semaphores(device, reinterpret_cast<const VkSemaphoreWaitInfoKHR *>(&wait_info), std::numeric_limits<std::uint64_t>::max()) != VK_SUCCESS)
+			throw std::runtime_error("failed to wait for timeline semaphore.");
+	}
+	else
+	{
+		auto it = std::find_if(submission_fences.begin(), submission_fences.end(),
+				[value](const std::pair<std::uint64_t, vk::Fence> &f) { return f.first >= value; });
+		if(it != submission_fences.end())
+			device.waitForFences(it->second, VK_TRUE, std::numeric_limits<std::uint64_t>::max());
+	}
+
+	GetCompletedValue();
+}
+
+void Engine::DestroyAfter(std::uint64_t value, std::function<void()> destroy)
+{
+	deferred_destructions.push_back({ value, std::move(destroy) });
+}
+
+void Engine::DestroyAfterSubmission(vk::CommandBuffer command_buffer, std::function<void()> destroy)
+{
+	pending_destructions.emplace_back(command_buffer, std::move(destroy));
+}
+
+void Engine::RunDeferredDestructions()
+{
+	if(deferred_destructions.empty())
+		return;
+
+	std::uint64_t completed = GetCompletedValue();
+
+	// destroy may defer further destructions, so collect the finished ones first
+	std::vector<std::function<void()>> finished;
+	deferred_destructions.erase(std::remove_if(deferred_destructions.begin(), deferred_destructions.end(),
+			[completed, &finished](DeferredDestruction &destruction) {
+		if(destruction.value > completed)
+			return false;
+		finished.push_back(std::move(destruction.destroy));
+		return true;
+	}), deferred_destructions.end());
+
+	for(auto &destroy : finished)
+		destroy();
+}
+
 vk::CommandBuffer Engine::BeginSingleTimeCommandBuffer()
 {
 	auto allocate_info = vk::CommandBufferAllocateInfo()
@@ -490,18 +914,23 @@ vk::CommandBuffer Engine::BeginSingleTimeCommandBuffer()
 	return command_buffer;
 }
 
-void Engine::EndSingleTimeCommandBuffer(vk::CommandBuffer command_buffer)
+std::uint64_t Engine::SubmitSingleTimeCommandBuffer(vk::CommandBuffer command_buffer)
 {
 	command_buffer.end();
 
-	auto submit_info = vk::SubmitInfo()
-			.setCommandBufferCount(1)
-			.setPCommandBuffers(&command_buffer);
+	std::uint64_t value = Submit(command_buffer);
+	DestroyAfter(value, [this, command_buffer]() {
+		device.freeCommandBuffers(transient_command_pool, command_buffer);
+	});
 
-	graphics_queue.submit(submit_info, nullptr);
-	graphics_queue.waitIdle(); // TODO: use fence maybe?
+	return value;
+}
 
-	device.freeCommandBuffers(transient_command_pool, command_buffer);
+void Engine::EndSingleTimeCommandBuffer(vk::CommandBuffer command_buffer)
+{
+	std::uint64_t value = SubmitSingleTimeCommandBuffer(command_buffer);
+	WaitForValue(value);
+	RunDeferredDestructions();
 }
 
 uint32_t Engine::FindMemoryType(uint32_t type_filter, vk::MemoryPropertyFlags properties)
@@ -546,7 +975,8 @@ bool Engine::HasStencilComponent(vk::Format format)
 	return format == vk::Format::eD32SfloatS8Uint || format == vk::Format::eD24UnormS8Uint;
 }
 
-Buffer *Engine::CreateBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage, VmaMemoryUsage vma_usage, vk::SharingMode sharing_mode)
+Buffer *Engine::CreateBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage, VmaMemoryUsage vma_usage,
+		MemoryCategory category, vk::SharingMode sharing_mode)
 {
 	auto create_info = vk::BufferCreateInfo()
 			.setSize(size)
@@ -558,44 +988,291 @@ Buffer *Engine::CreateBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage, Vm
 
 	VkBuffer buffer;
 	VmaAllocation allocation;
-	VkResult result = vmaCreateBuffer(allocator, reinterpret_cast<const VkBufferCreateInfo *>(&create_info), &alloc_info, &buffer, &allocation, nullptr);
+	VmaAllocationInfo allocation_info;
+	VkResult result = vmaCreateBuffer(allocator, reinterpret_cast<const VkBufferCreateInfo *>(&create_info), &alloc_info, &buffer, &allocation, &allocation_info);
 
 	if(result != VK_SUCCESS)
 		throw std::runtime_error("Failed to create buffer.");
 
+	TrackAllocation(allocation, allocation_info, category);
+
 	return new Buffer(this, buffer, allocation);
 }
 
 void Engine::DestroyBuffer(vk::Buffer buffer, VmaAllocation allocation)
 {
+	UntrackAllocation(allocation);
 	vmaDestroyBuffer(allocator, buffer, allocation);
 }
 
-Image Engine::CreateImage(vk::ImageCreateInfo create_info, VmaMemoryUsage vma_usage)
+Image Engine::CreateImage(vk::ImageCreateInfo create_info, VmaMemoryUsage vma_usage, MemoryCategory category)
 {
+	bool lazy = lazily_allocated_memory_available
+			&& vma_usage == VMA_MEMORY_USAGE_GPU_ONLY
+			&& (create_info.usage & vk::ImageUsageFlagBits::eTransientAttachment);
+
 	VmaAllocationCreateInfo alloc_info = {};
-	alloc_info.usage = vma_usage;
+	alloc_info.usage = lazy ? VMA_MEMORY_USAGE_GPU_LAZILY_ALLOCATED : vma_usage;
 
 	VkImage image;
 	VmaAllocation allocation;
-	VkResult result = vmaCreateImage(allocator, reinterpret_cast<const VkImageCreateInfo *>(&create_info), &alloc_info, &image, &allocation, nullptr);
+	VmaAllocationInfo allocation_info;
+	VkResult result = vmaCreateImage(allocator, reinterpret_cast<const VkImageCreateInfo *>(&create_info), &alloc_info, &image, &allocation, &allocation_info);
 
 	if(result != VK_SUCCESS)
 		throw std::runtime_error("Failed to create image.");
 
+	if(lazy)
+	{
+		lazily_allocated_images[allocation] = allocation_info.size;
+		lazily_allocated_size += allocation_info.size;
+		LAVOS_LOGF(LogLevel::Debug, "Transient attachment of %llu bytes uses lazily allocated memory, %llu bytes in total.",
+				static_cast<unsigned long long>(allocation_info.size),
+				static_cast<unsigned long long>(lazily_allocated_size));
+	}
+
+	TrackAllocation(allocation, allocation_info, category);
+
 	return Image(image, allocation, create_info.format);
 }
 
 void Engine::DestroyImage(const Image &image)
 {
+	auto it = lazily_allocated_images.find(image.allocation);
+	if(it != lazily_allocated_images.end())
+	{
+		lazily_allocated_size -= it->second;
+		lazily_allocated_images.erase(it);
+	}
+
+	UntrackAllocation(image.allocation);
 	vmaDestroyImage(allocator, image.image, image.allocation);
 }
 
+void Engine::LoadDeviceFunctions()
+{
+	if(info.enable_dynamic_rendering)
+	{
+		cmd_begin_rendering = (PFN_vkCmdBeginRenderingKHR) vkGetDeviceProcAddr(device, "vkCmdBeginRenderingKHR");
+		cmd_end_rendering = (PFN_vkCmdEndRenderingKHR) vkGetDeviceProcAddr(device, "vkCmdEndRenderingKHR");
+		if(!cmd_begin_rendering || !cmd_end_rendering)
+			throw std::runtime_error("Dynamic rendering enabled, but vkCmdBeginRenderingKHR is not available.");
+	}
+
+	if(info.enable_timeline_semaphore)
+	{
+		get_semaphore_counter_value = (PFN_vkGetSemaphoreCounterValueKHR) vkGetDeviceProcAddr(device, "vkGetSemaphoreCounterValueKHR");
+		wait_semaphores = (PFN_vkWaitSemaphoresKHR) vkGetDeviceProcAddr(device, "vkWaitSemaphoresKHR");
+		if(!get_semaphore_counter_value || !wait_semaphores)
+			throw std::runtime_error("Timeline semaphore enabled, but vkWaitSemaphoresKHR is not available.");
+	}
+}
+
+void Engine::CmdBeginRendering(vk::CommandBuffer command_buffer, const vk::RenderingInfoKHR &rendering_info)
+{
+	cmd_begin_rendering(command_buffer, reinterpret_cast<const VkRenderingInfoKHR *>(&rendering_info));
+}
+
+void Engine::CmdEndRendering(vk::CommandBuffer command_buffer)
+{
+	cmd_end_rendering(command_buffer);
+}
+
+VmaAllocation Engine::AllocateMemory(const vk::MemoryRequirements &requirements, VmaMemoryUsage vma_usage, MemoryCategory category)
+{
+	VmaAllocationCreateInfo alloc_info = {};
+	alloc_info.usage = vma_usage;
+
+	VmaAllocation allocation;
+	VmaAllocationInfo allocation_info;
+	VkResult result = vmaAllocateMemory(allocator, reinterpret_cast<const VkMemoryRequirements *>(&requirements), &alloc_info, &allocation, &allocation_info);
+
+	if(result != VK_SUCCESS)
+		throw std::runtime_error("Failed to allocate memory.");
+
+	TrackAllocation(allocation, allocation_info, category);
+
+	return allocation;
+}
+
+void Engine::FreeMemory(VmaAllocation allocation)
+{
+	UntrackAllocation(allocation);
+	vmaFreeMemory(allocator, allocation);
+}
+
+void Engine::TrackAllocation(VmaAllocation allocation, const VmaAllocationInfo &allocation_info, MemoryCategory category)
+{
+	allocation_records[allocation] = { category, allocation_info.size };
+	category_usage[static_cast<std::size_t>(category)] += allocation_info.size;
+
+	CheckMemoryBudget(physical_device.getMemoryProperties().memoryTypes[allocation_info.memoryType].heapIndex);
+}
+
+void Engine::UntrackAllocation(VmaAllocation allocation)
+{
+	auto it = allocation_records.find(allocation);
+	if(it == allocation_records.end())
+		return;
+
+	category_usage[static_cast<std::size_t>(it->second.category)] -= it->second.size;
+	allocation_records.erase(it);
+}
+
+void Engine::CheckMemoryBudget(std::uint32_t heap_index)
+{
+	auto budgets = GetMemoryBudgets();
+	const auto &budget = budgets[heap_index];
+
+	bool over = static_cast<double>(budget.usage) > static_cast<double>(budget.budget) * info.memory_budget_warning_fraction;
+	if(over == heaps_over_budget[heap_index])
+		return;
+
+	heaps_over_budget[heap_index] = over;
+	if(!over)
+		return;
+
+	LAVOS_LOGF(LogLevel::Warning, "Memory heap %u is close to its budget, %llu of %llu bytes used.",
+			heap_index,
+			static_cast<unsigned long long>(budget.usage),
+			static_cast<unsigned long long>(budget.budget));
+
+	if(memory_budget_callback)
+		memory_budget_callback(heap_index, budget);
+}
+
+vk::DeviceSize Engine::GetAllocationSize(VmaAllocation allocation) const
+{
+	auto it = allocation_records.find(allocation);
+	return it == allocation_records.end() ? 0 : it->second.size;
+}
+
+std::vector<Engine::HeapBudget> Engine::GetMemoryBudgets()
+{
+	std::array<VmaBudget, VK_MAX_MEMORY_HEAPS> vma_budgets;
+	vmaGetBudget(allocator, vma_budgets.data());
+
+	std::vector<HeapBudget> budgets(physical_device.getMemoryProperties().memoryHeapCount);
+	for(std::size_t i=0; i<budgets.size(); i++)
+		budgets[i] = { vma_budgets[i].usage, vma_budgets[i].budget };
+	return budgets;
+}
+
+const char *Engine::GetMemoryCategoryName(MemoryCategory category)
+{
+	switch(category)
+	{
+		case MemoryCategory::Other:
+			return "Other";
+		case MemoryCategory::Meshes:
+			return "Meshes";
+		case MemoryCategory::Textures:
+			return "Textures";
+		case MemoryCategory::Shadows:
+			return "Shadows";
+		case MemoryCategory::RenderTargets:
+			return "RenderTargets";
+		case MemoryCategory::Staging:
+			return "Staging";
+		case MemoryCategory::Uniforms:
+			return "Uniforms";
+		default:
+			return "Unknown";
+	}
+}
+
+void Engine::LogMemoryUsage()
+{
+	for(std::size_t i=0; i<category_usage.size(); i++)
+	{
+		LAVOS_LOGF(LogLevel::Info, "%s: %llu bytes",
+				GetMemoryCategoryName(static_cast<MemoryCategory>(i)),
+				static_cast<unsigned long long>(category_usage[i]));
+	}
+
+	auto budgets = GetMemoryBudgets();
+	for(std::size_t i=0; i<budgets.size(); i++)
+	{
+		LAVOS_LOGF(LogLevel::Info, "Heap %u: %llu of %llu bytes",
+				static_cast<unsigned int>(i),
+				static_cast<unsigned long long>(budgets[i].usage),
+				static_cast<unsigned long long>(budgets[i].budget));
+	}
+}
+
 void Engine::DestroyTexture(const Texture &texture)
 {
 	DestroyImage(texture.image);
 	device.destroyImageView(texture.image_view);
-	device.destroySampler(texture.sampler);
+
+	auto cached = std::find_if(samplers.begin(), samplers.end(), [&texture](const std::pair<vk::SamplerCreateInfo, vk::Sampler> &entry) {
+		return entry.second == texture.sampler;
+	});
+	if(cached == samplers.end())
+		device.destroySampler(texture.sampler);
+}
+
+vk::Sampler Engine::GetSampler(const vk::SamplerCreateInfo &create_info)
+{
+	assert(create_info.pNext == nullptr);
+
+	for(const auto &entry : samplers)
+	{
+		if(entry.first == create_info)
+			return entry.second;
+	}
+
+	auto sampler = device.createSampler(create_info);
+	samplers.emplace_back(create_info, sampler);
+	return sampler;
+}
+
+Texture Engine::AcquireSharedTexture(const SharedTextureKey &key, const void *holder, const std::function<Texture()> &create)
+{
+	auto it = shared_textures.find(key);
+	if(it != shared_textures.end())
+	{
+		it->second.holders.push_back(holder);
+		return it->second.texture;
+	}
+
+	Texture texture = create();
+	if(texture.image == nullptr)
+		return nullptr;
+
+	shared_textures[key] = { texture, { holder } };
+	return texture;
+}
+
+void Engine::ReleaseSharedTexture(const SharedTextureKey &key, const void *holder)
+{
+	auto it = shared_textures.find(key);
+	if(it == shared_textures.end())
+		throw std::runtime_error("releasing a shared texture that was not acquired.");
+
+	auto &holders = it->second.holders;
+	auto holder_it = std::find(holders.begin(), holders.end(), holder);
+	if(holder_it == holders.end())
+		throw std::runtime_error("releasing a shared texture that was not acquired by this holder.");
+
+	holders.erase(holder_it);
+	if(!holders.empty())
+		return;
+
+	// may still be sampled by a previous frame
+	Texture texture = it->second.texture;
+	shared_textures.erase(it);
+	DestroyAfter(GetSubmittedValue(), [this, texture]() {
+		DestroyTexture(texture);
+	});
+}
+
+const void *Engine::GetSharedTextureOwner(const SharedTextureKey &key) const
+{
+	auto it = shared_textures.find(key);
+	if(it == shared_textures.end())
+		return nullptr;
+	return it->second.holders.front();
 }
 
 void *Engine::MapMemory(const VmaAllocation &allocation)
@@ -614,6 +1291,11 @@ void Engine::UnmapMemory(const VmaAllocation &allocation)
 	vmaUnmapMemory(allocator, allocation);
 }
 
+void Engine::InvalidateMemory(const VmaAllocation &allocation, vk::DeviceSize offset, vk::DeviceSize size)
+{
+	vmaInvalidateAllocation(allocator, allocation, offset, size);
+}
+
 void Engine::CopyBuffer(vk::Buffer src_buffer, vk::Buffer dst_buffer, vk::DeviceSize size)
 {
 	auto command_buffer = BeginSingleTimeCommandBuffer();
@@ -622,7 +1304,7 @@ void Engine::CopyBuffer(vk::Buffer src_buffer, vk::Buffer dst_buffer, vk::Device
 }
 
 Image Engine::Create2DImage(uint32_t width, uint32_t height, vk::Format format, vk::ImageTiling tiling,
-								vk::ImageUsageFlags usage, VmaMemoryUsage vma_usage, vk::SharingMode sharing_mode)
+								vk::ImageUsageFlags usage, VmaMemoryUsage vma_usage, MemoryCategory category, vk::SharingMode sharing_mode)
 {
 	auto image_info = vk::ImageCreateInfo()
 			.setImageType(vk::ImageType::e2D)
@@ -636,7 +1318,7 @@ Image Engine::Create2DImage(uint32_t width, uint32_t height, vk::Format format,
 			.setSharingMode(sharing_mode)
 			.setSamples(vk::SampleCountFlagBits::e1);
 
-	return CreateImage(image_info, vma_usage);
+	return CreateImage(image_info, vma_usage, category);
 }
 
 void Engine::TransitionImageLayout(vk::Image image, vk::Format format, vk::ImageLayout old_layout,
@@ -0,0 +1,265 @@
+
+#include "lavos/gbuffer.h"
+#include "lavos/engine.h"
+#include "lavos/shader_load.h"
+#include "lavos/vk_util.h"
+
+#include "../glsl/common_glsl_cpp.h"
+
+using namespace lavos;
+
+const vk::Format GBuffer::albedo_format;
+const vk::Format GBuffer::normal_format;
+
+GBuffer::GBuffer(Engine *engine, vk::Extent2D extent)
+	: engine(engine), extent(extent)
+{
+	CreateImages();
+	CreateDescriptorSetLayout();
+	CreateDescriptorPool();
+	CreateDescriptorSet();
+
+	vert_shader_module = CreateShaderModule(engine->GetVkDevice(), "material/deferred_lighting.vert");
+	frag_shader_module = CreateShaderModule(engine->GetVkDevice(), "material/deferred_lighting.frag");
+}
+
+GBuffer::~GBuffer()
+{
+	auto &device = engine->GetVkDevice();
+
+	if(pipeline)
+	{
+		device.destroyPipeline(pipeline);
+		device.destroyPipelineLayout(pipeline_layout);
+	}
+
+	device.destroyShaderModule(vert_shader_module);
+	device.destroyShaderModule(frag_shader_module);
+
+	device.destroyDescriptorPool(descriptor_pool);
+	device.destroyDescriptorSetLayout(descriptor_set_layout);
+
+	CleanupImages();
+}
+
+Image GBuffer::CreateAttachment(vk::Format format, vk::ImageView *image_view, const char *name)
+{
+	Image image = engine->Create2DImage(extent.width, extent.height, format,
+			vk::ImageTiling::eOptimal,
+			vk::ImageUsageFlagBits::eColorAttachment
+			| vk::ImageUsageFlagBits::eInputAttachment
+			| vk::ImageUsageFlagBits::eTransientAttachment,
+			VMA_MEMORY_USAGE_GPU_ONLY,
+			Engine::MemoryCategory::RenderTargets);
+	vk_util::SetDebugUtilsObjectName(engine->GetVkDevice(), image.image, name);
+
+	*image_view = engine->GetVkDevice().createImageView(vk::ImageViewCreateInfo()
+			.setImage(image.image)
+			.setViewType(vk::ImageViewType::e2D)
+			.setFormat(format)
+			.setSubresourceRange(vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1)));
+	vk_util::SetDebugUtilsObjectName(engine->GetVkDevice(), *image_view, name);
+
+	return image;
+}
+
+void GBuffer::CreateImages()
+{
+	albedo_image = CreateAttachment(albedo_format, &albedo_image_view, "GBuffer Albedo Image");
+	normal_image = CreateAttachment(normal_format, &normal_image_view, "GBuffer Normal Image");
+}
+
+void GBuffer::CleanupImages()
+{
+	auto &device = engine->GetVkDevice();
+	device.destroyImageView(albedo_image_view);
+	engine->DestroyImage(albedo_image);
+	device.destroyImageView(normal_image_view);
+	engine->DestroyImage(normal_image);
+}
+
+void GBuffer::SetExtent(vk::Extent2D extent)
+{
+	if(extent == this->extent)
+		return;
+
+	this->extent = extent;
+	CleanupImages();
+	CreateImages();
+}
+
+void GBuffer::CreateDescriptorSetLayout()
+{
+	std::array<vk::DescriptorSetLayoutBinding, 3> bindings = {
+		vk::DescriptorSetLayoutBinding()
+			.setBinding(DESCRIPTOR_SET_GBUFFER_BINDING_ALBEDO)
+			.setDescriptorType(vk::DescriptorType::eInputAttachment)
+			.setDescriptorCount(1)
+			.setStageFlags(vk::ShaderStageFlagBits::eFragment),
+
+		vk::DescriptorSetLayoutBinding()
+			.setBinding(DESCRIPTOR_SET_GBUFFER_BINDING_NORMAL)
+			.setDescriptorType(vk::DescriptorType::eInputAttachment)
+			.setDescriptorCount(1)
+			.setStageFlags(vk::ShaderStageFlagBits::eFragment),
+
+		vk::DescriptorSetLayoutBinding()
+			.setBinding(DESCRIPTOR_SET_GBUFFER_BINDING_DEPTH)
+			.setDescriptorType(vk::DescriptorType::eInputAttachment)
+			.setDescriptorCount(1)
+			.setStageFlags(vk::ShaderStageFlagBits::eFragment)
+	};
+
+	descriptor_set_layout = engine->GetVkDevice().createDescriptorSetLayout(vk::DescriptorSetLayoutCreateInfo()
+			.setBindingCount(static_cast<uint32_t>(bindings.size()))
+			.setPBindings(bindings.data()));
+}
+
+void GBuffer::CreateDescriptorPool()
+{
+	auto pool_size = vk::DescriptorPoolSize(vk::DescriptorType::eInputAttachment, 3);
+
+	descriptor_pool = engine->GetVkDevice().createDescriptorPool(vk::DescriptorPoolCreateInfo()
+			.setPoolSizeCount(1)
+			.setPPoolSizes(&pool_size)
+			.setMaxSets(1));
+}
+
+void GBuffer::CreateDescriptorSet()
+{
+	descriptor_set = *engine->GetVkDevice().allocateDescriptorSets(vk::DescriptorSetAllocateInfo()
+			.setDescriptorPool(descriptor_pool)
+			.setDescriptorSetCount(1)
+			.setPSetLayouts(&descriptor_set_layout)).begin();
+}
+
+void GBuffer::WriteDescriptorSet(vk::ImageView depth_image_view)
+{
+	std::array<vk::DescriptorImageInfo, 3> image_infos = {
+		vk::DescriptorImageInfo(nullptr, albedo_image_view, vk::ImageLayout::eShaderReadOnlyOptimal),
+		vk::DescriptorImageInfo(nullptr, normal_image_view, vk::ImageLayout::eShaderReadOnlyOptimal),
+		vk::DescriptorImageInfo(nullptr, depth_image_view, vk::ImageLayout::eDepthStencilReadOnlyOptimal)
+	};
+
+	std::array<std::uint32_t, 3> bindings = {
+		DESCRIPTOR_SET_GBUFFER_BINDING_ALBEDO,
+		DESCRIPTOR_SET_GBUFFER_BINDING_NORMAL,
+		DESCRIPTOR_SET_GBUFFER_BINDING_DEPTH
+	};
+
+	std::array<vk::WriteDescriptorSet, 3> writes;
+	for(size_t i=0; i<writes.size(); i++)
+	{
+		writes[i] = vk::WriteDescriptorSet()
+			.setDstSet(descriptor_set)
+			.setDstBinding(bindings[i])
+			.setDstArrayElement(0)
+			.setDescriptorType(vk::DescriptorType::eInputAttachment)
+			.setDescriptorCount(1)
+			.setPImageInfo(&image_infos[i]);
+	}
+
+	engine->GetVkDevice().updateDescriptorSets(writes, nullptr);
+}
+
+void GBuffer::CreatePipeline(vk::RenderPass render_pass, std::uint32_t subpass, vk::DescriptorSetLayout renderer_descriptor_set_layout)
+{
+	auto device = engine->GetVkDevice();
+
+	static_assert(DESCRIPTOR_SET_INDEX_COMMON == 0, "descriptor set index mismatch");
+	static_assert(DESCRIPTOR_SET_INDEX_MATERIAL == 1, "descriptor set index mismatch");
+	std::array<vk::DescriptorSetLayout, 2> descriptor_set_layouts = {
+		renderer_descriptor_set_layout,
+		descriptor_set_layout
+	};
+
+	pipeline_layout = device.createPipelineLayout(vk::PipelineLayoutCreateInfo()
+			.setSetLayoutCount(static_cast<uint32_t>(descriptor_set_layouts.size()))
+			.setPSetLayouts(descriptor_set_layouts.data()));
+
+	std::array<vk::PipelineShaderStageCreateInfo, 2> shader_stages = {
+		vk::PipelineShaderStageCreateInfo(vk::PipelineShaderStageCreateFlags(),
+										  vk::ShaderStageFlagBits::eVertex,
+										  vert_shader_module,
+										  "main"),
+		vk::PipelineShaderStageCreateInfo(vk::PipelineShaderStageCreateFlags(),
+										  vk::ShaderStageFlagBits::eFragment,
+										  frag_shader_module,
+										  "main")
+	};
+
+	// fullscreen triangle generated from gl_VertexIndex
+	auto vertex_input_info = vk::PipelineVertexInputStateCreateInfo();
+
+	auto input_assembly_info = vk::PipelineInputAssemblyStateCreateInfo()
+			.setTopology(vk::PrimitiveTopology::eTriangleList);
+
+	// viewport and scissor are dynamic, so the pipeline survives resizing
+	auto viewport_state_info = vk::PipelineViewportStateCreateInfo()
+			.setViewportCount(1)
+			.setScissorCount(1);
+
+	auto rasterizer_info = vk::PipelineRasterizationStateCreateInfo()
+			.setDepthClampEnable(VK_FALSE)
+			.setRasterizerDiscardEnable(VK_FALSE)
+			.setPolygonMode(vk::PolygonMode::eFill)
+			.setLineWidth(1.0f)
+			.setCullMode(vk::CullModeFlagBits::eNone)
+			.setFrontFace(vk::FrontFace::eCounterClockwise)
+			.setDepthBiasEnable(VK_FALSE);
+
+	auto multisample_info = vk::PipelineMultisampleStateCreateInfo()
+			.setSampleShadingEnable(VK_FALSE)
+			.setRasterizationSamples(vk::SampleCountFlagBits::e1);
+
+	auto depth_stencil_info = vk::PipelineDepthStencilStateCreateInfo()
+			.setDepthTestEnable(VK_FALSE)
+			.setDepthWriteEnable(VK_FALSE)
+			.setDepthBoundsTestEnable(VK_FALSE)
+			.setStencilTestEnable(VK_FALSE);
+
+	auto color_blend_attachment = vk::PipelineColorBlendAttachmentState()
+			.setColorWriteMask(vk::ColorComponentFlagBits::eR
+							   | vk::ColorComponentFlagBits::eG
+							   | vk::ColorComponentFlagBits::eB
+							   | vk::ColorComponentFlagBits::eA)
+			.setBlendEnable(VK_FALSE);
+
+	auto color_blend_state_info = vk_util::PipelineColorBlendStateCreateInfo()
+			.SetAttachments({ color_blend_attachment });
+
+	std::array<vk::DynamicState, 2> dynamic_states = { vk::DynamicState::eViewport, vk::DynamicState::eScissor };
+	auto dynamic_state_info = vk::PipelineDynamicStateCreateInfo()
+			.setDynamicStateCount(static_cast<uint32_t>(dynamic_states.size()))
+			.setPDynamicStates(dynamic_states.data());
+
+	auto pipeline_info = vk::GraphicsPipelineCreateInfo()
+			.setStageCount(static_cast<uint32_t>(shader_stages.size()))
+			.setPStages(shader_stages.data())
+			.setPVertexInputState(&vertex_input_info)
+			.setPInputAssemblyState(&input_assembly_info)
+			.setPViewportState(&viewport_state_info)
+			.setPRasterizationState(&rasterizer_info)
+			.setPMultisampleState(&multisample_info)
+			.setPDepthStencilState(&depth_stencil_info)
+			.setPColorBlendState(&color_blend_state_info.Get())
+			.setPDynamicState(&dynamic_state_info)
+			.setLayout(pipeline_layout)
+			.setRenderPass(render_pass)
+			.setSubpass(subpass);
+
+	pipeline = device.createGraphicsPipeline(nullptr, pipeline_info);
+}
+
+void GBuffer::RecordLighting(vk::CommandBuffer command_buffer, vk::DescriptorSet renderer_descriptor_set,
+		vk::ArrayProxy<const std::uint32_t> renderer_dynamic_offsets)
+{
+	command_buffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+	command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipeline_layout, DESCRIPTOR_SET_INDEX_COMMON,
+			{ renderer_descriptor_set, descriptor_set }, renderer_dynamic_offsets);
+
+	command_buffer.setViewport(0, vk::Viewport(0.0f, 0.0f, extent.width, extent.height, 0.0f, 1.0f));
+	command_buffer.setScissor(0, vk::Rect2D({ 0, 0 }, extent));
+
+	command_buffer.draw(3, 1, 0, 0);
+}
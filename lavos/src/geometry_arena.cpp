@@ -0,0 +1,329 @@
+
+#include "lavos/geometry_arena.h"
+#include "lavos/engine.h"
+#include "lavos/buffer.h"
+#include "lavos/vertex.h"
+#include "lavos/vk_util.h"
+#include "lavos/log.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace lavos;
+
+GeometryArena::GeometryArena(Engine *engine, std::uint32_t mesh_vertices_capacity, std::uint32_t mesh_indices_capacity)
+	: engine(engine)
+{
+	CreatePool({ sizeof(Vertex), sizeof(glm::vec3) }, vk::BufferUsageFlagBits::eVertexBuffer, mesh_vertices_capacity);
+	CreatePool({ sizeof(std::uint16_t) }, vk::BufferUsageFlagBits::eIndexBuffer, mesh_indices_capacity);
+}
+
+GeometryArena::~GeometryArena()
+{
+	for(auto &pool : pools)
+	{
+		for(auto allocation : pool.allocations)
+			delete allocation;
+
+		for(auto buffer : pool.buffers)
+			delete buffer;
+	}
+}
+
+std::vector<lavos::Buffer *> GeometryArena::CreatePoolBuffers(const Pool &pool, std::uint32_t capacity)
+{
+	std::vector<lavos::Buffer *> buffers;
+	for(auto stride : pool.strides)
+	{
+		auto buffer = engine->CreateBuffer(stride * capacity,
+				pool.usage | vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst,
+				VMA_MEMORY_USAGE_GPU_ONLY,
+				Engine::MemoryCategory::Meshes);
+		vk_util::SetDebugUtilsObjectName(engine->GetVkDevice(), buffer->GetVkBuffer(), "GeometryArena");
+		buffers.push_back(buffer);
+	}
+	return buffers;
+}
+
+GeometryArena::PoolId GeometryArena::CreatePool(std::vector<vk::DeviceSize> strides, vk::BufferUsageFlags usage, std::uint32_t initial_capacity)
+{
+	Pool pool;
+	pool.strides = std::move(strides);
+	pool.usage = usage;
+	pool.initial_capacity = std::max(initial_capacity, 1u);
+	pool.capacity = 0;
+	pools.push_back(std::move(pool));
+	return static_cast<PoolId>(pools.size() - 1);
+}
+
+GeometryArena::PoolId GeometryArena::GetVertexPool(vk::DeviceSize stride)
+{
+	for(PoolId i=pool_mesh_indices + 1; i<pools.size(); i++)
+	{
+		if(pools[i].strides.size() == 1 && pools[i].strides[0] == stride)
+			return i;
+	}
+
+	return CreatePool({ stride }, vk::BufferUsageFlagBits::eVertexBuffer, 1u << 16);
+}
+
+void GeometryArena::Grow(Pool &pool, std::uint32_t capacity)
+{
+	if(pool.buffers.empty())
+	{
+		auto new_capacity = std::max(pool.initial_capacity, capacity);
+		pool.buffers = CreatePoolBuffers(pool, new_capacity);
+		pool.free_ranges[0] = new_capacity;
+		pool.capacity = new_capacity;
+		return;
+	}
+
+	auto new_capacity = std::max(pool.capacity * 2, capacity);
+	auto buffers = CreatePoolBuffers(pool, new_capacity);
+
+	auto command_buffer = engine->BeginSingleTimeCommandBuffer();
+	for(std::size_t i=0; i<buffers.size(); i++)
+		command_buffer.copyBuffer(pool.buffers[i]->GetVkBuffer(), buffers[i]->GetVkBuffer(), vk::BufferCopy(0, 0, pool.strides[i] * pool.capacity));
+	engine->EndSingleTimeCommandBuffer(command_buffer);
+
+	// the copy and all submissions before it are finished now, so no frame uses the old buffers anymore
+	for(auto buffer : pool.buffers)
+		delete buffer;
+	pool.buffers = buffers;
+
+	// extend a free range at the end or add a new one
+	std::uint32_t free_begin = pool.capacity;
+	if(!pool.free_ranges.empty())
+	{
+		auto last = std::prev(pool.free_ranges.end());
+		if(last->first + last->second == pool.capacity)
+		{
+			free_begin = last->first;
+			pool.free_ranges.erase(last);
+		}
+	}
+	pool.free_ranges[free_begin] = new_capacity - free_begin;
+	pool.capacity = new_capacity;
+
+	LAVOS_LOGF(LogLevel::Info, "GeometryArena pool grown to %u elements.", new_capacity);
+}
+
+GeometryArena::Allocation *GeometryArena::Allocate(PoolId pool_id, std::uint32_t count)
+{
+	auto &pool = pools[pool_id];
+
+	auto allocation = new Allocation { pool_id, 0, count };
+	if(count == 0)
+	{
+		pool.allocations.insert(allocation);
+		return allocation;
+	}
+
+	auto it = std::find_if(pool.free_ranges.begin(), pool.free_ranges.end(), [count](const std::pair<const std::uint32_t, std::uint32_t> &range) {
+		return range.second >= count;
+	});
+
+	if(it == pool.free_ranges.end())
+	{
+		std::uint32_t free_at_end = 0;
+		if(!pool.free_ranges.empty())
+		{
+			auto last = std::prev(pool.free_ranges.end());
+			if(last->first + last->second == pool.capacity)
+				free_at_end = last->second;
+		}
+		Grow(pool, pool.capacity + count - free_at_end);
+		it = std::prev(pool.free_ranges.end());
+	}
+
+	allocation->offset = it->first;
+	std::uint32_t remaining = it->second - count;
+	pool.free_ranges.erase(it);
+	if(remaining > 0)
+		pool.free_ranges[allocation->offset + count] = remaining;
+
+	pool.allocations.insert(allocation);
+	return allocation;
+}
+
+void GeometryArena::Free(Allocation *allocation)
+{
+	auto &pool = pools[allocation->pool];
+	pool.allocations.erase(allocation);
+
+	if(allocation->count > 0)
+	{
+		std::uint32_t offset = allocation->offset;
+		std::uint32_t count = allocation->count;
+
+		auto next = pool.free_ranges.lower_bound(offset);
+		if(next != pool.free_ranges.end() && offset + count == next->first)
+		{
+			count += next->second;
+			next = pool.free_ranges.erase(next);
+		}
+
+		if(next != pool.free_ranges.begin())
+		{
+			auto prev = std::prev(next);
+			if(prev->first + prev->second == offset)
+			{
+				offset = prev->first;
+				count += prev->second;
+				pool.free_ranges.erase(prev);
+			}
+		}
+
+		pool.free_ranges[offset] = count;
+	}
+
+	delete allocation;
+}
+
+void GeometryArena::Upload(const Allocation *allocation, std::uint32_t stream, const void *data)
+{
+	if(allocation->count == 0)
+		return;
+
+	const auto &pool = pools[allocation->pool];
+	vk::DeviceSize stride = pool.strides[stream];
+	vk::DeviceSize size = stride * allocation->count;
+
+	auto staging_buffer = engine->CreateBuffer(size, vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_CPU_ONLY,
+			Engine::MemoryCategory::Staging);
+	memcpy(staging_buffer->Map(), data, size);
+	staging_buffer->UnMap();
+
+	auto command_buffer = engine->BeginSingleTimeCommandBuffer();
+
+	// the range may have been freed by geometry that earlier frames still read
+	command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eVertexInput, vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags(),
+			vk::MemoryBarrier()
+				.setSrcAccessMask(vk::AccessFlags())
+				.setDstAccessMask(vk::AccessFlagBits::eTransferWrite),
+			nullptr, nullptr);
+
+	command_buffer.copyBuffer(staging_buffer->GetVkBuffer(), pool.buffers[stream]->GetVkBuffer(),
+			vk::BufferCopy(0, stride * allocation->offset, size));
+
+	// also visible to the copies of a later defragmentation
+	command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eVertexInput | vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags(),
+			vk::MemoryBarrier()
+				.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+				.setDstAccessMask(vk::AccessFlagBits::eVertexAttributeRead | vk::AccessFlagBits::eIndexRead | vk::AccessFlagBits::eTransferRead),
+			nullptr, nullptr);
+
+	// the draws reading the data are submitted later, so there is no need to wait
+	std::uint64_t value = engine->SubmitSingleTimeCommandBuffer(command_buffer);
+	engine->DestroyAfter(value, [staging_buffer]() {
+		delete staging_buffer;
+	});
+}
+
+vk::Buffer GeometryArena::GetVkBuffer(PoolId pool, std::uint32_t stream) const
+{
+	const auto &buffers = pools[pool].buffers;
+	if(buffers.empty())
+		return nullptr;
+	return buffers[stream]->GetVkBuffer();
+}
+
+vk::DeviceSize GeometryArena::GetPoolSize(PoolId pool_id) const
+{
+	const auto &pool = pools[pool_id];
+	vk::DeviceSize size = 0;
+	for(auto stride : pool.strides)
+		size += stride * pool.capacity;
+	return size;
+}
+
+vk::DeviceSize GeometryArena::GetAllocationSize(const Allocation *allocation) const
+{
+	vk::DeviceSize size = 0;
+	for(auto stride : pools[allocation->pool].strides)
+		size += stride * allocation->count;
+	return size;
+}
+
+float GeometryArena::GetFragmentation(PoolId pool_id) const
+{
+	const auto &pool = pools[pool_id];
+
+	std::uint32_t free_total = 0;
+	std::uint32_t free_largest = 0;
+	for(const auto &range : pool.free_ranges)
+	{
+		free_total += range.second;
+		free_largest = std::max(free_largest, range.second);
+	}
+
+	if(free_total == 0)
+		return 0.0f;
+
+	return 1.0f - static_cast<float>(free_largest) / static_cast<float>(free_total);
+}
+
+void GeometryArena::Defragment(vk::CommandBuffer command_buffer, Pool &pool)
+{
+	auto buffers = CreatePoolBuffers(pool, pool.capacity);
+
+	std::vector<Allocation *> allocations(pool.allocations.begin(), pool.allocations.end());
+	std::sort(allocations.begin(), allocations.end(), [](const Allocation *a, const Allocation *b) {
+		return a->offset < b->offset;
+	});
+
+	std::vector<std::vector<vk::BufferCopy>> regions(pool.strides.size());
+	std::uint32_t offset = 0;
+	for(auto allocation : allocations)
+	{
+		if(allocation->count == 0)
+			continue;
+
+		for(std::size_t i=0; i<pool.strides.size(); i++)
+		{
+			vk::DeviceSize stride = pool.strides[i];
+			regions[i].push_back(vk::BufferCopy(stride * allocation->offset, stride * offset, stride * allocation->count));
+		}
+
+		allocation->offset = offset;
+		offset += allocation->count;
+	}
+
+	// the old buffers are only read, earlier writes to them were already made available by Upload()
+	for(std::size_t i=0; i<pool.strides.size(); i++)
+	{
+		if(!regions[i].empty())
+			command_buffer.copyBuffer(pool.buffers[i]->GetVkBuffer(), buffers[i]->GetVkBuffer(), regions[i]);
+	}
+
+	command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eVertexInput, vk::DependencyFlags(),
+			vk::MemoryBarrier()
+				.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+				.setDstAccessMask(vk::AccessFlagBits::eVertexAttributeRead | vk::AccessFlagBits::eIndexRead),
+			nullptr, nullptr);
+
+	// read by the copies above and by earlier frames
+	for(auto buffer : pool.buffers)
+	{
+		engine->DestroyAfterSubmission(command_buffer, [buffer]() {
+			delete buffer;
+		});
+	}
+	pool.buffers = buffers;
+
+	pool.free_ranges.clear();
+	if(offset < pool.capacity)
+		pool.free_ranges[offset] = pool.capacity - offset;
+}
+
+void GeometryArena::RecordDefragmentation(vk::CommandBuffer command_buffer)
+{
+	for(PoolId i=0; i<pools.size(); i++)
+	{
+		if(GetFragmentation(i) > defragmentation_threshold)
+		{
+			Defragment(command_buffer, pools[i]);
+			break;
+		}
+	}
+}
@@ -48,7 +48,8 @@ Image Image::LoadFromPixelData(Engine *engine, vk::Format format, uint32_t width
 	}
 
 
-	auto staging_buffer = engine->CreateBuffer(image_size, vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_CPU_ONLY);
+	auto staging_buffer = engine->CreateBuffer(image_size, vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_CPU_ONLY,
+			Engine::MemoryCategory::Staging);
 
 	memcpy(staging_buffer->Map(), image_pixels, image_size);
 	staging_buffer->UnMap();
@@ -58,7 +59,7 @@ Image Image::LoadFromPixelData(Engine *engine, vk::Format format, uint32_t width
 
 	Image image = engine->Create2DImage(width, height, actual_format, vk::ImageTiling::eOptimal,
 										vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled,
-										VMA_MEMORY_USAGE_GPU_ONLY);
+										VMA_MEMORY_USAGE_GPU_ONLY, Engine::MemoryCategory::Textures);
 
 
 	vk::ImageAspectFlags aspect_mask = GetFormatIsDepth(format) ? vk::ImageAspectFlagBits::eDepth : vk::ImageAspectFlagBits::eColor;
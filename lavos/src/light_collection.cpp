@@ -3,13 +3,57 @@
 #include "lavos/scene.h"
 #include "lavos/component/directional_light.h"
 #include "lavos/component/spot_light.h"
+#include "lavos/component/point_light.h"
+
+#include <algorithm>
 
 using namespace lavos;
 
+void LightCollection::AddLight(Component *component)
+{
+	if(auto dir_light = dynamic_cast<DirectionalLight *>(component))
+	{
+		// only one directional light is supported, the first one stays in use
+		if(this->dir_light)
+			return;
+		this->dir_light = dir_light;
+	}
+	else if(auto spot_light = dynamic_cast<SpotLight *>(component))
+		spot_lights.push_back(spot_light);
+	else if(auto point_light = dynamic_cast<PointLight *>(component))
+		point_lights.push_back(point_light);
+	else
+		return;
+
+	MarkChanged();
+}
+
+void LightCollection::RemoveLight(Component *component)
+{
+	if(component == dir_light)
+	{
+		dir_light = nullptr;
+		MarkChanged();
+		return;
+	}
+
+	auto spot_it = std::find(spot_lights.begin(), spot_lights.end(), component);
+	if(spot_it != spot_lights.end())
+	{
+		spot_lights.erase(spot_it);
+		MarkChanged();
+		return;
+	}
+
+	auto point_it = std::find(point_lights.begin(), point_lights.end(), component);
+	if(point_it != point_lights.end())
+	{
+		point_lights.erase(point_it);
+		MarkChanged();
+	}
+}
+
 LightCollection LightCollection::EverythingInScene(Scene *scene)
 {
-	LightCollection ret;
-	ret.dir_light = scene->GetRootNode()->GetComponentInChildren<DirectionalLight>();
-	ret.spot_lights = scene->GetRootNode()->GetComponentsInChildren<SpotLight>();
-	return std::move(ret);
-}
\ No newline at end of file
+	return *scene->GetLightCollection();
+}
@@ -0,0 +1,276 @@
+
+#include "lavos/light_grid.h"
+#include "lavos/engine.h"
+#include "lavos/buffer.h"
+#include "lavos/component/camera.h"
+
+#include <glm/common.hpp>
+#include <glm/exponential.hpp>
+#include <glm/matrix.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+using namespace lavos;
+
+static const std::size_t initial_light_capacity = 64;
+
+LightGrid::LightGrid(Engine *engine, std::uint32_t frames_count, glm::uvec3 cluster_count)
+	: engine(engine), cluster_count(glm::max(cluster_count, glm::uvec3(1)))
+{
+	frames.resize(std::max(frames_count, 1u));
+	for(auto &frame : frames)
+		EnsureCapacity(frame, initial_light_capacity, 2 * GetClusterCountTotal() + initial_light_capacity);
+}
+
+LightGrid::~LightGrid()
+{
+	for(auto &frame : frames)
+	{
+		delete frame.light_buffer;
+		delete frame.cluster_buffer;
+	}
+}
+
+vk::Buffer LightGrid::GetLightBuffer(std::uint32_t frame_index) const
+{
+	return frames[frame_index].light_buffer->GetVkBuffer();
+}
+
+vk::Buffer LightGrid::GetClusterBuffer(std::uint32_t frame_index) const
+{
+	return frames[frame_index].cluster_buffer->GetVkBuffer();
+}
+
+static std::size_t NextPowerOfTwo(std::size_t v)
+{
+	std::size_t r = 1;
+	while(r < v)
+		r <<= 1;
+	return r;
+}
+
+bool LightGrid::EnsureCapacity(FrameBuffers &frame, std::size_t lights, std::size_t cluster_uints)
+{
+	lights = std::max(lights, static_cast<std::size_t>(1));
+
+	if(lights <= frame.light_capacity && cluster_uints <= frame.cluster_buffer_capacity)
+		return false;
+
+	// the old buffers may still be read by a previous frame
+	auto retire = [this](Buffer *buffer) {
+		if(buffer)
+			engine->DestroyAfter(engine->GetSubmittedValue(), [buffer]() { delete buffer; });
+	};
+
+	if(lights > frame.light_capacity)
+	{
+		retire(frame.light_buffer);
+		frame.light_capacity = NextPowerOfTwo(lights);
+		frame.light_buffer = engine->CreateBuffer(frame.light_capacity * sizeof(LightingStorageBufferSpotLight),
+				vk::BufferUsageFlagBits::eStorageBuffer,
+				VMA_MEMORY_USAGE_CPU_ONLY,
+				Engine::MemoryCategory::Uniforms);
+		vk_util::SetDebugUtilsObjectName(engine->GetVkDevice(), frame.light_buffer->GetVkBuffer(), "LightGrid Lights");
+	}
+
+	if(cluster_uints > frame.cluster_buffer_capacity)
+	{
+		retire(frame.cluster_buffer);
+		frame.cluster_buffer_capacity = NextPowerOfTwo(cluster_uints);
+		frame.cluster_buffer = engine->CreateBuffer(frame.cluster_buffer_capacity * sizeof(std::uint32_t),
+				vk::BufferUsageFlagBits::eStorageBuffer,
+				VMA_MEMORY_USAGE_CPU_ONLY,
+				Engine::MemoryCategory::Uniforms);
+		vk_util::SetDebugUtilsObjectName(engine->GetVkDevice(), frame.cluster_buffer->GetVkBuffer(), "LightGrid Clusters");
+	}
+
+	return true;
+}
+
+void LightGrid::CalculateClusterBounds(const glm::mat4 &projection, vk::Extent2D extent, float near_clip, float far_clip)
+{
+	tile_size = glm::vec2(
+			std::ceil(static_cast<float>(extent.width) / cluster_count.x),
+			std::ceil(static_cast<float>(extent.height) / cluster_count.y));
+
+	float log_ratio = std::log(far_clip / near_clip);
+	z_scale = cluster_count.z / log_ratio;
+	z_bias = -std::log(near_clip) * z_scale;
+
+	glm::mat4 projection_inv = glm::inverse(projection);
+
+	// view space points on the near and far plane for every tile corner
+	glm::uvec2 corner_count(cluster_count.x + 1, cluster_count.y + 1);
+	std::vector<glm::vec3> corners_near(corner_count.x * corner_count.y);
+	std::vector<glm::vec3> corners_far(corner_count.x * corner_count.y);
+	for(std::uint32_t y=0; y<corner_count.y; y++)
+	{
+		for(std::uint32_t x=0; x<corner_count.x; x++)
+		{
+			glm::vec2 ndc(
+					std::min(x * tile_size.x / extent.width, 1.0f) * 2.0f - 1.0f,
+					std::min(y * tile_size.y / extent.height, 1.0f) * 2.0f - 1.0f);
+			glm::vec4 n = projection_inv * glm::vec4(ndc, 0.0f, 1.0f);
+			glm::vec4 f = projection_inv * glm::vec4(ndc, 1.0f, 1.0f);
+			corners_near[y * corner_count.x + x] = glm::vec3(n) / n.w;
+			corners_far[y * corner_count.x + x] = glm::vec3(f) / f.w;
+		}
+	}
+
+	cluster_bounds_min.resize(GetClusterCountTotal());
+	cluster_bounds_max.resize(GetClusterCountTotal());
+
+	for(std::uint32_t z=0; z<cluster_count.z; z++)
+	{
+		float depths[2] = {
+				near_clip * std::pow(far_clip / near_clip, static_cast<float>(z) / cluster_count.z),
+				near_clip * std::pow(far_clip / near_clip, static_cast<float>(z + 1) / cluster_count.z)
+		};
+
+		for(std::uint32_t y=0; y<cluster_count.y; y++)
+		{
+			for(std::uint32_t x=0; x<cluster_count.x; x++)
+			{
+				std::size_t index = (z * cluster_count.y + y) * cluster_count.x + x;
+				glm::vec3 bounds_min(FLT_MAX);
+				glm::vec3 bounds_max(-FLT_MAX);
+
+				for(std::uint32_t c=0; c<4; c++)
+				{
+					std::size_t corner = (y + (c >> 1)) * corner_count.x + x + (c & 1);
+					const glm::vec3 &n = corners_near[corner];
+					const glm::vec3 &f = corners_far[corner];
+					for(float depth : depths)
+					{
+						float t = (depth + n.z) / (n.z - f.z);
+						glm::vec3 p = n + (f - n) * t;
+						bounds_min = glm::min(bounds_min, p);
+						bounds_max = glm::max(bounds_max, p);
+					}
+				}
+
+				cluster_bounds_min[index] = bounds_min;
+				cluster_bounds_max[index] = bounds_max;
+			}
+		}
+	}
+}
+
+void LightGrid::AssignLights(const std::vector<LightingStorageBufferSpotLight> &spot_lights, std::size_t first_clustered,
+		const glm::mat4 &modelview, float near_clip, float far_clip)
+{
+	assignments.clear();
+
+	for(auto i=static_cast<std::uint32_t>(first_clustered); i<spot_lights.size(); i++)
+	{
+		const auto &light = spot_lights[i];
+
+		if(light.range <= 0.0f) // unlimited range, affects every cluster, see SpotLight::GetEffectiveRange()
+		{
+			for(std::uint32_t c=0; c<GetClusterCountTotal(); c++)
+				assignments.emplace_back(c, i);
+			continue;
+		}
+
+		glm::vec3 center = modelview * glm::vec4(light.position, 1.0f);
+		float radius = light.range;
+		float depth = -center.z;
+
+		if(depth + radius < near_clip || depth - radius > far_clip)
+			continue;
+
+		auto slice = [this](float d) {
+			float s = std::floor(std::log(std::max(d, 1e-6f)) * z_scale + z_bias);
+			return static_cast<std::uint32_t>(glm::clamp(s, 0.0f, static_cast<float>(cluster_count.z - 1)));
+		};
+
+		std::uint32_t z_first = slice(depth - radius);
+		std::uint32_t z_last = slice(depth + radius);
+
+		for(std::uint32_t z=z_first; z<=z_last; z++)
+		{
+			for(std::uint32_t c=z*cluster_count.x*cluster_count.y; c<(z+1)*cluster_count.x*cluster_count.y; c++)
+			{
+				// sphere against cluster box
+				glm::vec3 closest = glm::clamp(center, cluster_bounds_min[c], cluster_bounds_max[c]);
+				glm::vec3 d = closest - center;
+				if(glm::dot(d, d) <= radius * radius)
+					assignments.emplace_back(c, i);
+			}
+		}
+	}
+
+	std::size_t clusters_total = GetClusterCountTotal();
+	cluster_data.assign(2 * clusters_total + assignments.size(), 0);
+
+	for(const auto &assignment : assignments)
+		cluster_data[2 * assignment.first + 1]++;
+
+	std::uint32_t offset = static_cast<std::uint32_t>(2 * clusters_total);
+	for(std::size_t c=0; c<clusters_total; c++)
+	{
+		cluster_data[2 * c] = offset;
+		offset += cluster_data[2 * c + 1];
+	}
+
+	// assignments are ordered by light, so each cluster's list stays sorted
+	std::vector<std::uint32_t> cursors(clusters_total, 0);
+	for(const auto &assignment : assignments)
+	{
+		std::uint32_t c = assignment.first;
+		cluster_data[cluster_data[2 * c] + cursors[c]++] = assignment.second;
+	}
+}
+
+bool LightGrid::Upload(std::uint32_t frame_index, const std::vector<LightingStorageBufferSpotLight> &spot_lights)
+{
+	auto &frame = frames[frame_index];
+	bool recreated = EnsureCapacity(frame, spot_lights.size(), cluster_data.size());
+
+	// both buffers stay mapped until they are destroyed
+	if(!spot_lights.empty())
+		memcpy(frame.light_buffer->Map(), spot_lights.data(), spot_lights.size() * sizeof(LightingStorageBufferSpotLight));
+
+	memcpy(frame.cluster_buffer->Map(), cluster_data.data(), cluster_data.size() * sizeof(std::uint32_t));
+
+	return recreated;
+}
+
+bool LightGrid::Update(std::uint32_t frame_index, const std::vector<LightingStorageBufferSpotLight> &spot_lights,
+		std::size_t first_clustered, Camera *camera, vk::Extent2D extent)
+{
+	single_cluster = false;
+
+	float near_clip = camera->GetNearClip();
+	float far_clip = camera->GetFarClip();
+
+	glm::mat4 projection = camera->GetProjectionMatrix();
+	projection[1][1] *= -1.0f; // same as the matrix used for rendering, so tiles match gl_FragCoord
+
+	CalculateClusterBounds(projection, extent, near_clip, far_clip);
+	AssignLights(spot_lights, first_clustered, camera->GetModelViewMatrix(), near_clip, far_clip);
+
+	return Upload(frame_index, spot_lights);
+}
+
+bool LightGrid::UpdateSingleCluster(std::uint32_t frame_index, const std::vector<LightingStorageBufferSpotLight> &spot_lights,
+		std::size_t first_clustered)
+{
+	single_cluster = true;
+
+	// every fragment maps to cluster 0, regardless of its tile and depth
+	tile_size = glm::vec2(1.0f);
+	z_scale = 0.0f;
+	z_bias = 0.0f;
+
+	std::size_t count = spot_lights.size() - std::min(first_clustered, spot_lights.size());
+	cluster_data.assign(2 + count, 0);
+	cluster_data[0] = 2;
+	cluster_data[1] = static_cast<std::uint32_t>(count);
+	for(std::size_t i=0; i<count; i++)
+		cluster_data[2 + i] = static_cast<std::uint32_t>(first_clustered + i);
+
+	return Upload(frame_index, spot_lights);
+}
@@ -54,10 +54,7 @@ void GouraudMaterial::WriteDescriptorSet(Material::DescriptorSetId id, vk::Descr
 {
 	auto instance_data = reinterpret_cast<UBOInstanceData *>(instance->GetInstanceData(id));
 
-	auto ubo_info = vk::DescriptorBufferInfo()
-		.setBuffer(instance_data->uniform_buffer->GetVkBuffer())
-		.setOffset(0)
-		.setRange(sizeof(UniformBuffer));
+	auto ubo_info = instance_data->GetDescriptorBufferInfo();
 
 	auto ubo_write = vk::WriteDescriptorSet()
 		.setDstSet(descriptor_set)
@@ -93,11 +90,7 @@ void GouraudMaterial::WriteDescriptorSet(Material::DescriptorSetId id, vk::Descr
 
 void *GouraudMaterial::CreateInstanceData(InstanceDataId id)
 {
-	auto buffer = engine->CreateBuffer(sizeof(UniformBuffer),
-									   vk::BufferUsageFlagBits::eUniformBuffer,
-									   VMA_MEMORY_USAGE_CPU_ONLY);
-
-	return new UBOInstanceData(buffer);
+	return new UBOInstanceData(engine->GetMaterialParameterArena(), sizeof(UniformBuffer));
 }
 
 void GouraudMaterial::DestroyInstanceData(InstanceDataId id, void *data_p)
@@ -114,6 +107,5 @@ void GouraudMaterial::UpdateInstanceData(InstanceDataId id, void *data_p, Materi
 	ubo.color_factor = instance->GetParameter(parameter_slot_base_color_factor, glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
 	ubo.specular_exponent = instance->GetParameter(parameter_slot_specular_exponent, 16.0f);
 
-	memcpy(data->uniform_buffer->Map(), &ubo, sizeof(ubo));
-	data->uniform_buffer->UnMap();
+	data->Write(&ubo, sizeof(ubo));
 }
\ No newline at end of file
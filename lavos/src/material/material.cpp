@@ -5,6 +5,10 @@
 
 #include "lavos/shader_load.h"
 
+#include "../../glsl/common_glsl_cpp.h"
+
+#include <algorithm>
+
 using namespace lavos;
 
 Material::Material(lavos::Engine *engine)
@@ -55,6 +59,35 @@ const Material::DescriptorSetLayout *Material::GetDescriptorSetLayout(Descriptor
 	return &it->second;
 }
 
+std::uint32_t Material::GetLightingFeaturesPointLights(std::size_t point_lights_count)
+{
+	std::uint32_t bucket = static_cast<std::uint32_t>(std::min<std::size_t>(point_lights_count, 3));
+	return bucket << LightingFeaturePointLightsShift;
+}
+
+void Material::AppendLightingSpecializationConstants(std::uint32_t lighting_features, std::vector<std::uint32_t> &constants)
+{
+	static_assert(SPECIALIZATION_CONSTANT_LIGHTING_DIRECTIONAL_LIGHT == 0
+			&& SPECIALIZATION_CONSTANT_LIGHTING_SPOT_LIGHT_SHADOW_MODES == 1
+			&& SPECIALIZATION_CONSTANT_LIGHTING_CLUSTERED_SPOT_LIGHTS == 2
+			&& SPECIALIZATION_CONSTANT_LIGHTING_POINT_LIGHTS_MAX == 3, "lighting specialization constant ids");
+
+	std::uint32_t shadow_modes = 0;
+	if(lighting_features & LightingFeatureSpotLightShadowDepth)
+		shadow_modes |= 1u << SPOT_LIGHT_SHADOW_MODE_DEPTH;
+	if(lighting_features & LightingFeatureSpotLightShadowMSM)
+		shadow_modes |= 1u << SPOT_LIGHT_SHADOW_MODE_MSM;
+
+	// the highest bucket stands for any number of point lights
+	std::uint32_t point_lights_bucket = (lighting_features & LightingFeaturePointLightsMask) >> LightingFeaturePointLightsShift;
+	std::uint32_t point_lights_max = point_lights_bucket < 3 ? point_lights_bucket : MAX_POINT_LIGHTS_COUNT;
+
+	constants.push_back((lighting_features & LightingFeatureDirectionalLight) ? VK_TRUE : VK_FALSE);
+	constants.push_back(shadow_modes);
+	constants.push_back((lighting_features & LightingFeatureClusteredSpotLights) ? VK_TRUE : VK_FALSE);
+	constants.push_back(point_lights_max);
+}
+
 vk::ShaderModule Material::CreateShaderModule(vk::Device device, std::string shader)
 {
 	size_t size;
@@ -76,12 +109,13 @@ std::vector<vk::VertexInputAttributeDescription> Material::GetVertexInputAttribu
 	return Vertex::GetAttributeDescription();
 }
 
-Material::UBOInstanceData::UBOInstanceData(lavos::Buffer *uniform_buffer)
-		: uniform_buffer(uniform_buffer)
+Material::UBOInstanceData::UBOInstanceData(MaterialParameterArena *arena, vk::DeviceSize size)
+		: arena(arena),
+		allocation(arena->Allocate(size))
 {
 }
 
 Material::UBOInstanceData::~UBOInstanceData()
 {
-	delete uniform_buffer;
+	arena->Free(allocation);
 }
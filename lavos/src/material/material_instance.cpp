@@ -3,6 +3,8 @@
 #include "lavos/material/material_instance.h"
 #include "lavos/engine.h"
 
+#include <algorithm>
+
 using namespace lavos;
 
 MaterialInstance::MaterialInstance(Material *material, const RenderConfig &render_config, vk::DescriptorPool descriptor_pool)
@@ -22,11 +24,21 @@ MaterialInstance::~MaterialInstance()
 	for(auto it : instance_data)
 		material->DestroyInstanceData(it.first, it.second);
 
-	for(auto &entry : textures)
-		engine->DestroyTexture(entry.second);
-
+	std::vector<vk::DescriptorSet> sets;
 	for(auto it : descriptor_sets)
-		engine->GetVkDevice().freeDescriptorSets(descriptor_pool, it.second);
+		sets.push_back(it.second);
+	for(const auto &retired : retired_descriptor_sets)
+		sets.push_back(retired.second);
+
+	if(sets.empty())
+		return;
+
+	// submitted frames may still bind the sets, the pool is released after them by its owner
+	auto device = engine->GetVkDevice();
+	auto pool = descriptor_pool;
+	engine->DestroyAfter(engine->GetSubmittedValue(), [device, pool, sets]() {
+		device.freeDescriptorSets(pool, sets);
+	});
 }
 
 void MaterialInstance::CreateDescriptorSet(Material::DescriptorSetId id)
@@ -96,7 +108,15 @@ Texture *MaterialInstance::GetTexture(Material::TextureSlot slot)
 
 void MaterialInstance::SetParameter(Material::ParameterSlot slot, MaterialInstance::Parameter parameter)
 {
-	parameters.insert(std::make_pair(slot, parameter));
+	auto it = parameters.find(slot);
+	if(it != parameters.end())
+		it->second = parameter;
+	else
+		parameters.insert(std::make_pair(slot, parameter));
+
+	// only rewrites the parameters in host memory, the dirty range is uploaded with the next frame
+	for(auto data_it : instance_data)
+		WriteInstanceData(data_it.first);
 }
 
 MaterialInstance::Parameter *MaterialInstance::GetParameter(Material::ParameterSlot slot)
@@ -157,3 +177,56 @@ void MaterialInstance::WriteAllData()
 	for(auto it : descriptor_sets)
 		WriteDescriptorSet(it.first);
 }
+
+void MaterialInstance::FreeRetiredDescriptorSets(std::uint64_t completed_value)
+{
+	auto &device = material->GetEngine()->GetVkDevice();
+	retired_descriptor_sets.erase(std::remove_if(retired_descriptor_sets.begin(), retired_descriptor_sets.end(),
+			[&device, this, completed_value](const std::pair<std::uint64_t, vk::DescriptorSet> &retired) {
+		if(retired.first > completed_value)
+			return false;
+		device.freeDescriptorSets(descriptor_pool, retired.second);
+		return true;
+	}), retired_descriptor_sets.end());
+}
+
+void MaterialInstance::RenewDescriptorSets()
+{
+	auto engine = material->GetEngine();
+
+	if(descriptor_sets.empty())
+	{
+		WriteAllData();
+		return;
+	}
+
+	FreeRetiredDescriptorSets(engine->GetCompletedValue());
+
+	// everything submitted so far may bind the current sets
+	std::uint64_t value = engine->GetSubmittedValue();
+	auto ids = descriptor_sets;
+	for(const auto &it : ids)
+	{
+		retired_descriptor_sets.emplace_back(value, it.second);
+		descriptor_sets.erase(it.first);
+
+		while(true)
+		{
+			try
+			{
+				CreateDescriptorSet(it.first);
+				break;
+			}
+			catch(const vk::SystemError &)
+			{
+				// the pool is exhausted, make room by waiting for the oldest replaced set
+				if(retired_descriptor_sets.empty())
+					throw;
+				engine->WaitForValue(retired_descriptor_sets.front().first);
+				FreeRetiredDescriptorSets(retired_descriptor_sets.front().first);
+			}
+		}
+	}
+
+	WriteAllData();
+}
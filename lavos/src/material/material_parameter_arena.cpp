@@ -0,0 +1,149 @@
+
+#include "lavos/material/material_parameter_arena.h"
+#include "lavos/engine.h"
+#include "lavos/buffer.h"
+#include "lavos/vk_util.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace lavos;
+
+// vkCmdUpdateBuffer is limited to 65536 bytes per command
+static const vk::DeviceSize update_buffer_max_size = 65536;
+
+MaterialParameterArena::MaterialParameterArena(Engine *engine, vk::DeviceSize page_size)
+	: engine(engine),
+	page_size(page_size)
+{
+	// offsets and sizes of vkCmdUpdateBuffer must be multiples of 4
+	alignment = std::max<vk::DeviceSize>(engine->GetVkPhysicalDevice().getProperties().limits.minUniformBufferOffsetAlignment, 4);
+}
+
+MaterialParameterArena::~MaterialParameterArena()
+{
+	for(auto &page : pages)
+		delete page.buffer;
+}
+
+void MaterialParameterArena::AddPage()
+{
+	Page page;
+	page.buffer = engine->CreateBuffer(page_size,
+			vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eTransferDst,
+			VMA_MEMORY_USAGE_GPU_ONLY,
+			Engine::MemoryCategory::Uniforms);
+	vk_util::SetDebugUtilsObjectName(engine->GetVkDevice(), page.buffer->GetVkBuffer(), "MaterialParameterArena");
+	page.data.resize(page_size, 0);
+	page.used = 0;
+	page.dirty_begin = page_size;
+	page.dirty_end = 0;
+	pages.push_back(page);
+}
+
+MaterialParameterArena::Allocation MaterialParameterArena::Allocate(vk::DeviceSize size)
+{
+	vk::DeviceSize aligned_size = GetAlignedSize(size);
+	if(aligned_size > page_size)
+		throw std::runtime_error("Material parameters exceed MaterialParameterArena page size.");
+
+	auto free_it = free_allocations.find(aligned_size);
+	if(free_it != free_allocations.end() && !free_it->second.empty())
+	{
+		Allocation allocation = free_it->second.back();
+		free_it->second.pop_back();
+		allocation.size = size;
+		return allocation;
+	}
+
+	if(pages.empty() || pages.back().used + aligned_size > page_size)
+		AddPage();
+
+	auto &page = pages.back();
+	Allocation allocation = { static_cast<std::uint32_t>(pages.size() - 1), page.used, size };
+	page.used += aligned_size;
+	return allocation;
+}
+
+void MaterialParameterArena::Free(const Allocation &allocation)
+{
+	free_allocations[GetAlignedSize(allocation.size)].push_back(allocation);
+}
+
+void MaterialParameterArena::Write(const Allocation &allocation, const void *data, vk::DeviceSize size)
+{
+	assert(size <= allocation.size);
+
+	auto &page = pages[allocation.page];
+	memcpy(page.data.data() + allocation.offset, data, size);
+
+	page.dirty_begin = std::min(page.dirty_begin, allocation.offset);
+	page.dirty_end = std::max(page.dirty_end, allocation.offset + GetAlignedSize(size));
+	dirty = true;
+}
+
+void MaterialParameterArena::WriteBuffer(vk::Buffer buffer, vk::DeviceSize offset, const void *data, vk::DeviceSize size)
+{
+	assert(offset % 4 == 0);
+
+	// vkCmdUpdateBuffer needs a size that is a multiple of 4, the padding is written as zeros
+	BufferWrite write = { buffer, offset, std::vector<std::uint8_t>((size + 3) / 4 * 4, 0) };
+	memcpy(write.data.data(), data, size);
+	buffer_writes.push_back(std::move(write));
+	dirty = true;
+}
+
+vk::DescriptorBufferInfo MaterialParameterArena::GetDescriptorBufferInfo(const Allocation &allocation) const
+{
+	return vk::DescriptorBufferInfo()
+			.setBuffer(pages[allocation.page].buffer->GetVkBuffer())
+			.setOffset(allocation.offset)
+			.setRange(allocation.size);
+}
+
+void MaterialParameterArena::RecordUpload(vk::CommandBuffer command_buffer)
+{
+	if(!dirty)
+		return;
+
+	const auto shader_stages = vk::PipelineStageFlagBits::eVertexShader | vk::PipelineStageFlagBits::eFragmentShader;
+	const auto shader_access = vk::AccessFlagBits::eUniformRead | vk::AccessFlagBits::eShaderRead;
+
+	// previously submitted frames may still read the old parameters
+	command_buffer.pipelineBarrier(shader_stages, vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags(),
+			vk::MemoryBarrier()
+				.setSrcAccessMask(shader_access)
+				.setDstAccessMask(vk::AccessFlagBits::eTransferWrite),
+			nullptr, nullptr);
+
+	for(auto &page : pages)
+	{
+		for(vk::DeviceSize offset = page.dirty_begin; offset < page.dirty_end; offset += update_buffer_max_size)
+		{
+			vk::DeviceSize size = std::min(update_buffer_max_size, page.dirty_end - offset);
+			command_buffer.updateBuffer(page.buffer->GetVkBuffer(), offset, size, page.data.data() + offset);
+		}
+
+		page.dirty_begin = page_size;
+		page.dirty_end = 0;
+	}
+
+	for(const auto &write : buffer_writes)
+	{
+		auto write_size = static_cast<vk::DeviceSize>(write.data.size());
+		for(vk::DeviceSize offset = 0; offset < write_size; offset += update_buffer_max_size)
+		{
+			vk::DeviceSize size = std::min(update_buffer_max_size, write_size - offset);
+			command_buffer.updateBuffer(write.buffer, write.offset + offset, size, write.data.data() + offset);
+		}
+	}
+	buffer_writes.clear();
+
+	command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, shader_stages, vk::DependencyFlags(),
+			vk::MemoryBarrier()
+				.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+				.setDstAccessMask(shader_access),
+			nullptr, nullptr);
+
+	dirty = false;
+}
@@ -0,0 +1,199 @@
+
+#include "lavos/material/material_table.h"
+#include "lavos/material/material_parameter_arena.h"
+#include "lavos/engine.h"
+#include "lavos/buffer.h"
+
+#include "../../glsl/common_glsl_cpp.h"
+
+#include <array>
+
+using namespace lavos;
+
+const std::size_t MaterialTable::block_size = MATERIAL_TABLE_BLOCK_SIZE;
+
+MaterialTable::MaterialTable(Engine *engine, std::uint32_t texture_capacity, std::uint32_t block_capacity)
+	: engine(engine),
+	texture_capacity(texture_capacity),
+	block_capacity(block_capacity)
+{
+	CreateDescriptorSetLayout();
+	CreateDescriptorPool();
+	CreateDescriptorSet();
+	CreateParameterBuffer();
+}
+
+MaterialTable::~MaterialTable()
+{
+	auto &device = engine->GetVkDevice();
+
+	delete parameter_buffer;
+
+	device.destroyDescriptorPool(descriptor_pool);
+	device.destroyDescriptorSetLayout(descriptor_set_layout);
+}
+
+void MaterialTable::CreateDescriptorSetLayout()
+{
+	std::array<vk::DescriptorSetLayoutBinding, 2> bindings = {
+		vk::DescriptorSetLayoutBinding()
+			.setBinding(DESCRIPTOR_SET_MATERIAL_TABLE_BINDING_TEXTURES)
+			.setDescriptorType(vk::DescriptorType::eCombinedImageSampler)
+			.setDescriptorCount(texture_capacity)
+			.setStageFlags(vk::ShaderStageFlagBits::eFragment),
+
+		vk::DescriptorSetLayoutBinding()
+			.setBinding(DESCRIPTOR_SET_MATERIAL_TABLE_BINDING_PARAMETERS)
+			.setDescriptorType(vk::DescriptorType::eStorageBuffer)
+			.setDescriptorCount(1)
+			.setStageFlags(vk::ShaderStageFlagBits::eFragment)
+	};
+
+	// textures are added and removed while command buffers using the set may be pending,
+	// and unused slots are never written
+	std::array<vk::DescriptorBindingFlagsEXT, 2> binding_flags = {
+		vk::DescriptorBindingFlagBitsEXT::ePartiallyBound
+			| vk::DescriptorBindingFlagBitsEXT::eUpdateAfterBind
+			| vk::DescriptorBindingFlagBitsEXT::eUpdateUnusedWhilePending,
+		vk::DescriptorBindingFlagsEXT()
+	};
+
+	auto binding_flags_info = vk::DescriptorSetLayoutBindingFlagsCreateInfoEXT()
+			.setBindingCount(static_cast<uint32_t>(binding_flags.size()))
+			.setPBindingFlags(binding_flags.data());
+
+	descriptor_set_layout = engine->GetVkDevice().createDescriptorSetLayout(vk::DescriptorSetLayoutCreateInfo()
+			.setPNext(&binding_flags_info)
+			.setFlags(vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPoolEXT)
+			.setBindingCount(static_cast<uint32_t>(bindings.size()))
+			.setPBindings(bindings.data()));
+}
+
+void MaterialTable::CreateDescriptorPool()
+{
+	std::array<vk::DescriptorPoolSize, 2> pool_sizes = {
+		vk::DescriptorPoolSize(vk::DescriptorType::eCombinedImageSampler, texture_capacity),
+		vk::DescriptorPoolSize(vk::DescriptorType::eStorageBuffer, 1)
+	};
+
+	descriptor_pool = engine->GetVkDevice().createDescriptorPool(vk::DescriptorPoolCreateInfo()
+			.setFlags(vk::DescriptorPoolCreateFlagBits::eUpdateAfterBindEXT)
+			.setPoolSizeCount(static_cast<uint32_t>(pool_sizes.size()))
+			.setPPoolSizes(pool_sizes.data())
+			.setMaxSets(1));
+}
+
+void MaterialTable::CreateDescriptorSet()
+{
+	descriptor_set = *engine->GetVkDevice().allocateDescriptorSets(vk::DescriptorSetAllocateInfo()
+			.setDescriptorPool(descriptor_pool)
+			.setDescriptorSetCount(1)
+			.setPSetLayouts(&descriptor_set_layout)).begin();
+}
+
+void MaterialTable::CreateParameterBuffer()
+{
+	vk::DeviceSize size = block_capacity * block_size;
+	parameter_buffer = engine->CreateBuffer(size, vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+			VMA_MEMORY_USAGE_GPU_ONLY, Engine::MemoryCategory::Uniforms);
+
+	auto buffer_info = vk::DescriptorBufferInfo()
+			.setBuffer(parameter_buffer->GetVkBuffer())
+			.setOffset(0)
+			.setRange(size);
+
+	engine->GetVkDevice().updateDescriptorSets(vk::WriteDescriptorSet()
+			.setDstSet(descriptor_set)
+			.setDstBinding(DESCRIPTOR_SET_MATERIAL_TABLE_BINDING_PARAMETERS)
+			.setDstArrayElement(0)
+			.setDescriptorType(vk::DescriptorType::eStorageBuffer)
+			.setDescriptorCount(1)
+			.setPBufferInfo(&buffer_info), nullptr);
+}
+
+MaterialTable::TextureIndex MaterialTable::AddTexture(const Texture &texture)
+{
+	auto key = std::make_pair(static_cast<VkImageView>(texture.image_view), static_cast<VkSampler>(texture.sampler));
+	auto it = texture_indices.find(key);
+	if(it != texture_indices.end())
+	{
+		textures[it->second].references++;
+		return it->second;
+	}
+
+	TextureIndex index;
+	if(!free_textures.empty())
+	{
+		index = free_textures.back();
+		free_textures.pop_back();
+	}
+	else
+	{
+		if(textures.size() >= texture_capacity)
+			throw std::runtime_error("MaterialTable texture capacity exceeded.");
+		index = static_cast<TextureIndex>(textures.size());
+		textures.emplace_back();
+	}
+
+	textures[index] = { texture.image_view, texture.sampler, 1 };
+	texture_indices[key] = index;
+
+	auto image_info = vk::DescriptorImageInfo()
+			.setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
+			.setImageView(texture.image_view)
+			.setSampler(texture.sampler);
+
+	engine->GetVkDevice().updateDescriptorSets(vk::WriteDescriptorSet()
+			.setDstSet(descriptor_set)
+			.setDstBinding(DESCRIPTOR_SET_MATERIAL_TABLE_BINDING_TEXTURES)
+			.setDstArrayElement(index)
+			.setDescriptorType(vk::DescriptorType::eCombinedImageSampler)
+			.setDescriptorCount(1)
+			.setPImageInfo(&image_info), nullptr);
+
+	return index;
+}
+
+void MaterialTable::RemoveTexture(TextureIndex index)
+{
+	auto &entry = textures[index];
+	if(--entry.references > 0)
+		return;
+
+	// the descriptor is left as it is, partially bound slots are fine as long as no shader reads them
+	texture_indices.erase(std::make_pair(static_cast<VkImageView>(entry.image_view), static_cast<VkSampler>(entry.sampler)));
+	entry = { nullptr, nullptr, 0 };
+
+	// submitted frames may still sample the slot, so it must not be overwritten by AddTexture() before they finished
+	engine->DestroyAfter(engine->GetSubmittedValue(), [this, index]() {
+		free_textures.push_back(index);
+	});
+}
+
+MaterialTable::BlockIndex MaterialTable::AllocateBlock()
+{
+	if(!free_blocks.empty())
+	{
+		BlockIndex index = free_blocks.back();
+		free_blocks.pop_back();
+		return index;
+	}
+
+	if(blocks_count >= block_capacity)
+		throw std::runtime_error("MaterialTable parameter block capacity exceeded.");
+
+	return blocks_count++;
+}
+
+void MaterialTable::FreeBlock(BlockIndex index)
+{
+	free_blocks.push_back(index);
+}
+
+void MaterialTable::WriteBlock(BlockIndex index, const void *data, std::size_t size)
+{
+	assert(size <= block_size);
+
+	// staged instead of written in place, submitted frames may still read the block
+	engine->GetMaterialParameterArena()->WriteBuffer(parameter_buffer->GetVkBuffer(), index * block_size, data, size);
+}
@@ -5,36 +5,66 @@
 
 #include "lavos/shader_load.h"
 
+#include "../../glsl/common_glsl_cpp.h"
+
 using namespace lavos;
 
-PhongMaterial::PhongMaterial(lavos::Engine *engine) : Material(engine)
+PhongMaterial::PhongMaterial(lavos::Engine *engine)
+	: Material(engine),
+	material_table(engine->GetMaterialTable())
 {
 	CreateDescriptorSetLayouts();
 
 	vert_shader_module = CreateShaderModule(engine->GetVkDevice(), "material/phong.vert");
-	frag_shader_module = CreateShaderModule(engine->GetVkDevice(), "material/phong.frag");
+	frag_shader_module = CreateShaderModule(engine->GetVkDevice(),
+			material_table ? "material/phong_bindless.frag" : "material/phong.frag");
+	gbuffer_frag_shader_module = CreateShaderModule(engine->GetVkDevice(),
+			material_table ? "material/phong_gbuffer_bindless.frag" : "material/phong_gbuffer.frag");
 	shadow_vert_shader_module = CreateShaderModule(engine->GetVkDevice(), "material/shadow.vert");
 	shadow_frag_shader_module = CreateShaderModule(engine->GetVkDevice(), "material/shadow.frag");
+	if(engine->GetMultiviewEnabled())
+		shadow_multiview_vert_shader_module = CreateShaderModule(engine->GetVkDevice(), "material/shadow_multiview.vert");
+	depth_prepass_vert_shader_module = CreateShaderModule(engine->GetVkDevice(), "material/depth_prepass.vert");
 
 	texture_default_base_color = Texture::CreateColor(engine, vk::Format::eR8G8B8Unorm, glm::vec4(1.0f, 1.0f, 1.0f, 0.0f));
 	texture_default_normal = Texture::CreateColor(engine, vk::Format::eR8G8B8Unorm, glm::vec4(0.5f, 0.5f, 1.0f, 0.0f));
+
+	if(material_table)
+	{
+		texture_default_base_color_index = material_table->AddTexture(texture_default_base_color);
+		texture_default_normal_index = material_table->AddTexture(texture_default_normal);
+	}
 }
 
 PhongMaterial::~PhongMaterial()
 {
 	auto &device = engine->GetVkDevice();
 
+	if(material_table)
+	{
+		material_table->RemoveTexture(texture_default_base_color_index);
+		material_table->RemoveTexture(texture_default_normal_index);
+	}
+
 	engine->DestroyTexture(texture_default_base_color);
 	engine->DestroyTexture(texture_default_normal);
 
 	device.destroyShaderModule(vert_shader_module);
 	device.destroyShaderModule(frag_shader_module);
+	device.destroyShaderModule(gbuffer_frag_shader_module);
 	device.destroyShaderModule(shadow_vert_shader_module);
 	device.destroyShaderModule(shadow_frag_shader_module);
+	if(shadow_multiview_vert_shader_module)
+		device.destroyShaderModule(shadow_multiview_vert_shader_module);
+	device.destroyShaderModule(depth_prepass_vert_shader_module);
 }
 
 void PhongMaterial::CreateDescriptorSetLayouts()
 {
+	// all resources come from the MaterialTable
+	if(material_table)
+		return;
+
 	CreateDescriptorSetLayout(DescriptorSetLayoutIdDefault, {
 			vk::DescriptorSetLayoutBinding()
 					.setBinding(0)
@@ -87,12 +117,96 @@ std::vector<vk::PipelineShaderStageCreateInfo> PhongMaterial::GetShaderStageCrea
 												  "main")
 		};
 	}
+	else if(render_mode == DefaultRenderMode::ShadowMultiview)
+	{
+		return {
+				vk::PipelineShaderStageCreateInfo(vk::PipelineShaderStageCreateFlags(),
+												  vk::ShaderStageFlagBits::eVertex,
+												  shadow_multiview_vert_shader_module,
+												  "main"),
+				vk::PipelineShaderStageCreateInfo(vk::PipelineShaderStageCreateFlags(),
+												  vk::ShaderStageFlagBits::eFragment,
+												  shadow_frag_shader_module,
+												  "main")
+		};
+	}
+	else if(render_mode == DefaultRenderMode::GBuffer)
+	{
+		return {
+				vk::PipelineShaderStageCreateInfo(vk::PipelineShaderStageCreateFlags(),
+												  vk::ShaderStageFlagBits::eVertex,
+												  vert_shader_module,
+												  "main"),
+				vk::PipelineShaderStageCreateInfo(vk::PipelineShaderStageCreateFlags(),
+												  vk::ShaderStageFlagBits::eFragment,
+												  gbuffer_frag_shader_module,
+												  "main")
+		};
+	}
+	else if(render_mode == DefaultRenderMode::DepthPrepass)
+	{
+		return {
+				vk::PipelineShaderStageCreateInfo(vk::PipelineShaderStageCreateFlags(),
+												  vk::ShaderStageFlagBits::eVertex,
+												  depth_prepass_vert_shader_module,
+												  "main")
+		};
+	}
 	else
 	{
 		assert(false);
 	}
 }
 
+Material::VariantKey PhongMaterial::GetVariantKey(RenderMode render_mode, MaterialInstance *instance, std::uint32_t lighting_features) const
+{
+	// the depth prepass only needs to know which instances it must leave out
+	if(render_mode == DefaultRenderMode::DepthPrepass)
+		return instance->GetParameter(parameter_slot_alpha_cutoff) ? VariantAlphaMask : 0;
+
+	if(render_mode != DefaultRenderMode::ColorForward && render_mode != DefaultRenderMode::GBuffer)
+		return 0;
+
+	VariantKey variant = 0;
+	if(instance->GetTexture(texture_slot_base_color))
+		variant |= VariantBaseColorTexture;
+	if(instance->GetTexture(texture_slot_normal))
+		variant |= VariantNormalTexture;
+	if(instance->GetParameter(parameter_slot_alpha_cutoff))
+		variant |= VariantAlphaMask;
+
+	// the G-buffer pass does no lighting
+	if(render_mode == DefaultRenderMode::ColorForward)
+		variant |= lighting_features << variant_lighting_features_shift;
+
+	return variant;
+}
+
+std::vector<std::uint32_t> PhongMaterial::GetSpecializationConstants(RenderMode render_mode, VariantKey variant) const
+{
+	if(render_mode != DefaultRenderMode::ColorForward && render_mode != DefaultRenderMode::GBuffer)
+		return {};
+
+	std::vector<std::uint32_t> constants;
+	AppendLightingSpecializationConstants(variant >> variant_lighting_features_shift, constants);
+
+	static_assert(SPECIALIZATION_CONSTANT_PHONG_BASE_COLOR_TEX == 4
+			&& SPECIALIZATION_CONSTANT_PHONG_NORMAL_TEX == 5
+			&& SPECIALIZATION_CONSTANT_PHONG_ALPHA_MASK == 6, "phong specialization constant ids");
+
+	constants.push_back((variant & VariantBaseColorTexture) ? VK_TRUE : VK_FALSE);
+	constants.push_back((variant & VariantNormalTexture) ? VK_TRUE : VK_FALSE);
+	constants.push_back((variant & VariantAlphaMask) ? VK_TRUE : VK_FALSE);
+	return constants;
+}
+
+std::uint32_t PhongMaterial::GetMaterialTableIndex(RenderMode render_mode, MaterialInstance *instance) const
+{
+	// the G-buffer pass shares the instance data of forward rendering
+	auto data = reinterpret_cast<MaterialTableInstanceData *>(instance->GetInstanceData(DefaultRenderMode::ColorForward));
+	return data ? data->block : 0;
+}
+
 
 void PhongMaterial::WriteDescriptorSet(Material::DescriptorSetId id, vk::DescriptorSet descriptor_set, MaterialInstance *instance)
 {
@@ -100,10 +214,7 @@ void PhongMaterial::WriteDescriptorSet(Material::DescriptorSetId id, vk::Descrip
 	{
 		auto instance_data = reinterpret_cast<UBOInstanceData *>(instance->GetInstanceData(id));
 
-		auto ubo_info = vk::DescriptorBufferInfo()
-				.setBuffer(instance_data->uniform_buffer->GetVkBuffer())
-				.setOffset(0)
-				.setRange(sizeof(UniformBuffer));
+		auto ubo_info = instance_data->GetDescriptorBufferInfo();
 
 		auto ubo_write = vk::WriteDescriptorSet()
 				.setDstSet(descriptor_set)
@@ -166,14 +277,18 @@ void PhongMaterial::WriteDescriptorSet(Material::DescriptorSetId id, vk::Descrip
 
 void *PhongMaterial::CreateInstanceData(InstanceDataId id)
 {
-	if(id == DefaultRenderMode::ColorForward)
+	if(id == DefaultRenderMode::ColorForward && material_table)
 	{
-		auto buffer = engine->CreateBuffer(sizeof(UniformBuffer),
-										   vk::BufferUsageFlagBits::eUniformBuffer,
-										   VMA_MEMORY_USAGE_CPU_ONLY);
-
-
-		return new UBOInstanceData(buffer);
+		// every instance data holds one reference to each of its textures, starting with the defaults
+		auto data = new MaterialTableInstanceData;
+		data->block = material_table->AllocateBlock();
+		data->base_color_texture = material_table->AddTexture(texture_default_base_color);
+		data->normal_texture = material_table->AddTexture(texture_default_normal);
+		return data;
+	}
+	else if(id == DefaultRenderMode::ColorForward)
+	{
+		return new UBOInstanceData(engine->GetMaterialParameterArena(), sizeof(UniformBuffer));
 	}
 	else if(id == DefaultRenderMode::Shadow)
 	{
@@ -187,7 +302,15 @@ void *PhongMaterial::CreateInstanceData(InstanceDataId id)
 
 void PhongMaterial::DestroyInstanceData(InstanceDataId id, void *data_p)
 {
-	if(id == DefaultRenderMode::ColorForward)
+	if(id == DefaultRenderMode::ColorForward && material_table)
+	{
+		auto data = reinterpret_cast<MaterialTableInstanceData *>(data_p);
+		material_table->RemoveTexture(data->base_color_texture);
+		material_table->RemoveTexture(data->normal_texture);
+		material_table->FreeBlock(data->block);
+		delete data;
+	}
+	else if(id == DefaultRenderMode::ColorForward)
 	{
 		auto data = reinterpret_cast<UBOInstanceData *>(data_p);
 		delete data;
@@ -203,16 +326,40 @@ void PhongMaterial::DestroyInstanceData(InstanceDataId id, void *data_p)
 
 void PhongMaterial::UpdateInstanceData(InstanceDataId id, void *data_p, MaterialInstance *instance)
 {
-	if(id == DefaultRenderMode::ColorForward)
+	if(id == DefaultRenderMode::ColorForward && material_table)
+	{
+		auto data = reinterpret_cast<MaterialTableInstanceData *>(data_p);
+
+		// add the new references before removing the old ones, which may be the same
+		auto update_texture = [this, instance](MaterialTable::TextureIndex &index, TextureSlot slot, const Texture &default_texture) {
+			Texture *texture = instance->GetTexture(slot);
+			auto new_index = material_table->AddTexture(texture ? *texture : default_texture);
+			material_table->RemoveTexture(index);
+			index = new_index;
+		};
+		update_texture(data->base_color_texture, texture_slot_base_color, texture_default_base_color);
+		update_texture(data->normal_texture, texture_slot_normal, texture_default_normal);
+
+		MaterialTableBlock block;
+		block.color_factor = instance->GetParameter(parameter_slot_base_color_factor, glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
+		block.specular_exponent = instance->GetParameter(parameter_slot_specular_exponent, 16.0f);
+		block.alpha_cutoff = instance->GetParameter(parameter_slot_alpha_cutoff, 0.0f);
+		block.base_color_texture = data->base_color_texture;
+		block.normal_texture = data->normal_texture;
+
+		static_assert(sizeof(MaterialTableBlock) <= MATERIAL_TABLE_BLOCK_SIZE, "MaterialTableBlock size");
+		material_table->WriteBlock(data->block, &block, sizeof(block));
+	}
+	else if(id == DefaultRenderMode::ColorForward)
 	{
 		auto data = reinterpret_cast<UBOInstanceData *>(data_p);
 
 		UniformBuffer ubo;
 		ubo.color_factor = instance->GetParameter(parameter_slot_base_color_factor, glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
 		ubo.specular_exponent = instance->GetParameter(parameter_slot_specular_exponent, 16.0f);
+		ubo.alpha_cutoff = instance->GetParameter(parameter_slot_alpha_cutoff, 0.0f);
 
-		memcpy(data->uniform_buffer->Map(), &ubo, sizeof(ubo));
-		data->uniform_buffer->UnMap();
+		data->Write(&ubo, sizeof(ubo));
 	}
 	else if(id == DefaultRenderMode::Shadow)
 	{
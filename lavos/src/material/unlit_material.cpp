@@ -66,10 +66,7 @@ void UnlitMaterial::WriteDescriptorSet(DescriptorSetId id, vk::DescriptorSet des
 {
 	auto instance_data = reinterpret_cast<UBOInstanceData *>(instance->GetInstanceData(id));
 
-	auto ubo_info = vk::DescriptorBufferInfo()
-		.setBuffer(instance_data->uniform_buffer->GetVkBuffer())
-		.setOffset(0)
-		.setRange(sizeof(UniformBuffer));
+	auto ubo_info = instance_data->GetDescriptorBufferInfo();
 
 	auto ubo_write = vk::WriteDescriptorSet()
 		.setDstSet(descriptor_set)
@@ -104,11 +101,7 @@ void UnlitMaterial::WriteDescriptorSet(DescriptorSetId id, vk::DescriptorSet des
 
 void *UnlitMaterial::CreateInstanceData(InstanceDataId id)
 {
-	auto buffer = engine->CreateBuffer(sizeof(UniformBuffer),
-									   vk::BufferUsageFlagBits::eUniformBuffer,
-									   VMA_MEMORY_USAGE_CPU_ONLY);
-
-	return new UBOInstanceData(buffer);
+	return new UBOInstanceData(engine->GetMaterialParameterArena(), sizeof(UniformBuffer));
 }
 
 void UnlitMaterial::DestroyInstanceData(InstanceDataId id, void *data_p)
@@ -125,6 +118,5 @@ void UnlitMaterial::UpdateInstanceData(InstanceDataId id, void *data_p, Material
 
 	ubo.color_factor = instance->GetParameter(parameter_slot_base_color_factor, glm::vec3(1.0f, 1.0f, 1.0f));
 
-	memcpy(data->uniform_buffer->Map(), &ubo, sizeof(ubo));
-	data->uniform_buffer->UnMap();
+	data->Write(&ubo, sizeof(ubo));
 }
\ No newline at end of file
@@ -3,9 +3,12 @@
 
 #include "lavos/material_pipeline_manager.h"
 #include "lavos/renderer.h"
+#include "lavos/material/material_table.h"
 
 #include "../glsl/common_glsl_cpp.h"
 
+#include <algorithm>
+
 using namespace lavos;
 
 MaterialPipelineManager::MaterialPipelineManager(Engine *engine, const MaterialPipelineConfiguration &config)
@@ -25,14 +28,16 @@ void MaterialPipelineManager::SetConfiguration(const MaterialPipelineConfigurati
 		return;
 
 	this->config = config;
-	RecreateAllMaterialPipelines();
+
+	// recreated on demand with the new configuration
+	DestroyAllMaterialPipelines();
 }
 
-MaterialPipeline MaterialPipelineManager::CreateMaterialPipeline(Material *material, Material::RenderMode render_mode)
+MaterialPipeline MaterialPipelineManager::CreateMaterialPipeline(Material *material, Material::RenderMode render_mode, Material::VariantKey variant)
 {
 	auto device = engine->GetVkDevice();
 
-	auto pipeline = MaterialPipeline(material);
+	auto pipeline = MaterialPipeline(material, variant);
 
 	// pipeline layout
 
@@ -43,11 +48,18 @@ MaterialPipeline MaterialPipelineManager::CreateMaterialPipeline(Material *mater
 	static_assert(DESCRIPTOR_SET_INDEX_COMMON == 0, "descriptor set index mismatch");
 	pipeline.renderer_descriptor_set_index = DESCRIPTOR_SET_INDEX_COMMON;
 
+	static_assert(DESCRIPTOR_SET_INDEX_MATERIAL == 1, "descriptor set index mismatch");
+
 	auto descriptor_set_layout_id = material->GetDescriptorSetId(render_mode);
 	auto material_descriptor_set_layout = material->GetDescriptorSetLayout(descriptor_set_layout_id);
-	if(material_descriptor_set_layout)
+	if(material->GetMaterialTableUsage(render_mode))
+	{
+		descriptor_set_layouts.push_back(engine->GetMaterialTable()->GetDescriptorSetLayout());
+		pipeline.material_descriptor_set_index = DESCRIPTOR_SET_INDEX_MATERIAL;
+		pipeline.material_table = true;
+	}
+	else if(material_descriptor_set_layout)
 	{
-		static_assert(DESCRIPTOR_SET_INDEX_MATERIAL == 1, "descriptor set index mismatch");
 		descriptor_set_layouts.push_back(material_descriptor_set_layout->layout);
 		pipeline.material_descriptor_set_index = DESCRIPTOR_SET_INDEX_MATERIAL;
 	}
@@ -59,7 +71,7 @@ MaterialPipeline MaterialPipelineManager::CreateMaterialPipeline(Material *mater
 
 
 	auto push_constant_range = vk::PushConstantRange()
-			.setStageFlags(vk::ShaderStageFlagBits::eVertex)
+			.setStageFlags(vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment)
 			.setOffset(0)
 			.setSize(sizeof(TransformPushConstant));
 
@@ -76,9 +88,52 @@ MaterialPipeline MaterialPipelineManager::CreateMaterialPipeline(Material *mater
 	// pipeline
 
 	auto shader_stages = material->GetShaderStageCreateInfos(render_mode);
+	if(config.depth_only)
+	{
+		shader_stages.erase(std::remove_if(shader_stages.begin(), shader_stages.end(),
+				[](const vk::PipelineShaderStageCreateInfo &stage) { return stage.stage != vk::ShaderStageFlagBits::eVertex; }),
+				shader_stages.end());
+	}
+
+	std::vector<std::uint32_t> specialization_constants;
+	if(render_mode == Material::DefaultRenderMode::Shadow || render_mode == Material::DefaultRenderMode::ShadowMultiview)
+	{
+		// the shadow vertex shaders only pass the depth on if there is a fragment shader writing moments
+		static_assert(SPECIALIZATION_CONSTANT_SHADOW_MOMENTS == 0, "shadow specialization constant ids");
+		specialization_constants.push_back(config.depth_only ? VK_FALSE : VK_TRUE);
+	}
+	else
+	{
+		specialization_constants = material->GetSpecializationConstants(render_mode, variant);
+	}
+	std::vector<vk::SpecializationMapEntry> specialization_entries;
+	for(std::uint32_t i=0; i<specialization_constants.size(); i++)
+		specialization_entries.emplace_back(i, i * sizeof(std::uint32_t), sizeof(std::uint32_t));
 
-	auto vertex_binding_descriptions = material->GetVertexInputBindingDescriptions();
-	auto vertex_attribute_descriptions = material->GetVertexInputAttributeDescriptions();
+	auto specialization_info = vk::SpecializationInfo()
+			.setMapEntryCount(static_cast<uint32_t>(specialization_entries.size()))
+			.setPMapEntries(specialization_entries.data())
+			.setDataSize(specialization_constants.size() * sizeof(std::uint32_t))
+			.setPData(specialization_constants.data());
+
+	if(!specialization_constants.empty())
+	{
+		for(auto &stage : shader_stages)
+			stage.setPSpecializationInfo(&specialization_info);
+	}
+
+	std::vector<vk::VertexInputBindingDescription> vertex_binding_descriptions;
+	std::vector<vk::VertexInputAttributeDescription> vertex_attribute_descriptions;
+	if(config.position_only)
+	{
+		vertex_binding_descriptions = { vk::VertexInputBindingDescription(0, sizeof(glm::vec3), vk::VertexInputRate::eVertex) };
+		vertex_attribute_descriptions = { vk::VertexInputAttributeDescription(0, 0, vk::Format::eR32G32B32Sfloat, 0) };
+	}
+	else
+	{
+		vertex_binding_descriptions = material->GetVertexInputBindingDescriptions();
+		vertex_attribute_descriptions = material->GetVertexInputAttributeDescriptions();
+	}
 
 	auto vertex_input_info = vk::PipelineVertexInputStateCreateInfo()
 			.setVertexBindingDescriptionCount(static_cast<uint32_t>(vertex_binding_descriptions.size()))
@@ -104,8 +159,10 @@ MaterialPipeline MaterialPipelineManager::CreateMaterialPipeline(Material *mater
 			.setPolygonMode(vk::PolygonMode::eFill)
 			.setLineWidth(1.0f)
 			.setCullMode(vk::CullModeFlagBits::eBack)
-			.setFrontFace(vk::FrontFace::eCounterClockwise)
-			.setDepthBiasEnable(VK_FALSE);
+			.setFrontFace(config.front_face)
+			// the actual bias values are set per draw as dynamic state
+			.setDepthBiasEnable(std::find(config.dynamic_states.begin(), config.dynamic_states.end(), vk::DynamicState::eDepthBias)
+					!= config.dynamic_states.end() ? VK_TRUE : VK_FALSE);
 
 
 	auto multisample_info = vk::PipelineMultisampleStateCreateInfo()
@@ -113,13 +170,21 @@ MaterialPipeline MaterialPipelineManager::CreateMaterialPipeline(Material *mater
 			.setRasterizationSamples(config.samples);
 
 
+	bool depth_prepassed = config.depth_prepass
+			&& material->GetRenderModeSupport(Material::DefaultRenderMode::DepthPrepass)
+			&& material->GetVariantDepthPrepassSupport(variant);
+
 	auto depth_stencil_info = vk::PipelineDepthStencilStateCreateInfo()
 			.setDepthTestEnable(VK_TRUE)
-			.setDepthWriteEnable(VK_TRUE)
-			.setDepthCompareOp(vk::CompareOp::eLess)
+			.setDepthWriteEnable(depth_prepassed ? VK_FALSE : VK_TRUE)
+			.setDepthCompareOp(depth_prepassed ? vk::CompareOp::eEqual : vk::CompareOp::eLess)
 			.setDepthBoundsTestEnable(VK_FALSE)
 			.setStencilTestEnable(VK_FALSE);
 
+	auto dynamic_state_info = vk::PipelineDynamicStateCreateInfo()
+			.setDynamicStateCount(static_cast<uint32_t>(config.dynamic_states.size()))
+			.setPDynamicStates(config.dynamic_states.data());
+
 	auto pipeline_info = vk::GraphicsPipelineCreateInfo()
 			.setStageCount(static_cast<uint32_t>(shader_stages.size()))
 			.setPStages(shader_stages.data())
@@ -130,11 +195,20 @@ MaterialPipeline MaterialPipelineManager::CreateMaterialPipeline(Material *mater
 			.setPMultisampleState(&multisample_info)
 			.setPDepthStencilState(&depth_stencil_info)
 			.setPColorBlendState(&config.color_blend_state_info.Get())
-			.setPDynamicState(nullptr)
+			.setPDynamicState(config.dynamic_states.empty() ? nullptr : &dynamic_state_info)
 			.setLayout(pipeline.pipeline_layout)
 			.setRenderPass(config.render_pass)
-			.setSubpass(0);
+			.setSubpass(config.subpass);
+
+	auto rendering_info = vk::PipelineRenderingCreateInfoKHR()
+			.setViewMask(config.view_mask)
+			.setColorAttachmentCount(static_cast<uint32_t>(config.color_formats.size()))
+			.setPColorAttachmentFormats(config.color_formats.data())
+			.setDepthAttachmentFormat(config.depth_format)
+			.setStencilAttachmentFormat(Engine::HasStencilComponent(config.depth_format) ? config.depth_format : vk::Format::eUndefined);
 
+	if(!config.render_pass)
+		pipeline_info.setPNext(&rendering_info);
 
 	pipeline.pipeline = device.createGraphicsPipeline(nullptr, pipeline_info);
 
@@ -158,45 +232,46 @@ void MaterialPipelineManager::DestroyAllMaterialPipelines()
 
 void MaterialPipelineManager::AddMaterial(Material *material)
 {
-	for(auto pipeline : material_pipelines)
-	{
-		if(pipeline.material == material)
-			return;
-	}
+	if(!material->GetRenderModeSupport(config.render_mode))
+		return;
 
-	material_pipelines.push_back(CreateMaterialPipeline(material, config.render_mode));
+	if(std::find(materials.begin(), materials.end(), material) != materials.end())
+		return;
+
+	materials.push_back(material);
 }
 
 void MaterialPipelineManager::RemoveMaterial(Material *material)
 {
-	for(auto it=material_pipelines.begin(); it!=material_pipelines.end(); it++)
+	auto material_it = std::find(materials.begin(), materials.end(), material);
+	if(material_it == materials.end())
+		return;
+	materials.erase(material_it);
+
+	for(auto it=material_pipelines.begin(); it!=material_pipelines.end();)
 	{
 		if(it->material == material)
 		{
 			DestroyMaterialPipeline(*it);
-			material_pipelines.erase(it);
-			return;
+			it = material_pipelines.erase(it);
 		}
+		else
+			it++;
 	}
 }
 
-void MaterialPipelineManager::RecreateAllMaterialPipelines()
-{
-	for(auto &material_pipeline : material_pipelines)
-	{
-		auto material = material_pipeline.material;
-		DestroyMaterialPipeline(material_pipeline);
-		material_pipeline = CreateMaterialPipeline(material, config.render_mode);
-	}
-}
-
-MaterialPipeline *MaterialPipelineManager::GetMaterialPipeline(Material *material)
+MaterialPipeline *MaterialPipelineManager::GetMaterialPipeline(Material *material, Material::VariantKey variant)
 {
 	for(auto &p : material_pipelines)
 	{
-		if(p.material == material)
+		if(p.material == material && p.variant == variant)
 			return &p;
 	}
-	return nullptr;
+
+	if(std::find(materials.begin(), materials.end(), material) == materials.end())
+		return nullptr;
+
+	material_pipelines.push_back(CreateMaterialPipeline(material, config.render_mode, variant));
+	return &material_pipelines.back();
 }
 
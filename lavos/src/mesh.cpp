@@ -2,6 +2,8 @@
 #include "lavos/mesh.h"
 #include "lavos/engine.h"
 
+#include <glm/common.hpp>
+
 #include <iostream>
 
 using namespace lavos;
@@ -13,49 +15,76 @@ Mesh::Mesh(Engine *engine)
 
 Mesh::~Mesh()
 {
-	delete vertex_buffer;
-	delete index_buffer;
+	auto geometry_arena = engine->GetGeometryArena();
+	if(vertex_allocation)
+		geometry_arena->Free(vertex_allocation);
+	if(index_allocation)
+		geometry_arena->Free(index_allocation);
 }
 
 void Mesh::CreateVertexBuffer()
 {
-	vk::DeviceSize size = sizeof(vertices[0]) * vertices.size();
-
-	auto staging_buffer = engine->CreateBuffer(size, vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_CPU_ONLY);
-	memcpy(staging_buffer->Map(), vertices.data(), size);
-	staging_buffer->UnMap();
-
-	vertex_buffer = engine->CreateBuffer(size, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eVertexBuffer,
-										 VMA_MEMORY_USAGE_GPU_ONLY);
-
-	engine->CopyBuffer(staging_buffer->GetVkBuffer(), vertex_buffer->GetVkBuffer(), size);
-
-	delete staging_buffer;
+	std::vector<glm::vec3> positions;
+	positions.reserve(vertices.size());
+	for(const auto &vertex : vertices)
+		positions.push_back(vertex.pos);
+
+	auto geometry_arena = engine->GetGeometryArena();
+	vertex_allocation = geometry_arena->Allocate(GeometryArena::pool_mesh_vertices, static_cast<std::uint32_t>(vertices.size()));
+	geometry_arena->Upload(vertex_allocation, 0, vertices.data());
+	geometry_arena->Upload(vertex_allocation, 1, positions.data());
 }
 
 void Mesh::CreateIndexBuffer()
 {
-	vk::DeviceSize size = sizeof(indices[0]) * indices.size();
+	auto geometry_arena = engine->GetGeometryArena();
+	index_allocation = geometry_arena->Allocate(GeometryArena::pool_mesh_indices, static_cast<std::uint32_t>(indices.size()));
+	geometry_arena->Upload(index_allocation, 0, indices.data());
+}
 
-	auto staging_buffer = engine->CreateBuffer(size, vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_CPU_ONLY);
-	memcpy(staging_buffer->Map(), indices.data(), size);
-	staging_buffer->UnMap();
+void Mesh::CreateBuffers()
+{
+	CreateVertexBuffer();
+	CreateIndexBuffer();
+	CalculateBounds();
+}
 
-	index_buffer = engine->CreateBuffer(size, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndexBuffer,
-										VMA_MEMORY_USAGE_GPU_ONLY);
+void Mesh::CalculateBounds()
+{
+	if(vertices.empty())
+	{
+		bounds_min = bounds_max = glm::vec3(0.0f);
+		return;
+	}
+
+	bounds_min = bounds_max = vertices[0].pos;
+	for(const auto &vertex : vertices)
+	{
+		bounds_min = glm::min(bounds_min, vertex.pos);
+		bounds_max = glm::max(bounds_max, vertex.pos);
+	}
+}
 
-	engine->CopyBuffer(staging_buffer->GetVkBuffer(), index_buffer->GetVkBuffer(), size);
+vk::Buffer Mesh::GetVkVertexBuffer() const
+{
+	return engine->GetGeometryArena()->GetVkBuffer(GeometryArena::pool_mesh_vertices, 0);
+}
 
-	delete staging_buffer;
+vk::Buffer Mesh::GetVkPositionBuffer() const
+{
+	return engine->GetGeometryArena()->GetVkBuffer(GeometryArena::pool_mesh_vertices, 1);
 }
 
-void Mesh::CreateBuffers()
+vk::Buffer Mesh::GetVkIndexBuffer() const
 {
-	CreateVertexBuffer();
-	CreateIndexBuffer();
+	return engine->GetGeometryArena()->GetVkBuffer(GeometryArena::pool_mesh_indices);
 }
 
 void Mesh::Primitive::Draw(vk::CommandBuffer command_buffer)
 {
-	command_buffer.drawIndexed(indices_count, 1, indices_offset, 0, 0);
+	// the offsets are read when recording, as defragmentation may move the allocations
+	command_buffer.drawIndexed(indices_count, 1,
+			mesh->index_allocation->offset + indices_offset,
+			static_cast<std::int32_t>(mesh->vertex_allocation->offset),
+			0);
 }
@@ -4,6 +4,7 @@
 #include <iostream>
 
 #include "lavos/node.h"
+#include "lavos/scene.h"
 #include "lavos/component/transform_component.h"
 
 
@@ -16,7 +17,11 @@ Node::Node()
 Node::~Node()
 {
 	for(auto component : components)
+	{
+		if(scene)
+			scene->ComponentRemoved(component);
 		delete component;
+	}
 
 	for(auto child : children)
 		delete child;
@@ -37,6 +42,9 @@ void Node::AddComponent(lavos::Component *component)
 
 	component->node = this;
 
+	if(scene)
+		scene->ComponentAdded(component);
+
 	auto transform_component = dynamic_cast<TransformComp *>(component);
 	if(transform_component != nullptr)
 		this->transform_component = transform_component;
@@ -51,6 +59,8 @@ void Node::RemoveComponent(Component *component)
 	{
 		if(*it == component)
 		{
+			if(scene)
+				scene->ComponentRemoved(component);
 			components.erase(it);
 			component->node = nullptr;
 			return;
@@ -65,6 +75,7 @@ void Node::AddChild(Node *node)
 
 	node->parent = this;
 	children.push_back(node);
+	node->SetScene(scene);
 }
 
 void Node::RemoveChild(Node *node)
@@ -78,11 +89,35 @@ void Node::RemoveChild(Node *node)
 		{
 			children.erase(it);
 			node->parent = nullptr;
+			node->SetScene(nullptr);
 			return;
 		}
 	}
 }
 
+void Node::SetScene(Scene *scene)
+{
+	if(this->scene == scene)
+		return;
+
+	if(this->scene)
+	{
+		for(auto component : components)
+			this->scene->ComponentRemoved(component);
+	}
+
+	this->scene = scene;
+
+	if(scene)
+	{
+		for(auto component : components)
+			scene->ComponentAdded(component);
+	}
+
+	for(auto child : children)
+		child->SetScene(scene);
+}
+
 void Node::TraversePreOrder(std::function<void(Node *)> func)
 {
 	func(this);
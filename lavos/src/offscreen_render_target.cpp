@@ -0,0 +1,211 @@
+
+#include "lavos/offscreen_render_target.h"
+#include "lavos/buffer.h"
+#include "lavos/vk_util.h"
+
+using namespace lavos;
+
+OffscreenRenderTarget::OffscreenRenderTarget(Engine *engine, vk::Extent2D extent, vk::Format format, std::uint32_t image_count)
+	: engine(engine),
+	  format(format),
+	  pixel_size(GetPixelSize(format)),
+	  extent(extent)
+{
+	if(image_count == 0)
+		throw std::runtime_error("OffscreenRenderTarget needs at least one image.");
+
+	CreateResources(image_count);
+}
+
+OffscreenRenderTarget::~OffscreenRenderTarget()
+{
+	// the readbacks are dropped, but their copies must not access the buffers anymore
+	for(const auto &slot : slots)
+		engine->WaitForValue(slot.value);
+
+	CleanupResources();
+}
+
+vk::DeviceSize OffscreenRenderTarget::GetPixelSize(vk::Format format)
+{
+	switch(format)
+	{
+		case vk::Format::eR8G8B8A8Unorm:
+		case vk::Format::eR8G8B8A8Srgb:
+		case vk::Format::eB8G8R8A8Unorm:
+		case vk::Format::eB8G8R8A8Srgb:
+		case vk::Format::eA2B10G10R10UnormPack32:
+		case vk::Format::eB10G11R11UfloatPack32:
+			return 4;
+		case vk::Format::eR16G16B16A16Unorm:
+		case vk::Format::eR16G16B16A16Sfloat:
+			return 8;
+		case vk::Format::eR32G32B32A32Sfloat:
+			return 16;
+		default:
+			throw std::runtime_error("Unsupported format for OffscreenRenderTarget.");
+	}
+}
+
+void OffscreenRenderTarget::CreateResources(std::uint32_t image_count)
+{
+	slots.resize(image_count);
+
+	for(auto &slot : slots)
+	{
+		slot.image = engine->Create2DImage(extent.width, extent.height, format,
+				vk::ImageTiling::eOptimal,
+				vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc,
+				VMA_MEMORY_USAGE_GPU_ONLY, Engine::MemoryCategory::RenderTargets);
+		vk_util::SetDebugUtilsObjectName(engine->GetVkDevice(), slot.image.image, "OffscreenRenderTarget");
+
+		slot.image_view = engine->GetVkDevice().createImageView(vk::ImageViewCreateInfo()
+				.setImage(slot.image.image)
+				.setViewType(vk::ImageViewType::e2D)
+				.setFormat(format)
+				.setSubresourceRange(vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1)));
+
+		slot.readback_buffer = engine->CreateBuffer(GetRowPitch() * extent.height,
+				vk::BufferUsageFlagBits::eTransferDst,
+				VMA_MEMORY_USAGE_GPU_TO_CPU, Engine::MemoryCategory::Staging);
+		slot.readback_buffer->Map();
+
+		slot.frame = 0;
+		slot.value = 0;
+	}
+
+	next_slot = 0;
+}
+
+void OffscreenRenderTarget::CleanupResources()
+{
+	for(auto &slot : slots)
+	{
+		delete slot.readback_buffer;
+		engine->GetVkDevice().destroyImageView(slot.image_view);
+		engine->DestroyImage(slot.image);
+	}
+
+	slots.clear();
+	pending_slots.clear();
+}
+
+void OffscreenRenderTarget::Resize(vk::Extent2D extent)
+{
+	FlushReadbacks();
+
+	// the images may still be used by frames without a readback
+	engine->WaitForValue(engine->GetSubmittedValue());
+
+	auto image_count = GetImageCount();
+	CleanupResources();
+	this->extent = extent;
+	CreateResources(image_count);
+
+	SignalChangedCallbacks();
+}
+
+std::vector<vk::ImageView> OffscreenRenderTarget::GetImageViews() const
+{
+	std::vector<vk::ImageView> image_views;
+	for(const auto &slot : slots)
+		image_views.push_back(slot.image_view);
+	return image_views;
+}
+
+std::vector<vk::Image> OffscreenRenderTarget::GetImages() const
+{
+	std::vector<vk::Image> images;
+	for(const auto &slot : slots)
+		images.push_back(slot.image.image);
+	return images;
+}
+
+std::uint32_t OffscreenRenderTarget::AcquireImage()
+{
+	std::uint32_t image_index = next_slot;
+	next_slot = (next_slot + 1) % GetImageCount();
+
+	// slots are used in order, so a pending readback of this slot is the oldest one
+	if(!pending_slots.empty() && pending_slots.front() == image_index)
+	{
+		engine->WaitForValue(slots[image_index].value);
+		CollectReadbacks();
+	}
+
+	return image_index;
+}
+
+std::uint64_t OffscreenRenderTarget::SubmitReadback(std::uint32_t image_index)
+{
+	auto &slot = slots[image_index];
+
+	auto command_buffer = engine->BeginSingleTimeCommandBuffer();
+
+	// the image is already in eTransferSrcOptimal and visible to transfers, see Renderer::CreateRenderPasses()
+	command_buffer.copyImageToBuffer(slot.image.image, vk::ImageLayout::eTransferSrcOptimal,
+			slot.readback_buffer->GetVkBuffer(),
+			vk::BufferImageCopy()
+				.setBufferOffset(0)
+				.setBufferRowLength(0)
+				.setBufferImageHeight(0)
+				.setImageSubresource(vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, 0, 1))
+				.setImageOffset(vk::Offset3D(0, 0, 0))
+				.setImageExtent(vk::Extent3D(extent.width, extent.height, 1)));
+
+	// the next frame drawn into the image must not overwrite it before the copy,
+	// the host reads the buffer only after the submission has finished
+	command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+			vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eHost,
+			vk::DependencyFlags(),
+			vk::MemoryBarrier()
+				.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+				.setDstAccessMask(vk::AccessFlagBits::eHostRead),
+			nullptr, nullptr);
+
+	slot.frame = frame_count++;
+	slot.value = engine->SubmitSingleTimeCommandBuffer(command_buffer);
+	pending_slots.push_back(image_index);
+
+	return slot.value;
+}
+
+void OffscreenRenderTarget::DeliverReadback(const Slot &slot)
+{
+	if(!readback_callback)
+		return;
+
+	engine->InvalidateMemory(slot.readback_buffer->GetAllocation());
+
+	Readback readback;
+	readback.frame = slot.frame;
+	readback.extent = extent;
+	readback.pixels = slot.readback_buffer->Map();
+	readback.row_pitch = GetRowPitch();
+	readback_callback(readback);
+}
+
+std::uint32_t OffscreenRenderTarget::CollectReadbacks()
+{
+	std::uint64_t completed_value = engine->GetCompletedValue();
+
+	std::uint32_t count = 0;
+	while(!pending_slots.empty() && slots[pending_slots.front()].value <= completed_value)
+	{
+		std::uint32_t index = pending_slots.front();
+		pending_slots.pop_front();
+		DeliverReadback(slots[index]);
+		count++;
+	}
+
+	return count;
+}
+
+void OffscreenRenderTarget::FlushReadbacks()
+{
+	if(pending_slots.empty())
+		return;
+
+	engine->WaitForValue(slots[pending_slots.back()].value);
+	CollectReadbacks();
+}
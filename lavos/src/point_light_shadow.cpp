@@ -0,0 +1,304 @@
+
+#include "lavos/point_light_shadow.h"
+#include "lavos/point_light_shadow_renderer.h"
+#include "lavos/component/point_light.h"
+#include "lavos/renderer.h"
+#include "lavos/culling.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include "../glsl/common_glsl_cpp.h"
+
+using namespace lavos;
+
+
+struct PointLightShadowMatrixUniformBuffer
+{
+	glm::mat4 modelview_projection[MAX_SHADOW_MULTIVIEW_COUNT];
+};
+
+static_assert(sizeof(PointLightShadowMatrixUniformBuffer) == 64 * MAX_SHADOW_MULTIVIEW_COUNT, "PointLightShadowMatrixUniformBuffer memory layout");
+
+
+PointLightShadow::PointLightShadow(Engine *engine, PointLight *light, PointLightShadowRenderer *renderer, float near_clip, float far_clip)
+		: engine(engine), light(light), renderer(renderer), near_clip(near_clip), far_clip(far_clip)
+{
+	depth_bias_constant = renderer->GetDefaultDepthBiasConstant();
+	depth_bias_slope = renderer->GetDefaultDepthBiasSlope();
+
+	CreateImage();
+	CreateSampler();
+	CreateFramebuffer();
+	CreateUniformBuffer();
+	CreateDescriptorPool();
+	CreateDescriptorSet();
+}
+
+PointLightShadow::~PointLightShadow()
+{
+	auto device = engine->GetVkDevice();
+
+	device.destroy(descriptor_pool);
+	for(auto buffer : matrix_uniform_buffers)
+		delete buffer;
+	device.destroy(framebuffer);
+	device.destroy(sampler);
+	device.destroy(cube_image_view);
+	device.destroy(depth_image_view);
+	engine->DestroyImage(depth_image);
+}
+
+glm::mat4 PointLightShadow::GetFaceViewProjectionMatrix(unsigned int face)
+{
+	static const glm::vec3 directions[] = {
+			glm::vec3(1.0f, 0.0f, 0.0f),
+			glm::vec3(-1.0f, 0.0f, 0.0f),
+			glm::vec3(0.0f, 1.0f, 0.0f),
+			glm::vec3(0.0f, -1.0f, 0.0f),
+			glm::vec3(0.0f, 0.0f, 1.0f),
+			glm::vec3(0.0f, 0.0f, -1.0f)
+	};
+
+	static const glm::vec3 ups[] = {
+			glm::vec3(0.0f, -1.0f, 0.0f),
+			glm::vec3(0.0f, -1.0f, 0.0f),
+			glm::vec3(0.0f, 0.0f, 1.0f),
+			glm::vec3(0.0f, 0.0f, -1.0f),
+			glm::vec3(0.0f, -1.0f, 0.0f),
+			glm::vec3(0.0f, -1.0f, 0.0f)
+	};
+
+	glm::vec3 position = light->GetPositionWorld();
+
+	// no y flip here: together with the ups above, this gives the (mirrored) orientation of the cube map faces
+	return glm::perspective(glm::half_pi<float>(), 1.0f, near_clip, far_clip)
+		   * glm::lookAt(position, position + directions[face], ups[face]);
+}
+
+void PointLightShadow::CreateImage()
+{
+	auto image_create_info = vk::ImageCreateInfo()
+			.setFlags(vk::ImageCreateFlagBits::eCubeCompatible)
+			.setImageType(vk::ImageType::e2D)
+			.setExtent(vk::Extent3D(renderer->GetResolution(), renderer->GetResolution(), 1))
+			.setMipLevels(1)
+			.setArrayLayers(PointLightShadowRenderer::face_count)
+			.setSamples(vk::SampleCountFlagBits::e1)
+			.setTiling(vk::ImageTiling::eOptimal)
+			.setFormat(renderer->GetDepthFormat())
+			.setUsage(vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eSampled);
+
+	depth_image = engine->CreateImage(image_create_info, VMA_MEMORY_USAGE_GPU_ONLY, Engine::MemoryCategory::Shadows);
+	vk_util::SetDebugUtilsObjectName(engine->GetVkDevice(), depth_image.image, "PointLightShadow Depth Image");
+
+	auto subresource_range = vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eDepth, 0, 1, 0, PointLightShadowRenderer::face_count);
+
+	auto image_view_create_info = vk::ImageViewCreateInfo()
+			.setViewType(vk::ImageViewType::e2DArray)
+			.setFormat(renderer->GetDepthFormat())
+			.setSubresourceRange(subresource_range)
+			.setImage(depth_image.image);
+
+	depth_image_view = engine->GetVkDevice().createImageView(image_view_create_info);
+	vk_util::SetDebugUtilsObjectName(engine->GetVkDevice(), depth_image_view, "PointLightShadow Depth ImageView");
+
+	image_view_create_info.setViewType(vk::ImageViewType::eCube);
+
+	cube_image_view = engine->GetVkDevice().createImageView(image_view_create_info);
+	vk_util::SetDebugUtilsObjectName(engine->GetVkDevice(), cube_image_view, "PointLightShadow Cube ImageView");
+}
+
+void PointLightShadow::CreateSampler()
+{
+	// with linear filtering, this gives 2x2 pcf in hardware
+	auto sampler_create_info = vk::SamplerCreateInfo()
+			.setMagFilter(vk::Filter::eLinear)
+			.setMinFilter(vk::Filter::eLinear)
+			.setMipmapMode(vk::SamplerMipmapMode::eNearest)
+			.setAddressModeU(vk::SamplerAddressMode::eClampToEdge)
+			.setAddressModeV(vk::SamplerAddressMode::eClampToEdge)
+			.setAddressModeW(vk::SamplerAddressMode::eClampToEdge)
+			.setMipLodBias(0.0f)
+			.setMaxAnisotropy(1.0f)
+			.setMinLod(0.0f)
+			.setMaxLod(0.0f)
+			.setCompareEnable(VK_TRUE)
+			.setCompareOp(vk::CompareOp::eLessOrEqual)
+			.setBorderColor(vk::BorderColor::eFloatOpaqueWhite);
+
+	sampler = engine->GetVkDevice().createSampler(sampler_create_info);
+	vk_util::SetDebugUtilsObjectName(engine->GetVkDevice(), sampler, "PointLightShadow Sampler");
+}
+
+void PointLightShadow::CreateFramebuffer()
+{
+	if(!renderer->GetRenderPass()) // dynamic rendering
+		return;
+
+	// with multiview, the faces are addressed by the view mask of the render pass, so layers must be 1 here
+	auto create_info = vk::FramebufferCreateInfo()
+			.setRenderPass(renderer->GetRenderPass())
+			.setAttachmentCount(1)
+			.setPAttachments(&depth_image_view)
+			.setWidth(renderer->GetResolution())
+			.setHeight(renderer->GetResolution())
+			.setLayers(1);
+
+	framebuffer = engine->GetVkDevice().createFramebuffer(create_info);
+	vk_util::SetDebugUtilsObjectName(engine->GetVkDevice(), framebuffer, "PointLightShadow");
+}
+
+void PointLightShadow::CreateUniformBuffer()
+{
+	matrix_uniform_buffers.resize(Renderer::frames_in_flight);
+	for(auto &buffer : matrix_uniform_buffers)
+	{
+		buffer = engine->CreateBuffer(sizeof(PointLightShadowMatrixUniformBuffer),
+				vk::BufferUsageFlagBits::eUniformBuffer,
+				VMA_MEMORY_USAGE_CPU_ONLY,
+				Engine::MemoryCategory::Uniforms);
+		vk_util::SetDebugUtilsObjectName(engine->GetVkDevice(), buffer->GetVkBuffer(), "PointLightShadow");
+	}
+}
+
+void PointLightShadow::CreateDescriptorPool()
+{
+	std::array<vk::DescriptorPoolSize, 1> pool_sizes = {
+		vk::DescriptorPoolSize(vk::DescriptorType::eUniformBuffer, Renderer::frames_in_flight)
+	};
+
+	auto create_info = vk::DescriptorPoolCreateInfo()
+			.setPoolSizeCount(static_cast<uint32_t>(pool_sizes.size()))
+			.setPPoolSizes(pool_sizes.data())
+			.setMaxSets(Renderer::frames_in_flight);
+
+	descriptor_pool = engine->GetVkDevice().createDescriptorPool(create_info);
+	vk_util::SetDebugUtilsObjectName(engine->GetVkDevice(), descriptor_pool, "PointLightShadow");
+}
+
+void PointLightShadow::CreateDescriptorSet()
+{
+	std::vector<vk::DescriptorSetLayout> layouts(Renderer::frames_in_flight, renderer->GetDescriptorSetLayout());
+
+	auto alloc_info = vk::DescriptorSetAllocateInfo()
+			.setDescriptorPool(descriptor_pool)
+			.setDescriptorSetCount(Renderer::frames_in_flight)
+			.setPSetLayouts(layouts.data());
+
+	descriptor_sets = engine->GetVkDevice().allocateDescriptorSets(alloc_info);
+
+	for(std::uint32_t frame=0; frame<Renderer::frames_in_flight; frame++)
+	{
+		vk_util::SetDebugUtilsObjectName(engine->GetVkDevice(), descriptor_sets[frame], "PointLightShadow");
+
+		auto matrix_buffer_info = vk::DescriptorBufferInfo()
+				.setBuffer(matrix_uniform_buffers[frame]->GetVkBuffer())
+				.setOffset(0)
+				.setRange(sizeof(PointLightShadowMatrixUniformBuffer));
+
+		auto matrix_buffer_write = vk::WriteDescriptorSet()
+				.setDstSet(descriptor_sets[frame])
+				.setDstBinding(0)
+				.setDstArrayElement(0)
+				.setDescriptorType(vk::DescriptorType::eUniformBuffer)
+				.setDescriptorCount(1)
+				.setPBufferInfo(&matrix_buffer_info);
+
+		engine->GetVkDevice().updateDescriptorSets(matrix_buffer_write, nullptr);
+	}
+}
+
+void PointLightShadow::UpdateMatrixUniformBuffer(std::uint32_t frame_index, const glm::mat4 *face_matrices)
+{
+	PointLightShadowMatrixUniformBuffer matrix_ubo;
+	for(unsigned int i=0; i<MAX_SHADOW_MULTIVIEW_COUNT; i++)
+		matrix_ubo.modelview_projection[i] = i < PointLightShadowRenderer::face_count ? face_matrices[i] : glm::mat4(0.0f);
+	// stays mapped until the buffer is destroyed
+	memcpy(matrix_uniform_buffers[frame_index]->Map(), &matrix_ubo, sizeof(matrix_ubo));
+}
+
+void PointLightShadow::Render(vk::CommandBuffer cmd, Renderer *renderer)
+{
+	std::array<glm::mat4, PointLightShadowRenderer::face_count> face_matrices;
+	for(unsigned int i=0; i<PointLightShadowRenderer::face_count; i++)
+		face_matrices[i] = GetFaceViewProjectionMatrix(i);
+
+	UpdateMatrixUniformBuffer(renderer->GetFrameIndex(), face_matrices.data());
+
+	vk::ClearValue clear_value = vk::ClearDepthStencilValue(1.0f, 0);
+
+	auto extent = vk::Extent2D(this->renderer->GetResolution(), this->renderer->GetResolution());
+
+	auto viewport = vk::Viewport(0, 0, extent.width, extent.height, 0.0f, 1.0f);
+	cmd.setViewport(0, 1, &viewport);
+
+	auto scissor = vk::Rect2D(vk::Offset2D(0, 0), extent);
+	cmd.setScissor(0, 1, &scissor);
+
+	cmd.setDepthBias(depth_bias_constant, 0.0f, depth_bias_slope);
+
+	if(this->renderer->GetRenderPass())
+	{
+		auto render_pass_begin_info = vk::RenderPassBeginInfo()
+				.setRenderPass(this->renderer->GetRenderPass())
+				.setFramebuffer(framebuffer)
+				.setRenderArea(vk::Rect2D(vk::Offset2D(0, 0), extent))
+				.setClearValueCount(1)
+				.setPClearValues(&clear_value);
+
+		cmd.beginRenderPass(render_pass_begin_info, vk::SubpassContents::eInline);
+	}
+	else
+	{
+		auto depth_attachment = vk::RenderingAttachmentInfoKHR()
+				.setImageView(depth_image_view)
+				.setImageLayout(vk::ImageLayout::eDepthStencilAttachmentOptimal)
+				.setLoadOp(vk::AttachmentLoadOp::eClear)
+				.setStoreOp(vk::AttachmentStoreOp::eStore)
+				.setClearValue(clear_value);
+
+		// one view per cube face
+		auto rendering_info = vk::RenderingInfoKHR()
+				.setRenderArea(vk::Rect2D(vk::Offset2D(0, 0), extent))
+				.setLayerCount(1)
+				.setViewMask((1u << PointLightShadowRenderer::face_count) - 1)
+				.setPDepthAttachment(&depth_attachment)
+				.setPStencilAttachment(Engine::HasStencilComponent(this->renderer->GetDepthFormat()) ? &depth_attachment : nullptr);
+
+		engine->CmdBeginRendering(cmd, rendering_info);
+	}
+
+	// casters are only drawn for the faces they intersect, and skipped entirely if they intersect none
+	renderer->RecordRenderables(cmd,
+			Material::DefaultRenderMode::ShadowMultiview,
+			this->renderer->GetMaterialPipelineManager(),
+			descriptor_sets[renderer->GetFrameIndex()],
+			[&face_matrices](Node *node, Renderable *renderable) {
+				return CalculateViewMask(node, renderable, face_matrices.data(), PointLightShadowRenderer::face_count);
+			});
+
+	if(this->renderer->GetRenderPass())
+		cmd.endRenderPass();
+	else
+		engine->CmdEndRendering(cmd);
+}
+
+RenderGraph::ResourceId PointLightShadow::AddPass(RenderGraph &graph, Renderer *renderer)
+{
+	vk::ImageAspectFlags aspect_mask = vk::ImageAspectFlagBits::eDepth;
+	if(Engine::HasStencilComponent(this->renderer->GetDepthFormat()))
+		aspect_mask |= vk::ImageAspectFlagBits::eStencil;
+
+	// the content is cleared, but sampling in the previous frame has to finish first
+	auto resource = graph.ImportImage("PointLightShadow", depth_image.image,
+			vk::ImageSubresourceRange(aspect_mask, 0, 1, 0, PointLightShadowRenderer::face_count),
+			vk::ImageLayout::eUndefined, vk::PipelineStageFlagBits::eFragmentShader);
+
+	auto pass = graph.AddPass("PointLightShadow", [this, renderer](vk::CommandBuffer cmd) {
+		Render(cmd, renderer);
+	});
+	graph.Write(pass, resource, RenderGraph::Access::DepthAttachment, true);
+
+	return resource;
+}
@@ -0,0 +1,127 @@
+
+#include "lavos/point_light_shadow_renderer.h"
+#include "lavos/engine.h"
+
+#include "../glsl/common_glsl_cpp.h"
+
+using namespace lavos;
+
+static_assert(PointLightShadowRenderer::face_count <= MAX_SHADOW_MULTIVIEW_COUNT, "cube map faces must fit into the multiview matrix buffer");
+
+PointLightShadowRenderer::PointLightShadowRenderer(Engine *engine, std::uint32_t resolution)
+	: SubRenderer(engine),
+	resolution(resolution)
+{
+	if(!engine->GetMultiviewEnabled())
+		throw std::runtime_error("PointLightShadowRenderer requires multiview to be enabled in the engine.");
+
+	depth_format = vk::Format::eD16Unorm;
+
+	// with dynamic rendering, render_pass stays null
+	if(!engine->GetDynamicRenderingEnabled())
+		CreateRenderPass();
+	CreateDescriptorSetLayout();
+
+	material_pipeline_manager = new MaterialPipelineManager(engine, CreateMaterialPipelineConfiguration());
+}
+
+PointLightShadowRenderer::~PointLightShadowRenderer()
+{
+	delete material_pipeline_manager;
+	const auto &device = engine->GetVkDevice();
+	device.destroyDescriptorSetLayout(descriptor_set_layout);
+	device.destroyRenderPass(render_pass);
+}
+
+MaterialPipelineConfiguration PointLightShadowRenderer::CreateMaterialPipelineConfiguration()
+{
+	auto config = MaterialPipelineConfiguration(
+			vk::Extent2D(resolution, resolution),
+			vk::SampleCountFlagBits::e1,
+			descriptor_set_layout,
+			render_pass,
+			Material::DefaultRenderMode::ShadowMultiview,
+			vk_util::PipelineColorBlendStateCreateInfo(),
+			{ vk::DynamicState::eViewport, vk::DynamicState::eScissor, vk::DynamicState::eDepthBias },
+			true,
+			// cube map faces are mirrored compared to a regular projection
+			vk::FrontFace::eClockwise);
+
+	if(!render_pass)
+	{
+		config.depth_format = depth_format;
+		config.view_mask = (1u << face_count) - 1;
+	}
+
+	return config;
+}
+
+void PointLightShadowRenderer::CreateRenderPass()
+{
+	auto depth_attachment = vk::AttachmentDescription()
+			.setFormat(depth_format)
+			.setSamples(vk::SampleCountFlagBits::e1)
+			.setLoadOp(vk::AttachmentLoadOp::eClear)
+			.setStoreOp(vk::AttachmentStoreOp::eStore)
+			.setStencilLoadOp(vk::AttachmentLoadOp::eDontCare)
+			.setStencilStoreOp(vk::AttachmentStoreOp::eDontCare)
+			// transitions and barriers from and towards sampling are done by the RenderGraph
+			.setInitialLayout(vk::ImageLayout::eDepthStencilAttachmentOptimal)
+			.setFinalLayout(vk::ImageLayout::eDepthStencilAttachmentOptimal);
+
+	auto depth_reference = vk::AttachmentReference()
+			.setAttachment(0)
+			.setLayout(vk::ImageLayout::eDepthStencilAttachmentOptimal);
+
+	auto subpass_desc = vk::SubpassDescription()
+			.setPipelineBindPoint(vk::PipelineBindPoint::eGraphics)
+			.setColorAttachmentCount(0)
+			.setPDepthStencilAttachment(&depth_reference);
+
+	// one view per cube face
+	uint32_t view_mask = (1u << face_count) - 1;
+	auto multiview_create_info = vk::RenderPassMultiviewCreateInfo()
+			.setSubpassCount(1)
+			.setPViewMasks(&view_mask)
+			.setCorrelationMaskCount(1)
+			.setPCorrelationMasks(&view_mask);
+
+	auto create_info = vk::RenderPassCreateInfo()
+			.setPNext(&multiview_create_info)
+			.setAttachmentCount(1)
+			.setPAttachments(&depth_attachment)
+			.setSubpassCount(1)
+			.setPSubpasses(&subpass_desc);
+
+	render_pass = engine->GetVkDevice().createRenderPass(create_info);
+	vk_util::SetDebugUtilsObjectName(engine->GetVkDevice(), render_pass, "PointLightShadowRenderer RenderPass");
+}
+
+void PointLightShadowRenderer::CreateDescriptorSetLayout()
+{
+	std::array<vk::DescriptorSetLayoutBinding, 1> bindings = {
+			// face matrices
+			vk::DescriptorSetLayoutBinding()
+					.setBinding(0)
+					.setDescriptorType(vk::DescriptorType::eUniformBuffer)
+					.setDescriptorCount(1)
+					.setStageFlags(vk::ShaderStageFlagBits::eVertex),
+	};
+
+	auto create_info = vk::DescriptorSetLayoutCreateInfo()
+			.setBindingCount(static_cast<uint32_t>(bindings.size()))
+			.setPBindings(bindings.data());
+
+	descriptor_set_layout = engine->GetVkDevice().createDescriptorSetLayout(create_info);
+	vk_util::SetDebugUtilsObjectName(engine->GetVkDevice(), descriptor_set_layout, "PointLightShadowRenderer DescriptorSetLayout");
+}
+
+void PointLightShadowRenderer::AddMaterial(Material *material)
+{
+	material_pipeline_manager->AddMaterial(material);
+}
+
+void PointLightShadowRenderer::RemoveMaterial(Material *material)
+{
+	material_pipeline_manager->RemoveMaterial(material);
+}
@@ -1,15 +1,51 @@
 
 #include "lavos/render_config.h"
 
+#include <stdexcept>
+
 using namespace lavos;
 
+float RenderConfig::GetMaxAnisotropy() const
+{
+	switch(texture_quality)
+	{
+		case TextureQuality::Low:
+			return 1.0f;
+		case TextureQuality::Medium:
+			return 4.0f;
+		case TextureQuality::High:
+		default:
+			return 16.0f;
+	}
+}
+
 RenderConfig RenderConfigBuilder::Build()
 {
+	if(deferred_enabled && depth_prepass_enabled)
+		throw std::runtime_error("Depth prepass is not supported together with deferred rendering.");
+
+	if(deferred_enabled && sample_count != vk::SampleCountFlagBits::e1)
+		throw std::runtime_error("Multisampling is not supported together with deferred rendering.");
+
 	RenderConfig config;
+	config.texture_quality = texture_quality;
+	config.sample_count = sample_count;
 	config.material_render_modes = { Material::DefaultRenderMode::ColorForward };
 
 	if(shadow_enabled)
 		config.material_render_modes.push_back(Material::DefaultRenderMode::Shadow);
 
+	if(depth_prepass_enabled)
+	{
+		config.material_render_modes.push_back(Material::DefaultRenderMode::DepthPrepass);
+		config.depth_prepass_enabled = true;
+	}
+
+	if(deferred_enabled)
+	{
+		config.material_render_modes.push_back(Material::DefaultRenderMode::GBuffer);
+		config.deferred_enabled = true;
+	}
+
 	return config;
 }
@@ -0,0 +1,525 @@
+
+#include "lavos/render_graph.h"
+#include "lavos/engine.h"
+#include "lavos/vk_util.h"
+#include "lavos/log.h"
+
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+
+using namespace lavos;
+
+namespace
+{
+
+struct AccessInfo
+{
+	vk::ImageLayout layout;
+	vk::PipelineStageFlags stages;
+	vk::AccessFlags access;
+};
+
+AccessInfo GetAccessInfo(RenderGraph::Access access)
+{
+	switch(access)
+	{
+		case RenderGraph::Access::ColorAttachment:
+			return { vk::ImageLayout::eColorAttachmentOptimal,
+					 vk::PipelineStageFlagBits::eColorAttachmentOutput,
+					 vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite };
+		case RenderGraph::Access::DepthAttachment:
+			return { vk::ImageLayout::eDepthStencilAttachmentOptimal,
+					 vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests,
+					 vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite };
+		case RenderGraph::Access::DepthAttachmentRead:
+			return { vk::ImageLayout::eDepthStencilReadOnlyOptimal,
+					 vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests,
+					 vk::AccessFlagBits::eDepthStencilAttachmentRead };
+		case RenderGraph::Access::FragmentShaderRead:
+			return { vk::ImageLayout::eShaderReadOnlyOptimal,
+					 vk::PipelineStageFlagBits::eFragmentShader,
+					 vk::AccessFlagBits::eShaderRead };
+		case RenderGraph::Access::TransferRead:
+			return { vk::ImageLayout::eTransferSrcOptimal,
+					 vk::PipelineStageFlagBits::eTransfer,
+					 vk::AccessFlagBits::eTransferRead };
+		case RenderGraph::Access::TransferWrite:
+			return { vk::ImageLayout::eTransferDstOptimal,
+					 vk::PipelineStageFlagBits::eTransfer,
+					 vk::AccessFlagBits::eTransferWrite };
+	}
+	throw std::runtime_error("invalid render graph access.");
+}
+
+vk::ImageAspectFlags GetAspectMask(vk::Format format)
+{
+	switch(format)
+	{
+		case vk::Format::eD16Unorm:
+		case vk::Format::eX8D24UnormPack32:
+		case vk::Format::eD32Sfloat:
+			return vk::ImageAspectFlagBits::eDepth;
+		case vk::Format::eD16UnormS8Uint:
+		case vk::Format::eD24UnormS8Uint:
+		case vk::Format::eD32SfloatS8Uint:
+			return vk::ImageAspectFlagBits::eDepth | vk::ImageAspectFlagBits::eStencil;
+		case vk::Format::eS8Uint:
+			return vk::ImageAspectFlagBits::eStencil;
+		default:
+			return vk::ImageAspectFlagBits::eColor;
+	}
+}
+
+}
+
+RenderGraph::RenderGraph(Engine *engine)
+	: engine(engine)
+{
+}
+
+RenderGraph::~RenderGraph()
+{
+	DestroyTransientImages(engine, transient_images, transient_memory);
+}
+
+void RenderGraph::Reset()
+{
+	resources.clear();
+	passes.clear();
+	compiled = false;
+}
+
+RenderGraph::ResourceId RenderGraph::ImportImage(std::string name, vk::Image image, vk::ImageSubresourceRange range,
+		vk::ImageLayout layout, vk::PipelineStageFlags last_stages)
+{
+	Resource resource;
+	resource.name = std::move(name);
+	resource.transient = false;
+	resource.desc = {};
+	resource.image = image;
+	resource.range = range;
+	resource.initial_state.layout = layout;
+	resource.initial_state.read_stages = last_stages;
+	resources.push_back(std::move(resource));
+	return static_cast<ResourceId>(resources.size() - 1);
+}
+
+RenderGraph::ResourceId RenderGraph::CreateImage(std::string name, const ImageDesc &desc)
+{
+	Resource resource;
+	resource.name = std::move(name);
+	resource.transient = true;
+	resource.desc = desc;
+	resource.range = vk::ImageSubresourceRange(GetAspectMask(desc.format), 0, 1, 0, desc.layers);
+	resources.push_back(std::move(resource));
+	return static_cast<ResourceId>(resources.size() - 1);
+}
+
+RenderGraph::PassId RenderGraph::AddPass(std::string name, RecordFunction record)
+{
+	Pass pass;
+	pass.name = std::move(name);
+	pass.record = std::move(record);
+	passes.push_back(std::move(pass));
+	return static_cast<PassId>(passes.size() - 1);
+}
+
+void RenderGraph::Read(PassId pass, ResourceId resource, Access access)
+{
+	passes[pass].uses.push_back({ resource, access, false, false });
+}
+
+void RenderGraph::Write(PassId pass, ResourceId resource, Access access, bool discard)
+{
+	passes[pass].uses.push_back({ resource, access, true, discard });
+}
+
+void RenderGraph::Cull()
+{
+	// whether the current content of a resource is read by a pass that is kept
+	std::vector<bool> content_needed(resources.size(), false);
+
+	for(auto it = passes.rbegin(); it != passes.rend(); it++)
+	{
+		auto &pass = *it;
+
+		bool needed = pass.side_effects;
+		for(const auto &use : pass.uses)
+		{
+			if(use.write && (!resources[use.resource].transient || content_needed[use.resource]))
+				needed = true;
+		}
+
+		pass.culled = !needed;
+		if(!needed)
+			continue;
+
+		// earlier writes are overwritten without being looked at
+		for(const auto &use : pass.uses)
+		{
+			if(use.write && use.discard)
+				content_needed[use.resource] = false;
+		}
+
+		for(const auto &use : pass.uses)
+		{
+			if(!use.write || !use.discard)
+				content_needed[use.resource] = true;
+		}
+	}
+}
+
+void RenderGraph::PlaceTransientImages()
+{
+	std::vector<TransientImage> images;
+	std::vector<ResourceId> placed_resources;
+
+	for(ResourceId r=0; r<resources.size(); r++)
+	{
+		if(!resources[r].transient)
+			continue;
+
+		bool used = false;
+		TransientImage image = {};
+		image.desc = resources[r].desc;
+		for(std::uint32_t i=0; i<passes.size(); i++)
+		{
+			if(passes[i].culled)
+				continue;
+			for(const auto &use : passes[i].uses)
+			{
+				if(use.resource != r)
+					continue;
+				if(!used)
+					image.first_pass = i;
+				image.last_pass = i;
+				used = true;
+			}
+		}
+
+		// unused transient resources keep a null image
+		if(!used)
+			continue;
+
+		resources[r].transient_index = static_cast<std::uint32_t>(images.size());
+		images.push_back(image);
+		placed_resources.push_back(r);
+	}
+
+	bool unchanged = images.size() == transient_images.size()
+			&& std::equal(images.begin(), images.end(), transient_images.begin(), [](const TransientImage &a, const TransientImage &b) {
+				return a.desc == b.desc && a.first_pass == b.first_pass && a.last_pass == b.last_pass;
+			});
+
+	if(!unchanged)
+	{
+		// only used by frames that are already submitted
+		if(!transient_images.empty())
+		{
+			auto engine = this->engine;
+			auto retired_images = std::move(transient_images);
+			auto retired_memory = std::move(transient_memory);
+			engine->DestroyAfter(engine->GetSubmittedValue(), [engine, retired_images, retired_memory]() mutable {
+				DestroyTransientImages(engine, retired_images, retired_memory);
+			});
+		}
+		transient_images.clear();
+		transient_memory.clear();
+
+		CreateTransientImages(images);
+		transient_images = std::move(images);
+		transient_generation++;
+	}
+
+	for(std::size_t i=0; i<placed_resources.size(); i++)
+	{
+		auto &resource = resources[placed_resources[i]];
+		resource.image = transient_images[i].image;
+		resource.image_view = transient_images[i].image_view;
+	}
+}
+
+void RenderGraph::CreateTransientImages(std::vector<TransientImage> &images)
+{
+	auto &device = engine->GetVkDevice();
+
+	std::vector<vk::MemoryRequirements> requirements;
+	for(auto &image : images)
+	{
+		auto create_info = vk::ImageCreateInfo()
+				.setImageType(vk::ImageType::e2D)
+				.setExtent(vk::Extent3D(image.desc.extent.width, image.desc.extent.height, 1))
+				.setMipLevels(1)
+				.setArrayLayers(image.desc.layers)
+				.setFormat(image.desc.format)
+				.setTiling(vk::ImageTiling::eOptimal)
+				.setInitialLayout(vk::ImageLayout::eUndefined)
+				.setUsage(image.desc.usage)
+				.setSamples(image.desc.samples)
+				.setSharingMode(vk::SharingMode::eExclusive);
+
+		image.image = device.createImage(create_info);
+		vk_util::SetDebugUtilsObjectName(device, image.image, "RenderGraph transient");
+		requirements.push_back(device.getImageMemoryRequirements(image.image));
+	}
+
+	// greedy interval assignment: an image shares memory with images whose lifetimes ended before its first pass
+	std::vector<std::uint32_t> order(images.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::sort(order.begin(), order.end(), [&images](std::uint32_t a, std::uint32_t b) {
+		return images[a].first_pass < images[b].first_pass;
+	});
+
+	std::vector<vk::MemoryRequirements> memory_requirements;
+	std::vector<std::uint32_t> memory_last_pass;
+	std::vector<bool> memory_lazy;
+	for(auto i : order)
+	{
+		auto &image = images[i];
+		const auto &req = requirements[i];
+
+		std::uint32_t m;
+		for(m=0; m<memory_requirements.size(); m++)
+		{
+			if(memory_last_pass[m] < image.first_pass && (memory_requirements[m].memoryTypeBits & req.memoryTypeBits))
+				break;
+		}
+
+		// memory can only be allocated lazily if all of its images are transient attachments
+		bool lazy = static_cast<bool>(image.desc.usage & vk::ImageUsageFlagBits::eTransientAttachment);
+
+		if(m == memory_requirements.size())
+		{
+			memory_requirements.push_back(req);
+			memory_last_pass.push_back(image.last_pass);
+			memory_lazy.push_back(lazy);
+		}
+		else
+		{
+			auto &merged = memory_requirements[m];
+			merged.size = std::max(merged.size, req.size);
+			merged.alignment = std::max(merged.alignment, req.alignment);
+			merged.memoryTypeBits &= req.memoryTypeBits;
+			memory_last_pass[m] = image.last_pass;
+			memory_lazy[m] = memory_lazy[m] && lazy;
+		}
+
+		image.memory_index = m;
+	}
+
+	transient_memory_size = 0;
+	for(std::uint32_t m=0; m<memory_requirements.size(); m++)
+	{
+		const auto &req = memory_requirements[m];
+		auto vma_usage = memory_lazy[m] && engine->GetLazilyAllocatedMemoryAvailable()
+				? VMA_MEMORY_USAGE_GPU_LAZILY_ALLOCATED : VMA_MEMORY_USAGE_GPU_ONLY;
+		transient_memory.push_back(engine->AllocateMemory(req, vma_usage, Engine::MemoryCategory::RenderTargets));
+		transient_memory_size += req.size;
+	}
+
+	for(auto &image : images)
+	{
+		VkResult result = vmaBindImageMemory(engine->GetVmaAllocator(), transient_memory[image.memory_index], image.image);
+		if(result != VK_SUCCESS)
+			throw std::runtime_error("Failed to bind transient image memory.");
+
+		auto view_info = vk::ImageViewCreateInfo()
+				.setImage(image.image)
+				.setViewType(image.desc.layers > 1 ? vk::ImageViewType::e2DArray : vk::ImageViewType::e2D)
+				.setFormat(image.desc.format)
+				.setSubresourceRange(vk::ImageSubresourceRange(GetAspectMask(image.desc.format), 0, 1, 0, image.desc.layers));
+
+		image.image_view = device.createImageView(view_info);
+	}
+
+	if(!images.empty())
+	{
+		LAVOS_LOGF(LogLevel::Debug, "RenderGraph placed %u transient images in %u allocations of %llu bytes in total.",
+				static_cast<unsigned int>(images.size()),
+				static_cast<unsigned int>(transient_memory.size()),
+				static_cast<unsigned long long>(transient_memory_size));
+	}
+}
+
+void RenderGraph::DestroyTransientImages(Engine *engine, std::vector<TransientImage> &images, std::vector<VmaAllocation> &memory)
+{
+	auto &device = engine->GetVkDevice();
+
+	for(auto &image : images)
+	{
+		device.destroyImageView(image.image_view);
+		device.destroyImage(image.image);
+	}
+	images.clear();
+
+	for(auto allocation : memory)
+		engine->FreeMemory(allocation);
+	memory.clear();
+}
+
+std::uint32_t RenderGraph::GetPreviousTransientImage(std::uint32_t index) const
+{
+	const auto &image = transient_images[index];
+
+	std::uint32_t previous = index;
+	bool found_before = false;
+	for(std::uint32_t i=0; i<transient_images.size(); i++)
+	{
+		const auto &other = transient_images[i];
+		if(other.memory_index != image.memory_index)
+			continue;
+
+		if(other.last_pass < image.first_pass)
+		{
+			if(!found_before || other.last_pass > transient_images[previous].last_pass)
+				previous = i;
+			found_before = true;
+		}
+		else if(!found_before && other.last_pass > transient_images[previous].last_pass)
+			previous = i;
+	}
+
+	return previous;
+}
+
+void RenderGraph::DeriveBarriers()
+{
+	// stages of all uses of each transient image, which have to finish before the next image in the same memory is used
+	std::vector<vk::PipelineStageFlags> transient_stages(transient_images.size());
+	for(const auto &pass : passes)
+	{
+		if(pass.culled)
+			continue;
+		for(const auto &use : pass.uses)
+		{
+			const auto &resource = resources[use.resource];
+			if(resource.transient)
+				transient_stages[resource.transient_index] |= GetAccessInfo(use.access).stages;
+		}
+	}
+
+	std::vector<ResourceState> states;
+	for(const auto &resource : resources)
+	{
+		ResourceState state = resource.initial_state;
+		if(resource.transient && resource.image)
+			state.read_stages = transient_stages[GetPreviousTransientImage(resource.transient_index)];
+		states.push_back(state);
+	}
+
+	for(auto &pass : passes)
+	{
+		pass.src_stages = vk::PipelineStageFlags();
+		pass.dst_stages = vk::PipelineStageFlags();
+		pass.barriers.clear();
+
+		if(pass.culled)
+			continue;
+
+		for(const auto &use : pass.uses)
+		{
+			const auto &resource = resources[use.resource];
+			auto &state = states[use.resource];
+			auto info = GetAccessInfo(use.access);
+
+			bool transition = state.layout != info.layout;
+			vk::PipelineStageFlags src_stages;
+			vk::AccessFlags src_access;
+			bool barrier;
+
+			if(use.write)
+			{
+				// write after write and after read
+				src_stages = state.write_stages | state.read_stages;
+				src_access = state.write_access;
+				barrier = transition || src_access;
+			}
+			else if(transition)
+			{
+				src_stages = state.write_stages | state.read_stages;
+				src_access = state.write_access;
+				barrier = true;
+			}
+			else
+			{
+				// read after write, unless the result is already visible to these stages
+				bool visible = (state.read_stages & info.stages) == info.stages
+						&& (state.read_access & info.access) == info.access;
+				src_stages = visible ? vk::PipelineStageFlags() : state.write_stages;
+				src_access = visible ? vk::AccessFlags() : state.write_access;
+				barrier = static_cast<bool>(src_access);
+			}
+
+			if(barrier)
+			{
+				pass.barriers.push_back(vk::ImageMemoryBarrier()
+						.setSrcAccessMask(src_access)
+						.setDstAccessMask(info.access)
+						.setOldLayout(use.discard ? vk::ImageLayout::eUndefined : state.layout)
+						.setNewLayout(info.layout)
+						.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+						.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+						.setImage(resource.image)
+						.setSubresourceRange(resource.range));
+			}
+
+			// execution dependencies alone are enough for write after read
+			if(barrier || src_stages)
+			{
+				pass.src_stages |= src_stages;
+				pass.dst_stages |= info.stages;
+			}
+
+			if(use.write)
+			{
+				state.write_stages = info.stages;
+				state.write_access = info.access;
+				state.read_stages = vk::PipelineStageFlags();
+				state.read_access = vk::AccessFlags();
+			}
+			else if(transition)
+			{
+				state.read_stages = info.stages;
+				state.read_access = info.access;
+			}
+			else
+			{
+				state.read_stages |= info.stages;
+				state.read_access |= info.access;
+			}
+			state.layout = info.layout;
+		}
+	}
+}
+
+void RenderGraph::Compile()
+{
+	Cull();
+	PlaceTransientImages();
+	DeriveBarriers();
+
+	compiled = true;
+}
+
+void RenderGraph::Execute(vk::CommandBuffer command_buffer)
+{
+	if(!compiled)
+		throw std::runtime_error("render graph was not compiled.");
+
+	for(const auto &pass : passes)
+	{
+		if(pass.culled)
+			continue;
+
+		if(pass.src_stages || !pass.barriers.empty())
+		{
+			command_buffer.pipelineBarrier(pass.src_stages ? pass.src_stages : vk::PipelineStageFlags(vk::PipelineStageFlagBits::eTopOfPipe),
+					pass.dst_stages,
+					vk::DependencyFlags(),
+					nullptr, nullptr, pass.barriers);
+		}
+
+		pass.record(command_buffer);
+	}
+}
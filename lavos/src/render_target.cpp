@@ -33,9 +33,10 @@ void RenderTarget::SignalChangedCallbacks()
 // ------------------------------------------
 
 
-ManagedDepthRenderTarget::ManagedDepthRenderTarget(Engine *engine, ColorRenderTarget *color_render_target)
+ManagedDepthRenderTarget::ManagedDepthRenderTarget(Engine *engine, ColorRenderTarget *color_render_target, bool transient)
 		: engine(engine),
-		  color_render_target(color_render_target)
+		  color_render_target(color_render_target),
+		  transient(transient)
 {
 	CreateResources();
 	color_render_target->AddChangedCallback(RenderTarget::ChangedCallbackOrder::AssociatedRenderTarget, this);
@@ -52,9 +53,14 @@ void ManagedDepthRenderTarget::CreateResources()
 
 	format = engine->FindDepthFormat();
 
+	// also read as input attachment by the deferred lighting pass
+	vk::ImageUsageFlags usage = vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eInputAttachment;
+	if(transient)
+		usage |= vk::ImageUsageFlagBits::eTransientAttachment;
+
 	image = engine->Create2DImage(extent.width, extent.height, format,
-								  vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eDepthStencilAttachment,
-								  VMA_MEMORY_USAGE_GPU_ONLY);
+								  vk::ImageTiling::eOptimal, usage,
+								  VMA_MEMORY_USAGE_GPU_ONLY, Engine::MemoryCategory::RenderTargets);
 
 	image_view = engine->GetVkDevice().createImageView(vk::ImageViewCreateInfo()
 															   .setImage(image.image)
@@ -1,18 +1,31 @@
 
 #include <chrono>
+#include <cstddef>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <set>
 
 #include "lavos/glm_config.h"
 #include "lavos/light_collection.h"
 #include "lavos/component/directional_light.h"
 #include "lavos/component/spot_light.h"
+#include "lavos/component/point_light.h"
 #include "lavos/spot_light_shadow.h"
+#include "lavos/spot_light_shadow_renderer.h"
+#include "lavos/point_light_shadow.h"
+#include "lavos/gbuffer.h"
 #include "lavos/renderer.h"
 #include "lavos/shader_load.h"
 #include "lavos/vertex.h"
 #include "lavos/component/mesh_component.h"
 #include "lavos/sub_renderer.h"
 #include "lavos/vk_util.h"
+#include "lavos/culling.h"
+#include "lavos/material/material_table.h"
+#include "lavos/material/material_parameter_arena.h"
+#include "lavos/geometry_arena.h"
+#include "lavos/log.h"
 
 #include "../glsl/common_glsl_cpp.h"
 
@@ -28,20 +41,44 @@ Renderer::Renderer(Engine *engine,
 	this->depth_render_target = depth_render_target;
 	color_render_target->AddChangedCallback(RenderTarget::ChangedCallbackOrder::Renderer, this);
 
+	shadow_descriptors_light_collections.resize(frames_in_flight, nullptr);
+	shadow_descriptors_versions.resize(frames_in_flight, 0);
+
 	CreateDescriptorPool();
 	CreateDescriptorSetLayout();
 	CreateUniformBuffers();
 	CreateDescriptorSet();
 
-	CreateRenderPasses();
+	if(config.GetDeferredEnabled())
+		gbuffer = new GBuffer(engine, color_render_target->GetExtent());
 
-	CreateFramebuffers();
+	samples = ChooseSampleCount(config.GetSampleCount());
+	if(samples != vk::SampleCountFlagBits::e1)
+		CreateMultisampleAttachments();
+
+	// the G-buffer is read as input attachments, which requires subpasses
+	if(!engine->GetDynamicRenderingEnabled() || gbuffer)
+	{
+		CreateRenderPasses();
+
+		if(gbuffer)
+			gbuffer->CreatePipeline(render_pass, 1, descriptor_set_layout);
+
+		CreateFramebuffers();
+	}
 
 	material_pipeline_manager = new MaterialPipelineManager(engine, CreateMaterialPipelineConfiguration());
+	if(config.GetDepthPrepassEnabled())
+		depth_prepass_pipeline_manager = new MaterialPipelineManager(engine, CreateDepthPrepassPipelineConfiguration());
 
 	spot_light_shadow_default = Texture::CreateColor(engine, vk::Format::eD16Unorm, glm::vec4(1.0f));
+	CreateShadowDepthDefaultTexture();
+	CreatePointLightShadowDefaultTexture();
 
-	CreateRenderCommandBuffer();
+	CreateRenderCommandBuffers();
+	CreateStatisticsQueryPool();
+
+	render_graph = new RenderGraph(engine);
 }
 
 Renderer::~Renderer()
@@ -56,16 +93,26 @@ Renderer::~Renderer()
 	device.destroyDescriptorSetLayout(descriptor_set_layout);
 
 	delete material_pipeline_manager;
+	delete depth_prepass_pipeline_manager;
+	delete gbuffer;
+
+	if(statistics_query_pool)
+		device.destroyQueryPool(statistics_query_pool);
 
 	device.destroyDescriptorPool(descriptor_pool);
 
 	engine->DestroyTexture(spot_light_shadow_default);
+	engine->DestroyTexture(spot_light_shadow_depth_default);
+	engine->DestroyTexture(point_light_shadow_default);
+
+	CleanupRenderCommandBuffers();
 
-	delete matrix_uniform_buffer;
-	delete lighting_uniform_buffer;
-	delete camera_uniform_buffer;
+	delete render_graph;
+	delete uniform_ring_buffer;
+	delete light_grid;
 
 	CleanupFramebuffers();
+	CleanupMultisampleAttachments();
 
 	CleanupRenderPasses();
 }
@@ -79,16 +126,73 @@ MaterialPipelineConfiguration Renderer::CreateMaterialPipelineConfiguration()
 							   | vk::ColorComponentFlagBits::eA)
 			.setBlendEnable(VK_FALSE);
 
+	// the G-buffer pass writes albedo and normal
 	auto color_blend_state_info = vk_util::PipelineColorBlendStateCreateInfo()
-			.SetAttachments({ color_blend_attachment });
+			.SetAttachments(gbuffer
+				? std::vector<vk::PipelineColorBlendAttachmentState>{ color_blend_attachment, color_blend_attachment }
+				: std::vector<vk::PipelineColorBlendAttachmentState>{ color_blend_attachment });
 
-	return MaterialPipelineConfiguration(
+	auto pipeline_config = MaterialPipelineConfiguration(
 			color_render_target->GetExtent(),
-			vk::SampleCountFlagBits::e1,
+			samples,
 			descriptor_set_layout,
 			render_pass,
-			Material::DefaultRenderMode::ColorForward,
+			gbuffer ? Material::DefaultRenderMode::GBuffer : Material::DefaultRenderMode::ColorForward,
 			color_blend_state_info);
+
+	if(config.GetDepthPrepassEnabled())
+	{
+		pipeline_config.subpass = 1;
+		pipeline_config.depth_prepass = true;
+	}
+
+	if(!gbuffer)
+		SetDynamicViewportConfiguration(pipeline_config);
+
+	if(!render_pass)
+		SetDynamicRenderingConfiguration(pipeline_config, true);
+
+	return pipeline_config;
+}
+
+MaterialPipelineConfiguration Renderer::CreateDepthPrepassPipelineConfiguration()
+{
+	auto pipeline_config = MaterialPipelineConfiguration(
+			color_render_target->GetExtent(),
+			samples,
+			descriptor_set_layout,
+			render_pass,
+			Material::DefaultRenderMode::DepthPrepass,
+			vk_util::PipelineColorBlendStateCreateInfo(),
+			{},
+			true);
+
+	pipeline_config.subpass = 0;
+	pipeline_config.position_only = true;
+
+	if(!gbuffer)
+		SetDynamicViewportConfiguration(pipeline_config);
+
+	if(!render_pass)
+		SetDynamicRenderingConfiguration(pipeline_config, false);
+
+	return pipeline_config;
+}
+
+void Renderer::SetDynamicViewportConfiguration(MaterialPipelineConfiguration &pipeline_config)
+{
+	// with the viewport and scissor of each view set in RecordFrameViews(), the pipelines don't depend on the extent
+	// and are kept when the render target is resized
+	pipeline_config.extent = vk::Extent2D();
+	pipeline_config.dynamic_states = { vk::DynamicState::eViewport, vk::DynamicState::eScissor };
+}
+
+void Renderer::SetDynamicRenderingConfiguration(MaterialPipelineConfiguration &pipeline_config, bool color)
+{
+	pipeline_config.subpass = 0;
+	if(color)
+		pipeline_config.color_formats = { color_render_target->GetFormat() };
+	pipeline_config.depth_format = depth_render_target->GetFormat();
 }
 
 void Renderer::CreateFramebuffers()
@@ -100,14 +204,23 @@ void Renderer::CreateFramebuffers()
 
 	for(size_t i=0; i<dst_image_views.size(); i++)
 	{
-		std::array<vk::ImageView, 2> attachments = {
+		std::vector<vk::ImageView> attachments = {
 			dst_image_views[i],
-			depth_render_target->GetImageView()
+			GetDepthImageView()
 		};
 
+		if(samples != vk::SampleCountFlagBits::e1)
+			attachments.push_back(multisample_color_image_view);
+
+		if(gbuffer)
+		{
+			attachments.push_back(gbuffer->GetAlbedoImageView());
+			attachments.push_back(gbuffer->GetNormalImageView());
+		}
+
 		auto framebuffer_info = vk::FramebufferCreateInfo()
 			.setRenderPass(render_pass)
-			.setAttachmentCount(attachments.size())
+			.setAttachmentCount(static_cast<uint32_t>(attachments.size()))
 			.setPAttachments(attachments.data())
 			.setWidth(extent.width)
 			.setHeight(extent.height)
@@ -115,6 +228,9 @@ void Renderer::CreateFramebuffers()
 
 		dst_framebuffers[i] = engine->GetVkDevice().createFramebuffer(framebuffer_info);
 	}
+
+	if(gbuffer)
+		gbuffer->WriteDescriptorSet(depth_render_target->GetImageView());
 }
 
 void Renderer::CleanupFramebuffers()
@@ -123,42 +239,141 @@ void Renderer::CleanupFramebuffers()
 		engine->GetVkDevice().destroyFramebuffer(framebuffer);
 }
 
+vk::SampleCountFlagBits Renderer::ChooseSampleCount(vk::SampleCountFlagBits requested) const
+{
+	auto limits = engine->GetVkPhysicalDevice().getProperties().limits;
+	vk::SampleCountFlags supported = limits.framebufferColorSampleCounts & limits.framebufferDepthSampleCounts;
+
+	auto count = static_cast<VkSampleCountFlags>(requested);
+	while(count > 1 && !(supported & static_cast<vk::SampleCountFlagBits>(count)))
+		count >>= 1;
+
+	if(count != static_cast<VkSampleCountFlags>(requested))
+	{
+		LAVOS_LOGF(LogLevel::Warning, "%u samples are not supported by the device, using %u.",
+				static_cast<unsigned int>(requested), static_cast<unsigned int>(count));
+	}
+
+	return static_cast<vk::SampleCountFlagBits>(count);
+}
+
+void Renderer::CreateMultisampleAttachments()
+{
+	auto extent = color_render_target->GetExtent();
+
+	// never leave the main pass, so they are transient and may be placed in lazily allocated memory
+	auto image_info = vk::ImageCreateInfo()
+			.setImageType(vk::ImageType::e2D)
+			.setExtent(vk::Extent3D(extent.width, extent.height, 1))
+			.setMipLevels(1)
+			.setArrayLayers(1)
+			.setTiling(vk::ImageTiling::eOptimal)
+			.setInitialLayout(vk::ImageLayout::eUndefined)
+			.setSharingMode(vk::SharingMode::eExclusive)
+			.setSamples(samples);
+
+	vk::Format color_format = color_render_target->GetFormat();
+	multisample_color_image = engine->CreateImage(vk::ImageCreateInfo(image_info)
+					.setFormat(color_format)
+					.setUsage(vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransientAttachment),
+			VMA_MEMORY_USAGE_GPU_ONLY, Engine::MemoryCategory::RenderTargets);
+	vk_util::SetDebugUtilsObjectName(engine->GetVkDevice(), multisample_color_image.image, "Renderer Multisample Color");
+
+	multisample_color_image_view = engine->GetVkDevice().createImageView(vk::ImageViewCreateInfo()
+			.setImage(multisample_color_image.image)
+			.setViewType(vk::ImageViewType::e2D)
+			.setFormat(color_format)
+			.setSubresourceRange(vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1)));
+
+	vk::Format depth_format = depth_render_target->GetFormat();
+	multisample_depth_image = engine->CreateImage(vk::ImageCreateInfo(image_info)
+					.setFormat(depth_format)
+					.setUsage(vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eTransientAttachment),
+			VMA_MEMORY_USAGE_GPU_ONLY, Engine::MemoryCategory::RenderTargets);
+	vk_util::SetDebugUtilsObjectName(engine->GetVkDevice(), multisample_depth_image.image, "Renderer Multisample Depth");
+
+	// also bound as stencil attachment if the format has stencil, see RecordDynamicRendering()
+	vk::ImageAspectFlags depth_aspect_mask = vk::ImageAspectFlagBits::eDepth;
+	if(Engine::HasStencilComponent(depth_format))
+		depth_aspect_mask |= vk::ImageAspectFlagBits::eStencil;
+
+	multisample_depth_image_view = engine->GetVkDevice().createImageView(vk::ImageViewCreateInfo()
+			.setImage(multisample_depth_image.image)
+			.setViewType(vk::ImageViewType::e2D)
+			.setFormat(depth_format)
+			.setSubresourceRange(vk::ImageSubresourceRange(depth_aspect_mask, 0, 1, 0, 1)));
+
+	// same as the depth render target, dynamic rendering expects it in eDepthStencilAttachmentOptimal
+	engine->TransitionImageLayout(multisample_depth_image.image, depth_format,
+			vk::ImageLayout::eUndefined, vk::ImageLayout::eDepthStencilAttachmentOptimal);
+}
+
+void Renderer::CleanupMultisampleAttachments()
+{
+	if(!multisample_color_image_view)
+		return;
+
+	// may still be used by frames in flight
+	auto device = engine->GetVkDevice();
+	auto color_image = multisample_color_image;
+	auto color_image_view = multisample_color_image_view;
+	auto depth_image = multisample_depth_image;
+	auto depth_image_view = multisample_depth_image_view;
+	auto engine = this->engine;
+	engine->DestroyAfter(engine->GetSubmittedValue(), [engine, device, color_image, color_image_view, depth_image, depth_image_view]() {
+		device.destroyImageView(color_image_view);
+		engine->DestroyImage(color_image);
+		device.destroyImageView(depth_image_view);
+		engine->DestroyImage(depth_image);
+	});
+
+	multisample_color_image_view = nullptr;
+	multisample_depth_image_view = nullptr;
+}
+
+vk::ImageView Renderer::GetDepthImageView() const
+{
+	return samples != vk::SampleCountFlagBits::e1 ? multisample_depth_image_view : depth_render_target->GetImageView();
+}
+
 void Renderer::CreateDescriptorPool()
 {
 	std::vector<vk::DescriptorPoolSize> pool_sizes = {
-		vk::DescriptorPoolSize(vk::DescriptorType::eUniformBuffer, 3),
-		vk::DescriptorPoolSize(vk::DescriptorType::eCombinedImageSampler, MAX_SPOT_LIGHTS_COUNT)
+		vk::DescriptorPoolSize(vk::DescriptorType::eUniformBufferDynamic, 3 * frames_in_flight),
+		vk::DescriptorPoolSize(vk::DescriptorType::eStorageBuffer, 2 * frames_in_flight),
+		vk::DescriptorPoolSize(vk::DescriptorType::eCombinedImageSampler,
+				(2 * MAX_SPOT_LIGHT_SHADOWS_COUNT + MAX_POINT_LIGHTS_COUNT) * frames_in_flight)
 	};
 
 	auto create_info = vk::DescriptorPoolCreateInfo()
 		.setPoolSizeCount(static_cast<uint32_t>(pool_sizes.size()))
 		.setPPoolSizes(pool_sizes.data())
-		.setMaxSets(1);
+		.setMaxSets(frames_in_flight);
 
 	descriptor_pool = engine->GetVkDevice().createDescriptorPool(create_info);
 }
 
 void Renderer::CreateDescriptorSetLayout()
 {
-	std::array<vk::DescriptorSetLayoutBinding, 4> bindings = {
+	std::array<vk::DescriptorSetLayoutBinding, 8> bindings = {
 		// matrix
 		vk::DescriptorSetLayoutBinding()
 			.setBinding(DESCRIPTOR_SET_COMMON_BINDING_MATRIX_BUFFER)
-			.setDescriptorType(vk::DescriptorType::eUniformBuffer)
+			.setDescriptorType(vk::DescriptorType::eUniformBufferDynamic)
 			.setDescriptorCount(1)
 			.setStageFlags(vk::ShaderStageFlagBits::eVertex),
 
 		// lighting
 		vk::DescriptorSetLayoutBinding()
 			.setBinding(DESCRIPTOR_SET_COMMON_BINDING_LIGHTING_BUFFER)
-			.setDescriptorType(vk::DescriptorType::eUniformBuffer)
+			.setDescriptorType(vk::DescriptorType::eUniformBufferDynamic)
 			.setDescriptorCount(1)
 			.setStageFlags(vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment),
 
 		// camera
 		vk::DescriptorSetLayoutBinding()
 			.setBinding(DESCRIPTOR_SET_COMMON_BINDING_CAMERA_BUFFER)
-			.setDescriptorType(vk::DescriptorType::eUniformBuffer)
+			.setDescriptorType(vk::DescriptorType::eUniformBufferDynamic)
 			.setDescriptorCount(1)
 			.setStageFlags(vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment),
 
@@ -166,7 +381,35 @@ void Renderer::CreateDescriptorSetLayout()
 		vk::DescriptorSetLayoutBinding()
 			.setBinding(DESCRIPTOR_SET_COMMON_BINDING_SPOT_LIGHT_SHADOW_TEX)
 			.setDescriptorType(vk::DescriptorType::eCombinedImageSampler)
-			.setDescriptorCount(MAX_SPOT_LIGHTS_COUNT)
+			.setDescriptorCount(MAX_SPOT_LIGHT_SHADOWS_COUNT)
+			.setStageFlags(vk::ShaderStageFlagBits::eFragment),
+
+		// spot light shadow depth tex (comparison samplers)
+		vk::DescriptorSetLayoutBinding()
+			.setBinding(DESCRIPTOR_SET_COMMON_BINDING_SPOT_LIGHT_SHADOW_DEPTH_TEX)
+			.setDescriptorType(vk::DescriptorType::eCombinedImageSampler)
+			.setDescriptorCount(MAX_SPOT_LIGHT_SHADOWS_COUNT)
+			.setStageFlags(vk::ShaderStageFlagBits::eFragment),
+
+		// point light shadow cube maps (comparison samplers)
+		vk::DescriptorSetLayoutBinding()
+			.setBinding(DESCRIPTOR_SET_COMMON_BINDING_POINT_LIGHT_SHADOW_TEX)
+			.setDescriptorType(vk::DescriptorType::eCombinedImageSampler)
+			.setDescriptorCount(MAX_POINT_LIGHTS_COUNT)
+			.setStageFlags(vk::ShaderStageFlagBits::eFragment),
+
+		// spot lights
+		vk::DescriptorSetLayoutBinding()
+			.setBinding(DESCRIPTOR_SET_COMMON_BINDING_SPOT_LIGHT_BUFFER)
+			.setDescriptorType(vk::DescriptorType::eStorageBuffer)
+			.setDescriptorCount(1)
+			.setStageFlags(vk::ShaderStageFlagBits::eFragment),
+
+		// light clusters
+		vk::DescriptorSetLayoutBinding()
+			.setBinding(DESCRIPTOR_SET_COMMON_BINDING_LIGHT_CLUSTER_BUFFER)
+			.setDescriptorType(vk::DescriptorType::eStorageBuffer)
+			.setDescriptorCount(1)
 			.setStageFlags(vk::ShaderStageFlagBits::eFragment)
 	};
 
@@ -181,27 +424,25 @@ void Renderer::CreateDescriptorSetLayout()
 size_t Renderer::GetLightingUniformBufferSize()
 {
 	return sizeof(LightingUniformBufferFixed)
-		   + max_spot_lights * sizeof(LightingUniformBufferSpotLight);
+		   + max_point_lights * sizeof(LightingUniformBufferPointLight);
 }
 
 void Renderer::CreateUniformBuffers()
 {
-	matrix_uniform_buffer = engine->CreateBuffer(sizeof(MatrixUniformBuffer),
-												 vk::BufferUsageFlagBits::eUniformBuffer,
-												 VMA_MEMORY_USAGE_CPU_ONLY);
+	// leave room for padding every buffer to the offset alignment, with matrices and camera for every view
+	vk::DeviceSize alignment = engine->GetVkPhysicalDevice().getProperties().limits.minUniformBufferOffsetAlignment;
+	vk::DeviceSize frame_size = GetLightingUniformBufferSize() + alignment
+			+ max_views * (sizeof(MatrixUniformBuffer) + sizeof(CameraUniformBuffer) + 2 * alignment);
 
-	lighting_uniform_buffer = engine->CreateBuffer(GetLightingUniformBufferSize(),
-												   vk::BufferUsageFlagBits::eUniformBuffer,
-												   VMA_MEMORY_USAGE_CPU_ONLY);
+	uniform_ring_buffer = new UniformRingBuffer(engine, frame_size, frames_in_flight);
 
-	camera_uniform_buffer = engine->CreateBuffer(sizeof(CameraUniformBuffer),
-												 vk::BufferUsageFlagBits::eUniformBuffer,
-												 VMA_MEMORY_USAGE_CPU_ONLY);
+	light_grid = new LightGrid(engine, frames_in_flight);
 }
 
-void Renderer::UpdateMatrixUniformBuffer()
+void Renderer::UpdateMatrixUniformBuffer(FrameView &view)
 {
-	auto extent = color_render_target->GetExtent();
+	Camera *camera = view.view.camera;
+	auto extent = view.view.region.extent;
 
 	if(auto_set_camera_aspect && camera->GetType() == Camera::Type::PERSPECTIVE)
 		camera->SetPerspectiveAspect((float)extent.width / (float)extent.height);
@@ -211,17 +452,30 @@ void Renderer::UpdateMatrixUniformBuffer()
 	matrix_ubo.projection = camera->GetProjectionMatrix();
 	matrix_ubo.projection[1][1] *= -1.0f;
 
-	memcpy(matrix_uniform_buffer->Map(), &matrix_ubo, sizeof(matrix_ubo));
-	matrix_uniform_buffer->UnMap();
+	view.matrix_offset = uniform_ring_buffer->Write(&matrix_ubo, sizeof(matrix_ubo));
 }
 
-void Renderer::UpdateCameraUniformBuffer()
+void Renderer::UpdateCameraUniformBuffer(FrameView &view)
 {
-	CameraUniformBuffer ubo;
-	ubo.position = camera->GetNode()->GetTransformComp()->GetMatrix() * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+	Camera *camera = view.view.camera;
 
-	memcpy(camera_uniform_buffer->Map(), &ubo, sizeof(ubo));
-	camera_uniform_buffer->UnMap();
+	CameraUniformBuffer ubo;
+	memset(&ubo, 0, sizeof(ubo));
+	glm::mat4 transform_mat = camera->GetNode()->GetTransformComp()->GetMatrixWorld();
+	ubo.position = transform_mat * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+	ubo.direction = glm::normalize(glm::vec3(transform_mat * glm::vec4(0.0f, 0.0f, -1.0f, 0.0f)));
+
+	// framebuffer coordinates are relative to the whole render target, not the region of the view
+	auto offset = view.view.region.offset;
+	auto extent = view.view.region.extent;
+	glm::mat4 projection = camera->GetProjectionMatrix();
+	projection[1][1] *= -1.0f;
+	glm::mat4 screen_to_ndc = glm::translate(glm::mat4(1.0f), glm::vec3(-1.0f, -1.0f, 0.0f))
+			* glm::scale(glm::mat4(1.0f), glm::vec3(2.0f / extent.width, 2.0f / extent.height, 1.0f))
+			* glm::translate(glm::mat4(1.0f), glm::vec3(-static_cast<float>(offset.x), -static_cast<float>(offset.y), 0.0f));
+	ubo.screen_to_world = glm::inverse(projection * camera->GetModelViewMatrix()) * screen_to_ndc;
+
+	view.camera_offset = uniform_ring_buffer->Write(&ubo, sizeof(ubo));
 }
 
 void Renderer::UpdateLightingUniformBuffer(LightCollection *light_collection)
@@ -244,118 +498,398 @@ void Renderer::UpdateLightingUniformBuffer(LightCollection *light_collection)
 	}
 
 
-	std::vector<LightingUniformBufferSpotLight> spot_light_buffers(max_spot_lights);
-	memset(spot_light_buffers.data(), 0, sizeof(LightingUniformBufferSpotLight) * spot_light_buffers.size());
+	// shadowed lights come first, in the order of their shadow textures (see UpdateShadowDescriptors()),
+	// all others are assigned to clusters
+	std::vector<LightingStorageBufferSpotLight> spot_light_buffers;
+	spot_light_buffers.reserve(light_collection->spot_lights.size());
 
-	fixed.spot_lights_count = static_cast<uint32_t>(light_collection->spot_lights.size());
+	auto fill_spot_light = [](SpotLight *spot_light, SpotLightShadow *shadow) {
+		LightingStorageBufferSpotLight buffer;
+		memset(&buffer, 0, sizeof(buffer));
+		glm::mat4 transform_mat = spot_light->GetNode()->GetTransformComp()->GetMatrixWorld();
+		buffer.position = transform_mat * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+		buffer.direction = transform_mat * glm::vec4(0.0f, 0.0f, -1.0f, 0.0f);
+		buffer.angle_cos = cosf(spot_light->GetAngle() * 0.5f);
+		buffer.range = spot_light->GetEffectiveRange();
+		if(shadow)
+		{
+			buffer.shadow_mvp_matrix = shadow->GetModelViewProjectionMatrix();
+			buffer.shadow_mode = shadow->GetRenderer()->GetShadowMode() == ShadowMode::Depth
+					? SPOT_LIGHT_SHADOW_MODE_DEPTH : SPOT_LIGHT_SHADOW_MODE_MSM;
+		}
+		else
+		{
+			buffer.shadow_mode = SPOT_LIGHT_SHADOW_MODE_NONE;
+		}
+		return buffer;
+	};
 
-	for(unsigned int i=0; i<std::min(light_collection->spot_lights.size(), spot_light_buffers.size()); i++)
+	std::vector<SpotLight *> unshadowed_spot_lights;
+	for(auto spot_light : light_collection->spot_lights)
 	{
-		auto spot_light = light_collection->spot_lights[i];
-		glm::mat4 transform_mat = spot_light->GetNode()->GetTransformComp()->GetMatrixWorld();
-		spot_light_buffers[i].position = transform_mat * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
-		spot_light_buffers[i].direction = transform_mat * glm::vec4(0.0f, 0.0f, -1.0f, 0.0f);
-		spot_light_buffers[i].angle_cos = cosf(spot_light->GetAngle() * 0.5f);
 		SpotLightShadow *shadow = spot_light->GetShadow();
-		if(shadow)
-			spot_light_buffers[i].shadow_mvp_matrix = shadow->GetModelViewProjectionMatrix();
+		if(shadow && spot_light_buffers.size() < MAX_SPOT_LIGHT_SHADOWS_COUNT)
+			spot_light_buffers.push_back(fill_spot_light(spot_light, shadow));
+		else
+			unshadowed_spot_lights.push_back(spot_light);
 	}
 
-	std::uint8_t *data = static_cast<std::uint8_t *>(lighting_uniform_buffer->Map());
-	memcpy(data, &fixed, sizeof(fixed));
-	memcpy(data + 48, spot_light_buffers.data(), sizeof(LightingUniformBufferSpotLight) * spot_light_buffers.size());
-	lighting_uniform_buffer->UnMap();
-}
+	fixed.shadowed_spot_lights_count = static_cast<uint32_t>(spot_light_buffers.size());
+	shadowed_spot_lights.assign(spot_light_buffers.begin(), spot_light_buffers.end());
+
+	lighting_features = fixed.directional_light_enabled ? Material::LightingFeatureDirectionalLight : 0;
+	for(const auto &spot_light_buffer : spot_light_buffers)
+	{
+		lighting_features |= spot_light_buffer.shadow_mode == SPOT_LIGHT_SHADOW_MODE_DEPTH
+				? Material::LightingFeatureSpotLightShadowDepth : Material::LightingFeatureSpotLightShadowMSM;
+	}
+	if(light_collection->spot_lights.size() > spot_light_buffers.size())
+		lighting_features |= Material::LightingFeatureClusteredSpotLights;
+
+	for(auto spot_light : unshadowed_spot_lights)
+		spot_light_buffers.push_back(fill_spot_light(spot_light, nullptr));
+
+	// the tiles of the clusters are only valid for a single view covering the whole render target
+	bool clustered = frame_views.size() == 1
+			&& frame_views[0].view.region == vk::Rect2D({ 0, 0 }, color_render_target->GetExtent());
+
+	bool recreated = clustered
+			? light_grid->Update(frame_index, spot_light_buffers, fixed.shadowed_spot_lights_count,
+					frame_views[0].view.camera, color_render_target->GetExtent())
+			: light_grid->UpdateSingleCluster(frame_index, spot_light_buffers, fixed.shadowed_spot_lights_count);
+	if(recreated)
+		WriteLightGridDescriptors(frame_index);
+
+	fixed.cluster_count = light_grid->GetClusterCount();
+	fixed.cluster_tile_size = light_grid->GetTileSize();
+	fixed.cluster_z_scale = light_grid->GetZScale();
+	fixed.cluster_z_bias = light_grid->GetZBias();
 
-void Renderer::UpdateShadowDescriptors(LightCollection *light_collection)
-{
-	std::array<vk::DescriptorImageInfo, MAX_SPOT_LIGHTS_COUNT> image_infos;
 
-	for(size_t i = 0; i < MAX_SPOT_LIGHTS_COUNT; i++)
+	std::vector<LightingUniformBufferPointLight> point_light_buffers(max_point_lights);
+	memset(point_light_buffers.data(), 0, sizeof(LightingUniformBufferPointLight) * point_light_buffers.size());
+
+	fixed.point_lights_count = static_cast<uint32_t>(std::min(light_collection->point_lights.size(), point_light_buffers.size()));
+	if(light_collection->point_lights.size() > max_point_lights && !point_lights_dropped_warned)
+	{
+		LAVOS_LOGF(LogLevel::Warning, "%u point lights exceed the maximum of %u, the remaining ones are ignored.",
+				static_cast<unsigned int>(light_collection->point_lights.size()), max_point_lights);
+		point_lights_dropped_warned = true;
+	}
+	lighting_features |= Material::GetLightingFeaturesPointLights(fixed.point_lights_count);
+
+	for(unsigned int i=0; i<fixed.point_lights_count; i++)
 	{
-		vk::ImageView image_view;
-		vk::Sampler sampler;
-		if(i < light_collection->spot_lights.size())
+		auto point_light = light_collection->point_lights[i];
+		point_light_buffers[i].position = point_light->GetPositionWorld();
+		point_light_buffers[i].intensity = point_light->GetIntensity();
+		PointLightShadow *shadow = point_light->GetShadow();
+		if(shadow)
 		{
-			SpotLightShadow *shadow = light_collection->spot_lights[i]->GetShadow();
-			image_view = shadow->GetFinalImageView();
-			sampler = shadow->GetSampler();
+			point_light_buffers[i].shadow_near_clip = shadow->GetNearClip();
+			point_light_buffers[i].shadow_far_clip = shadow->GetFarClip();
+			point_light_buffers[i].shadow_mode = SPOT_LIGHT_SHADOW_MODE_DEPTH;
 		}
 		else
 		{
-			image_view = spot_light_shadow_default.image_view;
-			sampler = spot_light_shadow_default.sampler;
+			point_light_buffers[i].shadow_mode = SPOT_LIGHT_SHADOW_MODE_NONE;
 		}
+	}
+
+	void *data;
+	descriptor_set_dynamic_offsets[1] = uniform_ring_buffer->Allocate(GetLightingUniformBufferSize(), &data);
+	memcpy(data, &fixed, sizeof(fixed));
+	memcpy(reinterpret_cast<std::uint8_t *>(data) + sizeof(fixed), point_light_buffers.data(), sizeof(LightingUniformBufferPointLight) * point_light_buffers.size());
+}
+
+void Renderer::UpdateShadowResolutions(LightCollection *light_collection)
+{
+	std::map<SpotLightShadowRenderer *, std::vector<SpotLightShadow *>> shadows;
+
+	for(SpotLight *spot_light : light_collection->spot_lights)
+	{
+		SpotLightShadow *shadow = spot_light->GetShadow();
+		if(!shadow || !shadow->GetRenderer()->GetAdaptiveResolutionEnabled())
+			continue;
+		shadows[shadow->GetRenderer()].push_back(shadow);
+	}
+
+	for(auto &entry : shadows)
+		entry.first->UpdateResolutions(entry.second, frame_views[0].view.camera, frame_views[0].view.region.extent);
+}
+
+void Renderer::UpdateShadowDescriptors(LightCollection *light_collection)
+{
+	// the descriptors only depend on which lights and shadows exist,
+	// the set of this frame is not in use anymore, but may be outdated from its previous frame
+	if(light_collection == shadow_descriptors_light_collections[frame_index]
+			&& light_collection->version == shadow_descriptors_versions[frame_index])
+		return;
+
+	shadow_descriptors_light_collections[frame_index] = light_collection;
+	shadow_descriptors_versions[frame_index] = light_collection->version;
+
+	// every shadow slot has an entry in both bindings, the one not matching its shadow mode gets a default texture
+	std::array<vk::DescriptorImageInfo, MAX_SPOT_LIGHT_SHADOWS_COUNT> image_infos;
+	std::array<vk::DescriptorImageInfo, MAX_SPOT_LIGHT_SHADOWS_COUNT> depth_image_infos;
+
+	// slots are assigned to shadowed lights in order, like in UpdateLightingUniformBuffer()
+	std::vector<SpotLightShadow *> shadows;
+	for(auto spot_light : light_collection->spot_lights)
+	{
+		if(spot_light->GetShadow() && shadows.size() < MAX_SPOT_LIGHT_SHADOWS_COUNT)
+			shadows.push_back(spot_light->GetShadow());
+	}
+
+	for(size_t i = 0; i < MAX_SPOT_LIGHT_SHADOWS_COUNT; i++)
+	{
+		const Texture &default_tex = spot_light_shadow_default;
+		const Texture &depth_default_tex = spot_light_shadow_depth_default;
+
 		image_infos[i] = vk::DescriptorImageInfo()
 				.setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
-				.setImageView(image_view)
-				.setSampler(sampler);
+				.setImageView(default_tex.image_view)
+				.setSampler(default_tex.sampler);
+
+		depth_image_infos[i] = vk::DescriptorImageInfo()
+				.setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
+				.setImageView(depth_default_tex.image_view)
+				.setSampler(depth_default_tex.sampler);
+
+		if(i >= shadows.size())
+			continue;
+
+		SpotLightShadow *shadow = shadows[i];
+		auto &info = shadow->GetRenderer()->GetShadowMode() == ShadowMode::Depth ? depth_image_infos[i] : image_infos[i];
+		info.setImageView(shadow->GetFinalImageView())
+				.setSampler(shadow->GetSampler());
+	}
+
+	std::array<vk::DescriptorImageInfo, MAX_POINT_LIGHTS_COUNT> point_image_infos;
+
+	for(size_t i = 0; i < MAX_POINT_LIGHTS_COUNT; i++)
+	{
+		point_image_infos[i] = vk::DescriptorImageInfo()
+				.setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
+				.setImageView(point_light_shadow_default.image_view)
+				.setSampler(point_light_shadow_default.sampler);
+
+		if(i >= light_collection->point_lights.size())
+			continue;
+
+		PointLightShadow *shadow = light_collection->point_lights[i]->GetShadow();
+		if(!shadow)
+			continue;
+
+		point_image_infos[i]
+				.setImageView(shadow->GetCubeImageView())
+				.setSampler(shadow->GetSampler());
 	}
 
-	auto write = vk::WriteDescriptorSet()
-			.setDstSet(descriptor_set)
+	std::array<vk::WriteDescriptorSet, 3> writes = {
+		vk::WriteDescriptorSet()
+			.setDstSet(descriptor_sets[frame_index])
 			.setDstBinding(DESCRIPTOR_SET_COMMON_BINDING_SPOT_LIGHT_SHADOW_TEX)
 			.setDstArrayElement(0)
 			.setDescriptorType(vk::DescriptorType::eCombinedImageSampler)
-			.setDescriptorCount(MAX_SPOT_LIGHTS_COUNT)
-			.setPImageInfo(image_infos.data());
+			.setDescriptorCount(MAX_SPOT_LIGHT_SHADOWS_COUNT)
+			.setPImageInfo(image_infos.data()),
+
+		vk::WriteDescriptorSet()
+			.setDstSet(descriptor_sets[frame_index])
+			.setDstBinding(DESCRIPTOR_SET_COMMON_BINDING_SPOT_LIGHT_SHADOW_DEPTH_TEX)
+			.setDstArrayElement(0)
+			.setDescriptorType(vk::DescriptorType::eCombinedImageSampler)
+			.setDescriptorCount(MAX_SPOT_LIGHT_SHADOWS_COUNT)
+			.setPImageInfo(depth_image_infos.data()),
 
-	engine->GetVkDevice().updateDescriptorSets({write}, nullptr);
+		vk::WriteDescriptorSet()
+			.setDstSet(descriptor_sets[frame_index])
+			.setDstBinding(DESCRIPTOR_SET_COMMON_BINDING_POINT_LIGHT_SHADOW_TEX)
+			.setDstArrayElement(0)
+			.setDescriptorType(vk::DescriptorType::eCombinedImageSampler)
+			.setDescriptorCount(MAX_POINT_LIGHTS_COUNT)
+			.setPImageInfo(point_image_infos.data())
+	};
+
+	engine->GetVkDevice().updateDescriptorSets(writes, nullptr);
+}
+
+void Renderer::CreateShadowDepthDefaultTexture()
+{
+	spot_light_shadow_depth_default = Texture::CreateColor(engine, vk::Format::eD16Unorm, glm::vec4(1.0f));
+
+	// replace the default sampler with a comparison sampler, as required by sampler2DShadow.
+	// Both are owned by the Engine's sampler cache, so the default one must not be destroyed here.
+	spot_light_shadow_depth_default.sampler = engine->GetSampler(vk::SamplerCreateInfo()
+		.setMagFilter(vk::Filter::eNearest)
+		.setMinFilter(vk::Filter::eNearest)
+		.setAddressModeU(vk::SamplerAddressMode::eClampToEdge)
+		.setAddressModeV(vk::SamplerAddressMode::eClampToEdge)
+		.setAddressModeW(vk::SamplerAddressMode::eClampToEdge)
+		.setCompareEnable(VK_TRUE)
+		.setCompareOp(vk::CompareOp::eLessOrEqual)
+		.setMipmapMode(vk::SamplerMipmapMode::eNearest)
+		.setMaxLod(0.0f));
+}
+
+void Renderer::CreatePointLightShadowDefaultTexture()
+{
+	auto &device = engine->GetVkDevice();
+	auto format = vk::Format::eD16Unorm;
+
+	auto image_create_info = vk::ImageCreateInfo()
+		.setFlags(vk::ImageCreateFlagBits::eCubeCompatible)
+		.setImageType(vk::ImageType::e2D)
+		.setExtent(vk::Extent3D(1, 1, 1))
+		.setMipLevels(1)
+		.setArrayLayers(6)
+		.setSamples(vk::SampleCountFlagBits::e1)
+		.setTiling(vk::ImageTiling::eOptimal)
+		.setFormat(format)
+		.setUsage(vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst);
+
+	Image image = engine->CreateImage(image_create_info, VMA_MEMORY_USAGE_GPU_ONLY, Engine::MemoryCategory::Shadows);
+
+	auto subresource_range = vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eDepth, 0, 1, 0, 6);
+
+	// clear all faces to the far plane and leave the image ready for sampling
+	auto command_buffer = engine->BeginSingleTimeCommandBuffer();
+
+	auto barrier = vk::ImageMemoryBarrier()
+		.setOldLayout(vk::ImageLayout::eUndefined)
+		.setNewLayout(vk::ImageLayout::eTransferDstOptimal)
+		.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+		.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+		.setImage(image.image)
+		.setSubresourceRange(subresource_range)
+		.setDstAccessMask(vk::AccessFlagBits::eTransferWrite);
+	command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer,
+			vk::DependencyFlags(), nullptr, nullptr, barrier);
+
+	command_buffer.clearDepthStencilImage(image.image, vk::ImageLayout::eTransferDstOptimal,
+			vk::ClearDepthStencilValue(1.0f, 0), subresource_range);
+
+	barrier
+		.setOldLayout(vk::ImageLayout::eTransferDstOptimal)
+		.setNewLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
+		.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+		.setDstAccessMask(vk::AccessFlagBits::eShaderRead);
+	command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader,
+			vk::DependencyFlags(), nullptr, nullptr, barrier);
+
+	engine->EndSingleTimeCommandBuffer(command_buffer);
+
+	auto image_view = device.createImageView(vk::ImageViewCreateInfo()
+		.setImage(image.image)
+		.setViewType(vk::ImageViewType::eCube)
+		.setFormat(format)
+		.setSubresourceRange(subresource_range));
+
+	auto sampler = device.createSampler(vk::SamplerCreateInfo()
+		.setMagFilter(vk::Filter::eNearest)
+		.setMinFilter(vk::Filter::eNearest)
+		.setAddressModeU(vk::SamplerAddressMode::eClampToEdge)
+		.setAddressModeV(vk::SamplerAddressMode::eClampToEdge)
+		.setAddressModeW(vk::SamplerAddressMode::eClampToEdge)
+		.setCompareEnable(VK_TRUE)
+		.setCompareOp(vk::CompareOp::eLessOrEqual)
+		.setMipmapMode(vk::SamplerMipmapMode::eNearest)
+		.setMaxLod(0.0f));
+
+	point_light_shadow_default = Texture(image, image_view, sampler);
 }
 
 void Renderer::CreateDescriptorSet()
 {
-	vk::DescriptorSetLayout layouts[] = { descriptor_set_layout };
+	std::vector<vk::DescriptorSetLayout> layouts(frames_in_flight, descriptor_set_layout);
 
 	auto alloc_info = vk::DescriptorSetAllocateInfo()
 		.setDescriptorPool(descriptor_pool)
-		.setDescriptorSetCount(1)
-		.setPSetLayouts(layouts);
+		.setDescriptorSetCount(frames_in_flight)
+		.setPSetLayouts(layouts.data());
 
-	descriptor_set = *engine->GetVkDevice().allocateDescriptorSets(alloc_info).begin();
+	descriptor_sets = engine->GetVkDevice().allocateDescriptorSets(alloc_info);
 
 	auto matrix_buffer_info = vk::DescriptorBufferInfo()
-		.setBuffer(matrix_uniform_buffer->GetVkBuffer())
+		.setBuffer(uniform_ring_buffer->GetVkBuffer())
 		.setOffset(0)
 		.setRange(sizeof(MatrixUniformBuffer));
 
-	auto matrix_buffer_write = vk::WriteDescriptorSet()
-		.setDstSet(descriptor_set)
-		.setDstBinding(DESCRIPTOR_SET_COMMON_BINDING_MATRIX_BUFFER)
-		.setDstArrayElement(0)
-		.setDescriptorType(vk::DescriptorType::eUniformBuffer)
-		.setDescriptorCount(1)
-		.setPBufferInfo(&matrix_buffer_info);
-
-
 	auto lighting_buffer_info = vk::DescriptorBufferInfo()
-		.setBuffer(lighting_uniform_buffer->GetVkBuffer())
+		.setBuffer(uniform_ring_buffer->GetVkBuffer())
 		.setOffset(0)
 		.setRange(GetLightingUniformBufferSize());
 
-	auto lighting_buffer_write = vk::WriteDescriptorSet()
-		.setDstSet(descriptor_set)
-		.setDstBinding(DESCRIPTOR_SET_COMMON_BINDING_LIGHTING_BUFFER)
-		.setDstArrayElement(0)
-		.setDescriptorType(vk::DescriptorType::eUniformBuffer)
-		.setDescriptorCount(1)
-		.setPBufferInfo(&lighting_buffer_info);
-
-
 	auto camera_buffer_info = vk::DescriptorBufferInfo()
-		.setBuffer(camera_uniform_buffer->GetVkBuffer())
+		.setBuffer(uniform_ring_buffer->GetVkBuffer())
 		.setOffset(0)
 		.setRange(sizeof(CameraUniformBuffer));
 
-	auto camera_buffer_write = vk::WriteDescriptorSet()
-		.setDstSet(descriptor_set)
-		.setDstBinding(DESCRIPTOR_SET_COMMON_BINDING_CAMERA_BUFFER)
-		.setDstArrayElement(0)
-		.setDescriptorType(vk::DescriptorType::eUniformBuffer)
-		.setDescriptorCount(1)
-		.setPBufferInfo(&camera_buffer_info);
+	// all sets point to the whole ring buffer, the region of a frame is selected by the dynamic offsets
+	for(std::uint32_t frame=0; frame<frames_in_flight; frame++)
+	{
+		auto matrix_buffer_write = vk::WriteDescriptorSet()
+			.setDstSet(descriptor_sets[frame])
+			.setDstBinding(DESCRIPTOR_SET_COMMON_BINDING_MATRIX_BUFFER)
+			.setDstArrayElement(0)
+			.setDescriptorType(vk::DescriptorType::eUniformBufferDynamic)
+			.setDescriptorCount(1)
+			.setPBufferInfo(&matrix_buffer_info);
+
+		auto lighting_buffer_write = vk::WriteDescriptorSet()
+			.setDstSet(descriptor_sets[frame])
+			.setDstBinding(DESCRIPTOR_SET_COMMON_BINDING_LIGHTING_BUFFER)
+			.setDstArrayElement(0)
+			.setDescriptorType(vk::DescriptorType::eUniformBufferDynamic)
+			.setDescriptorCount(1)
+			.setPBufferInfo(&lighting_buffer_info);
+
+		auto camera_buffer_write = vk::WriteDescriptorSet()
+			.setDstSet(descriptor_sets[frame])
+			.setDstBinding(DESCRIPTOR_SET_COMMON_BINDING_CAMERA_BUFFER)
+			.setDstArrayElement(0)
+			.setDescriptorType(vk::DescriptorType::eUniformBufferDynamic)
+			.setDescriptorCount(1)
+			.setPBufferInfo(&camera_buffer_info);
+
+		engine->GetVkDevice().updateDescriptorSets({matrix_buffer_write, lighting_buffer_write, camera_buffer_write}, nullptr);
+
+		WriteLightGridDescriptors(frame);
+	}
+}
+
+void Renderer::WriteLightGridDescriptors(std::uint32_t frame)
+{
+	auto light_buffer_info = vk::DescriptorBufferInfo()
+		.setBuffer(light_grid->GetLightBuffer(frame))
+		.setOffset(0)
+		.setRange(light_grid->GetLightBufferSize(frame));
+
+	auto cluster_buffer_info = vk::DescriptorBufferInfo()
+		.setBuffer(light_grid->GetClusterBuffer(frame))
+		.setOffset(0)
+		.setRange(light_grid->GetClusterBufferSize(frame));
+
+	std::array<vk::WriteDescriptorSet, 2> writes = {
+		vk::WriteDescriptorSet()
+			.setDstSet(descriptor_sets[frame])
+			.setDstBinding(DESCRIPTOR_SET_COMMON_BINDING_SPOT_LIGHT_BUFFER)
+			.setDstArrayElement(0)
+			.setDescriptorType(vk::DescriptorType::eStorageBuffer)
+			.setDescriptorCount(1)
+			.setPBufferInfo(&light_buffer_info),
+
+		vk::WriteDescriptorSet()
+			.setDstSet(descriptor_sets[frame])
+			.setDstBinding(DESCRIPTOR_SET_COMMON_BINDING_LIGHT_CLUSTER_BUFFER)
+			.setDstArrayElement(0)
+			.setDescriptorType(vk::DescriptorType::eStorageBuffer)
+			.setDescriptorCount(1)
+			.setPBufferInfo(&cluster_buffer_info)
+	};
 
-	engine->GetVkDevice().updateDescriptorSets({matrix_buffer_write, lighting_buffer_write, camera_buffer_write}, nullptr);
+	engine->GetVkDevice().updateDescriptorSets(writes, nullptr);
 }
 
 
@@ -387,6 +921,8 @@ void Renderer::AddMaterial(Material *material)
 
 	materials.push_back(material);
 	material_pipeline_manager->AddMaterial(material);
+	if(depth_prepass_pipeline_manager)
+		depth_prepass_pipeline_manager->AddMaterial(material);
 
 	for(auto sub_renderer : sub_renderers)
 		sub_renderer->AddMaterial(material);
@@ -400,6 +936,8 @@ void Renderer::RemoveMaterial(Material *material)
 		throw std::runtime_error("Material not in Renderer.");
 
 	material_pipeline_manager->RemoveMaterial(material);
+	if(depth_prepass_pipeline_manager)
+		depth_prepass_pipeline_manager->RemoveMaterial(material);
 
 	for(auto sub_renderer : sub_renderers)
 		sub_renderer->RemoveMaterial(material);
@@ -411,20 +949,23 @@ void Renderer::RemoveMaterial(Material *material)
 
 void Renderer::CreateRenderPasses()
 {
+	bool multisample = samples != vk::SampleCountFlagBits::e1;
+
+	// with multisampling, the render target is only written by the resolve at the end of the color subpass
 	auto color_attachment = vk::AttachmentDescription()
 		.setFormat(color_render_target->GetFormat())
 		.setSamples(vk::SampleCountFlagBits::e1)
-		.setLoadOp(vk::AttachmentLoadOp::eClear)
+		.setLoadOp(multisample ? vk::AttachmentLoadOp::eDontCare : vk::AttachmentLoadOp::eClear)
 		.setStoreOp(vk::AttachmentStoreOp::eStore)
 		.setStencilLoadOp(vk::AttachmentLoadOp::eDontCare)
 		.setStencilStoreOp(vk::AttachmentStoreOp::eDontCare)
 		.setInitialLayout(vk::ImageLayout::eUndefined)
-		.setFinalLayout(vk::ImageLayout::ePresentSrcKHR);
+		.setFinalLayout(color_render_target->GetFinalLayout());
 	vk::AttachmentReference color_attachment_ref(0, vk::ImageLayout::eColorAttachmentOptimal);
 
 	auto depth_attachment = vk::AttachmentDescription()
 		.setFormat(depth_render_target->GetFormat())
-		.setSamples(vk::SampleCountFlagBits::e1)
+		.setSamples(samples)
 		.setLoadOp(vk::AttachmentLoadOp::eClear)
 		.setStoreOp(vk::AttachmentStoreOp::eDontCare)
 		.setStencilLoadOp(vk::AttachmentLoadOp::eDontCare)
@@ -435,30 +976,159 @@ void Renderer::CreateRenderPasses()
 
 
 
-	auto subpass = vk::SubpassDescription()
-		.setColorAttachmentCount(1)
-		.setPColorAttachments(&color_attachment_ref)
-		.setPDepthStencilAttachment(&depth_attachment_ref);
+	std::vector<vk::AttachmentDescription> attachments = { color_attachment, depth_attachment };
+
+	// the multisampled color attachment takes the place of the render target, which becomes its resolve attachment
+	vk::AttachmentReference multisample_color_attachment_ref(2, vk::ImageLayout::eColorAttachmentOptimal);
+	if(multisample)
+	{
+		attachments.push_back(vk::AttachmentDescription()
+			.setFormat(color_render_target->GetFormat())
+			.setSamples(samples)
+			.setLoadOp(vk::AttachmentLoadOp::eClear)
+			.setStoreOp(vk::AttachmentStoreOp::eDontCare)
+			.setStencilLoadOp(vk::AttachmentLoadOp::eDontCare)
+			.setStencilStoreOp(vk::AttachmentStoreOp::eDontCare)
+			.setInitialLayout(vk::ImageLayout::eUndefined)
+			.setFinalLayout(vk::ImageLayout::eColorAttachmentOptimal));
+	}
+	std::vector<vk::SubpassDescription> subpasses;
+	std::vector<vk::SubpassDependency> subpass_dependencies;
+
+	// with a depth prepass or G-buffer pass, that is subpass 0 and subpass 1 writes the color attachment
+	std::uint32_t color_subpass = 0;
 
-	auto subpass_dependency = vk::SubpassDependency()
+	if(config.GetDepthPrepassEnabled())
+	{
+		subpasses.push_back(vk::SubpassDescription()
+			.setColorAttachmentCount(0)
+			.setPDepthStencilAttachment(&depth_attachment_ref));
+
+		subpass_dependencies.push_back(vk::SubpassDependency()
+			.setSrcSubpass(0)
+			.setDstSubpass(1)
+			.setSrcStageMask(vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests)
+			.setSrcAccessMask(vk::AccessFlagBits::eDepthStencilAttachmentWrite)
+			.setDstStageMask(vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests)
+			.setDstAccessMask(vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite)
+			.setDependencyFlags(vk::DependencyFlagBits::eByRegion));
+
+		color_subpass = 1;
+	}
+
+	std::array<vk::AttachmentReference, 2> gbuffer_attachment_refs = {
+		vk::AttachmentReference(2, vk::ImageLayout::eColorAttachmentOptimal),
+		vk::AttachmentReference(3, vk::ImageLayout::eColorAttachmentOptimal)
+	};
+
+	// order matches input_attachment_index in deferred_lighting.frag
+	std::array<vk::AttachmentReference, 3> gbuffer_input_attachment_refs = {
+		vk::AttachmentReference(2, vk::ImageLayout::eShaderReadOnlyOptimal),
+		vk::AttachmentReference(3, vk::ImageLayout::eShaderReadOnlyOptimal),
+		vk::AttachmentReference(1, vk::ImageLayout::eDepthStencilReadOnlyOptimal)
+	};
+
+	if(gbuffer)
+	{
+		// the G-buffer never leaves the render pass
+		for(auto format : { GBuffer::albedo_format, GBuffer::normal_format })
+		{
+			attachments.push_back(vk::AttachmentDescription()
+				.setFormat(format)
+				.setSamples(vk::SampleCountFlagBits::e1)
+				.setLoadOp(vk::AttachmentLoadOp::eDontCare)
+				.setStoreOp(vk::AttachmentStoreOp::eDontCare)
+				.setStencilLoadOp(vk::AttachmentLoadOp::eDontCare)
+				.setStencilStoreOp(vk::AttachmentStoreOp::eDontCare)
+				.setInitialLayout(vk::ImageLayout::eUndefined)
+				.setFinalLayout(vk::ImageLayout::eShaderReadOnlyOptimal));
+		}
+
+		subpasses.push_back(vk::SubpassDescription()
+			.setColorAttachmentCount(static_cast<uint32_t>(gbuffer_attachment_refs.size()))
+			.setPColorAttachments(gbuffer_attachment_refs.data())
+			.setPDepthStencilAttachment(&depth_attachment_ref));
+
+		subpasses.push_back(vk::SubpassDescription()
+			.setColorAttachmentCount(1)
+			.setPColorAttachments(&color_attachment_ref)
+			.setInputAttachmentCount(static_cast<uint32_t>(gbuffer_input_attachment_refs.size()))
+			.setPInputAttachments(gbuffer_input_attachment_refs.data()));
+
+		subpass_dependencies.push_back(vk::SubpassDependency()
+			.setSrcSubpass(0)
+			.setDstSubpass(1)
+			.setSrcStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eLateFragmentTests)
+			.setSrcAccessMask(vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eDepthStencilAttachmentWrite)
+			.setDstStageMask(vk::PipelineStageFlagBits::eFragmentShader)
+			.setDstAccessMask(vk::AccessFlagBits::eInputAttachmentRead)
+			.setDependencyFlags(vk::DependencyFlagBits::eByRegion));
+
+		color_subpass = 1;
+	}
+	else if(multisample)
+	{
+		subpasses.push_back(vk::SubpassDescription()
+			.setColorAttachmentCount(1)
+			.setPColorAttachments(&multisample_color_attachment_ref)
+			.setPResolveAttachments(&color_attachment_ref)
+			.setPDepthStencilAttachment(&depth_attachment_ref));
+	}
+	else
+	{
+		subpasses.push_back(vk::SubpassDescription()
+			.setColorAttachmentCount(1)
+			.setPColorAttachments(&color_attachment_ref)
+			.setPDepthStencilAttachment(&depth_attachment_ref));
+	}
+
+	// frames overlap on the GPU, but all of them use the same depth, multisample and G-buffer attachments,
+	// so their clears and layout transitions in the first subpass must wait for the writes of the previous frame
+	// and for its reads of the G-buffer as input attachments
+	subpass_dependencies.push_back(vk::SubpassDependency()
 		.setSrcSubpass(VK_SUBPASS_EXTERNAL)
 		.setDstSubpass(0)
-		.setSrcStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput)
-			//.setSrcAccessMask(0)
-		.setDstStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput)
-		.setDstAccessMask(vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite);
-
+		.setSrcStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput
+				| vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests
+				| vk::PipelineStageFlagBits::eFragmentShader)
+		.setSrcAccessMask(vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eDepthStencilAttachmentWrite)
+		.setDstStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput
+				| vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests)
+		.setDstAccessMask(vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite
+				| vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite));
+
+	// the color attachment is first written by the later subpass
+	if(color_subpass != 0)
+	{
+		subpass_dependencies.push_back(vk::SubpassDependency()
+			.setSrcSubpass(VK_SUBPASS_EXTERNAL)
+			.setDstSubpass(color_subpass)
+			.setSrcStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput)
+			.setSrcAccessMask(vk::AccessFlagBits::eColorAttachmentWrite)
+			.setDstStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput)
+			.setDstAccessMask(vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite));
+	}
 
-	std::array<vk::AttachmentDescription, 2> attachments = { color_attachment, depth_attachment };
+	// copied by transfers submitted after the frame, e.g. the readbacks of an OffscreenRenderTarget
+	if(color_render_target->GetFinalLayout() == vk::ImageLayout::eTransferSrcOptimal)
+	{
+		subpass_dependencies.push_back(vk::SubpassDependency()
+			.setSrcSubpass(color_subpass)
+			.setDstSubpass(VK_SUBPASS_EXTERNAL)
+			.setSrcStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput)
+			.setSrcAccessMask(vk::AccessFlagBits::eColorAttachmentWrite)
+			.setDstStageMask(vk::PipelineStageFlagBits::eTransfer)
+			.setDstAccessMask(vk::AccessFlagBits::eTransferRead));
+	}
 
 	render_pass = engine->GetVkDevice().createRenderPass(
 		vk::RenderPassCreateInfo()
-			.setAttachmentCount(attachments.size())
+			.setAttachmentCount(static_cast<uint32_t>(attachments.size()))
 			.setPAttachments(attachments.data())
-			.setSubpassCount(1)
-			.setPSubpasses(&subpass)
-			.setDependencyCount(1)
-			.setPDependencies(&subpass_dependency));
+			.setSubpassCount(static_cast<uint32_t>(subpasses.size()))
+			.setPSubpasses(subpasses.data())
+			.setDependencyCount(static_cast<uint32_t>(subpass_dependencies.size()))
+			.setPDependencies(subpass_dependencies.data()));
 
 	vk_util::SetDebugUtilsObjectName(engine->GetVkDevice(), render_pass, "Renderer RenderPass");
 }
@@ -470,53 +1140,164 @@ void Renderer::CleanupRenderPasses()
 
 
 
-void Renderer::CreateRenderCommandBuffer()
+void Renderer::CreateRenderCommandBuffers()
 {
-	render_command_buffer = engine->GetVkDevice().allocateCommandBuffers(
+	auto &device = engine->GetVkDevice();
+
+	render_command_buffers = device.allocateCommandBuffers(
 			vk::CommandBufferAllocateInfo()
 					.setCommandPool(engine->GetRenderCommandPool())
 					.setLevel(vk::CommandBufferLevel::ePrimary)
-					.setCommandBufferCount(1)).front();
+					.setCommandBufferCount(frames_in_flight));
+
+	// 0 is always completed, so the first use of every frame does not wait
+	render_submissions.resize(frames_in_flight, 0);
 }
 
-void Renderer::CleanupRenderCommandBuffer()
+void Renderer::CleanupRenderCommandBuffers()
 {
-	engine->GetVkDevice().freeCommandBuffers(engine->GetRenderCommandPool(), render_command_buffer);
+	for(auto value : render_submissions)
+		engine->WaitForValue(value);
+
+	engine->GetVkDevice().freeCommandBuffers(engine->GetRenderCommandPool(), render_command_buffers);
 }
 
-void Renderer::RecordRenderables(vk::CommandBuffer command_buffer,
-		Material::RenderMode render_mode,
-		MaterialPipelineManager *material_pipeline_manager,
-		vk::DescriptorSet renderer_descriptor_set)
+void Renderer::CreateStatisticsQueryPool()
+{
+	if(!engine->GetPipelineStatisticsEnabled())
+		return;
+
+	statistics_query_pool = engine->GetVkDevice().createQueryPool(vk::QueryPoolCreateInfo()
+			.setQueryType(vk::QueryType::ePipelineStatistics)
+			.setQueryCount(frames_in_flight)
+			.setPipelineStatistics(vk::QueryPipelineStatisticFlagBits::eVertexShaderInvocations
+								   | vk::QueryPipelineStatisticFlagBits::eClippingPrimitives
+								   | vk::QueryPipelineStatisticFlagBits::eFragmentShaderInvocations));
+
+	vk_util::SetDebugUtilsObjectName(engine->GetVkDevice(), statistics_query_pool, "Renderer Statistics QueryPool");
+
+	statistics_query_submitted.resize(frames_in_flight, false);
+}
+
+void Renderer::ReadStatistics()
 {
-	std::multimap<Material *, std::set<std::pair<Node *, Renderable *>>> material_primitives;
+	if(!statistics_query_pool || !statistics_query_submitted[frame_index])
+		return;
+
+	// results are in the order of the statistic flag bits
+	std::array<std::uint64_t, 3> results;
+	auto result = engine->GetVkDevice().getQueryPoolResults(statistics_query_pool, frame_index, 1,
+			sizeof(results), results.data(), sizeof(results),
+			vk::QueryResultFlagBits::e64);
+
+	// keep the previous values if the frame has not finished yet
+	if(result != vk::Result::eSuccess)
+		return;
+
+	statistics.available = true;
+	statistics.vertex_shader_invocations = results[0];
+	statistics.clipping_primitives = results[1];
+	statistics.fragment_shader_invocations = results[2];
+}
 
-	scene->GetRootNode()->TraversePreOrder([&material_primitives] (Node *node) {
+std::uint32_t Renderer::CalculateSpotLightMask(Node *node, Renderable *renderable) const
+{
+	static_assert(MAX_SPOT_LIGHT_SHADOWS_COUNT <= 32, "spot_light_mask has one bit per shadowed spot light");
+
+	std::uint32_t all_lights = (1u << shadowed_spot_lights.size()) - 1;
+
+	glm::vec3 center;
+	float radius;
+	if(!CalculateBoundingSphere(node, renderable, center, radius))
+		return all_lights;
+
+	std::uint32_t mask = 0;
+	for(std::size_t i=0; i<shadowed_spot_lights.size(); i++)
+	{
+		const auto &light = shadowed_spot_lights[i];
+		if(SphereIntersectsSpotLight(center, radius, light.position, light.direction, light.angle_cos, light.range))
+			mask |= 1u << i;
+	}
+	return mask;
+}
+
+Renderer::RenderableList Renderer::CollectRenderables(Material::RenderMode render_mode, const ViewMaskFunction &view_mask_function)
+{
+	using PipelineKey = std::pair<Material *, Material::VariantKey>;
+	RenderableList list;
+	auto &material_primitives = list.material_primitives;
+	auto &view_masks = list.view_masks;
+
+	std::uint32_t lighting_features = this->lighting_features;
+
+	scene->GetRootNode()->TraversePreOrder([&material_primitives, &view_masks, &view_mask_function, render_mode, lighting_features] (Node *node) {
 		auto renderable = node->GetComponent<Renderable>();
 		if(renderable == nullptr || !renderable->GetCurrentlyRenderable())
 			return;
 
+		if(view_mask_function)
+		{
+			std::uint32_t view_mask = view_mask_function(node, renderable);
+			if(view_mask == 0)
+				return;
+			view_masks[renderable] = view_mask;
+		}
+
 		unsigned int primitives_count = renderable->GetPrimitivesCount();
 		for(unsigned int i=0; i<primitives_count; i++)
 		{
-			auto primitive = renderable->GetPrimitive(i);
-			auto material = primitive->GetMaterialInstance()->GetMaterial();
-
-			auto it = material_primitives.find(material);
-			if(it != material_primitives.end())
-				it->second.insert(std::pair<Node *, Renderable *>(node, renderable));
-			else
-				material_primitives.insert(std::pair<Material *, std::set<std::pair<Node *, Renderable *>>>(
-						material, { std::pair<Node *, Renderable *>(node, renderable) }));
+			auto material_instance = renderable->GetPrimitive(i)->GetMaterialInstance();
+			auto material = material_instance->GetMaterial();
+			auto variant = material->GetVariantKey(render_mode, material_instance, lighting_features);
+			material_primitives[PipelineKey(material, variant)].insert(std::pair<Node *, Renderable *>(node, renderable));
 		}
 	});
 
-	for(auto &entry : material_primitives)
+	return list;
+}
+
+void Renderer::RecordRenderables(vk::CommandBuffer command_buffer,
+		Material::RenderMode render_mode,
+		MaterialPipelineManager *material_pipeline_manager,
+		vk::DescriptorSet renderer_descriptor_set,
+		const ViewMaskFunction &view_mask_function)
+{
+	RecordRenderables(command_buffer,
+			CollectRenderables(render_mode, view_mask_function),
+			render_mode,
+			material_pipeline_manager,
+			renderer_descriptor_set,
+			~0u);
+}
+
+void Renderer::RecordRenderables(vk::CommandBuffer command_buffer,
+		const RenderableList &renderable_list,
+		Material::RenderMode render_mode,
+		MaterialPipelineManager *material_pipeline_manager,
+		vk::DescriptorSet renderer_descriptor_set,
+		std::uint32_t view_filter)
+{
+	const auto &view_masks = renderable_list.view_masks;
+
+	bool position_only = material_pipeline_manager->GetConfiguration().position_only;
+
+	// only forward shading evaluates the spot lights per object
+	bool spot_light_masks = render_mode == Material::DefaultRenderMode::ColorForward;
+
+	// renderables sharing their buffers, e.g. from the GeometryArena, only bind them once
+	Renderable::BufferBinding bound_buffers;
+	bool bound_buffers_shared = false;
+
+	for(auto &entry : renderable_list.material_primitives)
 	{
-		auto material = entry.first;
+		auto material = entry.first.first;
+		auto variant = entry.first.second;
 		auto &renderables = entry.second;
 
-		MaterialPipeline *pipeline = material_pipeline_manager->GetMaterialPipeline(material);
+		if(render_mode == Material::DefaultRenderMode::DepthPrepass && !material->GetVariantDepthPrepassSupport(variant))
+			continue;
+
+		MaterialPipeline *pipeline = material_pipeline_manager->GetMaterialPipeline(material, variant);
 		if(!pipeline)
 			continue;
 
@@ -524,11 +1305,33 @@ void Renderer::RecordRenderables(vk::CommandBuffer command_buffer,
 		auto pipeline_layout = pipeline->pipeline_layout;
 
 		command_buffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline->pipeline);
-		command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics,
-										  pipeline_layout,
-										  static_cast<uint32_t>(pipeline->renderer_descriptor_set_index),
-										  renderer_descriptor_set,
-										  nullptr);
+		if(renderer_descriptor_set == descriptor_sets[frame_index])
+		{
+			command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics,
+											  pipeline_layout,
+											  static_cast<uint32_t>(pipeline->renderer_descriptor_set_index),
+											  renderer_descriptor_set,
+											  descriptor_set_dynamic_offsets);
+		}
+		else
+		{
+			// sets of sub renderers have no dynamic buffers
+			command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics,
+											  pipeline_layout,
+											  static_cast<uint32_t>(pipeline->renderer_descriptor_set_index),
+											  renderer_descriptor_set,
+											  nullptr);
+		}
+
+		// one set for all instances, which then only differ in material_index
+		if(pipeline->material_table)
+		{
+			command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics,
+											  pipeline_layout,
+											  static_cast<uint32_t>(material_descriptor_set_index),
+											  engine->GetMaterialTable()->GetDescriptorSet(),
+											  nullptr);
+		}
 
 
 		for(auto &renderable_entry : renderables)
@@ -536,31 +1339,65 @@ void Renderer::RecordRenderables(vk::CommandBuffer command_buffer,
 			auto node = renderable_entry.first;
 			auto renderable = renderable_entry.second;
 
+			auto view_mask_it = view_masks.find(renderable);
+			std::uint32_t view_mask = view_mask_it != view_masks.end() ? view_mask_it->second : ~0u;
+			if(!(view_mask & view_filter))
+				continue;
+
+			Renderable::BufferBinding buffer_binding;
+			bool buffers_shared = renderable->GetBufferBinding(position_only, buffer_binding);
+			if(!buffers_shared || !bound_buffers_shared || !(buffer_binding == bound_buffers))
+			{
+				if(position_only)
+				{
+					if(!renderable->BindPositionBuffers(command_buffer))
+						continue;
+				}
+				else
+					renderable->BindBuffers(command_buffer);
+
+				bound_buffers = buffer_binding;
+				bound_buffers_shared = buffers_shared;
+			}
+
 			auto transform_component = node->GetTransformComp();
 			TransformPushConstant transform_push_constant;
 			if(transform_component != nullptr)
 				transform_push_constant.transform = transform_component->GetMatrixWorld();
 
+			transform_push_constant.view_mask = view_mask;
+
+			transform_push_constant.spot_light_mask = spot_light_masks ? CalculateSpotLightMask(node, renderable) : ~0u;
+			transform_push_constant.material_index = 0;
+
 			command_buffer.pushConstants(pipeline_layout,
-										 vk::ShaderStageFlagBits::eVertex,
+										 vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment,
 										 0,
 										 sizeof(TransformPushConstant),
 										 &transform_push_constant);
 
-			renderable->BindBuffers(command_buffer);
-
 			unsigned int primitives_count = renderable->GetPrimitivesCount();
 			for(unsigned int i=0; i<primitives_count; i++)
 			{
 				auto primitive = renderable->GetPrimitive(i);
 
 				auto material_instance = primitive->GetMaterialInstance();
-				if(material_instance->GetMaterial() != material)
+				if(material_instance->GetMaterial() != material
+					|| material->GetVariantKey(render_mode, material_instance, lighting_features) != variant)
 					continue;
 
-				if(material_descriptor_set_index >= 0)
+				if(pipeline->material_table)
+				{
+					std::uint32_t material_index = material->GetMaterialTableIndex(render_mode, material_instance);
+					command_buffer.pushConstants(pipeline_layout,
+												 vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment,
+												 offsetof(TransformPushConstant, material_index),
+												 sizeof(material_index),
+												 &material_index);
+				}
+				else if(material_descriptor_set_index >= 0)
 				{
-					auto descriptor_set = primitive->GetMaterialInstance()->GetDescriptorSet(render_mode);
+					auto descriptor_set = material_instance->GetDescriptorSet(material->GetDescriptorSetId(render_mode));
 					command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics,
 													  pipeline_layout,
 													  static_cast<uint32_t>(material_descriptor_set_index),
@@ -574,7 +1411,60 @@ void Renderer::RecordRenderables(vk::CommandBuffer command_buffer,
 	}
 }
 
-void Renderer::DrawFrame(std::uint32_t image_index, std::vector<vk::Semaphore> wait_semaphores,
+std::uint32_t Renderer::GetFrameViewMask(Node *node, Renderable *renderable)
+{
+	auto it = frame_view_masks.find(renderable);
+	if(it != frame_view_masks.end())
+		return it->second;
+
+	std::uint32_t mask = CalculateViewMask(node, renderable, frame_view_projections.data(),
+			static_cast<std::uint32_t>(frame_view_projections.size()));
+	frame_view_masks[renderable] = mask;
+	return mask;
+}
+
+void Renderer::RecordFrameViews(vk::CommandBuffer command_buffer,
+		Material::RenderMode render_mode,
+		MaterialPipelineManager *material_pipeline_manager)
+{
+	// traversed and culled once for all views
+	ViewMaskFunction view_mask_function;
+	if(frame_views_culled)
+	{
+		view_mask_function = [this](Node *node, Renderable *renderable) {
+			return GetFrameViewMask(node, renderable);
+		};
+	}
+
+	auto renderables = CollectRenderables(render_mode, view_mask_function);
+
+	for(std::size_t i=0; i<frame_views.size(); i++)
+	{
+		const auto &view = frame_views[i];
+
+		// the pipelines of the G-buffer have a fixed viewport covering the whole render target
+		if(!gbuffer)
+		{
+			const auto &region = view.view.region;
+			auto viewport = vk::Viewport(static_cast<float>(region.offset.x), static_cast<float>(region.offset.y),
+					region.extent.width, region.extent.height, 0.0f, 1.0f);
+			command_buffer.setViewport(0, 1, &viewport);
+			command_buffer.setScissor(0, 1, &region);
+		}
+
+		descriptor_set_dynamic_offsets[0] = view.matrix_offset;
+		descriptor_set_dynamic_offsets[2] = view.camera_offset;
+
+		RecordRenderables(command_buffer,
+				renderables,
+				render_mode,
+				material_pipeline_manager,
+				descriptor_sets[frame_index],
+				1u << i);
+	}
+}
+
+std::uint64_t Renderer::DrawFrame(std::uint32_t image_index, std::vector<vk::Semaphore> wait_semaphores,
 						 std::vector<vk::PipelineStageFlags> wait_stages, std::vector<vk::Semaphore> signal_semaphores)
 {
 	if(scene == nullptr)
@@ -583,51 +1473,145 @@ void Renderer::DrawFrame(std::uint32_t image_index, std::vector<vk::Semaphore> w
 	if(camera == nullptr)
 		throw std::runtime_error("renderer has no camera.");
 
-	LightCollection light_collection = LightCollection::EverythingInScene(scene);
+	frame_views = { FrameView { View { camera, vk::Rect2D({ 0, 0 }, color_render_target->GetExtent()) }, 0, 0 } };
+	frame_views_culled = false;
 
-	UpdateMatrixUniformBuffer();
-	UpdateLightingUniformBuffer(&light_collection);
-	UpdateShadowDescriptors(&light_collection);
-	UpdateCameraUniformBuffer();
+	return DrawFrameViews(image_index, std::move(wait_semaphores), std::move(wait_stages), std::move(signal_semaphores));
+}
 
-	std::vector<SpotLight *> spot_lights = scene->GetRootNode()->GetComponentsInChildren<SpotLight>();
-	std::vector<SpotLightShadow *> spot_light_shadows;
+std::uint64_t Renderer::DrawViews(std::uint32_t image_index, const std::vector<View> &views,
+		std::vector<vk::Semaphore> wait_semaphores, std::vector<vk::PipelineStageFlags> wait_stages,
+		std::vector<vk::Semaphore> signal_semaphores)
+{
+	if(scene == nullptr)
+		throw std::runtime_error("renderer has no scene.");
 
-	render_command_buffer.begin({ vk::CommandBufferUsageFlagBits::eSimultaneousUse }); // TODO: flags can probably be better
+	if(views.empty() || views.size() > max_views)
+		throw std::runtime_error("invalid number of views.");
 
-	std::vector<vk::ImageMemoryBarrier> shadow_barriers;
+	// the lighting pass of the G-buffer covers the whole render target with a single camera
+	if(gbuffer)
+		throw std::runtime_error("multiple views are only supported with forward shading.");
 
-	for(SpotLight *spot_light : spot_lights)
+	frame_views.clear();
+	for(const auto &view : views)
+	{
+		if(view.camera == nullptr)
+			throw std::runtime_error("view has no camera.");
+		frame_views.push_back(FrameView { view, 0, 0 });
+	}
+	frame_views_culled = true;
+
+	return DrawFrameViews(image_index, std::move(wait_semaphores), std::move(wait_stages), std::move(signal_semaphores));
+}
+
+std::uint64_t Renderer::DrawFrameViews(std::uint32_t image_index, std::vector<vk::Semaphore> wait_semaphores,
+		std::vector<vk::PipelineStageFlags> wait_stages, std::vector<vk::Semaphore> signal_semaphores)
+{
+	// the command buffer, uniform buffers and statistics query of this frame are reused once its previous use finished
+	frame_index = (frame_index + 1) % frames_in_flight;
+	engine->WaitForValue(render_submissions[frame_index]);
+
+	ReadStatistics();
+
+	uniform_ring_buffer->BeginFrame(frame_index);
+
+	LightCollection *light_collection = scene->GetLightCollection();
+
+	UpdateShadowResolutions(light_collection);
+
+	for(auto &view : frame_views)
+	{
+		UpdateMatrixUniformBuffer(view);
+		UpdateCameraUniformBuffer(view);
+	}
+	UpdateLightingUniformBuffer(light_collection);
+	UpdateShadowDescriptors(light_collection);
+
+	frame_view_masks.clear();
+	frame_view_projections.clear();
+	for(const auto &view : frame_views)
+	{
+		Camera *camera = view.view.camera;
+		frame_view_projections.push_back(camera->GetProjectionMatrix() * camera->GetModelViewMatrix());
+	}
+
+	vk::CommandBuffer render_command_buffer = render_command_buffers[frame_index];
+	render_command_buffer.begin({ vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+
+	engine->GetMaterialParameterArena()->RecordUpload(render_command_buffer);
+	engine->GetGeometryArena()->RecordDefragmentation(render_command_buffer);
+
+	render_graph->Reset();
+
+	std::vector<RenderGraph::ResourceId> shadow_maps;
+
+	for(SubRenderer *sub_renderer : sub_renderers)
+		sub_renderer->AddPasses(*render_graph, this, shadow_maps);
+
+	for(SpotLight *spot_light : light_collection->spot_lights)
 	{
 		auto shadow = spot_light->GetShadow();
-		if(!shadow)
-			continue;
-		shadow->Render(render_command_buffer, this);
-		spot_light_shadows.push_back(shadow);
+		if(shadow && !shadow->GetBatch())
+			shadow_maps.push_back(shadow->AddPass(*render_graph, this));
 	}
 
-	DrawFrameRecord(render_command_buffer, dst_framebuffers[image_index]);
+	// the point lights beyond max_point_lights are not lit, see UpdateLightingUniformBuffer()
+	auto point_lights_count = std::min<std::size_t>(light_collection->point_lights.size(), max_point_lights);
+	for(std::size_t i=0; i<point_lights_count; i++)
+	{
+		auto shadow = light_collection->point_lights[i]->GetShadow();
+		if(shadow)
+			shadow_maps.push_back(shadow->AddPass(*render_graph, this));
+	}
+
+	auto main_pass = render_graph->AddPass("Main", [this, image_index](vk::CommandBuffer cmd) {
+		DrawFrameRecord(cmd, image_index);
+	});
+	for(auto shadow_map : shadow_maps)
+		render_graph->Read(main_pass, shadow_map, RenderGraph::Access::FragmentShaderRead);
+
+	// the attachments of the main pass are synchronized by its render pass and the semaphores
+	render_graph->SetSideEffects(main_pass);
+
+	render_graph->Compile();
+	render_graph->Execute(render_command_buffer);
 
 	render_command_buffer.end();
 
-	engine->GetGraphicsQueue().submit(
-		vk::SubmitInfo()
-			.setWaitSemaphoreCount(static_cast<uint32_t>(wait_semaphores.size()))
-			.setPWaitSemaphores(wait_semaphores.data())
-			.setPWaitDstStageMask(wait_stages.data())
-			.setCommandBufferCount(1)
-			.setPCommandBuffers(&render_command_buffer)
-			.setSignalSemaphoreCount(static_cast<uint32_t>(signal_semaphores.size()))
-			.setPSignalSemaphores(signal_semaphores.data()),
-		nullptr);
+	render_submissions[frame_index] = engine->Submit(render_command_buffer, wait_semaphores, wait_stages, signal_semaphores);
+	return render_submissions[frame_index];
+}
+
+void Renderer::DrawFrameRecord(vk::CommandBuffer command_buffer, std::uint32_t image_index)
+{
+	if(statistics_query_pool)
+	{
+		command_buffer.resetQueryPool(statistics_query_pool, frame_index, 1);
+		command_buffer.beginQuery(statistics_query_pool, frame_index, vk::QueryControlFlags());
+	}
+
+	if(render_pass)
+		RecordRenderPass(command_buffer, dst_framebuffers[image_index]);
+	else
+		RecordDynamicRendering(command_buffer, image_index);
+
+	if(statistics_query_pool)
+	{
+		command_buffer.endQuery(statistics_query_pool, frame_index);
+		statistics_query_submitted[frame_index] = true;
+	}
 }
 
-void Renderer::DrawFrameRecord(vk::CommandBuffer command_buffer, vk::Framebuffer dst_framebuffer)
+void Renderer::RecordRenderPass(vk::CommandBuffer command_buffer, vk::Framebuffer dst_framebuffer)
 {
-	std::array<vk::ClearValue, 2> clear_values = {
+	// the multisampled color attachment is cleared instead of the render target
+	std::array<vk::ClearValue, 3> clear_values = {
 			vk::ClearColorValue(std::array<float, 4>{{0.0f, 0.0f, 0.0f, 1.0f }}),
-			vk::ClearDepthStencilValue(1.0f, 0)
+			vk::ClearDepthStencilValue(1.0f, 0),
+			vk::ClearColorValue(std::array<float, 4>{{0.0f, 0.0f, 0.0f, 1.0f }})
 	};
+	std::uint32_t clear_value_count = samples != vk::SampleCountFlagBits::e1 ? 3 : 2;
 
 	auto extent = color_render_target->GetExtent();
 
@@ -636,25 +1620,191 @@ void Renderer::DrawFrameRecord(vk::CommandBuffer command_buffer, vk::Framebuffer
 					.setRenderPass(render_pass)
 					.setFramebuffer(dst_framebuffer)
 					.setRenderArea(vk::Rect2D({0, 0 }, extent))
-					.setClearValueCount(clear_values.size())
+					.setClearValueCount(clear_value_count)
 					.setPClearValues(clear_values.data()),
 			vk::SubpassContents::eInline);
 
-	RecordRenderables(command_buffer,
-			Material::DefaultRenderMode::ColorForward,
-			material_pipeline_manager,
-			descriptor_set);
+	if(depth_prepass_pipeline_manager)
+	{
+		RecordFrameViews(command_buffer,
+				Material::DefaultRenderMode::DepthPrepass,
+				depth_prepass_pipeline_manager);
+
+		command_buffer.nextSubpass(vk::SubpassContents::eInline);
+	}
+
+	RecordFrameViews(command_buffer,
+			gbuffer ? Material::DefaultRenderMode::GBuffer : Material::DefaultRenderMode::ColorForward,
+			material_pipeline_manager);
+
+	if(gbuffer)
+	{
+		command_buffer.nextSubpass(vk::SubpassContents::eInline);
+		gbuffer->RecordLighting(command_buffer, descriptor_sets[frame_index], descriptor_set_dynamic_offsets);
+	}
 
 	command_buffer.endRenderPass();
 }
 
+void Renderer::RecordDynamicRendering(vk::CommandBuffer command_buffer, std::uint32_t image_index)
+{
+	auto extent = color_render_target->GetExtent();
+	vk::Image color_image = color_render_target->GetImages()[image_index];
+
+	bool has_stencil = Engine::HasStencilComponent(depth_render_target->GetFormat());
+
+	vk::ImageAspectFlags depth_aspect_mask = vk::ImageAspectFlagBits::eDepth;
+	if(has_stencil)
+		depth_aspect_mask |= vk::ImageAspectFlagBits::eStencil;
+
+	bool multisample = samples != vk::SampleCountFlagBits::e1;
+
+	std::vector<vk::ImageMemoryBarrier> image_barriers = {
+		vk::ImageMemoryBarrier()
+				.setSrcAccessMask(vk::AccessFlags())
+				.setDstAccessMask(vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite)
+				.setOldLayout(vk::ImageLayout::eUndefined)
+				.setNewLayout(vk::ImageLayout::eColorAttachmentOptimal)
+				.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+				.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+				.setImage(color_image)
+				.setSubresourceRange(vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1))
+	};
+
+	// its content is cleared every frame, so it is discarded like the render target
+	if(multisample)
+	{
+		image_barriers.push_back(vk::ImageMemoryBarrier(image_barriers[0])
+				.setImage(multisample_color_image.image));
+	}
+
+	// same as the external dependency of the render pass of CreateRenderPasses(), the depth image
+	// stays in eDepthStencilAttachmentOptimal, but the previous frame must be done writing it
+	command_buffer.pipelineBarrier(
+			vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests,
+			vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests,
+			vk::DependencyFlags(),
+			vk::MemoryBarrier()
+					.setSrcAccessMask(vk::AccessFlagBits::eDepthStencilAttachmentWrite)
+					.setDstAccessMask(vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite),
+			nullptr,
+			image_barriers);
+
+	auto render_area = vk::Rect2D({ 0, 0 }, extent);
+
+	auto depth_attachment = vk::RenderingAttachmentInfoKHR()
+			.setImageView(GetDepthImageView())
+			.setImageLayout(vk::ImageLayout::eDepthStencilAttachmentOptimal)
+			.setLoadOp(vk::AttachmentLoadOp::eClear)
+			.setStoreOp(vk::AttachmentStoreOp::eDontCare)
+			.setClearValue(vk::ClearDepthStencilValue(1.0f, 0));
+
+	// the pipelines declare the depth format as stencil format too if it has stencil, see MaterialPipelineManager,
+	// so the same view with the same operations is bound as stencil attachment
+	auto stencil_attachment = has_stencil ? &depth_attachment : nullptr;
+
+	if(depth_prepass_pipeline_manager)
+	{
+		depth_attachment.setStoreOp(vk::AttachmentStoreOp::eStore);
+
+		engine->CmdBeginRendering(command_buffer, vk::RenderingInfoKHR()
+				.setRenderArea(render_area)
+				.setLayerCount(1)
+				.setPDepthAttachment(&depth_attachment)
+				.setPStencilAttachment(stencil_attachment));
+
+		RecordFrameViews(command_buffer,
+				Material::DefaultRenderMode::DepthPrepass,
+				depth_prepass_pipeline_manager);
+
+		engine->CmdEndRendering(command_buffer);
+
+		// replaces the dependency between the subpasses of the render pass
+		command_buffer.pipelineBarrier(
+				vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests,
+				vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests,
+				vk::DependencyFlagBits::eByRegion,
+				vk::MemoryBarrier()
+						.setSrcAccessMask(vk::AccessFlagBits::eDepthStencilAttachmentWrite)
+						.setDstAccessMask(vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite),
+				nullptr, nullptr);
+
+		depth_attachment
+				.setLoadOp(vk::AttachmentLoadOp::eLoad)
+				.setStoreOp(vk::AttachmentStoreOp::eDontCare);
+	}
+
+	auto color_attachment = vk::RenderingAttachmentInfoKHR()
+			.setImageView(color_render_target->GetImageViews()[image_index])
+			.setImageLayout(vk::ImageLayout::eColorAttachmentOptimal)
+			.setLoadOp(vk::AttachmentLoadOp::eClear)
+			.setStoreOp(vk::AttachmentStoreOp::eStore)
+			.setClearValue(vk::ClearColorValue(std::array<float, 4>{{ 0.0f, 0.0f, 0.0f, 1.0f }}));
+
+	// render into the multisampled image and resolve into the render target at the end
+	if(multisample)
+	{
+		color_attachment
+				.setImageView(multisample_color_image_view)
+				.setStoreOp(vk::AttachmentStoreOp::eDontCare)
+				.setResolveMode(vk::ResolveModeFlagBits::eAverage)
+				.setResolveImageView(color_render_target->GetImageViews()[image_index])
+				.setResolveImageLayout(vk::ImageLayout::eColorAttachmentOptimal);
+	}
+
+	engine->CmdBeginRendering(command_buffer, vk::RenderingInfoKHR()
+			.setRenderArea(render_area)
+			.setLayerCount(1)
+			.setColorAttachmentCount(1)
+			.setPColorAttachments(&color_attachment)
+			.setPDepthAttachment(&depth_attachment)
+			.setPStencilAttachment(stencil_attachment));
+
+	RecordFrameViews(command_buffer,
+			Material::DefaultRenderMode::ColorForward,
+			material_pipeline_manager);
+
+	engine->CmdEndRendering(command_buffer);
+
+	// final layout of the color attachment in the render pass, including its dependency for later copies
+	auto final_layout = color_render_target->GetFinalLayout();
+	bool copied = final_layout == vk::ImageLayout::eTransferSrcOptimal;
+	command_buffer.pipelineBarrier(
+			vk::PipelineStageFlagBits::eColorAttachmentOutput,
+			copied ? vk::PipelineStageFlagBits::eTransfer : vk::PipelineStageFlagBits::eBottomOfPipe,
+			vk::DependencyFlags(),
+			nullptr, nullptr,
+			vk::ImageMemoryBarrier()
+					.setSrcAccessMask(vk::AccessFlagBits::eColorAttachmentWrite)
+					.setDstAccessMask(copied ? vk::AccessFlagBits::eTransferRead : vk::AccessFlags())
+					.setOldLayout(vk::ImageLayout::eColorAttachmentOptimal)
+					.setNewLayout(final_layout)
+					.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+					.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+					.setImage(color_image)
+					.setSubresourceRange(vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1)));
+}
+
 void Renderer::RenderTargetChanged(RenderTarget *render_target)
 {
 	//CleanupRenderPasses();
 	//CreateRenderPasses();
 
 	material_pipeline_manager->SetConfiguration(CreateMaterialPipelineConfiguration());
+	if(depth_prepass_pipeline_manager)
+		depth_prepass_pipeline_manager->SetConfiguration(CreateDepthPrepassPipelineConfiguration());
+
+	if(samples != vk::SampleCountFlagBits::e1)
+	{
+		CleanupMultisampleAttachments();
+		CreateMultisampleAttachments();
+	}
+
+	if(!render_pass) // dynamic rendering, nothing else depends on the extent
+		return;
 
 	CleanupFramebuffers();
+	if(gbuffer)
+		gbuffer->SetExtent(color_render_target->GetExtent());
 	CreateFramebuffers();
 }
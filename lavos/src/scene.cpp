@@ -4,9 +4,20 @@
 lavos::Scene::Scene()
 {
 	root_node.is_root = true;
+	root_node.scene = this;
 }
 
 lavos::Scene::~Scene()
 {
 
 }
+
+void lavos::Scene::ComponentAdded(Component *component)
+{
+	light_collection.AddLight(component);
+}
+
+void lavos::Scene::ComponentRemoved(Component *component)
+{
+	light_collection.RemoveLight(component);
+}
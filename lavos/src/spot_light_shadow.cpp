@@ -3,6 +3,9 @@
 #include "lavos/component/spot_light.h"
 #include "lavos/renderer.h"
 #include "lavos/spot_light_shadow_renderer.h"
+#include "lavos/spot_light_shadow_batch.h"
+
+#include <algorithm>
 
 using namespace lavos;
 
@@ -21,8 +24,19 @@ SpotLightShadow::SpotLightShadow(Engine *engine, SpotLight *light, SpotLightShad
 	min_filter = vk::Filter::eLinear;
 	mag_filter = vk::Filter::eLinear;
 
+	depth_bias_constant = renderer->GetDefaultDepthBiasConstant();
+	depth_bias_slope = renderer->GetDefaultDepthBiasSlope();
+
+	if(renderer->GetMultiviewEnabled())
+	{
+		batch = renderer->AddToBatch(this, &batch_layer);
+		CreateBatchLayerView();
+		CreateSampler();
+		return;
+	}
+
 	CreateImage();
-	CreateFramebuffer();
+	CreateSampler();
 	CreateUniformBuffer();
 	CreateDescriptorPool();
 	CreateDescriptorSet();
@@ -49,112 +63,116 @@ SpotLightShadow::~SpotLightShadow()
 {
 	auto device = engine->GetVkDevice();
 
-	engine->GetVkDevice().destroy(descriptor_pool);
-	delete matrix_uniform_buffer;
-	device.destroy(framebuffer);
-	device.destroy(sampler);
-	device.destroy(depth_image_view);
-	engine->DestroyImage(depth_image);
-	if(shadow_image)
-	{
-		device.destroy(shadow_image_view);
-		engine->DestroyImage(shadow_image);
-	}
-	if(resolve_image)
+	if(batch)
 	{
-		device.destroy(resolve_image_view);
-		engine->DestroyImage(resolve_image);
+		device.destroy(batch_layer_view);
+		device.destroy(sampler);
+		renderer->RemoveFromBatch(this, batch);
+		return;
 	}
+
+	engine->GetVkDevice().destroy(descriptor_pool);
+	for(auto buffer : matrix_uniform_buffers)
+		delete buffer;
+	renderer->DestroyFramebuffer(framebuffer);
+	device.destroy(sampler);
+	CleanupImage();
+}
+
+std::uint32_t SpotLightShadow::GetWidth() const
+{
+	return std::max(renderer->GetWidth() >> resolution_level, 1u);
+}
+
+std::uint32_t SpotLightShadow::GetHeight() const
+{
+	return std::max(renderer->GetHeight() >> resolution_level, 1u);
+}
+
+void SpotLightShadow::SetResolutionLevel(unsigned int level)
+{
+	if(level == resolution_level || batch)
+		return;
+
+	// the image may still be in use by a previous frame
+	auto engine = this->engine;
+	auto image = final_image;
+	auto image_view = final_image_view;
+	engine->DestroyAfter(engine->GetSubmittedValue(), [engine, image, image_view]() {
+		engine->GetVkDevice().destroy(image_view);
+		engine->DestroyImage(image);
+	});
+	final_image = nullptr;
+	final_image_view = nullptr;
+
+	renderer->DestroyFramebuffer(framebuffer);
+
+	resolution_level = level;
+
+	CreateImage();
+
+	// the shadow descriptors must point to the new image
+	if(auto scene = light->GetScene())
+		scene->GetLightCollection()->MarkChanged();
+}
+
+void SpotLightShadow::CleanupImage()
+{
+	engine->GetVkDevice().destroy(final_image_view);
+	engine->DestroyImage(final_image);
+	final_image_view = nullptr;
+	final_image = nullptr;
 }
 
 void SpotLightShadow::CreateImage()
 {
 	bool have_shadow_tex = renderer->GetShadowFormat() != vk::Format::eUndefined;
-	bool use_multisampling = renderer->GetSamples() != vk::SampleCountFlagBits::e1;
 
-	vk::ImageUsageFlags usage = vk::ImageUsageFlagBits::eDepthStencilAttachment;
-	if(!have_shadow_tex)
-		usage |= vk::ImageUsageFlagBits::eSampled;
+	// the final image is never multisampled, with multisampling the transient shadow attachment is resolved into it
+	vk::Format format = have_shadow_tex ? renderer->GetShadowFormat() : renderer->GetDepthFormat();
+	vk::ImageUsageFlags usage = vk::ImageUsageFlagBits::eSampled;
+	usage |= have_shadow_tex ? vk::ImageUsageFlagBits::eColorAttachment : vk::ImageUsageFlagBits::eDepthStencilAttachment;
 
 	auto image_create_info = vk::ImageCreateInfo()
 			.setImageType(vk::ImageType::e2D)
-			.setExtent(vk::Extent3D(renderer->GetWidth(), renderer->GetHeight(), 1))
+			.setExtent(vk::Extent3D(GetWidth(), GetHeight(), 1))
 			.setMipLevels(1)
 			.setArrayLayers(1)
-			.setSamples(renderer->GetSamples())
+			.setSamples(vk::SampleCountFlagBits::e1)
 			.setTiling(vk::ImageTiling::eOptimal)
-			.setFormat(renderer->GetDepthFormat())
+			.setFormat(format)
 			.setUsage(usage);
 
-	depth_image = engine->CreateImage(image_create_info, VMA_MEMORY_USAGE_GPU_ONLY);
-	vk_util::SetDebugUtilsObjectName(engine->GetVkDevice(), depth_image.image, "SpotLightShadow Depth Image");
+	final_image = engine->CreateImage(image_create_info, VMA_MEMORY_USAGE_GPU_ONLY, Engine::MemoryCategory::Shadows);
+	vk_util::SetDebugUtilsObjectName(engine->GetVkDevice(), final_image.image, "SpotLightShadow Image");
 
 	auto image_view_create_info = vk::ImageViewCreateInfo()
 			.setViewType(vk::ImageViewType::e2D)
-			.setFormat(renderer->GetDepthFormat())
-			.setSubresourceRange(vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eDepth, 0, 1, 0, 1))
-			.setImage(depth_image.image);
+			.setFormat(format)
+			.setSubresourceRange(vk::ImageSubresourceRange(have_shadow_tex ? vk::ImageAspectFlagBits::eColor : vk::ImageAspectFlagBits::eDepth, 0, 1, 0, 1))
+			.setImage(final_image.image);
 
-	depth_image_view = engine->GetVkDevice().createImageView(image_view_create_info);
-	vk_util::SetDebugUtilsObjectName(engine->GetVkDevice(), depth_image_view, "SpotLightShadow Depth ImageView");
+	final_image_view = engine->GetVkDevice().createImageView(image_view_create_info);
+	vk_util::SetDebugUtilsObjectName(engine->GetVkDevice(), final_image_view, "SpotLightShadow ImageView");
+}
 
-	if(have_shadow_tex)
-	{
-		usage = vk::ImageUsageFlagBits::eColorAttachment;
-		if(!use_multisampling)
-			usage |= vk::ImageUsageFlagBits::eSampled;
-		else
-			usage |= vk::ImageUsageFlagBits::eTransientAttachment;
-
-		image_create_info = vk::ImageCreateInfo()
-				.setImageType(vk::ImageType::e2D)
-				.setExtent(vk::Extent3D(renderer->GetWidth(), renderer->GetHeight(), 1))
-				.setMipLevels(1)
-				.setArrayLayers(1)
-				.setSamples(renderer->GetSamples())
-				.setTiling(vk::ImageTiling::eOptimal)
-				.setFormat(renderer->GetShadowFormat())
-				.setUsage(usage);
-
-		// TODO: use VMA_MEMORY_USAGE_GPU_LAZILY_ALLOCATED if multisampling and available
-		shadow_image = engine->CreateImage(image_create_info, VMA_MEMORY_USAGE_GPU_ONLY);
-		vk_util::SetDebugUtilsObjectName(engine->GetVkDevice(), shadow_image.image, "SpotLightShadow Shadow Image");
-
-		image_view_create_info = vk::ImageViewCreateInfo()
-				.setViewType(vk::ImageViewType::e2D)
-				.setFormat(renderer->GetShadowFormat())
-				.setSubresourceRange(vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1))
-				.setImage(shadow_image.image);
-
-		shadow_image_view = engine->GetVkDevice().createImageView(image_view_create_info);
-		vk_util::SetDebugUtilsObjectName(engine->GetVkDevice(), shadow_image_view, "SpotLightShadow Shadow ImageView");
-
-		if(use_multisampling)
-		{
-			image_create_info = vk::ImageCreateInfo()
-					.setImageType(vk::ImageType::e2D)
-					.setExtent(vk::Extent3D(renderer->GetWidth(), renderer->GetHeight(), 1))
-					.setMipLevels(1)
-					.setArrayLayers(1)
-					.setSamples(vk::SampleCountFlagBits::e1)
-					.setTiling(vk::ImageTiling::eOptimal)
-					.setFormat(renderer->GetShadowFormat())
-					.setUsage(vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eSampled);
-
-			resolve_image = engine->CreateImage(image_create_info, VMA_MEMORY_USAGE_GPU_ONLY);
-			vk_util::SetDebugUtilsObjectName(engine->GetVkDevice(), resolve_image.image, "SpotLightShadow Resolve Image");
-
-			image_view_create_info = vk::ImageViewCreateInfo()
-					.setViewType(vk::ImageViewType::e2D)
-					.setFormat(renderer->GetShadowFormat())
-					.setSubresourceRange(vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1))
-					.setImage(resolve_image.image);
-
-			resolve_image_view = engine->GetVkDevice().createImageView(image_view_create_info);
-			vk_util::SetDebugUtilsObjectName(engine->GetVkDevice(), resolve_image_view, "SpotLightShadow Resolve ImageView");
-		}
-	}
+void SpotLightShadow::CreateBatchLayerView()
+{
+	Image image = batch->GetFinalImage();
+	vk::ImageAspectFlags aspect = image.format == renderer->GetDepthFormat() ? vk::ImageAspectFlagBits::eDepth : vk::ImageAspectFlagBits::eColor;
+
+	auto image_view_create_info = vk::ImageViewCreateInfo()
+			.setViewType(vk::ImageViewType::e2D)
+			.setFormat(image.format)
+			.setSubresourceRange(vk::ImageSubresourceRange(aspect, 0, 1, batch_layer, 1))
+			.setImage(image.image);
+
+	batch_layer_view = engine->GetVkDevice().createImageView(image_view_create_info);
+	vk_util::SetDebugUtilsObjectName(engine->GetVkDevice(), batch_layer_view, "SpotLightShadow Batch Layer ImageView");
+}
 
+void SpotLightShadow::CreateSampler()
+{
 	auto sampler_create_info = vk::SamplerCreateInfo()
 			.setMagFilter(mag_filter)
 			.setMinFilter(min_filter)
@@ -168,58 +186,41 @@ void SpotLightShadow::CreateImage()
 			.setMaxLod(1.0f)
 			.setBorderColor(vk::BorderColor::eFloatOpaqueWhite);
 
-	sampler = engine->GetVkDevice().createSampler(sampler_create_info);
-	vk_util::SetDebugUtilsObjectName(engine->GetVkDevice(), sampler, "SpotLightShadow Sampler");
-}
-
-void SpotLightShadow::CreateFramebuffer()
-{
-	std::array<vk::ImageView, 3> attachments;
-	attachments[0] = depth_image_view;
-	size_t attachment_count = 1;
-
-	if(shadow_image_view)
+	if(renderer->GetShadowMode() == ShadowMode::Depth)
 	{
-		attachments[1] = { shadow_image_view };
-		attachment_count++;
-
-		if(resolve_image_view)
-		{
-			attachments[2] = { resolve_image_view };
-			attachment_count++;
-		}
+		// with linear filtering, this gives 2x2 pcf in hardware
+		sampler_create_info
+				.setCompareEnable(VK_TRUE)
+				.setCompareOp(vk::CompareOp::eLessOrEqual);
 	}
 
-	auto create_info = vk::FramebufferCreateInfo()
-			.setRenderPass(renderer->GetRenderPass())
-			.setAttachmentCount(attachment_count)
-			.setPAttachments(attachments.data())
-			.setWidth(renderer->GetWidth())
-			.setHeight(renderer->GetHeight())
-			.setLayers(1);
-
-	framebuffer = engine->GetVkDevice().createFramebuffer(create_info);
-	vk_util::SetDebugUtilsObjectName(engine->GetVkDevice(), framebuffer, "SpotLightShadow");
+	sampler = engine->GetVkDevice().createSampler(sampler_create_info);
+	vk_util::SetDebugUtilsObjectName(engine->GetVkDevice(), sampler, "SpotLightShadow Sampler");
 }
 
 void SpotLightShadow::CreateUniformBuffer()
 {
-	matrix_uniform_buffer = engine->CreateBuffer(sizeof(ShadowMatrixUniformBuffer),
-												 vk::BufferUsageFlagBits::eUniformBuffer,
-												 VMA_MEMORY_USAGE_CPU_ONLY);
-	vk_util::SetDebugUtilsObjectName(engine->GetVkDevice(), matrix_uniform_buffer->GetVkBuffer(), "SpotLightShadow");
+	matrix_uniform_buffers.resize(Renderer::frames_in_flight);
+	for(auto &buffer : matrix_uniform_buffers)
+	{
+		buffer = engine->CreateBuffer(sizeof(ShadowMatrixUniformBuffer),
+				vk::BufferUsageFlagBits::eUniformBuffer,
+				VMA_MEMORY_USAGE_CPU_ONLY,
+				Engine::MemoryCategory::Uniforms);
+		vk_util::SetDebugUtilsObjectName(engine->GetVkDevice(), buffer->GetVkBuffer(), "SpotLightShadow");
+	}
 }
 
 void SpotLightShadow::CreateDescriptorPool()
 {
 	std::array<vk::DescriptorPoolSize, 1> pool_sizes = {
-		vk::DescriptorPoolSize(vk::DescriptorType::eUniformBuffer, 1)
+		vk::DescriptorPoolSize(vk::DescriptorType::eUniformBuffer, Renderer::frames_in_flight)
 	};
 
 	auto create_info = vk::DescriptorPoolCreateInfo()
 			.setPoolSizeCount(static_cast<uint32_t>(pool_sizes.size()))
 			.setPPoolSizes(pool_sizes.data())
-			.setMaxSets(1);
+			.setMaxSets(Renderer::frames_in_flight);
 
 	descriptor_pool = engine->GetVkDevice().createDescriptorPool(create_info);
 	vk_util::SetDebugUtilsObjectName(engine->GetVkDevice(), descriptor_pool, "SpotLightShadow");
@@ -227,88 +228,91 @@ void SpotLightShadow::CreateDescriptorPool()
 
 void SpotLightShadow::CreateDescriptorSet()
 {
-	vk::DescriptorSetLayout layouts[] = { renderer->GetDescriptorSetLayout() };
+	std::vector<vk::DescriptorSetLayout> layouts(Renderer::frames_in_flight, renderer->GetDescriptorSetLayout());
 
 	auto alloc_info = vk::DescriptorSetAllocateInfo()
 			.setDescriptorPool(descriptor_pool)
-			.setDescriptorSetCount(1)
-			.setPSetLayouts(layouts);
-
-	descriptor_set = *engine->GetVkDevice().allocateDescriptorSets(alloc_info).begin();
-	vk_util::SetDebugUtilsObjectName(engine->GetVkDevice(), descriptor_set, "SpotLightShadow");
-
-	auto matrix_buffer_info = vk::DescriptorBufferInfo()
-			.setBuffer(matrix_uniform_buffer->GetVkBuffer())
-			.setOffset(0)
-			.setRange(sizeof(ShadowMatrixUniformBuffer));
-
-	auto matrix_buffer_write = vk::WriteDescriptorSet()
-			.setDstSet(descriptor_set)
-			.setDstBinding(0)
-			.setDstArrayElement(0)
-			.setDescriptorType(vk::DescriptorType::eUniformBuffer)
-			.setDescriptorCount(1)
-			.setPBufferInfo(&matrix_buffer_info);
-
-	engine->GetVkDevice().updateDescriptorSets(matrix_buffer_write, nullptr);
+			.setDescriptorSetCount(Renderer::frames_in_flight)
+			.setPSetLayouts(layouts.data());
+
+	descriptor_sets = engine->GetVkDevice().allocateDescriptorSets(alloc_info);
+
+	for(std::uint32_t frame=0; frame<Renderer::frames_in_flight; frame++)
+	{
+		vk_util::SetDebugUtilsObjectName(engine->GetVkDevice(), descriptor_sets[frame], "SpotLightShadow");
+
+		auto matrix_buffer_info = vk::DescriptorBufferInfo()
+				.setBuffer(matrix_uniform_buffers[frame]->GetVkBuffer())
+				.setOffset(0)
+				.setRange(sizeof(ShadowMatrixUniformBuffer));
+
+		auto matrix_buffer_write = vk::WriteDescriptorSet()
+				.setDstSet(descriptor_sets[frame])
+				.setDstBinding(0)
+				.setDstArrayElement(0)
+				.setDescriptorType(vk::DescriptorType::eUniformBuffer)
+				.setDescriptorCount(1)
+				.setPBufferInfo(&matrix_buffer_info);
+
+		engine->GetVkDevice().updateDescriptorSets(matrix_buffer_write, nullptr);
+	}
 }
 
-void SpotLightShadow::UpdateMatrixUniformBuffer()
+void SpotLightShadow::UpdateMatrixUniformBuffer(std::uint32_t frame_index)
 {
 	ShadowMatrixUniformBuffer matrix_ubo;
 	matrix_ubo.modelview_projection = GetModelViewProjectionMatrix();
-	memcpy(matrix_uniform_buffer->Map(), &matrix_ubo, sizeof(matrix_ubo));
-	matrix_uniform_buffer->UnMap();
+	// stays mapped until the buffer is destroyed
+	memcpy(matrix_uniform_buffers[frame_index]->Map(), &matrix_ubo, sizeof(matrix_ubo));
 }
 
 
-void SpotLightShadow::Render(vk::CommandBuffer cmd, Renderer *renderer)
+void SpotLightShadow::Render(vk::CommandBuffer cmd, Renderer *renderer, const SpotLightShadowRenderer::ShadowAttachments &attachments)
 {
-	const vk::Device &device = engine->GetVkDevice();
+	if(batch) // rendered together with the rest of the batch in a pass of SpotLightShadowRenderer::AddPasses()
+		return;
 
-	UpdateMatrixUniformBuffer(); // TODO: Do this only if the contents really changed
-
-	auto clear_value = vk::ClearValue(vk::ClearDepthStencilValue(1.0f, 0));
+	const vk::Device &device = engine->GetVkDevice();
 
-	auto render_pass_begin_info = vk::RenderPassBeginInfo()
-			.setRenderPass(this->renderer->GetRenderPass())
-			.setFramebuffer(framebuffer)
-			.setRenderArea(vk::Rect2D(vk::Offset2D(0, 0), vk::Extent2D(this->renderer->GetWidth(), this->renderer->GetHeight())))
-			.setClearValueCount(2) // TODO: really 2?
-			.setPClearValues(&clear_value);
+	UpdateMatrixUniformBuffer(renderer->GetFrameIndex()); // TODO: Do this only if the contents really changed
 
-	auto viewport = vk::Viewport(0, 0, this->renderer->GetWidth(), this->renderer->GetHeight(), 0.0f, 1.0f);
+	auto viewport = vk::Viewport(0, 0, GetWidth(), GetHeight(), 0.0f, 1.0f);
 	cmd.setViewport(0, 1, (const vk::Viewport *)&viewport);
 
-	auto scissor = vk::Rect2D(vk::Rect2D(vk::Offset2D(0, 0), vk::Extent2D(this->renderer->GetWidth(), this->renderer->GetHeight())));
+	auto scissor = vk::Rect2D(vk::Rect2D(vk::Offset2D(0, 0), vk::Extent2D(GetWidth(), GetHeight())));
 	cmd.setScissor(0, 1, (const vk::Rect2D *)&scissor);
 
-	// TODO command_buffer.setDepthBias()
+	if(this->renderer->GetShadowMode() == ShadowMode::Depth)
+		cmd.setDepthBias(depth_bias_constant, 0.0f, depth_bias_slope);
 
-	cmd.beginRenderPass(render_pass_begin_info, vk::SubpassContents::eInline);
+	this->renderer->BeginRendering(cmd, framebuffer, vk::Extent2D(GetWidth(), GetHeight()), attachments);
 
 	renderer->RecordRenderables(cmd,
 			Material::DefaultRenderMode::Shadow,
 			this->renderer->GetMaterialPipelineManager(),
-			descriptor_set);
+			descriptor_sets[renderer->GetFrameIndex()]);
 
-	cmd.endRenderPass();
+	this->renderer->EndRendering(cmd);
+}
+
+RenderGraph::ResourceId SpotLightShadow::AddPass(RenderGraph &graph, Renderer *renderer)
+{
+	return this->renderer->AddShadowPass(graph, "SpotLightShadow", vk::Extent2D(GetWidth(), GetHeight()), final_image, final_image_view,
+			[this, renderer](vk::CommandBuffer cmd, const SpotLightShadowRenderer::ShadowAttachments &attachments) {
+				Render(cmd, renderer, attachments);
+			});
 }
 
 Image SpotLightShadow::GetFinalImage()
 {
-	if(resolve_image_view)
-		return resolve_image;
-	if(shadow_image_view)
-		return shadow_image;
-	return depth_image;
+	if(batch)
+		return batch->GetFinalImage();
+	return final_image;
 }
 
 vk::ImageView SpotLightShadow::GetFinalImageView()
 {
-	if(resolve_image_view)
-		return resolve_image_view;
-	if(shadow_image_view)
-		return shadow_image_view;
-	return depth_image_view;
+	if(batch)
+		return batch_layer_view;
+	return final_image_view;
 }
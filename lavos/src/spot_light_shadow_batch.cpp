@@ -0,0 +1,245 @@
+
+#include "lavos/spot_light_shadow_batch.h"
+#include "lavos/spot_light_shadow.h"
+#include "lavos/spot_light_shadow_renderer.h"
+#include "lavos/renderer.h"
+#include "lavos/engine.h"
+#include "lavos/culling.h"
+
+#include "../glsl/common_glsl_cpp.h"
+
+#include <algorithm>
+
+using namespace lavos;
+
+
+struct ShadowMultiviewMatrixUniformBuffer
+{
+	glm::mat4 modelview_projection[MAX_SHADOW_MULTIVIEW_COUNT];
+};
+
+static_assert(sizeof(ShadowMultiviewMatrixUniformBuffer) == 64 * MAX_SHADOW_MULTIVIEW_COUNT, "ShadowMultiviewMatrixUniformBuffer memory layout");
+
+
+SpotLightShadowBatch::SpotLightShadowBatch(Engine *engine, SpotLightShadowRenderer *renderer)
+	: engine(engine), renderer(renderer), shadows(renderer->GetViewCount(), nullptr)
+{
+	CreateImage();
+	CreateUniformBuffer();
+	CreateDescriptorPool();
+	CreateDescriptorSet();
+}
+
+SpotLightShadowBatch::~SpotLightShadowBatch()
+{
+	auto device = engine->GetVkDevice();
+
+	device.destroy(descriptor_pool);
+	for(auto buffer : matrix_uniform_buffers)
+		delete buffer;
+	renderer->DestroyFramebuffer(framebuffer);
+	device.destroy(final_image_view);
+	engine->DestroyImage(final_image);
+}
+
+void SpotLightShadowBatch::CreateImage()
+{
+	bool have_shadow_tex = renderer->GetShadowFormat() != vk::Format::eUndefined;
+	auto layer_count = static_cast<uint32_t>(shadows.size());
+
+	// the final image is never multisampled, with multisampling the transient shadow attachment is resolved into it
+	vk::Format format = have_shadow_tex ? renderer->GetShadowFormat() : renderer->GetDepthFormat();
+	vk::ImageUsageFlags usage = vk::ImageUsageFlagBits::eSampled;
+	usage |= have_shadow_tex ? vk::ImageUsageFlagBits::eColorAttachment : vk::ImageUsageFlagBits::eDepthStencilAttachment;
+
+	auto image_create_info = vk::ImageCreateInfo()
+			.setImageType(vk::ImageType::e2D)
+			.setExtent(vk::Extent3D(renderer->GetWidth(), renderer->GetHeight(), 1))
+			.setMipLevels(1)
+			.setArrayLayers(layer_count)
+			.setSamples(vk::SampleCountFlagBits::e1)
+			.setTiling(vk::ImageTiling::eOptimal)
+			.setFormat(format)
+			.setUsage(usage);
+
+	final_image = engine->CreateImage(image_create_info, VMA_MEMORY_USAGE_GPU_ONLY, Engine::MemoryCategory::Shadows);
+	vk_util::SetDebugUtilsObjectName(engine->GetVkDevice(), final_image.image, "SpotLightShadowBatch Image");
+
+	auto image_view_create_info = vk::ImageViewCreateInfo()
+			.setViewType(vk::ImageViewType::e2DArray)
+			.setFormat(format)
+			.setSubresourceRange(vk::ImageSubresourceRange(have_shadow_tex ? vk::ImageAspectFlagBits::eColor : vk::ImageAspectFlagBits::eDepth, 0, 1, 0, layer_count))
+			.setImage(final_image.image);
+
+	final_image_view = engine->GetVkDevice().createImageView(image_view_create_info);
+	vk_util::SetDebugUtilsObjectName(engine->GetVkDevice(), final_image_view, "SpotLightShadowBatch ImageView");
+}
+
+void SpotLightShadowBatch::CreateUniformBuffer()
+{
+	matrix_uniform_buffers.resize(Renderer::frames_in_flight);
+	for(auto &buffer : matrix_uniform_buffers)
+	{
+		buffer = engine->CreateBuffer(sizeof(ShadowMultiviewMatrixUniformBuffer),
+				vk::BufferUsageFlagBits::eUniformBuffer,
+				VMA_MEMORY_USAGE_CPU_ONLY,
+				Engine::MemoryCategory::Uniforms);
+		vk_util::SetDebugUtilsObjectName(engine->GetVkDevice(), buffer->GetVkBuffer(), "SpotLightShadowBatch");
+	}
+}
+
+void SpotLightShadowBatch::CreateDescriptorPool()
+{
+	std::array<vk::DescriptorPoolSize, 1> pool_sizes = {
+		vk::DescriptorPoolSize(vk::DescriptorType::eUniformBuffer, Renderer::frames_in_flight)
+	};
+
+	auto create_info = vk::DescriptorPoolCreateInfo()
+			.setPoolSizeCount(static_cast<uint32_t>(pool_sizes.size()))
+			.setPPoolSizes(pool_sizes.data())
+			.setMaxSets(Renderer::frames_in_flight);
+
+	descriptor_pool = engine->GetVkDevice().createDescriptorPool(create_info);
+	vk_util::SetDebugUtilsObjectName(engine->GetVkDevice(), descriptor_pool, "SpotLightShadowBatch");
+}
+
+void SpotLightShadowBatch::CreateDescriptorSet()
+{
+	std::vector<vk::DescriptorSetLayout> layouts(Renderer::frames_in_flight, renderer->GetDescriptorSetLayout());
+
+	auto alloc_info = vk::DescriptorSetAllocateInfo()
+			.setDescriptorPool(descriptor_pool)
+			.setDescriptorSetCount(Renderer::frames_in_flight)
+			.setPSetLayouts(layouts.data());
+
+	descriptor_sets = engine->GetVkDevice().allocateDescriptorSets(alloc_info);
+
+	for(std::uint32_t frame=0; frame<Renderer::frames_in_flight; frame++)
+	{
+		vk_util::SetDebugUtilsObjectName(engine->GetVkDevice(), descriptor_sets[frame], "SpotLightShadowBatch");
+
+		auto matrix_buffer_info = vk::DescriptorBufferInfo()
+				.setBuffer(matrix_uniform_buffers[frame]->GetVkBuffer())
+				.setOffset(0)
+				.setRange(sizeof(ShadowMultiviewMatrixUniformBuffer));
+
+		auto matrix_buffer_write = vk::WriteDescriptorSet()
+				.setDstSet(descriptor_sets[frame])
+				.setDstBinding(0)
+				.setDstArrayElement(0)
+				.setDescriptorType(vk::DescriptorType::eUniformBuffer)
+				.setDescriptorCount(1)
+				.setPBufferInfo(&matrix_buffer_info);
+
+		engine->GetVkDevice().updateDescriptorSets(matrix_buffer_write, nullptr);
+	}
+}
+
+void SpotLightShadowBatch::UpdateMatrixUniformBuffer(std::uint32_t frame_index)
+{
+	ShadowMultiviewMatrixUniformBuffer matrix_ubo;
+	for(size_t i=0; i<MAX_SHADOW_MULTIVIEW_COUNT; i++)
+	{
+		if(i < shadows.size() && shadows[i])
+			matrix_ubo.modelview_projection[i] = shadows[i]->GetModelViewProjectionMatrix();
+		else
+			matrix_ubo.modelview_projection[i] = glm::mat4(0.0f); // collapses all geometry of unused views
+	}
+	// stays mapped until the buffer is destroyed
+	memcpy(matrix_uniform_buffers[frame_index]->Map(), &matrix_ubo, sizeof(matrix_ubo));
+}
+
+int SpotLightShadowBatch::AddShadow(SpotLightShadow *shadow)
+{
+	for(size_t i=0; i<shadows.size(); i++)
+	{
+		if(shadows[i] == nullptr)
+		{
+			shadows[i] = shadow;
+			return static_cast<int>(i);
+		}
+	}
+	return -1;
+}
+
+void SpotLightShadowBatch::RemoveShadow(SpotLightShadow *shadow)
+{
+	for(auto &s : shadows)
+	{
+		if(s == shadow)
+			s = nullptr;
+	}
+}
+
+bool SpotLightShadowBatch::IsEmpty() const
+{
+	for(auto shadow : shadows)
+	{
+		if(shadow)
+			return false;
+	}
+	return true;
+}
+
+void SpotLightShadowBatch::Render(vk::CommandBuffer cmd, Renderer *renderer, const SpotLightShadowRenderer::ShadowAttachments &attachments)
+{
+	UpdateMatrixUniformBuffer(renderer->GetFrameIndex());
+
+	auto extent = vk::Extent2D(this->renderer->GetWidth(), this->renderer->GetHeight());
+
+	auto viewport = vk::Viewport(0, 0, extent.width, extent.height, 0.0f, 1.0f);
+	cmd.setViewport(0, 1, &viewport);
+
+	auto scissor = vk::Rect2D(vk::Offset2D(0, 0), extent);
+	cmd.setScissor(0, 1, &scissor);
+
+	if(this->renderer->GetShadowMode() == ShadowMode::Depth)
+	{
+		// all views are rendered with the same state, so use the largest bias requested in the batch
+		float depth_bias_constant = 0.0f;
+		float depth_bias_slope = 0.0f;
+		for(auto shadow : shadows)
+		{
+			if(!shadow)
+				continue;
+			depth_bias_constant = std::max(depth_bias_constant, shadow->GetDepthBiasConstant());
+			depth_bias_slope = std::max(depth_bias_slope, shadow->GetDepthBiasSlope());
+		}
+		cmd.setDepthBias(depth_bias_constant, 0.0f, depth_bias_slope);
+	}
+
+	this->renderer->BeginRendering(cmd, framebuffer, extent, attachments);
+
+	// skip casters per layer that are outside of the respective light's frustum
+	std::vector<glm::mat4> view_projections(shadows.size(), glm::mat4(0.0f));
+	for(size_t i=0; i<shadows.size(); i++)
+	{
+		if(shadows[i])
+			view_projections[i] = shadows[i]->GetModelViewProjectionMatrix();
+	}
+
+	renderer->RecordRenderables(cmd,
+			Material::DefaultRenderMode::ShadowMultiview,
+			this->renderer->GetMaterialPipelineManager(),
+			descriptor_sets[renderer->GetFrameIndex()],
+			[&view_projections](Node *node, Renderable *renderable) {
+				return CalculateViewMask(node, renderable, view_projections.data(),
+						static_cast<std::uint32_t>(view_projections.size()));
+			});
+
+	this->renderer->EndRendering(cmd);
+}
+
+RenderGraph::ResourceId SpotLightShadowBatch::AddPass(RenderGraph &graph, Renderer *renderer)
+{
+	return this->renderer->AddShadowPass(graph, "SpotLightShadowBatch", vk::Extent2D(this->renderer->GetWidth(), this->renderer->GetHeight()),
+			final_image, final_image_view,
+			[this, renderer](vk::CommandBuffer cmd, const SpotLightShadowRenderer::ShadowAttachments &attachments) {
+				Render(cmd, renderer, attachments);
+			});
+}
+
+Image SpotLightShadowBatch::GetFinalImage()
+{
+	return final_image;
+}
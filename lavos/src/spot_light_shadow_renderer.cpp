@@ -1,25 +1,57 @@
 
 #include "lavos/spot_light_shadow_renderer.h"
+#include "lavos/spot_light_shadow.h"
+#include "lavos/spot_light_shadow_batch.h"
 #include "lavos/engine.h"
+#include "lavos/log.h"
+#include "lavos/component/camera.h"
+#include "lavos/component/spot_light.h"
+
+#include <algorithm>
+#include <cmath>
 
 #include "../glsl/common_glsl_cpp.h"
 
 using namespace lavos;
 
-SpotLightShadowRenderer::SpotLightShadowRenderer(Engine *engine, std::uint32_t width, std::uint32_t height, vk::SampleCountFlagBits samples)
+SpotLightShadowRenderer::SpotLightShadowRenderer(Engine *engine, std::uint32_t width, std::uint32_t height, vk::SampleCountFlagBits samples,
+		std::uint32_t view_count, ShadowMode mode)
 	: SubRenderer(engine),
+	mode(mode),
 	width(width),
 	height(height),
-	samples(samples)
+	samples(samples),
+	view_count(std::max(view_count, 1u))
 {
+	if(this->view_count > 1)
+	{
+		if(!engine->GetMultiviewEnabled())
+			throw std::runtime_error("SpotLightShadowRenderer with multiple views requires multiview to be enabled in the engine.");
+		if(this->view_count > MAX_SHADOW_MULTIVIEW_COUNT)
+			throw std::runtime_error("SpotLightShadowRenderer view count exceeds MAX_SHADOW_MULTIVIEW_COUNT.");
+	}
+
 	depth_format = vk::Format::eD16Unorm;
-#if SHADOW_MSM
-	shadow_format = vk::Format::eR32G32B32A32Sfloat;
-#else
-	shadow_format = vk::Format::eUndefined;
-#endif
 
-	CreateRenderPass();
+	if(mode == ShadowMode::MSM)
+	{
+		shadow_format = vk::Format::eR32G32B32A32Sfloat;
+	}
+	else
+	{
+		shadow_format = vk::Format::eUndefined;
+
+		// the depth image is sampled directly, so it can't be multisampled
+		if(this->samples != vk::SampleCountFlagBits::e1)
+		{
+			LAVOS_LOG(LogLevel::Warning, "Depth shadows do not support multisampling, using 1 sample.");
+			this->samples = vk::SampleCountFlagBits::e1;
+		}
+	}
+
+	// with dynamic rendering, render_pass stays null
+	if(!engine->GetDynamicRenderingEnabled())
+		CreateRenderPass();
 	CreateDescriptorSetLayout();
 
 	material_pipeline_manager = new MaterialPipelineManager(engine, CreateMaterialPipelineConfiguration());
@@ -27,6 +59,8 @@ SpotLightShadowRenderer::SpotLightShadowRenderer(Engine *engine, std::uint32_t w
 
 SpotLightShadowRenderer::~SpotLightShadowRenderer()
 {
+	for(auto batch : batches)
+		delete batch;
 	delete material_pipeline_manager;
 	const auto &device = engine->GetVkDevice();
 	device.destroyDescriptorSetLayout(descriptor_set_layout);
@@ -49,13 +83,29 @@ MaterialPipelineConfiguration SpotLightShadowRenderer::CreateMaterialPipelineCon
 		color_blend_state.SetAttachments({ color_blend_attachment });
 	}
 
-	return MaterialPipelineConfiguration(
+	std::vector<vk::DynamicState> dynamic_states = { vk::DynamicState::eViewport, vk::DynamicState::eScissor };
+	if(mode == ShadowMode::Depth)
+		dynamic_states.push_back(vk::DynamicState::eDepthBias);
+
+	auto config = MaterialPipelineConfiguration(
 			vk::Extent2D(width, height),
 			samples,
 			descriptor_set_layout,
 			render_pass,
-			Material::DefaultRenderMode::Shadow,
-			color_blend_state);
+			GetMultiviewEnabled() ? Material::DefaultRenderMode::ShadowMultiview : Material::DefaultRenderMode::Shadow,
+			color_blend_state,
+			dynamic_states,
+			mode == ShadowMode::Depth);
+
+	if(!render_pass)
+	{
+		if(shadow_format != vk::Format::eUndefined)
+			config.color_formats = { shadow_format };
+		config.depth_format = depth_format;
+		config.view_mask = GetMultiviewEnabled() ? (1u << view_count) - 1 : 0;
+	}
+
+	return config;
 }
 
 void SpotLightShadowRenderer::CreateRenderPass()
@@ -74,9 +124,9 @@ void SpotLightShadowRenderer::CreateRenderPass()
 			.setStoreOp(have_shadow_tex ? vk::AttachmentStoreOp::eDontCare : vk::AttachmentStoreOp::eStore)
 			.setStencilLoadOp(vk::AttachmentLoadOp::eDontCare)
 			.setStencilStoreOp(vk::AttachmentStoreOp::eDontCare)
-			.setInitialLayout(vk::ImageLayout::eUndefined)
-			// if we have a dedicated shadow tex, we will use this instead of the depth buffer
-			.setFinalLayout(have_shadow_tex ? vk::ImageLayout::eDepthStencilAttachmentOptimal : vk::ImageLayout::eShaderReadOnlyOptimal);
+			// all attachments are transitioned by the RenderGraph, see AddShadowPass()
+			.setInitialLayout(vk::ImageLayout::eDepthStencilAttachmentOptimal)
+			.setFinalLayout(vk::ImageLayout::eDepthStencilAttachmentOptimal);
 
 	auto depth_reference = vk::AttachmentReference()
 			.setAttachment(0)
@@ -98,9 +148,8 @@ void SpotLightShadowRenderer::CreateRenderPass()
 				.setStoreOp(use_multisampling ? vk::AttachmentStoreOp::eDontCare : vk::AttachmentStoreOp::eStore)
 				.setStencilLoadOp(vk::AttachmentLoadOp::eDontCare)
 				.setStencilStoreOp(vk::AttachmentStoreOp::eDontCare)
-				.setInitialLayout(vk::ImageLayout::eUndefined)
-				// if we use multisampling, we don't care about the final layout of this
-				.setFinalLayout(use_multisampling ? vk::ImageLayout::eColorAttachmentOptimal : vk::ImageLayout::eShaderReadOnlyOptimal);
+				.setInitialLayout(vk::ImageLayout::eColorAttachmentOptimal)
+				.setFinalLayout(vk::ImageLayout::eColorAttachmentOptimal);
 
 		shadow_reference = vk::AttachmentReference()
 				.setAttachment(1)
@@ -121,8 +170,8 @@ void SpotLightShadowRenderer::CreateRenderPass()
 					.setStoreOp(vk::AttachmentStoreOp::eStore)
 					.setStencilLoadOp(vk::AttachmentLoadOp::eDontCare)
 					.setStencilStoreOp(vk::AttachmentStoreOp::eDontCare)
-					.setInitialLayout(vk::ImageLayout::eUndefined)
-					.setFinalLayout(vk::ImageLayout::eShaderReadOnlyOptimal);
+					.setInitialLayout(vk::ImageLayout::eColorAttachmentOptimal)
+					.setFinalLayout(vk::ImageLayout::eColorAttachmentOptimal);
 
 			resolve_reference = vk::AttachmentReference()
 					.setAttachment(2)
@@ -139,32 +188,22 @@ void SpotLightShadowRenderer::CreateRenderPass()
 		subpass_desc.setColorAttachmentCount(0);
 	}
 
-	std::array<vk::SubpassDependency, 2> dependencies;
-
-	dependencies[0]
-			.setSrcSubpass(VK_SUBPASS_EXTERNAL)
-			.setDstSubpass(0)
-			.setSrcStageMask(vk::PipelineStageFlagBits::eBottomOfPipe)
-			.setDstStageMask(vk::PipelineStageFlagBits::eLateFragmentTests)
-			.setSrcAccessMask(static_cast<vk::AccessFlags>(0))
-			.setDstAccessMask(vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite)
-			.setDependencyFlags(vk::DependencyFlagBits::eByRegion);
-
-	dependencies[1]
-			.setSrcSubpass(0).setDstSubpass(VK_SUBPASS_EXTERNAL)
-			.setSrcStageMask(vk::PipelineStageFlagBits::eLateFragmentTests)
-			.setDstStageMask(vk::PipelineStageFlagBits::eFragmentShader)
-			.setSrcAccessMask(vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite)
-			.setDstAccessMask(vk::AccessFlagBits::eShaderRead)
-			.setDependencyFlags(vk::DependencyFlagBits::eByRegion);
-
 	auto create_info = vk::RenderPassCreateInfo()
 			.setAttachmentCount(attachment_count)
 			.setPAttachments(attachments.data())
 			.setSubpassCount(1)
-			.setPSubpasses(&subpass_desc)
-			.setDependencyCount(dependencies.size())
-			.setPDependencies(dependencies.data());
+			.setPSubpasses(&subpass_desc);
+
+	// one view per layer, all views are rendered from the same draw calls
+	uint32_t view_mask = (1u << view_count) - 1;
+	auto multiview_create_info = vk::RenderPassMultiviewCreateInfo()
+			.setSubpassCount(1)
+			.setPViewMasks(&view_mask)
+			.setCorrelationMaskCount(1)
+			.setPCorrelationMasks(&view_mask);
+
+	if(GetMultiviewEnabled())
+		create_info.setPNext(&multiview_create_info);
 
 	render_pass = engine->GetVkDevice().createRenderPass(create_info);
 	vk_util::SetDebugUtilsObjectName(engine->GetVkDevice(), render_pass, "SpotLightShadowRenderer RenderPass");
@@ -198,3 +237,385 @@ void SpotLightShadowRenderer::RemoveMaterial(Material *material)
 {
 	material_pipeline_manager->RemoveMaterial(material);
 }
+
+void SpotLightShadowRenderer::SetAdaptiveResolution(bool enabled, std::uint32_t min_resolution, vk::DeviceSize memory_budget)
+{
+	if(enabled && GetMultiviewEnabled())
+		throw std::runtime_error("adaptive shadow resolution is not supported with multiview.");
+
+	this->adaptive_resolution = enabled;
+	this->min_resolution = std::max(min_resolution, 1u);
+	this->memory_budget = memory_budget;
+}
+
+unsigned int SpotLightShadowRenderer::GetMaxResolutionLevel() const
+{
+	unsigned int level = 0;
+	while((width >> (level + 1)) >= min_resolution && (height >> (level + 1)) >= min_resolution)
+		level++;
+	return level;
+}
+
+static vk::DeviceSize GetFormatTexelSize(vk::Format format)
+{
+	switch(format)
+	{
+		case vk::Format::eUndefined:			return 0;
+		case vk::Format::eD16Unorm:				return 2;
+		case vk::Format::eR32G32B32A32Sfloat:	return 16;
+		default:								return 4;
+	}
+}
+
+vk::DeviceSize SpotLightShadowRenderer::GetMemoryRequirement(unsigned int level) const
+{
+	auto extent = GetResolution(level);
+	vk::DeviceSize texels = static_cast<vk::DeviceSize>(extent.width) * extent.height;
+
+	// the intermediate attachments are transient images of the RenderGraph, shared by all shadow passes
+	if(shadow_format == vk::Format::eUndefined)
+		return texels * GetFormatTexelSize(depth_format);
+	return texels * GetFormatTexelSize(shadow_format);
+}
+
+/**
+ * @return the fraction of the screen (0 to 1) that is covered by the bounding sphere of the light
+ */
+static float CalculateScreenCoverage(SpotLightShadow *shadow, Camera *camera, vk::Extent2D screen_extent)
+{
+	auto transform_component = shadow->GetLight()->GetNode()->GetTransformComp();
+	if(transform_component == nullptr)
+		return 1.0f;
+
+	glm::vec3 light_pos = camera->GetModelViewMatrix() * transform_component->GetMatrixWorld() * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+	float radius = shadow->GetFarClip();
+	float distance = glm::length(light_pos);
+
+	if(distance <= radius)
+		return 1.0f;
+
+	float screen_size = static_cast<float>(std::max(screen_extent.width, screen_extent.height));
+	float projected_diameter;
+
+	if(camera->GetType() == Camera::Type::PERSPECTIVE)
+	{
+		float focal_length = static_cast<float>(screen_extent.height) * 0.5f / std::tan(camera->GetPerspectiveFovY() * 0.5f);
+		projected_diameter = 2.0f * focal_length * radius / std::sqrt(distance * distance - radius * radius);
+	}
+	else
+	{
+		float ortho_height = camera->GetOrthographicTop() - camera->GetOrthographicBottom();
+		projected_diameter = 2.0f * radius * static_cast<float>(screen_extent.height) / ortho_height;
+	}
+
+	return std::min(1.0f, projected_diameter / screen_size);
+}
+
+void SpotLightShadowRenderer::UpdateResolutions(const std::vector<SpotLightShadow *> &shadows, Camera *camera, vk::Extent2D screen_extent)
+{
+	unsigned int max_level = GetMaxResolutionLevel();
+
+	std::vector<float> coverages(shadows.size());
+	std::vector<unsigned int> levels(shadows.size());
+
+	vk::DeviceSize total_memory = 0;
+
+	for(size_t i=0; i<shadows.size(); i++)
+	{
+		float coverage = camera != nullptr ? CalculateScreenCoverage(shadows[i], camera, screen_extent) : 1.0f;
+		coverages[i] = coverage;
+
+		unsigned int level = 0;
+		while(level < max_level && coverage <= 0.5f)
+		{
+			coverage *= 2.0f;
+			level++;
+		}
+
+		levels[i] = level;
+		total_memory += GetMemoryRequirement(level);
+	}
+
+	std::vector<bool> budget_reduced(shadows.size(), false);
+
+	// reduce the shadows with the least coverage first until everything fits into the budget
+	while(memory_budget > 0 && total_memory > memory_budget)
+	{
+		size_t reduce_index = shadows.size();
+		for(size_t i=0; i<shadows.size(); i++)
+		{
+			if(levels[i] >= max_level)
+				continue;
+			if(reduce_index == shadows.size() || coverages[i] < coverages[reduce_index])
+				reduce_index = i;
+		}
+
+		if(reduce_index == shadows.size())
+			break;
+
+		total_memory -= GetMemoryRequirement(levels[reduce_index]);
+		levels[reduce_index]++;
+		budget_reduced[reduce_index] = true;
+		coverages[reduce_index] *= 2.0f;
+		total_memory += GetMemoryRequirement(levels[reduce_index]);
+	}
+
+	for(size_t i=0; i<shadows.size(); i++)
+	{
+		auto shadow = shadows[i];
+		unsigned int current_level = shadow->GetResolutionLevel();
+
+		if(levels[i] < current_level)
+		{
+			shadow->SetResolutionLevel(levels[i]);
+			shadow->downscale_frames = 0;
+		}
+		else if(levels[i] > current_level)
+		{
+			// reducing the resolution is delayed, unless the budget requires it
+			shadow->downscale_frames++;
+			if(shadow->downscale_frames >= downscale_delay || budget_reduced[i])
+			{
+				shadow->SetResolutionLevel(levels[i]);
+				shadow->downscale_frames = 0;
+			}
+		}
+		else
+		{
+			shadow->downscale_frames = 0;
+		}
+	}
+}
+
+SpotLightShadowBatch *SpotLightShadowRenderer::AddToBatch(SpotLightShadow *shadow, std::uint32_t *layer)
+{
+	for(auto batch : batches)
+	{
+		int batch_layer = batch->AddShadow(shadow);
+		if(batch_layer >= 0)
+		{
+			*layer = static_cast<std::uint32_t>(batch_layer);
+			return batch;
+		}
+	}
+
+	auto batch = new SpotLightShadowBatch(engine, this);
+	batches.push_back(batch);
+	*layer = static_cast<std::uint32_t>(batch->AddShadow(shadow));
+	return batch;
+}
+
+void SpotLightShadowRenderer::RemoveFromBatch(SpotLightShadow *shadow, SpotLightShadowBatch *batch)
+{
+	batch->RemoveShadow(shadow);
+	if(!batch->IsEmpty())
+		return;
+
+	auto it = std::find(batches.begin(), batches.end(), batch);
+	if(it != batches.end())
+		batches.erase(it);
+	delete batch;
+}
+
+RenderGraph::ResourceId SpotLightShadowRenderer::AddShadowPass(RenderGraph &graph, const char *name, vk::Extent2D extent,
+		const Image &final_image, vk::ImageView final_image_view, ShadowRecordFunction record)
+{
+	bool have_shadow_tex = shadow_format != vk::Format::eUndefined;
+	bool use_multisampling = samples != vk::SampleCountFlagBits::e1;
+	std::uint32_t layers = GetMultiviewEnabled() ? view_count : 1;
+
+	vk::ImageAspectFlags final_aspect_mask = vk::ImageAspectFlagBits::eColor;
+	if(!have_shadow_tex)
+	{
+		final_aspect_mask = vk::ImageAspectFlagBits::eDepth;
+		if(Engine::HasStencilComponent(depth_format))
+			final_aspect_mask |= vk::ImageAspectFlagBits::eStencil;
+	}
+
+	// the final image is cleared or fully resolved, but sampling it in the main pass of the previous frame has to finish first
+	auto final_resource = graph.ImportImage(name, final_image.image, vk::ImageSubresourceRange(final_aspect_mask, 0, 1, 0, layers),
+			vk::ImageLayout::eUndefined, vk::PipelineStageFlagBits::eFragmentShader);
+
+	auto depth_resource = final_resource;
+	auto shadow_resource = final_resource;
+
+	if(have_shadow_tex)
+	{
+		RenderGraph::ImageDesc desc;
+		desc.format = depth_format;
+		desc.extent = extent;
+		desc.usage = vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eTransientAttachment;
+		desc.samples = samples;
+		desc.layers = layers;
+		depth_resource = graph.CreateImage(std::string(name) + " Depth", desc);
+	}
+
+	if(use_multisampling)
+	{
+		RenderGraph::ImageDesc desc;
+		desc.format = shadow_format;
+		desc.extent = extent;
+		desc.usage = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransientAttachment;
+		desc.samples = samples;
+		desc.layers = layers;
+		shadow_resource = graph.CreateImage(std::string(name) + " Shadow", desc);
+	}
+
+	// views of transient images are only known after RenderGraph::Compile()
+	auto pass = graph.AddPass(name, [&graph, have_shadow_tex, use_multisampling, depth_resource, shadow_resource, final_image_view, record](vk::CommandBuffer cmd) {
+		ShadowAttachments attachments;
+		attachments.transient_generation = graph.GetTransientGeneration();
+		if(!have_shadow_tex)
+		{
+			attachments.depth_image_view = final_image_view;
+		}
+		else
+		{
+			attachments.depth_image_view = graph.GetImageView(depth_resource);
+			if(!use_multisampling)
+			{
+				attachments.shadow_image_view = final_image_view;
+			}
+			else
+			{
+				attachments.shadow_image_view = graph.GetImageView(shadow_resource);
+				attachments.resolve_image_view = final_image_view;
+			}
+		}
+		record(cmd, attachments);
+	});
+
+	// all attachments are cleared or fully resolved
+	graph.Write(pass, depth_resource, RenderGraph::Access::DepthAttachment, true);
+	if(have_shadow_tex)
+		graph.Write(pass, shadow_resource, RenderGraph::Access::ColorAttachment, true);
+	if(use_multisampling)
+		graph.Write(pass, final_resource, RenderGraph::Access::ColorAttachment, true);
+
+	return final_resource;
+}
+
+void SpotLightShadowRenderer::UpdateFramebuffer(ShadowFramebuffer &framebuffer, vk::Extent2D extent, const ShadowAttachments &attachments)
+{
+	if(framebuffer.framebuffer && framebuffer.attachments == attachments && framebuffer.extent == extent)
+		return;
+
+	DestroyFramebuffer(framebuffer);
+
+	std::array<vk::ImageView, 3> views;
+	views[0] = attachments.depth_image_view;
+	size_t attachment_count = 1;
+
+	if(attachments.shadow_image_view)
+	{
+		views[1] = attachments.shadow_image_view;
+		attachment_count++;
+
+		if(attachments.resolve_image_view)
+		{
+			views[2] = attachments.resolve_image_view;
+			attachment_count++;
+		}
+	}
+
+	// with multiview, the layers are addressed by the view mask of the render pass, so layers must be 1 here
+	auto create_info = vk::FramebufferCreateInfo()
+			.setRenderPass(render_pass)
+			.setAttachmentCount(attachment_count)
+			.setPAttachments(views.data())
+			.setWidth(extent.width)
+			.setHeight(extent.height)
+			.setLayers(1);
+
+	framebuffer.framebuffer = engine->GetVkDevice().createFramebuffer(create_info);
+	framebuffer.attachments = attachments;
+	framebuffer.extent = extent;
+	vk_util::SetDebugUtilsObjectName(engine->GetVkDevice(), framebuffer.framebuffer, "SpotLightShadowRenderer Framebuffer");
+}
+
+void SpotLightShadowRenderer::DestroyFramebuffer(ShadowFramebuffer &framebuffer)
+{
+	if(!framebuffer.framebuffer)
+		return;
+
+	// only used by frames that are already submitted
+	auto engine = this->engine;
+	auto handle = framebuffer.framebuffer;
+	engine->DestroyAfter(engine->GetSubmittedValue(), [engine, handle]() {
+		engine->GetVkDevice().destroy(handle);
+	});
+
+	framebuffer = ShadowFramebuffer();
+}
+
+void SpotLightShadowRenderer::BeginRendering(vk::CommandBuffer cmd, ShadowFramebuffer &framebuffer, vk::Extent2D extent,
+		const ShadowAttachments &attachments)
+{
+	std::array<vk::ClearValue, 2> clear_values = {
+			vk::ClearDepthStencilValue(1.0f, 0),
+			vk::ClearColorValue(std::array<float, 4>{{ 1.0f, 1.0f, 1.0f, 1.0f }})
+	};
+
+	if(render_pass)
+	{
+		UpdateFramebuffer(framebuffer, extent, attachments);
+
+		auto render_pass_begin_info = vk::RenderPassBeginInfo()
+				.setRenderPass(render_pass)
+				.setFramebuffer(framebuffer.framebuffer)
+				.setRenderArea(vk::Rect2D(vk::Offset2D(0, 0), extent))
+				.setClearValueCount(attachments.shadow_image_view ? 2 : 1)
+				.setPClearValues(clear_values.data());
+
+		cmd.beginRenderPass(render_pass_begin_info, vk::SubpassContents::eInline);
+		return;
+	}
+
+	// same load and store operations as the attachments of CreateRenderPass()
+	auto depth_attachment = vk::RenderingAttachmentInfoKHR()
+			.setImageView(attachments.depth_image_view)
+			.setImageLayout(vk::ImageLayout::eDepthStencilAttachmentOptimal)
+			.setLoadOp(vk::AttachmentLoadOp::eClear)
+			.setStoreOp(attachments.shadow_image_view ? vk::AttachmentStoreOp::eDontCare : vk::AttachmentStoreOp::eStore)
+			.setClearValue(clear_values[0]);
+
+	auto shadow_attachment = vk::RenderingAttachmentInfoKHR()
+			.setImageView(attachments.shadow_image_view)
+			.setImageLayout(vk::ImageLayout::eColorAttachmentOptimal)
+			.setLoadOp(vk::AttachmentLoadOp::eClear)
+			.setStoreOp(attachments.resolve_image_view ? vk::AttachmentStoreOp::eDontCare : vk::AttachmentStoreOp::eStore)
+			.setClearValue(clear_values[1]);
+
+	if(attachments.resolve_image_view)
+	{
+		shadow_attachment
+				.setResolveMode(vk::ResolveModeFlagBits::eAverage)
+				.setResolveImageView(attachments.resolve_image_view)
+				.setResolveImageLayout(vk::ImageLayout::eColorAttachmentOptimal);
+	}
+
+	auto rendering_info = vk::RenderingInfoKHR()
+			.setRenderArea(vk::Rect2D(vk::Offset2D(0, 0), extent))
+			.setLayerCount(1)
+			.setViewMask(GetMultiviewEnabled() ? (1u << view_count) - 1 : 0)
+			.setColorAttachmentCount(attachments.shadow_image_view ? 1 : 0)
+			.setPColorAttachments(&shadow_attachment)
+			.setPDepthAttachment(&depth_attachment)
+			.setPStencilAttachment(Engine::HasStencilComponent(depth_format) ? &depth_attachment : nullptr);
+
+	engine->CmdBeginRendering(cmd, rendering_info);
+}
+
+void SpotLightShadowRenderer::EndRendering(vk::CommandBuffer cmd)
+{
+	if(render_pass)
+		cmd.endRenderPass();
+	else
+		engine->CmdEndRendering(cmd);
+}
+
+void SpotLightShadowRenderer::AddPasses(RenderGraph &graph, Renderer *renderer, std::vector<RenderGraph::ResourceId> &sampled)
+{
+	for(auto batch : batches)
+		sampled.push_back(batch->AddPass(graph, renderer));
+}
@@ -36,7 +36,7 @@ Texture Texture::CreateColor(Engine *engine, vk::Format format, glm::vec4 color)
 		.setMinLod(0.0f)
 		.setMaxLod(0.0f);
 
-	auto sampler = device.createSampler(create_info);
+	auto sampler = engine->GetSampler(create_info);
 
 	return Texture(image, image_view, sampler);
 }
\ No newline at end of file
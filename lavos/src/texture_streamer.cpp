@@ -0,0 +1,373 @@
+
+#include "lavos/texture_streamer.h"
+#include "lavos/engine.h"
+#include "lavos/buffer.h"
+#include "lavos/scene.h"
+#include "lavos/renderable.h"
+#include "lavos/culling.h"
+#include "lavos/vk_util.h"
+#include "lavos/material/material_instance.h"
+#include "lavos/component/camera.h"
+
+#include <glm/geometric.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace lavos;
+
+static const vk::Format streamed_format = vk::Format::eR8G8B8A8Unorm;
+static const std::uint32_t streamed_components = 4;
+
+TextureStreamer::TextureStreamer(Engine *engine, vk::DeviceSize budget, std::uint32_t max_uploads_per_update)
+	: engine(engine),
+	budget(budget),
+	max_uploads_per_update(max_uploads_per_update)
+{
+}
+
+TextureStreamer::~TextureStreamer()
+{
+	for(auto texture : textures)
+	{
+		engine->DestroyTexture(texture->texture);
+		delete texture;
+	}
+}
+
+vk::DeviceSize TextureStreamer::GetLevelsSize(const StreamedTexture *texture, std::uint32_t level)
+{
+	vk::DeviceSize size = 0;
+	for(std::uint32_t i=level; i<texture->levels.size(); i++)
+		size += texture->levels[i].size();
+	return size;
+}
+
+TextureStreamer::StreamedTexture *TextureStreamer::AddTexture(std::uint32_t width, std::uint32_t height, std::uint32_t components, const std::uint8_t *pixels)
+{
+	if(components == 0 || components > streamed_components)
+		throw std::runtime_error("invalid component count for streamed texture.");
+
+	auto texture = new StreamedTexture;
+	texture->width = width;
+	texture->height = height;
+
+	std::vector<std::uint8_t> level(static_cast<std::size_t>(width) * height * streamed_components);
+	for(std::size_t i=0; i<static_cast<std::size_t>(width) * height; i++)
+	{
+		for(std::uint32_t c=0; c<streamed_components; c++)
+			level[i * streamed_components + c] = c < components ? pixels[i * components + c] : (c == 3 ? 255 : 0);
+	}
+	texture->levels.push_back(std::move(level));
+
+	// box filtered mip chain down to 1x1, odd sizes repeat their last row or column
+	std::uint32_t level_width = width;
+	std::uint32_t level_height = height;
+	while(level_width > 1 || level_height > 1)
+	{
+		std::uint32_t next_width = std::max(level_width / 2, 1u);
+		std::uint32_t next_height = std::max(level_height / 2, 1u);
+
+		const auto &src = texture->levels.back();
+		std::vector<std::uint8_t> dst(static_cast<std::size_t>(next_width) * next_height * streamed_components);
+
+		for(std::uint32_t y=0; y<next_height; y++)
+		{
+			std::uint32_t y0 = std::min(y * 2, level_height - 1);
+			std::uint32_t y1 = std::min(y * 2 + 1, level_height - 1);
+			for(std::uint32_t x=0; x<next_width; x++)
+			{
+				std::uint32_t x0 = std::min(x * 2, level_width - 1);
+				std::uint32_t x1 = std::min(x * 2 + 1, level_width - 1);
+				for(std::uint32_t c=0; c<streamed_components; c++)
+				{
+					unsigned int sum = src[(y0 * level_width + x0) * streamed_components + c]
+							+ src[(y0 * level_width + x1) * streamed_components + c]
+							+ src[(y1 * level_width + x0) * streamed_components + c]
+							+ src[(y1 * level_width + x1) * streamed_components + c];
+					dst[(y * next_width + x) * streamed_components + c] = static_cast<std::uint8_t>((sum + 2) / 4);
+				}
+			}
+		}
+
+		texture->levels.push_back(std::move(dst));
+		level_width = next_width;
+		level_height = next_height;
+	}
+
+	texture->fallback_level = 0;
+	while(std::max(width >> texture->fallback_level, height >> texture->fallback_level) > min_resident_size)
+		texture->fallback_level++;
+	texture->requested_level = texture->fallback_level;
+
+	SetResidentLevel(texture, texture->fallback_level);
+
+	textures.push_back(texture);
+	return texture;
+}
+
+void TextureStreamer::RemoveTexture(StreamedTexture *texture)
+{
+	for(const auto &user : texture->users)
+	{
+		auto it = instance_textures.find(user.material_instance);
+		if(it == instance_textures.end())
+			continue;
+
+		auto &instance_textures_list = it->second;
+		instance_textures_list.erase(std::remove(instance_textures_list.begin(), instance_textures_list.end(), texture), instance_textures_list.end());
+		if(instance_textures_list.empty())
+			instance_textures.erase(it);
+	}
+
+	resident_size -= engine->GetAllocationSize(texture->texture.image.allocation);
+
+	// may still be sampled by submitted frames
+	Texture old_texture = texture->texture;
+	engine->DestroyAfter(engine->GetSubmittedValue(), [this, old_texture]() {
+		engine->DestroyTexture(old_texture);
+	});
+
+	textures.erase(std::remove(textures.begin(), textures.end(), texture), textures.end());
+	delete texture;
+}
+
+void TextureStreamer::Bind(StreamedTexture *texture, MaterialInstance *material_instance, Material::TextureSlot slot, vk::Sampler sampler)
+{
+	texture->users.push_back({ material_instance, slot, sampler });
+	instance_textures[material_instance].push_back(texture);
+
+	material_instance->SetTexture(slot, Texture(texture->texture.image, texture->texture.image_view, sampler));
+}
+
+void TextureStreamer::SetResidentLevel(StreamedTexture *texture, std::uint32_t level)
+{
+	auto &device = engine->GetVkDevice();
+
+	auto levels_count = static_cast<std::uint32_t>(texture->levels.size()) - level;
+	std::uint32_t width = std::max(texture->width >> level, 1u);
+	std::uint32_t height = std::max(texture->height >> level, 1u);
+
+	auto staging_buffer = engine->CreateBuffer(GetLevelsSize(texture, level), vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_CPU_ONLY,
+			Engine::MemoryCategory::Staging);
+
+	std::vector<vk::BufferImageCopy> regions;
+	auto map = reinterpret_cast<std::uint8_t *>(staging_buffer->Map());
+	vk::DeviceSize offset = 0;
+	for(std::uint32_t i=level; i<texture->levels.size(); i++)
+	{
+		const auto &data = texture->levels[i];
+		memcpy(map + offset, data.data(), data.size());
+
+		regions.push_back(vk::BufferImageCopy()
+				.setBufferOffset(offset)
+				.setBufferRowLength(0)
+				.setBufferImageHeight(0)
+				.setImageSubresource(vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, i - level, 0, 1))
+				.setImageOffset(vk::Offset3D(0, 0, 0))
+				.setImageExtent(vk::Extent3D(std::max(texture->width >> i, 1u), std::max(texture->height >> i, 1u), 1)));
+
+		offset += data.size();
+	}
+	staging_buffer->UnMap();
+
+	auto image_create_info = vk::ImageCreateInfo()
+			.setImageType(vk::ImageType::e2D)
+			.setExtent(vk::Extent3D(width, height, 1))
+			.setMipLevels(levels_count)
+			.setArrayLayers(1)
+			.setFormat(streamed_format)
+			.setTiling(vk::ImageTiling::eOptimal)
+			.setInitialLayout(vk::ImageLayout::eUndefined)
+			.setUsage(vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled)
+			.setSharingMode(vk::SharingMode::eExclusive)
+			.setSamples(vk::SampleCountFlagBits::e1);
+
+	Image image = engine->CreateImage(image_create_info, VMA_MEMORY_USAGE_GPU_ONLY, Engine::MemoryCategory::Textures);
+	vk_util::SetDebugUtilsObjectName(device, image.image, "TextureStreamer Image");
+
+	auto subresource_range = vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, levels_count, 0, 1);
+
+	auto command_buffer = engine->BeginSingleTimeCommandBuffer();
+
+	command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags(),
+			nullptr, nullptr,
+			vk::ImageMemoryBarrier()
+				.setSrcAccessMask(vk::AccessFlags())
+				.setDstAccessMask(vk::AccessFlagBits::eTransferWrite)
+				.setOldLayout(vk::ImageLayout::eUndefined)
+				.setNewLayout(vk::ImageLayout::eTransferDstOptimal)
+				.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+				.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+				.setImage(image.image)
+				.setSubresourceRange(subresource_range));
+
+	command_buffer.copyBufferToImage(staging_buffer->GetVkBuffer(), image.image, vk::ImageLayout::eTransferDstOptimal, regions);
+
+	command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader, vk::DependencyFlags(),
+			nullptr, nullptr,
+			vk::ImageMemoryBarrier()
+				.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+				.setDstAccessMask(vk::AccessFlagBits::eShaderRead)
+				.setOldLayout(vk::ImageLayout::eTransferDstOptimal)
+				.setNewLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
+				.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+				.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+				.setImage(image.image)
+				.setSubresourceRange(subresource_range));
+
+	// frames submitted later sample the image only after the copy, see the barrier above
+	std::uint64_t value = engine->SubmitSingleTimeCommandBuffer(command_buffer);
+	engine->DestroyAfter(value, [staging_buffer]() {
+		delete staging_buffer;
+	});
+
+	auto image_view = device.createImageView(vk::ImageViewCreateInfo()
+			.setImage(image.image)
+			.setViewType(vk::ImageViewType::e2D)
+			.setFormat(streamed_format)
+			.setSubresourceRange(subresource_range));
+
+	Texture old_texture = texture->texture;
+	texture->texture = Texture(image, image_view, nullptr);
+	texture->resident_level = level;
+
+	// the descriptors are written by RenewUsers(), the current ones may be in use by submitted frames
+	for(const auto &user : texture->users)
+	{
+		user.material_instance->SetTexture(user.slot, Texture(image, image_view, user.sampler));
+		changed_instances.insert(user.material_instance);
+	}
+
+	resident_size += engine->GetAllocationSize(image.allocation);
+	if(old_texture.image)
+	{
+		resident_size -= engine->GetAllocationSize(old_texture.image.allocation);
+
+		// still sampled by submitted frames through the previous descriptors
+		engine->DestroyAfter(engine->GetSubmittedValue(), [this, old_texture]() {
+			engine->DestroyTexture(old_texture);
+		});
+	}
+}
+
+void TextureStreamer::RenewUsers()
+{
+	for(auto material_instance : changed_instances)
+		material_instance->RenewDescriptorSets();
+	changed_instances.clear();
+}
+
+void TextureStreamer::RequestLevel(StreamedTexture *texture, float projected_size)
+{
+	// assumes the texture is mapped once across the projected bounds
+	float texels = static_cast<float>(std::max(texture->width, texture->height));
+	float lod = std::log2(texels / std::max(projected_size, 1.0f));
+
+	std::uint32_t level = lod <= 0.0f ? 0 : std::min(static_cast<std::uint32_t>(lod), texture->fallback_level);
+	texture->requested_level = std::min(texture->requested_level, level);
+	texture->last_used_frame = frame;
+}
+
+bool TextureStreamer::MakeRoom(vk::DeviceSize size, StreamedTexture *keep)
+{
+	while(resident_size + size > budget)
+	{
+		// only levels finer than currently requested can be evicted, which includes all unused ones
+		StreamedTexture *victim = nullptr;
+		for(auto texture : textures)
+		{
+			if(texture == keep || texture->resident_level >= texture->requested_level)
+				continue;
+			if(!victim || texture->last_used_frame < victim->last_used_frame)
+				victim = texture;
+		}
+
+		if(!victim)
+			return false;
+
+		SetResidentLevel(victim, victim->requested_level);
+	}
+
+	return true;
+}
+
+void TextureStreamer::Update(Scene *scene, Camera *camera, float viewport_height)
+{
+	frame++;
+
+	for(auto texture : textures)
+		texture->requested_level = texture->fallback_level;
+
+	glm::mat4 view_projection = camera->GetProjectionMatrix() * camera->GetModelViewMatrix();
+	glm::vec3 camera_position = camera->GetNode()->GetTransformComp()->GetMatrixWorld()[3];
+	bool perspective = camera->GetType() == Camera::Type::PERSPECTIVE;
+	float near_clip = camera->GetNearClip();
+
+	// pixels covered by one unit, at distance 1 for perspective
+	float pixels_per_unit = perspective
+			? viewport_height / (2.0f * std::tan(camera->GetPerspectiveFovY() * 0.5f))
+			: viewport_height / (camera->GetOrthographicTop() - camera->GetOrthographicBottom());
+
+	scene->GetRootNode()->TraversePreOrder([this, &view_projection, &camera_position, perspective, near_clip, pixels_per_unit] (Node *node) {
+		auto renderable = node->GetComponent<Renderable>();
+		if(renderable == nullptr || !renderable->GetCurrentlyRenderable())
+			return;
+
+		// without bounds, no projected size can be estimated
+		glm::vec3 min, max;
+		if(!renderable->GetBounds(min, max))
+			return;
+
+		auto transform_component = node->GetTransformComp();
+		glm::mat4 transform = transform_component != nullptr ? transform_component->GetMatrixWorld() : glm::mat4(1.0f);
+		if(!BoxIntersectsFrustum(view_projection * transform, min, max))
+			return;
+
+		glm::vec3 center;
+		float radius;
+		CalculateBoundingSphere(node, renderable, center, radius);
+
+		float projected_size = 2.0f * radius * pixels_per_unit;
+		if(perspective)
+			projected_size /= std::max(glm::distance(center, camera_position) - radius, near_clip);
+
+		unsigned int primitives_count = renderable->GetPrimitivesCount();
+		for(unsigned int i=0; i<primitives_count; i++)
+		{
+			auto it = instance_textures.find(renderable->GetPrimitive(i)->GetMaterialInstance());
+			if(it == instance_textures.end())
+				continue;
+
+			for(auto texture : it->second)
+				RequestLevel(texture, projected_size);
+		}
+	});
+
+	std::vector<StreamedTexture *> uploads;
+	for(auto texture : textures)
+	{
+		if(texture->requested_level < texture->resident_level)
+			uploads.push_back(texture);
+	}
+
+	// textures missing the most levels first
+	std::sort(uploads.begin(), uploads.end(), [](const StreamedTexture *a, const StreamedTexture *b) {
+		return a->resident_level - a->requested_level > b->resident_level - b->requested_level;
+	});
+
+	if(uploads.size() > max_uploads_per_update)
+		uploads.resize(max_uploads_per_update);
+
+	for(auto texture : uploads)
+	{
+		vk::DeviceSize additional_size = GetLevelsSize(texture, texture->requested_level) - GetLevelsSize(texture, texture->resident_level);
+		if(!MakeRoom(additional_size, texture))
+			break;
+
+		SetResidentLevel(texture, texture->requested_level);
+	}
+
+	RenewUsers();
+}
@@ -0,0 +1,64 @@
+
+#include "lavos/uniform_ring_buffer.h"
+#include "lavos/engine.h"
+#include "lavos/buffer.h"
+#include "lavos/vk_util.h"
+
+#include <cstring>
+
+using namespace lavos;
+
+UniformRingBuffer::UniformRingBuffer(Engine *engine, vk::DeviceSize frame_size, std::uint32_t frames_count)
+	: engine(engine),
+	frames_count(frames_count)
+{
+	alignment = engine->GetVkPhysicalDevice().getProperties().limits.minUniformBufferOffsetAlignment;
+	this->frame_size = (frame_size + alignment - 1) / alignment * alignment;
+
+	buffer = engine->CreateBuffer(this->frame_size * frames_count,
+			vk::BufferUsageFlagBits::eUniformBuffer,
+			VMA_MEMORY_USAGE_CPU_ONLY,
+			Engine::MemoryCategory::Uniforms);
+	vk_util::SetDebugUtilsObjectName(engine->GetVkDevice(), buffer->GetVkBuffer(), "UniformRingBuffer");
+
+	// stays mapped until the buffer is destroyed
+	map = reinterpret_cast<std::uint8_t *>(buffer->Map());
+}
+
+UniformRingBuffer::~UniformRingBuffer()
+{
+	delete buffer;
+}
+
+void UniformRingBuffer::BeginFrame(std::uint32_t frame_index)
+{
+	assert(frame_index < frames_count);
+	frame_begin = frame_index * frame_size;
+	frame_offset = 0;
+}
+
+std::uint32_t UniformRingBuffer::Allocate(vk::DeviceSize size, void **data)
+{
+	vk::DeviceSize aligned_size = (size + alignment - 1) / alignment * alignment;
+	if(frame_offset + aligned_size > frame_size)
+		throw std::runtime_error("UniformRingBuffer frame size exceeded.");
+
+	vk::DeviceSize offset = frame_begin + frame_offset;
+	frame_offset += aligned_size;
+
+	*data = map + offset;
+	return static_cast<std::uint32_t>(offset);
+}
+
+std::uint32_t UniformRingBuffer::Write(const void *data, vk::DeviceSize size)
+{
+	void *dst;
+	std::uint32_t offset = Allocate(size, &dst);
+	memcpy(dst, data, size);
+	return offset;
+}
+
+vk::Buffer UniformRingBuffer::GetVkBuffer() const
+{
+	return buffer->GetVkBuffer();
+}
@@ -2,6 +2,7 @@
 #ifndef LAVOS_SHELL_GLFW_WINDOW_APPLICATION_H
 #define LAVOS_SHELL_GLFW_WINDOW_APPLICATION_H
 
+#include <array>
 #include <chrono>
 
 #define GLFW_INCLUDE_VULKAN
@@ -21,6 +22,7 @@ class WindowApplication
 		GLFWwindow *window;
 		static void OnWindowResized(GLFWwindow *window, int width, int height);
 
+		lavos::Engine::CreateInfo engine_create_info;
 		lavos::Engine *engine;
 
 		vk::SurfaceKHR surface;
@@ -31,8 +33,13 @@ class WindowApplication
 		lavos::Swapchain *swapchain;
 		lavos::ManagedDepthRenderTarget *depth_render_target;
 
-		vk::Semaphore image_available_semaphore;
-		vk::Semaphore render_finished_semaphore;
+		/**
+		 * One pair of semaphores per frame in flight, reused once the frame that used them last is finished
+		 */
+		std::array<vk::Semaphore, lavos::Renderer::frames_in_flight> image_available_semaphores;
+		std::array<vk::Semaphore, lavos::Renderer::frames_in_flight> render_finished_semaphores;
+		std::array<std::uint64_t, lavos::Renderer::frames_in_flight> frame_submissions = {};
+		unsigned int frame_index = 0;
 
 		std::chrono::high_resolution_clock::time_point last_frame_time;
 		float delta_time = 0.0f;
@@ -54,7 +61,12 @@ class WindowApplication
 		void CreateSemaphores();
 
 	public:
-		WindowApplication(int width, int height, std::string title, bool enable_layers);
+		/**
+		 * @param engine_create_info base settings for the engine, e.g. optional features.
+		 * 			Extensions required for the window are added to it.
+		 */
+		WindowApplication(int width, int height, std::string title, bool enable_layers,
+				const lavos::Engine::CreateInfo &engine_create_info = lavos::Engine::CreateInfo());
 		~WindowApplication();
 
 		void BeginFrame();
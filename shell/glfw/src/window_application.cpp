@@ -4,7 +4,9 @@
 
 using namespace lavos::shell::glfw;
 
-WindowApplication::WindowApplication(int width, int height, std::string title, bool enable_layers)
+WindowApplication::WindowApplication(int width, int height, std::string title, bool enable_layers,
+		const lavos::Engine::CreateInfo &engine_create_info)
+	: engine_create_info(engine_create_info)
 {
 	InitWindow(width, height, title);
 	InitVulkan(enable_layers);
@@ -49,7 +51,7 @@ void WindowApplication::InitVulkan(bool enable_layers)
 
 void WindowApplication::CreateEngine(bool enable_layers)
 {
-	lavos::Engine::CreateInfo create_info;
+	lavos::Engine::CreateInfo create_info = engine_create_info;
 
 	unsigned int glfw_extensions_count;
 	const char **glfw_extensions = glfwGetRequiredInstanceExtensions(&glfw_extensions_count);
@@ -59,7 +61,7 @@ void WindowApplication::CreateEngine(bool enable_layers)
 
 	create_info.enable_validation_layers = enable_layers;
 
-	create_info.required_device_extensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+	create_info.required_device_extensions.insert(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
 
 	engine = new lavos::Engine(create_info);
 
@@ -91,8 +93,11 @@ void WindowApplication::RecreateSwapchain()
 
 void WindowApplication::CreateSemaphores()
 {
-	image_available_semaphore = engine->GetVkDevice().createSemaphore(vk::SemaphoreCreateInfo());
-	render_finished_semaphore = engine->GetVkDevice().createSemaphore(vk::SemaphoreCreateInfo());
+	for(unsigned int i=0; i<lavos::Renderer::frames_in_flight; i++)
+	{
+		image_available_semaphores[i] = engine->GetVkDevice().createSemaphore(vk::SemaphoreCreateInfo());
+		render_finished_semaphores[i] = engine->GetVkDevice().createSemaphore(vk::SemaphoreCreateInfo());
+	}
 }
 
 
@@ -109,6 +114,14 @@ void WindowApplication::Update()
 
 void WindowApplication::Render(lavos::Renderer *renderer)
 {
+	// only the semaphores of this frame must be free again, the device is not idled because everything
+	// the Renderer writes from the host, like uniforms, light lists and material parameters, exists per frame in flight
+	frame_index = (frame_index + 1) % lavos::Renderer::frames_in_flight;
+	engine->WaitForValue(frame_submissions[frame_index]);
+
+	vk::Semaphore image_available_semaphore = image_available_semaphores[frame_index];
+	vk::Semaphore render_finished_semaphore = render_finished_semaphores[frame_index];
+
 	auto image_index_result = engine->GetVkDevice().acquireNextImageKHR(swapchain->GetSwapchain(),
 																		std::numeric_limits<uint64_t>::max(),
 																		image_available_semaphore,
@@ -126,7 +139,7 @@ void WindowApplication::Render(lavos::Renderer *renderer)
 
 	uint32_t image_index = image_index_result.value;
 
-	renderer->DrawFrame(image_index,
+	frame_submissions[frame_index] = renderer->DrawFrame(image_index,
 						{ image_available_semaphore },
 						{ vk::PipelineStageFlagBits::eColorAttachmentOutput },
 						{ render_finished_semaphore });
@@ -158,8 +171,6 @@ void WindowApplication::Render(lavos::Renderer *renderer)
 	{
 		throw std::runtime_error("failed to present swap chain image!");
 	}
-
-	present_queue.waitIdle();
 }
 
 
@@ -168,8 +179,6 @@ void WindowApplication::EndFrame()
 	auto time = std::chrono::high_resolution_clock::now();
 	delta_time = std::chrono::duration<float, std::ratio<1>>(time - last_frame_time).count();
 	last_frame_time = time;
-
-	engine->GetVkDevice().waitIdle();
 }
 
 
@@ -177,11 +186,17 @@ void WindowApplication::Cleanup()
 {
 	auto device = engine->GetVkDevice();
 
+	// the semaphores may still be waited for by the last presentation
+	device.waitIdle();
+
 	delete swapchain;
 	delete depth_render_target;
 
-	device.destroySemaphore(image_available_semaphore);
-	device.destroySemaphore(render_finished_semaphore);
+	for(unsigned int i=0; i<lavos::Renderer::frames_in_flight; i++)
+	{
+		device.destroySemaphore(image_available_semaphores[i]);
+		device.destroySemaphore(render_finished_semaphores[i]);
+	}
 
 	engine->GetVkInstance().destroySurfaceKHR(surface);
 
@@ -2,6 +2,8 @@
 #ifndef LAVOS_SHELL_QT_LAVOS_WINDOW_H
 #define LAVOS_SHELL_QT_LAVOS_WINDOW_H
 
+#include <array>
+
 #include <lavos/engine.h>
 #include <lavos/material/phong_material.h>
 #include <lavos/renderer.h>
@@ -39,8 +41,13 @@ class LavosWindow: public QWindow
 		lavos::Swapchain *swapchain = nullptr;
 		lavos::ManagedDepthRenderTarget *depth_render_target = nullptr;
 
-		vk::Semaphore image_available_semaphore = nullptr;
-		vk::Semaphore render_finished_semaphore = nullptr;
+		/**
+		 * One pair of semaphores per frame in flight, reused once the frame that used them last is finished
+		 */
+		std::array<vk::Semaphore, lavos::Renderer::frames_in_flight> image_available_semaphores = {};
+		std::array<vk::Semaphore, lavos::Renderer::frames_in_flight> render_finished_semaphores = {};
+		std::array<std::uint64_t, lavos::Renderer::frames_in_flight> frame_submissions = {};
+		unsigned int frame_index = 0;
 
 		void RecreateSwapchain();
 		void InitializeVulkan();
@@ -34,8 +34,12 @@ void LavosWindow::InitializeVulkan()
 	swapchain = new lavos::Swapchain(engine, surface, present_queue_family_index, extent);
 	depth_render_target = new lavos::ManagedDepthRenderTarget(engine, swapchain);
 
-	image_available_semaphore = engine->GetVkDevice().createSemaphore(vk::SemaphoreCreateInfo());
-	render_finished_semaphore = engine->GetVkDevice().createSemaphore(vk::SemaphoreCreateInfo());
+	for(unsigned int i=0; i<lavos::Renderer::frames_in_flight; i++)
+	{
+		image_available_semaphores[i] = engine->GetVkDevice().createSemaphore(vk::SemaphoreCreateInfo());
+		render_finished_semaphores[i] = engine->GetVkDevice().createSemaphore(vk::SemaphoreCreateInfo());
+	}
+	frame_submissions = {};
 
 	vulkan_initialized = true;
 }
@@ -44,21 +48,28 @@ void LavosWindow::CleanupVulkan()
 {
 	auto device = engine->GetVkDevice();
 
+	// the semaphores may still be waited for by the last presentation
+	if(vulkan_initialized)
+		device.waitIdle();
+
 	delete swapchain;
 	swapchain = nullptr;
 	delete depth_render_target;
 	depth_render_target = nullptr;
 
-	if(image_available_semaphore)
+	for(unsigned int i=0; i<lavos::Renderer::frames_in_flight; i++)
 	{
-		device.destroySemaphore(image_available_semaphore);
-		image_available_semaphore = nullptr;
-	}
+		if(image_available_semaphores[i])
+		{
+			device.destroySemaphore(image_available_semaphores[i]);
+			image_available_semaphores[i] = nullptr;
+		}
 
-	if(render_finished_semaphore)
-	{
-		device.destroySemaphore(render_finished_semaphore);
-		render_finished_semaphore = nullptr;
+		if(render_finished_semaphores[i])
+		{
+			device.destroySemaphore(render_finished_semaphores[i]);
+			render_finished_semaphores[i] = nullptr;
+		}
 	}
 
 	vulkan_initialized = false;
@@ -77,6 +88,14 @@ void LavosWindow::Render(lavos::Renderer *renderer)
 		return;
 	}
 
+	// only the semaphores of this frame must be free again, the device is not idled because everything
+	// the Renderer writes from the host, like uniforms, light lists and material parameters, exists per frame in flight
+	frame_index = (frame_index + 1) % lavos::Renderer::frames_in_flight;
+	engine->WaitForValue(frame_submissions[frame_index]);
+
+	vk::Semaphore image_available_semaphore = image_available_semaphores[frame_index];
+	vk::Semaphore render_finished_semaphore = render_finished_semaphores[frame_index];
+
 	auto image_index_result = engine->GetVkDevice().acquireNextImageKHR(swapchain->GetSwapchain(),
 																		std::numeric_limits<uint64_t>::max(),
 																		image_available_semaphore,
@@ -94,7 +113,7 @@ void LavosWindow::Render(lavos::Renderer *renderer)
 
 	uint32_t image_index = image_index_result.value;
 
-	renderer->DrawFrame(image_index,
+	frame_submissions[frame_index] = renderer->DrawFrame(image_index,
 						{ image_available_semaphore },
 						{ vk::PipelineStageFlagBits::eColorAttachmentOutput },
 						{ render_finished_semaphore });
@@ -128,7 +147,6 @@ void LavosWindow::Render(lavos::Renderer *renderer)
 	}
 
 	vulkanInstance()->presentQueued(this);
-	present_queue.waitIdle();
 }
 
 bool LavosWindow::event(QEvent *event)